@@ -0,0 +1,224 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium allocation check: fails if GAMEPLAY allocates once the game is warmed up
+*
+*   Plays bot matches back to back through the game's own simulation thread (simthread.h), started
+*   as the game starts it, recording a replay and saving it whenever a match is won. The bots play
+*   by pressing keys: each frame their inputs become key transitions pushed onto the input queue,
+*   just as the game's key callback pushes them, and the rewind key is held for a while every match.
+*   Each frame the main thread then does what the game does that doesn't need a window: sounds
+*   started and a frame's worth mixed, particles spawned and moved, and trails recorded and written
+*   as strips. Drawing itself needs a window, so the instrumented game build reports that.
+*
+*   Time comes from a clock of the check's own (it provides glfwGetTime), moved on a frame at a
+*   time once the simulation has caught up with it, so matches play as fast as the CPU allows.
+*
+*   Every allocation is counted, on every thread (alloctrack.h); once the warm-up frames are over
+*   any allocation at all fails the check, listing where it was made from. Exits with 0 if the
+*   steady-state frames allocated nothing, 1 if they did.
+*
+*   Usage: alloccheck [--matches N] [--warmup FRAMES] [--sim-rate N] [--record FILE]
+*       N bot matches (default 20) after FRAMES frames of warm-up (default 600, 10 seconds), at a
+*       simulation tick rate (default 60), the replays saved to FILE (default alloccheck.rpl)
+*
+*   Build: g++ alloccheck.cpp -o alloccheck.exe -O2 -pthread -DTRACK_ALLOCATIONS -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free -Wl,--disable-dynamicbase
+*          (on Linux -no-pie instead of -Wl,--disable-dynamicbase)
+*
+******************************************************************************************************/
+
+#if !defined(TRACK_ALLOCATIONS)
+    #error "alloccheck counts allocations: build it with -DTRACK_ALLOCATIONS and the --wrap linker options above"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include "alloctrack.h"
+#include "controllers.h"
+#include "simthread.h"
+#include "mixer.h"
+#include "particles.h"
+#include "trails.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int checkDefaultMatches = 20;
+const int checkDefaultWarmup = 600;
+const int checkFrameSamples = mixerSampleRate / 60;     // Samples the mixer makes in a 60 FPS frame
+const int checkRewindFrom = 1800;               // Frame of each match the rewind key is pressed on (30 seconds in)
+const int checkRewindFrames = 120;              // Frames it is held for
+
+// Create an enum of the phases allocations are counted in
+enum CheckPhase { CHECK_WARMUP, CHECK_STEADY, CHECK_PHASES };
+
+const char *const checkPhaseNames[CHECK_PHASES] = { "warm-up", "steady" };
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+//----------------------------------------------------------------------------------------------------
+static std::atomic<double> checkClock;          // The time glfwGetTime gives the simulation thread
+static SimulationThread simulation;
+static float mixed[2 * checkFrameSamples];
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// The GLFW functions the simulation thread calls, on the check's clock
+extern "C"
+{
+    double glfwGetTime(void)
+    {
+        return checkClock.load();
+    }
+
+    void glfwPostEmptyEvent(void)
+    {
+    }
+}
+
+// Press or release a key at the current time, as the game's key callback does
+void PushKey(int key, bool down)
+{
+    InputEvent event = { key, down, checkClock.load() };
+    if (!PushInputEvent(inputSampler.queue, event)) inputSampler.dropped++;
+}
+
+// Hold or release the paddle keys to match a bot's inputs (a key is held for an input of a half or more)
+void PressBotKeys(const PaddleInput &input, int upKey, int downKey, bool held[2])
+{
+    bool up = input.up >= 0.5f, down = input.down >= 0.5f;
+    if (up != held[0]) PushKey(upKey, up);
+    if (down != held[1]) PushKey(downKey, down);
+    held[0] = up;
+    held[1] = down;
+}
+
+int main(int argc, char *argv[])
+{
+    int matches = checkDefaultMatches, warmup = checkDefaultWarmup, simRate = 60;
+    const char *recordPath = "alloccheck.rpl";
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--matches") == 0 && i + 1 < argc) matches = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) warmup = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--sim-rate") == 0 && i + 1 < argc) simRate = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) recordPath = argv[++i];
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (simRate < 1)
+    {
+        fprintf(stderr, "--sim-rate must be at least 1\n");
+        return 1;
+    }
+
+    // Everything set up as the game sets it up before the main loop
+    Controller left, right;
+    ParseController(left, "predict");
+    ParseController(right, "search");
+    ControllerState leftState, rightState;
+    InitialiseControllerState(leftState, 1);
+    InitialiseControllerState(rightState, 2);
+    bool leftHeld[2] = {}, rightHeld[2] = {};
+
+    MixerSound sound;                   // A made up sound as long as hitBall.wav, the mixer never looks inside it
+    sound.frames = mixerSampleRate / 10;
+    sound.samples.assign(sound.frames + mixerLanes, 0.25f);
+    mixer.sounds.push_back(sound);
+    mixer.sounds.push_back(sound);
+    particles.random = 0x2545F491u;
+    ClearTrails(trails);
+    trails.slots = 2;
+    static float stripVertices[3 * trailVertices];
+    static Color stripColours[trailVertices];
+
+    StartSimulation(simulation, simRate, recordPath);
+    PlaySimulation(simulation);
+
+    int restarts = 0, restartedVersion = -1, matchFrame = 0, ballEventsPlayed = 0;
+    long long frames = 0;
+    double time = 0;
+    while (true)
+    {
+        if (frames == warmup) StartAllocationRecording();
+        AllocationFrame((frames < warmup) ? CHECK_WARMUP : CHECK_STEADY);
+
+        // Move the clock on a frame and let the simulation run the ticks that fell due (or rewind them)
+        time += framePeriod;
+        checkClock.store(time);
+        WakeSimulation(simulation);
+        while (true)
+        {
+            AcquireSlot(simulation.snapshots);
+            const GameSnapshot &latest = ReadSlot(simulation.snapshots);
+            if (latest.simTime + simulation.tickTime > time) break;
+            std::this_thread::yield();
+        }
+
+        const GameSnapshot &snapshot = ReadSlot(simulation.snapshots);
+        const Game &game = snapshot.game;
+        if (restarts == matches && !game.gameWon && game.tick > 0) break;       // The last match's replay has been saved
+
+        // The main thread's frame
+        if (ballEventsPlayed < snapshot.eventCount - ballEventCapacity) ballEventsPlayed = snapshot.eventCount - ballEventCapacity;
+        for (; ballEventsPlayed < snapshot.eventCount; ballEventsPlayed++)
+        {
+            const BallEvent &event = snapshot.events[ballEventsPlayed % ballEventCapacity];
+            PlayMixerSound(mixer, (event.type == BALL_HIT) ? 0 : 1, event.x, 1.0f);
+            SpawnBallEventParticles(particles, event.type == BALL_SCORED, event.x, event.y, time);
+        }
+        MixerCallback(mixed, checkFrameSamples);
+        UpdateParticles(particles, time);
+
+        if (game.ball1.visible) RecordTrail(trails, 0, game.ball1.position.x, game.ball1.position.y, game.ball1.radius, GOLD);
+        else ClearTrail(trails, 0);
+        if (game.ball2.visible) RecordTrail(trails, 1, game.ball2.position.x, game.ball2.position.y, game.ball2.radius, MAGENTA);
+        else ClearTrail(trails, 1);
+        for (int slot = 0; slot < trails.slots; slot++) WriteTrailStrip(trails, slot, stripVertices, stripColours);
+
+        // The players' keys for the ticks up to the next frame, the rewind key held for a while every match
+        bool rewindHeld = matchFrame >= checkRewindFrom && matchFrame < checkRewindFrom + checkRewindFrames;
+        if (rewindHeld != simulation.rewinding.load()) RewindSimulation(simulation, rewindHeld);
+        PressBotKeys(ControlPaddle(left, leftState, game, 1), KEY_W, KEY_S, leftHeld);
+        PressBotKeys(ControlPaddle(right, rightState, game, 2), KEY_UP, KEY_DOWN, rightHeld);
+
+        // Start the next match once this one is won (a won snapshot of the version restarted from is the same match, not yet restarted)
+        if (game.gameWon && restarts < matches && !simulation.rewinding.load() && snapshot.version != restartedVersion)
+        {
+            RestartSimulation(simulation);
+            restarts++;
+            restartedVersion = snapshot.version;
+            matchFrame = 0;
+        }
+        else
+        {
+            matchFrame++;
+        }
+        frames++;
+    }
+    AllocationFrame(-1);
+    StopSimulation(simulation);
+
+    long long steady = allocTracker.screens[CHECK_STEADY].allocations;
+    long long steadyFrames = allocTracker.screens[CHECK_STEADY].frames;
+    WriteAllocationReport(checkPhaseNames, CHECK_PHASES);
+    if (inputSampler.dropped > 0) printf("%d key transitions were dropped, the input queue was full\n", inputSampler.dropped);
+    if (steadyFrames == 0)
+    {
+        printf("FAIL: no steady-state frames were played (fewer frames than --warmup)\n");
+        return 1;
+    }
+    if (steady > 0)
+    {
+        printf("FAIL: %lld allocations in %lld steady-state frames\n", steady, steadyFrames);
+        return 1;
+    }
+    printf("OK: %lld steady-state frames over %d matches at %d Hz, no allocations\n", steadyFrames, matches, simRate);
+    return 0;
+}
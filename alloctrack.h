@@ -0,0 +1,299 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium allocation tracking: every heap allocation counted, per frame and per call site
+*
+*   Built with -DTRACK_ALLOCATIONS and the linker told to wrap malloc, calloc, realloc and free
+*   (-Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free), every call to them from the
+*   program or from a library linked statically into it (raylib, GLFW, miniaudio) goes through the
+*   counting functions below instead; operator new and delete are replaced to count the same way,
+*   so allocations made by the C++ library for vectors and strings are counted too. Each one is put
+*   down to the address it was called from, so allocating code can be found with
+*       addr2line -f -e pongdemonium-alloc.exe ADDRESS
+*   (the build lines turn address randomisation off so the addresses printed are the linked ones).
+*
+*   The heap held is followed by adding and taking off each block's usable size as the allocator
+*   reports it (malloc_usable_size, or _msize on Windows), so no block is changed. Blocks the C
+*   library allocates for itself and the program frees are taken off without having been added.
+*
+*   Without TRACK_ALLOCATIONS nothing is replaced and the functions below do nothing. Defines the
+*   replacement operator new and delete, so it is included in one translation unit (a program here
+*   is one file).
+*
+******************************************************************************************************/
+
+#ifndef ALLOCTRACK_H
+#define ALLOCTRACK_H
+
+#include <stdio.h>
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int allocMaxScreens = 8;                  // Screens (or phases) frames can be counted against
+const int allocSiteSlots = 1024;                // Call sites told apart (a power of two), the rest are lumped together
+const int allocReportSites = 20;                // Call sites printed, the most allocating first
+
+#if defined(TRACK_ALLOCATIONS)
+
+#include <malloc.h>
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+#if defined(_WIN32)
+    #define ALLOC_USABLE_SIZE(block) _msize(block)
+#else
+    #define ALLOC_USABLE_SIZE(block) malloc_usable_size(block)
+#endif
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for the allocations made from one address
+struct AllocationSite
+{
+    void *address;                  // 0 for a free slot
+    long long count;
+    long long bytes;
+};
+
+// Create a structure for the frames of one screen
+struct AllocationScreen
+{
+    long long frames;
+    long long allocations;          // allocations during them
+    long long framesAllocating;     // frames with at least one allocation
+    long long mostInFrame;          // most allocations in one frame
+    long long peakHeap;             // most heap held at any time during them (bytes)
+};
+
+// Create a structure for everything counted, changed by every thread that allocates
+struct AllocationTracker
+{
+    std::atomic<long long> allocations;         // since the program started
+    std::atomic<long long> heap;                // bytes held
+    std::atomic<long long> peakHeap;            // most bytes held since the frame started
+    std::atomic<bool> recording;                // whether call sites are being counted
+
+    std::atomic_flag sitesLock = ATOMIC_FLAG_INIT;
+    AllocationSite sites[allocSiteSlots];
+    AllocationSite otherSites;                  // allocations from addresses that found no free slot
+
+    AllocationScreen screens[allocMaxScreens];  // only touched by the thread marking frames
+    int screen = -1;                            // screen of the frame being counted, -1 if none is
+    long long frameStart;                       // allocations when it started
+};
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+//----------------------------------------------------------------------------------------------------
+static AllocationTracker allocTracker;
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+extern "C"
+{
+    void *__real_malloc(size_t size);
+    void *__real_calloc(size_t count, size_t size);
+    void *__real_realloc(void *block, size_t size);
+    void __real_free(void *block);
+}
+
+inline void CountAllocationSite(void *address, long long bytes)
+{
+    AllocationTracker &t = allocTracker;
+    while (t.sitesLock.test_and_set(std::memory_order_acquire)) {}
+
+    // Open addressing on the address, the slot it ends up in is its slot from then on
+    size_t hash = ((size_t)address >> 2) * 0x9E3779B1u;
+    AllocationSite *site = &t.otherSites;
+    for (int probe = 0; probe < allocSiteSlots; probe++)
+    {
+        AllocationSite &slot = t.sites[(hash + probe) & (allocSiteSlots - 1)];
+        if (slot.address == address || slot.address == 0)
+        {
+            slot.address = address;
+            site = &slot;
+            break;
+        }
+    }
+    site->count++;
+    site->bytes += bytes;
+
+    t.sitesLock.clear(std::memory_order_release);
+}
+
+// Count a block allocated from an address (a failed allocation counts as one too)
+inline void CountAllocation(void *block, void *address)
+{
+    AllocationTracker &t = allocTracker;
+    long long bytes = block ? (long long)ALLOC_USABLE_SIZE(block) : 0;
+    t.allocations.fetch_add(1, std::memory_order_relaxed);
+    long long heap = t.heap.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    long long peak = t.peakHeap.load(std::memory_order_relaxed);
+    while (heap > peak && !t.peakHeap.compare_exchange_weak(peak, heap, std::memory_order_relaxed)) {}
+
+    if (t.recording.load(std::memory_order_relaxed)) CountAllocationSite(address, bytes);
+}
+
+inline void CountFree(void *block)
+{
+    if (block) allocTracker.heap.fetch_sub((long long)ALLOC_USABLE_SIZE(block), std::memory_order_relaxed);
+}
+
+inline void *TrackedAllocate(size_t size, void *address)
+{
+    void *block = __real_malloc(size);
+    CountAllocation(block, address);
+    return block;
+}
+
+inline void TrackedFree(void *block)
+{
+    CountFree(block);
+    __real_free(block);
+}
+
+extern "C"
+{
+    __attribute__((noinline)) void *__wrap_malloc(size_t size)
+    {
+        return TrackedAllocate(size, __builtin_return_address(0));
+    }
+
+    __attribute__((noinline)) void *__wrap_calloc(size_t count, size_t size)
+    {
+        void *block = __real_calloc(count, size);
+        CountAllocation(block, __builtin_return_address(0));
+        return block;
+    }
+
+    // A new block as far as counting goes: the old one is freed, the new one allocated
+    __attribute__((noinline)) void *__wrap_realloc(void *block, size_t size)
+    {
+        long long oldBytes = block ? (long long)ALLOC_USABLE_SIZE(block) : 0;
+        void *moved = __real_realloc(block, size);
+        if (!moved && size > 0) return moved;       // Failed, the old block is still there
+        allocTracker.heap.fetch_sub(oldBytes, std::memory_order_relaxed);
+        if (moved) CountAllocation(moved, __builtin_return_address(0));
+        return moved;
+    }
+
+    void __wrap_free(void *block)
+    {
+        TrackedFree(block);
+    }
+}
+
+__attribute__((noinline)) void *operator new(size_t size)
+{
+    void *block = TrackedAllocate(size ? size : 1, __builtin_return_address(0));
+    if (!block) throw std::bad_alloc();
+    return block;
+}
+
+__attribute__((noinline)) void *operator new[](size_t size)
+{
+    void *block = TrackedAllocate(size ? size : 1, __builtin_return_address(0));
+    if (!block) throw std::bad_alloc();
+    return block;
+}
+
+__attribute__((noinline)) void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return TrackedAllocate(size ? size : 1, __builtin_return_address(0));
+}
+
+__attribute__((noinline)) void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return TrackedAllocate(size ? size : 1, __builtin_return_address(0));
+}
+
+void operator delete(void *block) noexcept { TrackedFree(block); }
+void operator delete[](void *block) noexcept { TrackedFree(block); }
+void operator delete(void *block, size_t) noexcept { TrackedFree(block); }
+void operator delete[](void *block, size_t) noexcept { TrackedFree(block); }
+void operator delete(void *block, const std::nothrow_t &) noexcept { TrackedFree(block); }
+void operator delete[](void *block, const std::nothrow_t &) noexcept { TrackedFree(block); }
+
+// Allocations made so far, by every thread
+inline long long AllocationCount()
+{
+    return allocTracker.allocations.load(std::memory_order_relaxed);
+}
+
+// Start putting allocations down to call sites (after loading, so only the ones made while running are listed)
+inline void StartAllocationRecording()
+{
+    allocTracker.recording.store(true);
+}
+
+// End the frame being counted and start one of a screen (0 to allocMaxScreens - 1, or -1 to stop), from one thread
+inline void AllocationFrame(int screen)
+{
+    AllocationTracker &t = allocTracker;
+    long long now = AllocationCount();
+    if (t.screen >= 0)
+    {
+        AllocationScreen &s = t.screens[t.screen];
+        long long made = now - t.frameStart;
+        s.frames++;
+        s.allocations += made;
+        if (made > 0) s.framesAllocating++;
+        if (made > s.mostInFrame) s.mostInFrame = made;
+        long long peak = t.peakHeap.load(std::memory_order_relaxed);
+        if (peak > s.peakHeap) s.peakHeap = peak;
+    }
+    t.screen = screen;
+    t.frameStart = now;
+    t.peakHeap.store(t.heap.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+// Print the allocations of each screen's frames and the call sites that allocated most since recording started
+inline void WriteAllocationReport(const char *const *screenNames, int screens)
+{
+    AllocationTracker &t = allocTracker;
+    bool recording = t.recording.exchange(false);       // printf may allocate, don't list it
+
+    printf("Allocations (all threads)\n");
+    printf("%-10s %10s %12s %10s %10s %12s %14s\n", "screen", "frames", "allocations", "per frame", "most", "allocating", "peak heap (KB)");
+    for (int s = 0; s < screens && s < allocMaxScreens; s++)
+    {
+        const AllocationScreen &screen = t.screens[s];
+        double perFrame = screen.frames ? (double)screen.allocations / screen.frames : 0;
+        printf("%-10s %10lld %12lld %10.3f %10lld %12lld %14.1f\n", screenNames[s], screen.frames, screen.allocations, perFrame,
+               screen.mostInFrame, screen.framesAllocating, screen.peakHeap / 1024.0);
+    }
+
+    // The busiest sites, by a selection of the top few (the table is small and this runs once)
+    bool printed[allocSiteSlots] = {};
+    bool any = false;
+    for (int n = 0; n < allocReportSites; n++)
+    {
+        int best = -1;
+        for (int i = 0; i < allocSiteSlots; i++)
+        {
+            if (!printed[i] && t.sites[i].address && (best < 0 || t.sites[i].count > t.sites[best].count)) best = i;
+        }
+        if (best < 0) break;
+        if (!any) printf("Call sites allocating while running (addr2line -f -e EXECUTABLE ADDRESS)\n%18s %10s %12s\n", "address", "count", "bytes");
+        any = true;
+        printed[best] = true;
+        printf("%18p %10lld %12lld\n", t.sites[best].address, t.sites[best].count, t.sites[best].bytes);
+    }
+    if (t.otherSites.count > 0) printf("%18s %10lld %12lld\n", "other", t.otherSites.count, t.otherSites.bytes);
+    if (!any) printf("No allocations while running\n");
+
+    t.recording.store(recording);
+}
+
+#else
+
+inline long long AllocationCount() { return 0; }
+inline void StartAllocationRecording() {}
+inline void AllocationFrame(int) {}
+inline void WriteAllocationReport(const char *const *, int) {}
+
+#endif
+
+#endif // ALLOCTRACK_H
@@ -0,0 +1,535 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium atlas builder: packs the UI images into one texture and a table of where each is
+*
+*   Every PNG in the resources directory is decoded, the images are packed
+*   in rows with a gap between them (taller images first, names breaking ties, so the layout only
+*   changes when the images do), and the atlas is written as a QOI image, which raylib loads
+*   without a PNG decoder. A header is written alongside it naming every image (upArrow.png is
+*   SPRITE_UP_ARROW) and giving its rectangle in the atlas, so the game loads one texture and
+*   draws every UI image as a part of it, in one draw call.
+*
+*   Reads 8 bit PNGs that aren't interlaced (grey, grey + alpha, RGB, RGBA and palette); the
+*   decoder is a plain inflate and the five PNG row filters, enough for the images of a game.
+*
+*   Usage: atlasbuild [DIRECTORY]      pack the PNGs in DIRECTORY (default resources) into DIRECTORY/uiAtlas.qoi
+*                                      and DIRECTORY/uiatlas.h, run after adding or changing a UI image
+*
+*   Build: g++ atlasbuild.cpp -o atlasbuild.exe -O2
+*
+******************************************************************************************************/
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int atlasGap = 2;                         // Transparent pixels between images, so filtering never blends two
+const int atlasMaxWidth = 4096;                 // Widest atlas tried
+const char *const atlasImageName = "uiAtlas.qoi";
+const char *const atlasHeaderName = "uiatlas.h";
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for a decoded image, 4 bytes (RGBA) a pixel
+struct AtlasImage
+{
+    std::string name;               // file name without .png
+    int width, height;
+    std::vector<unsigned char> pixels;
+    int x, y;                       // where it is packed in the atlas
+};
+
+// Create a structure for reading a deflate stream a bit at a time
+struct BitReader
+{
+    const unsigned char *data;
+    size_t size, position;
+    unsigned int bits;
+    int count;
+    bool failed;
+};
+
+// Create a structure for a canonical Huffman code: the codes of each length and the symbols in code order
+struct Huffman
+{
+    short counts[16];
+    short symbols[288];
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+int ReadBits(BitReader &reader, int need)
+{
+    while (reader.count < need)
+    {
+        if (reader.position >= reader.size)
+        {
+            reader.failed = true;
+            return 0;
+        }
+        reader.bits |= (unsigned int)reader.data[reader.position++] << reader.count;
+        reader.count += 8;
+    }
+    int value = (int)(reader.bits & ((1u << need) - 1));
+    reader.bits >>= need;
+    reader.count -= need;
+    return value;
+}
+
+// Build a code from the bit length of every symbol
+void BuildHuffman(Huffman &code, const short *lengths, int symbolCount)
+{
+    short offsets[16];
+    memset(code.counts, 0, sizeof(code.counts));
+    for (int s = 0; s < symbolCount; s++) code.counts[lengths[s]]++;
+    code.counts[0] = 0;
+    offsets[1] = 0;
+    for (int l = 1; l < 15; l++) offsets[l + 1] = offsets[l] + code.counts[l];
+    for (int s = 0; s < symbolCount; s++)
+    {
+        if (lengths[s] != 0) code.symbols[offsets[lengths[s]]++] = (short)s;
+    }
+}
+
+// Read one symbol, a bit at a time from the shortest codes up
+int DecodeSymbol(BitReader &reader, const Huffman &code)
+{
+    int first = 0, index = 0, value = 0;
+    for (int l = 1; l < 16; l++)
+    {
+        value |= ReadBits(reader, 1);
+        int count = code.counts[l];
+        if (value - first < count) return code.symbols[index + value - first];
+        index += count;
+        first = (first + count) << 1;
+        value <<= 1;
+        if (reader.failed) break;
+    }
+    reader.failed = true;
+    return 0;
+}
+
+// Inflate a raw deflate stream, returns false if it is broken
+bool Inflate(const unsigned char *data, size_t size, std::vector<unsigned char> &out)
+{
+    static const short lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const short lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const short distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+                                            4097, 6145, 8193, 12289, 16385, 24577 };
+    static const short distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    static const unsigned char lengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    BitReader reader = { data, size, 0, 0, 0, false };
+    int last;
+    do
+    {
+        last = ReadBits(reader, 1);
+        int type = ReadBits(reader, 2);
+        if (type == 0)
+        {
+            // Stored: byte aligned length, its complement, then the bytes
+            reader.bits = 0;
+            reader.count = 0;
+            if (reader.position + 4 > size) return false;
+            int length = data[reader.position] | (data[reader.position + 1] << 8);
+            reader.position += 4;
+            if (reader.position + length > size) return false;
+            out.insert(out.end(), data + reader.position, data + reader.position + length);
+            reader.position += length;
+            continue;
+        }
+        if (type == 3) return false;
+
+        Huffman literals, distances;
+        short lengths[320];
+        if (type == 1)
+        {
+            // Fixed codes
+            for (int s = 0; s < 288; s++) lengths[s] = (s < 144) ? 8 : (s < 256) ? 9 : (s < 280) ? 7 : 8;
+            BuildHuffman(literals, lengths, 288);
+            for (int s = 0; s < 30; s++) lengths[s] = 5;
+            BuildHuffman(distances, lengths, 30);
+        }
+        else
+        {
+            // Dynamic codes, their lengths themselves Huffman coded
+            int literalCount = ReadBits(reader, 5) + 257, distanceCount = ReadBits(reader, 5) + 1, codeCount = ReadBits(reader, 4) + 4;
+            short codeLengths[19] = { 0 };
+            for (int i = 0; i < codeCount; i++) codeLengths[lengthOrder[i]] = (short)ReadBits(reader, 3);
+            Huffman lengthCode;
+            BuildHuffman(lengthCode, codeLengths, 19);
+
+            int i = 0;
+            while (i < literalCount + distanceCount && !reader.failed)
+            {
+                int symbol = DecodeSymbol(reader, lengthCode);
+                if (symbol < 16)
+                {
+                    lengths[i++] = (short)symbol;
+                    continue;
+                }
+                short repeat = 0;
+                int times;
+                if (symbol == 16)
+                {
+                    if (i == 0) return false;
+                    repeat = lengths[i - 1];
+                    times = 3 + ReadBits(reader, 2);
+                }
+                else times = (symbol == 17) ? 3 + ReadBits(reader, 3) : 11 + ReadBits(reader, 7);
+                if (i + times > literalCount + distanceCount) return false;
+                while (times--) lengths[i++] = repeat;
+            }
+            BuildHuffman(literals, lengths, literalCount);
+            BuildHuffman(distances, lengths + literalCount, distanceCount);
+        }
+
+        for (;;)
+        {
+            int symbol = DecodeSymbol(reader, literals);
+            if (reader.failed) return false;
+            if (symbol < 256)
+            {
+                out.push_back((unsigned char)symbol);
+                continue;
+            }
+            if (symbol == 256) break;
+
+            symbol -= 257;
+            if (symbol >= 29) return false;
+            int length = lengthBase[symbol] + ReadBits(reader, lengthExtra[symbol]);
+            int distanceSymbol = DecodeSymbol(reader, distances);
+            if (distanceSymbol >= 30) return false;
+            size_t distance = distanceBase[distanceSymbol] + ReadBits(reader, distanceExtra[distanceSymbol]);
+            if (reader.failed || distance > out.size()) return false;
+            for (int k = 0; k < length; k++) out.push_back(out[out.size() - distance]);
+        }
+    } while (!last && !reader.failed);
+
+    return !reader.failed;
+}
+
+unsigned int ReadBigEndian(const unsigned char *bytes)
+{
+    return ((unsigned int)bytes[0] << 24) | ((unsigned int)bytes[1] << 16) | ((unsigned int)bytes[2] << 8) | bytes[3];
+}
+
+int Paeth(int a, int b, int c)
+{
+    int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
+}
+
+// Decode a PNG file into RGBA, returns false if it can't be read or is a kind this doesn't read
+bool LoadPng(const char *fileName, AtlasImage &image)
+{
+    FILE *file = fopen(fileName, "rb");
+    if (!file) return false;
+    std::vector<unsigned char> bytes;
+    unsigned char buffer[65536];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) bytes.insert(bytes.end(), buffer, buffer + read);
+    fclose(file);
+
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    if (bytes.size() < 8 || memcmp(bytes.data(), signature, 8) != 0) return false;
+
+    int depth = 0, colourType = -1, interlace = 0;
+    std::vector<unsigned char> compressed, palette, transparency;
+    for (size_t at = 8; at + 12 <= bytes.size(); )
+    {
+        unsigned int length = ReadBigEndian(&bytes[at]);
+        const unsigned char *type = &bytes[at + 4], *chunk = &bytes[at + 8];
+        if (at + 12 + length > bytes.size()) return false;
+        if (memcmp(type, "IHDR", 4) == 0 && length >= 13)
+        {
+            image.width = (int)ReadBigEndian(chunk);
+            image.height = (int)ReadBigEndian(chunk + 4);
+            depth = chunk[8];
+            colourType = chunk[9];
+            interlace = chunk[12];
+        }
+        else if (memcmp(type, "PLTE", 4) == 0) palette.assign(chunk, chunk + length);
+        else if (memcmp(type, "tRNS", 4) == 0) transparency.assign(chunk, chunk + length);
+        else if (memcmp(type, "IDAT", 4) == 0) compressed.insert(compressed.end(), chunk, chunk + length);
+        else if (memcmp(type, "IEND", 4) == 0) break;
+        at += 12 + length;
+    }
+
+    static const int channelsOf[7] = { 1, 0, 3, 1, 2, 0, 4 };
+    if (depth != 8 || interlace != 0 || colourType < 0 || colourType > 6 || channelsOf[colourType] == 0) return false;
+    if (image.width <= 0 || image.height <= 0 || compressed.size() < 2) return false;
+    int channels = channelsOf[colourType];
+    size_t stride = (size_t)image.width * channels;
+
+    // The zlib header is 2 bytes, the deflate stream follows it
+    std::vector<unsigned char> raw;
+    if (!Inflate(compressed.data() + 2, compressed.size() - 2, raw) || raw.size() < (stride + 1) * image.height) return false;
+
+    // Undo each row's filter against the row above (already unfiltered) and the pixel to the left
+    std::vector<unsigned char> rows(stride * image.height);
+    for (int y = 0; y < image.height; y++)
+    {
+        int filter = raw[y * (stride + 1)];
+        const unsigned char *in = &raw[y * (stride + 1) + 1];
+        unsigned char *row = &rows[y * stride];
+        const unsigned char *above = (y > 0) ? row - stride : 0;
+        for (size_t i = 0; i < stride; i++)
+        {
+            int a = (i >= (size_t)channels) ? row[i - channels] : 0;
+            int b = above ? above[i] : 0;
+            int c = (above && i >= (size_t)channels) ? above[i - channels] : 0;
+            int predicted = (filter == 1) ? a : (filter == 2) ? b : (filter == 3) ? (a + b) / 2 : (filter == 4) ? Paeth(a, b, c) : 0;
+            row[i] = (unsigned char)(in[i] + predicted);
+        }
+    }
+
+    image.pixels.resize((size_t)image.width * image.height * 4);
+    for (size_t p = 0; p < (size_t)image.width * image.height; p++)
+    {
+        const unsigned char *in = &rows[p * channels];
+        unsigned char *out = &image.pixels[p * 4];
+        switch (colourType)
+        {
+            case 0: out[0] = out[1] = out[2] = in[0]; out[3] = 255; break;
+            case 2: out[0] = in[0]; out[1] = in[1]; out[2] = in[2]; out[3] = 255; break;
+            case 3:
+                if ((size_t)in[0] * 3 + 2 >= palette.size()) return false;
+                out[0] = palette[in[0] * 3];
+                out[1] = palette[in[0] * 3 + 1];
+                out[2] = palette[in[0] * 3 + 2];
+                out[3] = (in[0] < transparency.size()) ? transparency[in[0]] : 255;
+                break;
+            case 4: out[0] = out[1] = out[2] = in[0]; out[3] = in[1]; break;
+            default: memcpy(out, in, 4); break;
+        }
+    }
+    return true;
+}
+
+// Pack the images in rows no wider than a width, returns the atlas size
+void PackRows(std::vector<AtlasImage> &images, int maxWidth, int &width, int &height)
+{
+    int x = 0, y = 0, rowHeight = 0;
+    width = height = 0;
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        AtlasImage &image = images[i];
+        if (x > 0 && x + image.width > maxWidth)
+        {
+            x = 0;
+            y += rowHeight + atlasGap;
+            rowHeight = 0;
+        }
+        image.x = x;
+        image.y = y;
+        x += image.width + atlasGap;
+        if (image.height > rowHeight) rowHeight = image.height;
+        if (image.x + image.width > width) width = image.x + image.width;
+        if (image.y + image.height > height) height = image.y + image.height;
+    }
+}
+
+// Write RGBA pixels as a QOI image
+bool WriteQoi(const char *fileName, const std::vector<unsigned char> &pixels, int width, int height)
+{
+    std::vector<unsigned char> out;
+    const unsigned char header[14] = { 'q', 'o', 'i', 'f', (unsigned char)(width >> 24), (unsigned char)(width >> 16), (unsigned char)(width >> 8),
+                                       (unsigned char)width, (unsigned char)(height >> 24), (unsigned char)(height >> 16), (unsigned char)(height >> 8),
+                                       (unsigned char)height, 4, 0 };
+    out.insert(out.end(), header, header + 14);
+
+    unsigned char seen[64][4] = { { 0 } };
+    unsigned char previous[4] = { 0, 0, 0, 255 };
+    int run = 0;
+    size_t count = (size_t)width * height;
+    for (size_t p = 0; p < count; p++)
+    {
+        const unsigned char *pixel = &pixels[p * 4];
+        if (memcmp(pixel, previous, 4) == 0)
+        {
+            run++;
+            if (run == 62 || p + 1 == count)
+            {
+                out.push_back((unsigned char)(0xC0 | (run - 1)));       // QOI_OP_RUN
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0)
+        {
+            out.push_back((unsigned char)(0xC0 | (run - 1)));
+            run = 0;
+        }
+
+        int index = (pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11) % 64;
+        if (memcmp(seen[index], pixel, 4) == 0) out.push_back((unsigned char)index);       // QOI_OP_INDEX
+        else
+        {
+            memcpy(seen[index], pixel, 4);
+            if (pixel[3] == previous[3])
+            {
+                signed char dr = (signed char)(pixel[0] - previous[0]), dg = (signed char)(pixel[1] - previous[1]), db = (signed char)(pixel[2] - previous[2]);
+                signed char drg = (signed char)(dr - dg), dbg = (signed char)(db - dg);
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                {
+                    out.push_back((unsigned char)(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));     // QOI_OP_DIFF
+                }
+                else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+                {
+                    out.push_back((unsigned char)(0x80 | (dg + 32)));       // QOI_OP_LUMA
+                    out.push_back((unsigned char)(((drg + 8) << 4) | (dbg + 8)));
+                }
+                else
+                {
+                    out.push_back(0xFE);        // QOI_OP_RGB
+                    out.insert(out.end(), pixel, pixel + 3);
+                }
+            }
+            else
+            {
+                out.push_back(0xFF);            // QOI_OP_RGBA
+                out.insert(out.end(), pixel, pixel + 4);
+            }
+        }
+        memcpy(previous, pixel, 4);
+    }
+
+    const unsigned char end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    out.insert(out.end(), end, end + 8);
+
+    FILE *file = fopen(fileName, "wb");
+    if (!file) return false;
+    bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+    return (fclose(file) == 0) && ok;
+}
+
+// Name of an image's sprite, e.g. upArrow is SPRITE_UP_ARROW
+std::string SpriteName(const std::string &name)
+{
+    std::string sprite = "SPRITE_";
+    for (size_t i = 0; i < name.size(); i++)
+    {
+        char c = name[i];
+        if (c >= 'A' && c <= 'Z' && i > 0 && name[i - 1] >= 'a' && name[i - 1] <= 'z') sprite += '_';
+        sprite += (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') ? c : '_';
+    }
+    return sprite;
+}
+
+// Write the header naming every sprite and giving its rectangle in the atlas
+bool WriteAtlasHeader(const char *fileName, const char *directory, std::vector<AtlasImage> images, int width, int height)
+{
+    FILE *file = fopen(fileName, "w");
+    if (!file) return false;
+
+    // Sprites are listed by name, whatever order they were packed in
+    std::sort(images.begin(), images.end(), [](const AtlasImage &a, const AtlasImage &b) { return a.name < b.name; });
+
+    fprintf(file, "/*****************************************************************************************************\n");
+    fprintf(file, "*\n*   Pongdemonium UI atlas: written by atlasbuild from the PNGs in %s, don't edit (run atlasbuild instead)\n*\n", directory);
+    fprintf(file, "*   Include after raylib.h. Draw a sprite with DrawTextureRec(atlas, uiAtlasRects[SPRITE_...], ...).\n*\n");
+    fprintf(file, "******************************************************************************************************/\n\n");
+    fprintf(file, "#ifndef UIATLAS_H\n#define UIATLAS_H\n\n");
+    fprintf(file, "const char *const uiAtlasFile = \"%s/%s\";\n", directory, atlasImageName);
+    fprintf(file, "const int uiAtlasWidth = %d;\nconst int uiAtlasHeight = %d;\n\n", width, height);
+
+    fprintf(file, "// Create an enum of the images in the atlas\nenum AtlasSprite\n{\n");
+    for (size_t i = 0; i < images.size(); i++) fprintf(file, "    %s,\n", SpriteName(images[i].name).c_str());
+    fprintf(file, "    SPRITE_COUNT\n};\n\n");
+
+    fprintf(file, "// Where each image is in the atlas\nconst Rectangle uiAtlasRects[SPRITE_COUNT] =\n{\n");
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        const AtlasImage &image = images[i];
+        fprintf(file, "    { %d, %d, %d, %d },     // %s.png\n", image.x, image.y, image.width, image.height, image.name.c_str());
+    }
+    fprintf(file, "};\n\n#endif // UIATLAS_H\n");
+    return fclose(file) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *directory = (argc >= 2) ? argv[1] : "resources";
+
+    // Find the PNGs, by name so the atlas is the same whatever order the directory lists them in
+    std::vector<std::string> names;
+    DIR *dir = opendir(directory);
+    if (!dir)
+    {
+        fprintf(stderr, "Couldn't read directory %s\n", directory);
+        return 1;
+    }
+    while (dirent *entry = readdir(dir))
+    {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".png") == 0) names.push_back(name.substr(0, name.size() - 4));
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    if (names.empty())
+    {
+        fprintf(stderr, "No PNG images in %s\n", directory);
+        return 1;
+    }
+
+    std::vector<AtlasImage> images;
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        AtlasImage image;
+        image.name = names[i];
+        std::string path = std::string(directory) + "/" + names[i] + ".png";
+        if (!LoadPng(path.c_str(), image))
+        {
+            fprintf(stderr, "Couldn't read %s (only 8 bit, non-interlaced PNGs are read)\n", path.c_str());
+            return 1;
+        }
+        images.push_back(image);
+    }
+
+    // Taller images first so rows waste little height, then try every power of two width and keep the smallest atlas
+    std::stable_sort(images.begin(), images.end(), [](const AtlasImage &a, const AtlasImage &b) { return a.height > b.height; });
+    int widest = 0;
+    for (size_t i = 0; i < images.size(); i++) widest = std::max(widest, images[i].width);
+    int bestWidth = 0, width, height;
+    long long bestArea = -1;
+    for (int maxWidth = 1; maxWidth <= atlasMaxWidth; maxWidth *= 2)
+    {
+        if (maxWidth < widest) continue;
+        PackRows(images, maxWidth, width, height);
+        if (bestArea < 0 || (long long)width * height < bestArea)
+        {
+            bestArea = (long long)width * height;
+            bestWidth = maxWidth;
+        }
+    }
+    PackRows(images, bestWidth, width, height);
+
+    std::vector<unsigned char> atlas((size_t)width * height * 4, 0);
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        const AtlasImage &image = images[i];
+        for (int y = 0; y < image.height; y++)
+        {
+            memcpy(&atlas[((size_t)(image.y + y) * width + image.x) * 4], &image.pixels[(size_t)y * image.width * 4], (size_t)image.width * 4);
+        }
+    }
+
+    std::string imagePath = std::string(directory) + "/" + atlasImageName, headerPath = std::string(directory) + "/" + atlasHeaderName;
+    if (!WriteQoi(imagePath.c_str(), atlas, width, height) || !WriteAtlasHeader(headerPath.c_str(), directory, images, width, height))
+    {
+        fprintf(stderr, "Couldn't write the atlas to %s\n", directory);
+        return 1;
+    }
+    printf("Packed %zu images into a %dx%d atlas: %s and %s\n", images.size(), width, height, imagePath.c_str(), headerPath.c_str());
+    return 0;
+}
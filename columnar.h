@@ -0,0 +1,103 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium columnar output: tables written as one binary file per column
+*
+*   A table is a directory holding <column>.f32 / <column>.i32 files of raw little-endian values
+*   and a columns.txt manifest ("name type rows" per line), so analysis scripts can load
+*   a single column straight into an array (e.g. numpy.fromfile(path, dtype="<f4")).
+*
+******************************************************************************************************/
+
+#ifndef COLUMNAR_H
+#define COLUMNAR_H
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#if defined(_WIN32)
+    #include <direct.h>
+    #define MakeDirectory(path) _mkdir(path)
+#else
+    #include <sys/stat.h>
+    #define MakeDirectory(path) mkdir(path, 0755)
+#endif
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for one column of a table
+struct Column
+{
+    char name[48];                  // file name of the column (without extension)
+    bool isFloat;                   // float32 column if true, int32 column otherwise
+    std::vector<float> floats;      // values of a float column
+    std::vector<int> ints;          // values of an int column
+};
+
+// Create a structure for a table of equally long columns
+struct ColumnTable
+{
+    std::vector<Column> columns;
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Add an empty column to a table, returns its index for appending values
+inline int AddColumn(ColumnTable &table, const char *name, bool isFloat)
+{
+    Column column;
+    snprintf(column.name, sizeof(column.name), "%s", name);
+    column.isFloat = isFloat;
+    table.columns.push_back(column);
+    return (int)table.columns.size() - 1;
+}
+
+// Append a value to a float column
+inline void AppendFloat(ColumnTable &table, int column, float value)
+{
+    table.columns[column].floats.push_back(value);
+}
+
+// Append a value to an int column
+inline void AppendInt(ColumnTable &table, int column, int value)
+{
+    table.columns[column].ints.push_back(value);
+}
+
+// Write every column of a table into a directory (created if needed), returns false on failure
+inline bool WriteColumnTable(const ColumnTable &table, const char *directory)
+{
+    MakeDirectory(directory);
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/columns.txt", directory);
+    FILE *manifest = fopen(path, "w");
+    if (!manifest) return false;
+
+    bool ok = true;
+    for (size_t i = 0; i < table.columns.size(); i++)
+    {
+        const Column &column = table.columns[i];
+        size_t rows = column.isFloat ? column.floats.size() : column.ints.size();
+        const void *data = column.isFloat ? (const void *)column.floats.data() : (const void *)column.ints.data();
+
+        fprintf(manifest, "%s %s %zu\n", column.name, column.isFloat ? "f32" : "i32", rows);
+
+        snprintf(path, sizeof(path), "%s/%s.%s", directory, column.name, column.isFloat ? "f32" : "i32");
+        FILE *file = fopen(path, "wb");
+        if (!file)
+        {
+            ok = false;
+            continue;
+        }
+        if (rows > 0 && fwrite(data, 4, rows, file) != rows) ok = false;
+        fclose(file);
+    }
+
+    fclose(manifest);
+    return ok;
+}
+
+#endif // COLUMNAR_H
@@ -1 +1,12 @@
-g++ pongdemonium.cpp -o pongdemonium.exe -Iinclude/ -Iresources -Llib/ -lraylib -lopengl32 -lgdi32 -lwinmm
\ No newline at end of file
+g++ pongdemonium.cpp -o pongdemonium.exe -Iinclude/ -Iresources -Llib/ -lraylib -lopengl32 -lgdi32 -lwinmm -pthread
+g++ pongdemonium.cpp -o pongdemonium-alloc.exe -Iinclude/ -Iresources -Llib/ -lraylib -lopengl32 -lgdi32 -lwinmm -pthread -DTRACK_ALLOCATIONS -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free -Wl,--disable-dynamicbase
+g++ tournament.cpp -o tournament.exe -O2 -pthread
+g++ sweep.cpp -o sweep.exe -O2 -pthread
+g++ atlasbuild.cpp -o atlasbuild.exe -O2
+g++ musicbuild.cpp -o musicbuild.exe -O2 -Iinclude/ -Llib/ -lraylib -lopengl32 -lgdi32 -lwinmm
+./musicbuild.exe
+g++ snapbench.cpp -o snapbench.exe -O2
+g++ replaycheck.cpp -o replaycheck.exe -O2
+g++ physbench.cpp -o physbench.exe -O2
+g++ replayvideo.cpp -o replayvideo.exe -O2 -pthread
+g++ alloccheck.cpp -o alloccheck.exe -O2 -pthread -DTRACK_ALLOCATIONS -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free -Wl,--disable-dynamicbase
@@ -0,0 +1,380 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium paddle controllers: bots that play the game in place of a player at the keyboard
+*
+*   Every controller reads the current Game state and returns the keys it would be holding down
+*   this tick, so bots go through exactly the same input path as W/S and UP/DOWN.
+*
+*   Kinds of controller:
+*       idle        never moves (baseline)
+*       follow      heuristic: chases the y position of the nearest incoming ball
+*       predict     heuristic: works out where the ball will cross its paddle, bounces included
+*       search      searches over where to hit the ball on the paddle to send it furthest from the opponent
+*       policy      small neural network (tanh MLP) with weights loaded from a text file
+*
+******************************************************************************************************/
+
+#ifndef CONTROLLERS_H
+#define CONTROLLERS_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "pongsim.h"
+#include "fixedsim.h"
+#include "specsim.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int policyInputs = 6;         // Number of features fed into a policy network
+const int policyHidden = 8;         // Number of hidden tanh units in a policy network
+const int policyWeightCount = policyHidden * policyInputs + policyHidden + policyHidden + 1;
+
+const int searchCandidates = 9;     // Number of paddle contact points tried by the search controller
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create an enum of the different kinds of controller
+enum ControllerKind { CONTROLLER_IDLE, CONTROLLER_FOLLOW, CONTROLLER_PREDICT, CONTROLLER_SEARCH, CONTROLLER_POLICY };
+
+// Create a structure describing a controller - shared (read only) between all matches it plays
+struct Controller
+{
+    char name[64];                  // name shown in results tables
+    ControllerKind kind;            // what the controller does
+    int reactionTicks;              // ticks between decisions - a slower bot re-plans less often
+    float aimNoise;                 // random error (pixels) added to where the bot decides to go
+    float weights[policyWeightCount];       // network weights for policy controllers
+};
+
+// Create a structure for the result of one bot-vs-bot match
+struct MatchResult
+{
+    int winner;                     // 1 or 2 for the winning side, 0 if the match hit the tick limit
+    int player1LeftScore;           // final score of the left player
+    int player2RightScore;          // final score of the right player
+    int ticks;                      // number of ticks the match lasted
+};
+
+// Create a structure for the per-match state of one controller
+struct ControllerState
+{
+    unsigned int random;            // random number generator state (seeded per match)
+    float targetY;                  // y position the paddle is moving towards
+    int ticksUntilDecision;         // ticks left before the next decision
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Get the next random number from a xorshift generator
+inline unsigned int NextRandom(unsigned int &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Get a random float between -1 and 1
+inline float RandomSigned(unsigned int &state)
+{
+    return (NextRandom(state) & 0xFFFFFF) / (float)0x800000 - 1.0f;
+}
+
+// Mix numbers into a well spread seed, so every match of a tournament or sweep gets its own random stream
+inline unsigned int MixSeed(unsigned int seed, unsigned int a, unsigned int b, unsigned int c)
+{
+    unsigned int h = seed * 0x9E3779B1u;
+    h = (h ^ a) * 0x85EBCA77u;
+    h = (h ^ b) * 0xC2B2AE3Du;
+    h = (h ^ c) * 0x27D4EB2Fu;
+    return h ^ (h >> 15);
+}
+
+// Reset a controller's per-match state, the seed makes every match different but repeatable
+inline void InitialiseControllerState(ControllerState &state, unsigned int seed)
+{
+    state.random = seed ? seed : 0x9E3779B9u;
+    state.targetY = screenHeight / 2;
+    state.ticksUntilDecision = 0;
+}
+
+// Get the player a controller moves (side 1 is the left player, side 2 the right player)
+inline const Player &ControlledPlayer(const Game &game, int side)
+{
+    return (side == 1) ? game.player1Left : game.player2Right;
+}
+
+// Get the x position where a ball touches the face of a player's paddle
+inline float PaddlePlaneX(const Player &player, const Ball &ball, int side)
+{
+    if (side == 1) return player.position.x + (player.size.x / 2) + ball.radius;
+    return player.position.x - (player.size.x / 2) - ball.radius;
+}
+
+// Get the y position where a ball will cross a vertical line, folding in its bounces off the top and bottom
+inline float PredictBallY(Vector2 position, Vector2 velocity, float radius, float planeX)
+{
+    if (velocity.x == 0) return position.y;
+
+    float time = (planeX - position.x) / velocity.x;
+    float range = screenHeight - 2 * radius;                // distance the centre of the ball can travel vertically
+    float y = fmodf(position.y + velocity.y * time - radius, 2 * range);
+
+    if (y < 0) y += 2 * range;
+    if (y > range) y = 2 * range - y;                       // the ball is on its way back after a bounce
+    return y + radius;
+}
+
+// Find the visible ball that will reach a player's paddle first, returns 0 if none is incoming
+inline const Ball *IncomingBall(const Game &game, int side)
+{
+    const Ball *balls[2] = { &game.ball1, &game.ball2 };
+    const Ball *nearest = 0;
+    float nearestTime = 0;
+
+    for (int i = 0; i < 2; i++)
+    {
+        const Ball &ball = *balls[i];
+        bool incoming = (side == 1) ? (ball.velocity.x < 0) : (ball.velocity.x > 0);
+        if (!ball.visible || !incoming) continue;
+
+        float time = (PaddlePlaneX(ControlledPlayer(game, side), ball, side) - ball.position.x) / ball.velocity.x;
+        if (time < 0) continue;                             // already past the paddle
+
+        if (!nearest || time < nearestTime)
+        {
+            nearest = &ball;
+            nearestTime = time;
+        }
+    }
+    return nearest;
+}
+
+// Work out which y position a search controller should meet the ball at
+// Tries a spread of contact points on the paddle and keeps the one whose return lands furthest from the opponent
+inline float SearchTargetY(const Game &game, const Ball &ball, int side)
+{
+    const Player &player = ControlledPlayer(game, side);
+    const Player &opponent = ControlledPlayer(game, (side == 1) ? 2 : 1);
+
+    float contactX = PaddlePlaneX(player, ball, side);
+    float contactY = PredictBallY(ball.position, ball.velocity, ball.radius, contactX);
+    float direction = (side == 1) ? 1.0f : -1.0f;
+    float returnSpeed = fabsf(ball.velocity.x) * game.rules.speedUp;       // bouncing speeds the ball up
+
+    float bestOffset = 0, bestScore = -1;
+    for (int i = 0; i < searchCandidates; i++)
+    {
+        // Offset of the contact point from the centre of the paddle, -1 (top) to 1 (bottom), avoiding the edges
+        float offset = -0.9f + 1.8f * i / (searchCandidates - 1);
+        float paddleY = contactY - offset * (player.size.y / 2);
+        if (paddleY < player.size.y / 2 || paddleY > screenHeight - player.size.y / 2) continue;   // paddle can't get there
+
+        Vector2 position = { contactX, contactY };
+        Vector2 velocity = { direction * returnSpeed, returnSpeed * offset };
+        float landingY = PredictBallY(position, velocity, ball.radius, PaddlePlaneX(opponent, ball, (side == 1) ? 2 : 1));
+
+        float score = fabsf(landingY - opponent.position.y);
+        if (score > bestScore)
+        {
+            bestScore = score;
+            bestOffset = offset;
+        }
+    }
+    return contactY - bestOffset * (player.size.y / 2);
+}
+
+// Run a policy network on the current game state, returns a value between -1 (up) and 1 (down)
+inline float EvaluatePolicy(const Controller &controller, const Game &game, int side)
+{
+    const Player &player = ControlledPlayer(game, side);
+    const Ball *ball = IncomingBall(game, side);
+    float direction = (side == 1) ? -1.0f : 1.0f;
+
+    float features[policyInputs] = { 0, 0, 0, 0, 0, (player.position.y - screenHeight / 2) / screenHeight };
+    if (ball)
+    {
+        features[0] = 1;
+        features[1] = (ball->position.y - player.position.y) / screenHeight;
+        features[2] = fabsf(ball->position.x - player.position.x) / screenWidth;
+        features[3] = ball->velocity.x * direction / 1000;
+        features[4] = ball->velocity.y / 1000;
+    }
+
+    const float *weights = controller.weights;
+    const float *hiddenBias = weights + policyHidden * policyInputs;
+    const float *outputWeights = hiddenBias + policyHidden;
+    float output = outputWeights[policyHidden];             // output bias is the last weight
+
+    for (int h = 0; h < policyHidden; h++)
+    {
+        float sum = hiddenBias[h];
+        for (int i = 0; i < policyInputs; i++)
+        {
+            sum += weights[h * policyInputs + i] * features[i];
+        }
+        output += outputWeights[h] * tanhf(sum);
+    }
+    return tanhf(output);
+}
+
+// Decide which keys a controller holds down this tick
+inline PaddleInput ControlPaddle(const Controller &controller, ControllerState &state, const Game &game, int side)
+{
+    PaddleInput input = { 0, 0 };
+    const Player &player = ControlledPlayer(game, side);
+
+    if (controller.kind == CONTROLLER_IDLE)
+    {
+        return input;
+    }
+
+    if (controller.kind == CONTROLLER_POLICY)
+    {
+        float action = EvaluatePolicy(controller, game, side);
+        input.up = action < -0.3f;
+        input.down = action > 0.3f;
+        return input;
+    }
+
+    // Heuristic and search controllers only re-plan every few ticks, like a player's reaction time
+    if (--state.ticksUntilDecision <= 0)
+    {
+        state.ticksUntilDecision = controller.reactionTicks;
+
+        const Ball *ball = IncomingBall(game, side);
+        if (!ball)
+        {
+            state.targetY = screenHeight / 2;       // Nothing coming - wait in the middle
+        }
+        else if (controller.kind == CONTROLLER_FOLLOW)
+        {
+            state.targetY = ball->position.y;
+        }
+        else if (controller.kind == CONTROLLER_PREDICT)
+        {
+            state.targetY = PredictBallY(ball->position, ball->velocity, ball->radius, PaddlePlaneX(player, *ball, side));
+        }
+        else
+        {
+            state.targetY = SearchTargetY(game, *ball, side);
+        }
+        state.targetY += controller.aimNoise * RandomSigned(state.random);
+    }
+
+    // Only move when further away than one tick of movement, so the paddle doesn't jitter around the target
+    float deadZone = player.speed * simTickTime / 2;
+    input.down = player.position.y < state.targetY - deadZone;
+    input.up = player.position.y > state.targetY + deadZone;
+    return input;
+}
+
+// Load the weights of a policy network from a text file of whitespace separated numbers
+inline bool LoadPolicyWeights(Controller &controller, const char *fileName)
+{
+    FILE *file = fopen(fileName, "r");
+    if (!file) return false;
+
+    int count = 0;
+    while (count < policyWeightCount && fscanf(file, "%f", &controller.weights[count]) == 1) count++;
+    fclose(file);
+
+    return count == policyWeightCount;
+}
+
+// Set up a controller from a text description: kind[:reaction=N][,noise=N][,weights=file]
+// e.g. "predict", "search:reaction=6,noise=30", "policy:weights=bots/policy.txt"
+inline bool ParseController(Controller &controller, const char *description)
+{
+    memset(&controller, 0, sizeof(controller));
+    controller.reactionTicks = 1;
+    snprintf(controller.name, sizeof(controller.name), "%s", description);
+
+    char kind[32] = { 0 };
+    const char *options = strchr(description, ':');
+    size_t kindLength = options ? (size_t)(options - description) : strlen(description);
+    if (kindLength >= sizeof(kind)) return false;
+    memcpy(kind, description, kindLength);
+
+    if (strcmp(kind, "idle") == 0) controller.kind = CONTROLLER_IDLE;
+    else if (strcmp(kind, "follow") == 0) controller.kind = CONTROLLER_FOLLOW;
+    else if (strcmp(kind, "predict") == 0) controller.kind = CONTROLLER_PREDICT;
+    else if (strcmp(kind, "search") == 0) controller.kind = CONTROLLER_SEARCH;
+    else if (strcmp(kind, "policy") == 0) controller.kind = CONTROLLER_POLICY;
+    else return false;
+
+    bool haveWeights = false;
+    while (options && *options)
+    {
+        options++;      // skip ':' or ','
+        char key[32] = { 0 }, value[200] = { 0 };
+        if (sscanf(options, "%31[^=]=%199[^,]", key, value) != 2) return false;
+
+        if (strcmp(key, "reaction") == 0) controller.reactionTicks = atoi(value);
+        else if (strcmp(key, "noise") == 0) controller.aimNoise = (float)atof(value);
+        else if (strcmp(key, "weights") == 0)
+        {
+            if (!LoadPolicyWeights(controller, value)) return false;
+            haveWeights = true;
+        }
+        else return false;
+
+        options = strchr(options, ',');
+    }
+
+    if (controller.reactionTicks < 1) controller.reactionTicks = 1;
+    return (controller.kind != CONTROLLER_POLICY) || haveWeights;
+}
+
+// Play a whole match between two controllers without a window, ticking at the game's 60 FPS
+inline MatchResult PlayBotMatch(const Controller &left, const Controller &right, unsigned int seed, int maxTicks, const MatchRules &rules = MatchRules())
+{
+    Game game;
+    InitialiseGame(game, rules);
+
+    ControllerState leftState, rightState;
+    InitialiseControllerState(leftState, seed);
+    InitialiseControllerState(rightState, seed ^ 0x5BD1E995u);
+
+    UpdateGameFunction update = SelectUpdateGame(rules);      // Specialised for the rules if it can be (specsim.h)
+    while (!game.gameWon && game.tick < maxTicks)
+    {
+        PaddleInput leftInput = ControlPaddle(left, leftState, game, 1);
+        PaddleInput rightInput = ControlPaddle(right, rightState, game, 2);
+        update(game, leftInput, rightInput, simTickTime);
+    }
+
+    MatchResult result = { game.winner, game.player1LeftScore, game.player2RightScore, game.tick };
+    return result;
+}
+
+// Play a whole bot match with the fixed-point simulation (fixedsim.h) at the headless tick rate
+// The bots still decide on the float view of the match, so only the physics is exact on every build
+inline MatchResult PlayFixedBotMatch(const Controller &left, const Controller &right, unsigned int seed, int maxTicks, const MatchRules &rules = MatchRules())
+{
+    FixedGame fixed;
+    InitialiseFixedGame(fixed, 60, rules);
+    Game game;
+    FixedToGame(fixed, rules, game);
+
+    ControllerState leftState, rightState;
+    InitialiseControllerState(leftState, seed);
+    InitialiseControllerState(rightState, seed ^ 0x5BD1E995u);
+
+    while (!fixed.gameWon && fixed.tick < maxTicks)
+    {
+        PaddleInput leftInput = ControlPaddle(left, leftState, game, 1);
+        PaddleInput rightInput = ControlPaddle(right, rightState, game, 2);
+        UpdateFixedGame(fixed, ToFixedInput(leftInput), ToFixedInput(rightInput));
+        FixedToGame(fixed, rules, game);
+    }
+
+    MatchResult result = { fixed.winner, fixed.player1LeftScore, fixed.player2RightScore, fixed.tick };
+    return result;
+}
+
+#endif // CONTROLLERS_H
@@ -0,0 +1,148 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium draw counting: the draw calls and batch flushes behind the game's drawing
+*
+*   raylib doesn't draw each shape as it is asked to: rlgl adds its vertices to a batch, starts a
+*   new draw call in the batch when the primitive type or texture changes, and only submits the
+*   batch to OpenGL (a flush) when its vertex buffer or draw call list is full, or at EndDrawing,
+*   BeginTextureMode, BeginMode2D and so on. rlgl keeps those counts to itself, so the game draws
+*   through the Counted functions below, which call raylib and follow the same rules on the side:
+*   a batch of 8192 quads (32768 vertices) and 256 draw calls as in raylib 4.2, shapes drawn with
+*   the default font's texture (raylib's shapes texture), circles as 18 quads.
+*
+*   Only batches with something in them count as flushes, and the draw calls of a batch are
+*   counted when it is flushed. A mesh drawn straight to OpenGL (the particles) flushes the batch
+*   before it and is a draw call of its own. Counting is a few integer adds a shape, so it is always on.
+*
+******************************************************************************************************/
+
+#ifndef DRAWCOUNT_H
+#define DRAWCOUNT_H
+
+#include "include/raylib.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int drawBatchVertices = 8192 * 4;         // Vertices in rlgl's default batch
+const int drawBatchCalls = 256;                 // Draw calls in rlgl's default batch
+const int drawCircleVertices = 4 * 36 / 2;      // DrawCircle draws 36 segments as quads, two segments a quad
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create an enum of the primitive types rlgl batches separately
+enum DrawMode { DRAW_LINES, DRAW_TRIANGLES, DRAW_QUADS };
+
+// Create a structure for the counts, and for the batch being filled
+struct DrawCounters
+{
+    long long drawCalls;            // draw calls in the batches flushed so far
+    long long flushes;              // batches flushed with something in them
+    long long vertices;             // vertices drawn
+
+    int batchVertices;              // vertices in the batch being filled
+    int batchCalls;                 // draw calls in it, the last still being added to
+    DrawMode mode;                  // primitive type and texture of the last draw call
+    unsigned int texture;
+};
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+//----------------------------------------------------------------------------------------------------
+static DrawCounters drawCounters;           // Draw calls, flushes and vertices counted so far
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Count the batch being submitted (EndDrawing, Begin/EndTextureMode, Begin/EndMode2D all flush it)
+inline void CountFlush()
+{
+    DrawCounters &c = drawCounters;
+    if (c.batchVertices > 0)
+    {
+        c.flushes++;
+        c.drawCalls += c.batchCalls;
+    }
+    c.batchVertices = 0;
+    c.batchCalls = 0;
+}
+
+// Count a shape's vertices, as rlgl adds them to the batch
+inline void CountPrimitive(DrawMode mode, unsigned int texture, int vertices)
+{
+    DrawCounters &c = drawCounters;
+    if (c.batchVertices + vertices >= drawBatchVertices) CountFlush();
+    if (c.batchCalls == 0 || mode != c.mode || texture != c.texture)
+    {
+        if (c.batchCalls >= drawBatchCalls) CountFlush();
+        c.batchCalls++;
+        c.mode = mode;
+        c.texture = texture;
+    }
+    c.batchVertices += vertices;
+    c.vertices += vertices;
+}
+
+// Count a mesh drawn with DrawMesh, after the batch before it was drawn (rlDrawRenderBatchActive)
+inline void CountMesh(int vertices)
+{
+    CountFlush();
+    drawCounters.drawCalls++;
+    drawCounters.vertices += vertices;
+}
+
+inline void ResetDrawCounters()
+{
+    drawCounters = DrawCounters();
+}
+
+inline void DrawTextCounted(const char *text, int x, int y, int fontSize, Color colour)
+{
+    DrawText(text, x, y, fontSize, colour);
+
+    // A quad for every character but spaces and line breaks
+    unsigned int texture = GetFontDefault().texture.id;
+    for (const char *c = text; *c; c++)
+    {
+        if (*c != ' ' && *c != '\t' && *c != '\n') CountPrimitive(DRAW_QUADS, texture, 4);
+    }
+}
+
+inline void DrawTextureCounted(Texture2D texture, int x, int y, Color tint)
+{
+    DrawTexture(texture, x, y, tint);
+    CountPrimitive(DRAW_QUADS, texture.id, 4);
+}
+
+inline void DrawTextureRecCounted(Texture2D texture, Rectangle source, Vector2 position, Color tint)
+{
+    DrawTextureRec(texture, source, position, tint);
+    CountPrimitive(DRAW_QUADS, texture.id, 4);
+}
+
+inline void DrawTextureProCounted(Texture2D texture, Rectangle source, Rectangle destination, Vector2 origin, float rotation, Color tint)
+{
+    DrawTexturePro(texture, source, destination, origin, rotation, tint);
+    CountPrimitive(DRAW_QUADS, texture.id, 4);
+}
+
+inline void DrawLineCounted(int startX, int startY, int endX, int endY, Color colour)
+{
+    DrawLine(startX, startY, endX, endY, colour);
+    CountPrimitive(DRAW_LINES, 0, 2);
+}
+
+inline void DrawRectangleRecCounted(Rectangle rec, Color colour)
+{
+    DrawRectangleRec(rec, colour);
+    CountPrimitive(DRAW_QUADS, GetFontDefault().texture.id, 4);
+}
+
+inline void DrawCircleCounted(int centreX, int centreY, float radius, Color colour)
+{
+    DrawCircle(centreX, centreY, radius, colour);
+    CountPrimitive(DRAW_QUADS, GetFontDefault().texture.id, drawCircleVertices);
+}
+
+#endif // DRAWCOUNT_H
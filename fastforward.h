@@ -0,0 +1,268 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium fast-forward: jumps a fixed-point match (fixedsim.h) straight to its next event
+*
+*   Between events a tick only moves things in straight lines: the balls by their velocity, the
+*   players by their keys. QuietFixedTicks works out in closed form how many ticks that lasts with
+*   the keys held steady, up to the first tick that bounces a ball off a wall, could bounce it off
+*   a player (the ball is level with the paddle), scores it, clamps a player to the screen or brings
+*   ball 2 into play. FastForwardFixedGame adds that many ticks of motion at once and steps the
+*   event tick with UpdateFixedGame. In fixed point n ticks of motion are exactly one multiply, so
+*   a fast-forwarded match is bit for bit the match stepped tick by tick.
+*
+*   The keys have to stay steady for it to jump, so the bots here decide on events too: a fast bot
+*   predicts where the incoming ball will cross its paddle (in integers, bounces folded in), aims
+*   somewhere on the paddle and moves there, and can say for how many ticks its keys won't change.
+*   A whole bot match takes some hundreds of jumps instead of thousands of ticks.
+*
+******************************************************************************************************/
+
+#ifndef FASTFORWARD_H
+#define FASTFORWARD_H
+
+#include "controllers.h"
+#include "fixedsim.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int quietForever = 0x7FFFFFFF;        // Ticks until the next event when nothing will ever happen
+const int fastBotAimRange = 40;             // Fast bots aim up to this many px either side of the ball's path
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for what a fast bot remembers between decisions
+struct FastBotState
+{
+    unsigned int random;            // random number generator state (seeded per match)
+    int plannedBall;                // ball it last planned for (1 or 2), 0 for none
+    int plannedVx, plannedVy;       // that ball's velocity when it planned, 16.16 px/s
+    int plannedScore;               // total score when it planned (a scored ball restarts from the centre)
+    int targetY;                    // y position the paddle is moving towards, 16.16 px
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Count the ticks a value moving by step a tick stays within [low, high], from the first step on
+// Positions are on screen and steps below fixedMaxSpeed, so the division fits in 32 bits (much quicker than 64)
+inline int TicksInRange(int start, int step, int low, int high)
+{
+    if (step == 0) return (start >= low && start <= high) ? quietForever : 0;
+    long long next = (long long)start + step;
+    if (next < low || next > high) return 0;
+
+    return (step > 0) ? (int)((unsigned int)(high - start) / (unsigned int)step) : (int)((unsigned int)(start - low) / (unsigned int)-step);
+}
+
+inline int FixedPlayerStep(const FixedPlayer &player, FixedInput input, unsigned int tickFraction)
+{
+    return FixedMultiply(FixedTickDistance(player.speed, tickFraction), input.down - input.up);
+}
+
+// Count the ticks from now with nothing but straight-line motion, if both players keep their keys
+inline int QuietFixedTicks(const FixedGame &game, FixedInput left, FixedInput right)
+{
+    int quiet = quietForever;
+    const int courtWidth = screenWidth << fixedShift, courtHeight = screenHeight << fixedShift;
+
+    // A player's clamp does nothing while it starts every tick inside the screen
+    const FixedPlayer *players[2] = { &game.player1Left, &game.player2Right };
+    FixedInput inputs[2] = { left, right };
+    for (int p = 0; p < 2; p++)
+    {
+        const FixedPlayer &player = *players[p];
+        int halfHeight = player.height / 2;
+        if (player.y < halfHeight || player.y > courtHeight - halfHeight) return 0;
+
+        int inside = TicksInRange(player.y, FixedPlayerStep(player, inputs[p], game.tickFraction), halfHeight, courtHeight - halfHeight);
+        if (inside < quiet - 1) quiet = inside + 1;
+    }
+
+    const FixedBall *balls[2] = { &game.ball1, &game.ball2 };
+    for (int b = 0; b < 2; b++)
+    {
+        // Ball 2 stands still until it comes into play, but it is still checked against the players and goals
+        const FixedBall &ball = *balls[b];
+        bool moving = (b == 0 || ball.visible);
+        int dx = moving ? FixedTickDistance(ball.vx, game.tickFraction) : 0;
+        int dy = moving ? FixedTickDistance(ball.vy, game.tickFraction) : 0;
+
+        int wallTicks = TicksInRange(ball.y, dy, ball.radius, courtHeight - ball.radius);
+        if (wallTicks < quiet) quiet = wallTicks;
+
+        // Only the player a ball is travelling towards can bounce it, and not while the ball is level with its paddle
+        int low = 0, high = courtWidth;
+        if (ball.vx != 0)
+        {
+            const FixedPlayer &player = (ball.vx < 0) ? game.player1Left : game.player2Right;
+            int centreX = player.x & ~(fixedOne - 1), reach = player.width / 2 + ball.radius;
+            if (ball.x > centreX + reach) low = centreX + reach + 1;
+            else if (ball.x < centreX - reach) high = centreX - reach - 1;
+            else return 0;
+        }
+        int courtTicks = TicksInRange(ball.x, dx, low, high);
+        if (courtTicks < quiet) quiet = courtTicks;
+    }
+
+    // Ball 2 comes into play on the tick its counter reaches the delay (at least 1, so the tick is never skipped)
+    bool counting = game.player1LeftScore >= game.rules.ball2Score || game.player2RightScore >= game.rules.ball2Score;
+    if (counting && game.frameCounterBall2 < game.ball2DelayTicks && game.ball2DelayTicks - game.frameCounterBall2 - 1 < quiet)
+    {
+        quiet = game.ball2DelayTicks - game.frameCounterBall2 - 1;
+    }
+    return quiet;
+}
+
+// Simulate ticks that QuietFixedTicks says are quiet, all at once
+inline void AdvanceFixedGame(FixedGame &game, FixedInput left, FixedInput right, int ticks)
+{
+    game.player1Left.y += (int)((long long)ticks * FixedPlayerStep(game.player1Left, left, game.tickFraction));
+    game.player2Right.y += (int)((long long)ticks * FixedPlayerStep(game.player2Right, right, game.tickFraction));
+
+    FixedBall *balls[2] = { &game.ball1, &game.ball2 };
+    for (int b = 0; b < 2; b++)
+    {
+        if (b == 1 && !game.ball2.visible) continue;
+        balls[b]->x += (int)((long long)ticks * FixedTickDistance(balls[b]->vx, game.tickFraction));
+        balls[b]->y += (int)((long long)ticks * FixedTickDistance(balls[b]->vy, game.tickFraction));
+    }
+
+    if (game.player1LeftScore >= game.rules.ball2Score || game.player2RightScore >= game.rules.ball2Score) game.frameCounterBall2 += ticks;
+    game.tick += ticks;
+}
+
+// Simulate up to maxTicks ticks with the keys held steady: every quiet tick at once, then the event tick (if it comes first)
+// Returns the ticks simulated, 0 once the game is won; events are those of the event tick
+inline int FastForwardFixedGame(FixedGame &game, FixedInput left, FixedInput right, int maxTicks, TickEvents *events = 0)
+{
+    if (events) *events = TickEvents{ 0, 0, 0, 0 };
+    if (game.gameWon || maxTicks <= 0) return 0;
+
+    int quiet = QuietFixedTicks(game, left, right);
+    if (quiet >= maxTicks)
+    {
+        AdvanceFixedGame(game, left, right, maxTicks);
+        return maxTicks;
+    }
+
+    AdvanceFixedGame(game, left, right, quiet);
+    TickEvents eventTick = UpdateFixedGame(game, left, right);
+    if (events) *events = eventTick;
+    return quiet + 1;
+}
+
+inline void InitialiseFastBot(FastBotState &state, unsigned int seed)
+{
+    state.random = seed ? seed : 0x9E3779B9u;
+    state.plannedBall = -1;         // Nothing planned yet
+    state.plannedVx = state.plannedVy = state.plannedScore = 0;
+    state.targetY = (screenHeight / 2) << fixedShift;
+}
+
+// Get the y position where a ball will reach a vertical line, stepping as UpdateFixedGame does and folding in wall bounces
+inline int PredictFixedBallY(const FixedBall &ball, int ticks, unsigned int tickFraction)
+{
+    long long low = ball.radius, range = (screenHeight << fixedShift) - 2 * ball.radius;
+    long long y = ball.y + (long long)ticks * FixedTickDistance(ball.vy, tickFraction) - low;
+    y %= 2 * range;
+    if (y < 0) y += 2 * range;
+    if (y > range) y = 2 * range - y;
+    return (int)(y + low);
+}
+
+// Decide which keys a fast bot holds this tick and for how many ticks they stay the same if nothing happens
+// The decision only changes on events (a ball changing course or being scored, or the paddle arriving), so a
+// fast-forwarded match asks it only between jumps and gets the same answers as asking every tick
+inline FixedInput FastBotInput(const FixedGame &game, int side, FastBotState &state, int &steadyTicks)
+{
+    const FixedPlayer &player = (side == 1) ? game.player1Left : game.player2Right;
+    int planeX = (side == 1) ? player.x + player.width / 2 : player.x - player.width / 2;
+
+    // Find the ball that will reach this player's paddle first
+    const FixedBall *balls[2] = { &game.ball1, &game.ball2 };
+    int incoming = 0, incomingTicks = 0;
+    for (int b = 0; b < 2; b++)
+    {
+        const FixedBall &ball = *balls[b];
+        int dx = FixedTickDistance(ball.vx, game.tickFraction);
+        int distance = (side == 1) ? ball.x - ball.radius - planeX : planeX - ball.x - ball.radius;
+        int closing = (side == 1) ? -dx : dx;
+        if (!ball.visible || closing <= 0 || distance < 0) continue;
+
+        int ticks = (int)(((unsigned int)distance + closing - 1) / (unsigned int)closing);
+        if (!incoming || ticks < incomingTicks)
+        {
+            incoming = b + 1;
+            incomingTicks = ticks;
+        }
+    }
+
+    // Plan again whenever the ball to play changes course
+    const FixedBall *ball = incoming ? balls[incoming - 1] : 0;
+    int score = game.player1LeftScore + game.player2RightScore;
+    if (incoming != state.plannedBall || (ball && (ball->vx != state.plannedVx || ball->vy != state.plannedVy)) || score != state.plannedScore)
+    {
+        state.plannedBall = incoming;
+        state.plannedVx = ball ? ball->vx : 0;
+        state.plannedVy = ball ? ball->vy : 0;
+        state.plannedScore = score;
+
+        if (!ball) state.targetY = (screenHeight / 2) << fixedShift;       // Nothing coming - wait in the middle
+        else
+        {
+            int aim = (int)(NextRandom(state.random) % (2 * fastBotAimRange + 1)) - fastBotAimRange;
+            state.targetY = PredictFixedBallY(*ball, incomingTicks, game.tickFraction) + (aim << fixedShift);
+        }
+
+        int halfHeight = player.height / 2;
+        if (state.targetY < halfHeight) state.targetY = halfHeight;
+        if (state.targetY > (screenHeight << fixedShift) - halfHeight) state.targetY = (screenHeight << fixedShift) - halfHeight;
+    }
+
+    // Move at full speed until within half a tick of movement of the target
+    FixedInput input = { 0, 0 };
+    int step = FixedTickDistance(player.speed, game.tickFraction), deadZone = step / 2;
+    steadyTicks = quietForever;
+    if (player.y < state.targetY - deadZone)
+    {
+        input.down = fixedOne;
+        steadyTicks = (int)((unsigned int)(state.targetY - deadZone - player.y + step - 1) / (unsigned int)step);
+    }
+    else if (player.y > state.targetY + deadZone)
+    {
+        input.up = fixedOne;
+        steadyTicks = (int)((unsigned int)(player.y - state.targetY - deadZone + step - 1) / (unsigned int)step);
+    }
+    return input;
+}
+
+// Play a whole match between two fast bots, jumping from event to event
+// jumps (if given) counts the calls to FastForwardFixedGame, the work the match took
+inline MatchResult PlayFastBotMatch(unsigned int seed, int maxTicks, const MatchRules &rules = MatchRules(), long long *jumps = 0)
+{
+    FixedGame game;
+    InitialiseFixedGame(game, 60, rules);
+    FastBotState leftState, rightState;
+    InitialiseFastBot(leftState, seed);
+    InitialiseFastBot(rightState, seed ^ 0x5BD1E995u);
+
+    while (!game.gameWon && game.tick < maxTicks)
+    {
+        int leftSteady, rightSteady;
+        FixedInput leftInput = FastBotInput(game, 1, leftState, leftSteady);
+        FixedInput rightInput = FastBotInput(game, 2, rightState, rightSteady);
+
+        int limit = maxTicks - game.tick;
+        if (leftSteady < limit) limit = leftSteady;
+        if (rightSteady < limit) limit = rightSteady;
+        FastForwardFixedGame(game, leftInput, rightInput, limit);
+        if (jumps) (*jumps)++;
+    }
+
+    MatchResult result = { game.winner, game.player1LeftScore, game.player2RightScore, game.tick };
+    return result;
+}
+
+#endif // FASTFORWARD_H
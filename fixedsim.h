@@ -0,0 +1,368 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium fixed-point simulation: the rules of pongsim.h in integers, bit-identical everywhere
+*
+*   Float results can differ between compilers, optimisation levels and instruction sets (x87 or
+*   SSE, fused multiply-adds), which breaks lockstep and replays. This backend plays the same rules
+*   with positions and velocities in 16.16 fixed point and only integer arithmetic, so the same
+*   inputs give the same match on every machine and build. The tick length is a 0.32 fraction of a
+*   second (exact to 1 part in 4 billion for any integer tick rate); velocities are capped at
+*   fixedMaxSpeed, where the float game would run on towards infinity (the classic speed cap never
+*   stops a ball sent left).
+*
+*   It is optional: the float game stays the reference. FixedToGame gives the float view of a
+*   fixed match, for drawing and the bots in controllers.h; HashFixedState hashes the fixed state
+*   itself in statehash.h's canonical layout, so its chains are the same on every build.
+*
+******************************************************************************************************/
+
+#ifndef FIXEDSIM_H
+#define FIXEDSIM_H
+
+#include <math.h>
+#include "pongsim.h"
+#include "statehash.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int fixedShift = 16;                          // Fraction bits of a fixed-point value
+const int fixedOne = 1 << fixedShift;
+const int fixedMaxSpeed = 20000 << fixedShift;      // Fastest a ball can travel, px/s (keeps products inside 64 bits)
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for a ball in fixed point
+struct FixedBall
+{
+    int x, y;               // position, 16.16 px
+    int vx, vy;             // velocity, 16.16 px/s
+    int radius;             // 16.16 px
+    bool visible;
+};
+
+// Create a structure for a player in fixed point
+struct FixedPlayer
+{
+    int x, y;               // centre, 16.16 px
+    int width, height;      // 16.16 px
+    int speed;              // 16.16 px/s
+};
+
+// Create a structure for the balance constants of a match in fixed point
+struct FixedRules
+{
+    int ballSpeed;          // 16.16 px/s
+    int speedUp;            // 16.16 factor
+    int speedCap;           // 16.16 px/s
+    int paddleWidth, paddleHeight, paddleSpeed;
+    int ball2Score, ball2Delay, winScore;
+};
+
+// Create a structure holding the complete state of one fixed-point match
+struct FixedGame
+{
+    FixedRules rules;
+    unsigned int tickFraction;      // length of a tick, as a fraction of a second times 2^32
+    int ball2DelayTicks;            // ticks from the ball 2 score to ball 2 coming into play
+    FixedPlayer player1Left, player2Right;
+    FixedBall ball1, ball2;
+    int player1LeftScore, player2RightScore, frameCounterBall2;
+    bool gameWon;
+    int winner;
+    int tick;
+};
+
+// Create a structure for the keys held during a tick in fixed point
+struct FixedInput
+{
+    int up, down;           // fraction of the tick each key was held, 0 to fixedOne
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Convert a float to fixed point, rounding to the nearest (only used on rules and inputs, where it is exact or deterministic)
+inline int ToFixed(double value)
+{
+    return (int)lround(value * fixedOne);
+}
+
+inline float FromFixed(int value)
+{
+    return value / (float)fixedOne;
+}
+
+// Multiply two fixed-point values, rounding to the nearest
+inline int FixedMultiply(int a, int b)
+{
+    return (int)(((long long)a * b + (fixedOne / 2)) >> fixedShift);
+}
+
+// Distance travelled in one tick at a speed (16.16 px/s to 16.16 px)
+inline int FixedTickDistance(int speed, unsigned int tickFraction)
+{
+    return (int)(((long long)speed * tickFraction + 0x80000000ll) >> 32);
+}
+
+inline int ClampFixedSpeed(long long speed)
+{
+    if (speed > fixedMaxSpeed) return fixedMaxSpeed;
+    if (speed < -fixedMaxSpeed) return -fixedMaxSpeed;
+    return (int)speed;
+}
+
+inline FixedInput ToFixedInput(PaddleInput input)
+{
+    FixedInput fixed = { ToFixed(input.up), ToFixed(input.down) };
+    if (fixed.up < 0) fixed.up = 0;
+    if (fixed.up > fixedOne) fixed.up = fixedOne;
+    if (fixed.down < 0) fixed.down = 0;
+    if (fixed.down > fixedOne) fixed.down = fixedOne;
+    return fixed;
+}
+
+inline void ResetFixedBall(FixedBall &ball, int startSpeed)
+{
+    ball.x = (screenWidth / 2) << fixedShift;
+    ball.y = (screenHeight / 2) << fixedShift;
+    ball.vx = startSpeed;
+    ball.vy = startSpeed;
+}
+
+// Set the starting values of a fixed-point match, played at a whole number of ticks per second
+inline void InitialiseFixedGame(FixedGame &game, int tickRate = 60, const MatchRules &rules = MatchRules())
+{
+    game.rules.ballSpeed = ToFixed(rules.ballSpeed);
+    game.rules.speedUp = ToFixed(rules.speedUp);
+    game.rules.speedCap = ToFixed(rules.speedCap);
+    game.rules.paddleWidth = ToFixed(rules.paddleWidth);
+    game.rules.paddleHeight = ToFixed(rules.paddleHeight);
+    game.rules.paddleSpeed = rules.paddleSpeed << fixedShift;
+    game.rules.ball2Score = rules.ball2Score;
+    game.rules.ball2Delay = rules.ball2Delay;
+    game.rules.winScore = rules.winScore;
+    game.tickFraction = (unsigned int)((0x100000000ull + tickRate / 2) / tickRate);
+    game.ball2DelayTicks = (rules.ball2Delay * tickRate + 30) / 60;     // ball2Delay is in 60 FPS frames
+    if (game.ball2DelayTicks < 1) game.ball2DelayTicks = 1;             // as UpdateGame, at least a tick
+
+    FixedPlayer *players[2] = { &game.player1Left, &game.player2Right };
+    for (int p = 0; p < 2; p++)
+    {
+        players[p]->x = (p == 0 ? 25 : screenWidth - 25) << fixedShift;
+        players[p]->y = (screenHeight / 2) << fixedShift;
+        players[p]->width = game.rules.paddleWidth;
+        players[p]->height = game.rules.paddleHeight;
+        players[p]->speed = game.rules.paddleSpeed;
+    }
+
+    FixedBall *balls[2] = { &game.ball1, &game.ball2 };
+    for (int b = 0; b < 2; b++)
+    {
+        ResetFixedBall(*balls[b], game.rules.ballSpeed);
+        balls[b]->radius = 10 << fixedShift;
+        balls[b]->visible = (b == 0);
+    }
+
+    game.player1LeftScore = 0;
+    game.player2RightScore = 0;
+    game.frameCounterBall2 = 0;
+    game.gameWon = false;
+    game.winner = 0;
+    game.tick = 0;
+}
+
+// Check collision between a ball and a player, the same test as CheckCollisionBallPlayer in integers
+inline bool CheckFixedCollision(const FixedBall &ball, const FixedPlayer &player)
+{
+    int halfWidth = player.width / 2, halfHeight = player.height / 2;
+
+    // The float test truncates the centre of the rectangle to whole pixels
+    int centreX = player.x & ~(fixedOne - 1);
+    int centreY = player.y & ~(fixedOne - 1);
+
+    int dx = ball.x > centreX ? ball.x - centreX : centreX - ball.x;
+    int dy = ball.y > centreY ? ball.y - centreY : centreY - ball.y;
+
+    if (dx > halfWidth + ball.radius) return false;
+    if (dy > halfHeight + ball.radius) return false;
+
+    if (dx <= halfWidth) return true;
+    if (dy <= halfHeight) return true;
+
+    long long cornerX = dx - halfWidth, cornerY = dy - halfHeight;
+    return cornerX * cornerX + cornerY * cornerY <= (long long)ball.radius * ball.radius;
+}
+
+inline void ClampFixedPlayer(FixedPlayer &player)
+{
+    int halfHeight = player.height / 2, bottom = (screenHeight << fixedShift) - halfHeight;
+    player.y = player.y > bottom ? bottom : player.y < halfHeight ? halfHeight : player.y;
+}
+
+inline void MoveFixedBall(FixedBall &ball, unsigned int tickFraction)
+{
+    ball.x += FixedTickDistance(ball.vx, tickFraction);
+    ball.y += FixedTickDistance(ball.vy, tickFraction);
+
+    // Bounce off the bottom and top of the screen
+    if (ball.y > (screenHeight << fixedShift) - ball.radius)
+    {
+        ball.y = (screenHeight << fixedShift) - ball.radius;
+        ball.vy = -ball.vy;
+    }
+    else if (ball.y < ball.radius)
+    {
+        ball.y = ball.radius;
+        ball.vy = -ball.vy;
+    }
+}
+
+// Move a player by how much longer down was held than up, one multiply and no branch on the keys (they change every tick)
+inline void MoveFixedPlayer(FixedPlayer &player, FixedInput input, unsigned int tickFraction)
+{
+    player.y += FixedMultiply(FixedTickDistance(player.speed, tickFraction), input.down - input.up);
+}
+
+// Bounce a ball off a player if they collide, returns true if the ball was sent back (see BounceBallOffPlayer)
+inline bool BounceFixedBall(FixedBall &ball, const FixedPlayer &player, int direction, const FixedRules &rules)
+{
+    if (!CheckFixedCollision(ball, player)) return false;
+    if ((long long)ball.vx * direction >= 0) return false;
+
+    ball.vx = -ball.vx;
+    if (ball.vx <= rules.speedCap || ball.vy <= rules.speedCap)
+    {
+        ball.vx = ClampFixedSpeed(((long long)ball.vx * rules.speedUp + (fixedOne / 2)) >> fixedShift);
+
+        // Send the ball up or down by where it hit the paddle, as the float game does
+        long long offset = ball.y - player.y;
+        ball.vy = ClampFixedSpeed((long long)direction * ball.vx * offset / (player.height / 2));
+    }
+    return true;
+}
+
+inline bool ScoreFixedBall(FixedGame &game, FixedBall &ball)
+{
+    if (ball.x > (screenWidth << fixedShift))
+    {
+        game.player1LeftScore++;
+        ResetFixedBall(ball, game.rules.ballSpeed);
+        return true;
+    }
+    if (ball.x < 0)
+    {
+        game.player2RightScore++;
+        ResetFixedBall(ball, game.rules.ballSpeed);
+        return true;
+    }
+    return false;
+}
+
+// Update a fixed-point match by one tick, in the same order as UpdateGame
+inline TickEvents UpdateFixedGame(FixedGame &game, FixedInput left, FixedInput right)
+{
+    TickEvents events = { 0, 0, 0, 0 };
+    if (game.gameWon) return events;
+
+    ClampFixedPlayer(game.player1Left);
+    ClampFixedPlayer(game.player2Right);
+
+    MoveFixedBall(game.ball1, game.tickFraction);
+    if (game.ball2.visible) MoveFixedBall(game.ball2, game.tickFraction);
+
+    MoveFixedPlayer(game.player1Left, left, game.tickFraction);
+    MoveFixedPlayer(game.player2Right, right, game.tickFraction);
+
+    if (BounceFixedBall(game.ball1, game.player1Left, 1, game.rules)) { events.ballHits++; events.hitMask |= 1; }
+    if (BounceFixedBall(game.ball2, game.player1Left, 1, game.rules)) { events.ballHits++; events.hitMask |= 2; }
+    if (BounceFixedBall(game.ball1, game.player2Right, -1, game.rules)) { events.ballHits++; events.hitMask |= 1; }
+    if (BounceFixedBall(game.ball2, game.player2Right, -1, game.rules)) { events.ballHits++; events.hitMask |= 2; }
+
+    if (ScoreFixedBall(game, game.ball1)) { events.ballResets++; events.resetMask |= 1; }
+    if (ScoreFixedBall(game, game.ball2)) { events.ballResets++; events.resetMask |= 2; }
+
+    if (game.player1LeftScore >= game.rules.ball2Score || game.player2RightScore >= game.rules.ball2Score)
+    {
+        game.frameCounterBall2++;
+        if (game.frameCounterBall2 >= game.ball2DelayTicks) game.ball2.visible = true;
+    }
+
+    if (game.player1LeftScore >= game.rules.winScore || game.player2RightScore >= game.rules.winScore)
+    {
+        game.gameWon = true;
+        game.winner = (game.player1LeftScore >= game.rules.winScore) ? 1 : 2;
+        game.ball1.visible = false;
+        game.ball2.visible = false;
+    }
+
+    game.tick++;
+    return events;
+}
+
+// Get the float view of a fixed-point match (its rules are the ones it was started with)
+inline void FixedToGame(const FixedGame &fixed, const MatchRules &rules, Game &game)
+{
+    game.rules = rules;
+    const FixedPlayer *fixedPlayers[2] = { &fixed.player1Left, &fixed.player2Right };
+    Player *players[2] = { &game.player1Left, &game.player2Right };
+    for (int p = 0; p < 2; p++)
+    {
+        players[p]->position.x = FromFixed(fixedPlayers[p]->x);
+        players[p]->position.y = FromFixed(fixedPlayers[p]->y);
+        players[p]->size.x = FromFixed(fixedPlayers[p]->width);
+        players[p]->size.y = FromFixed(fixedPlayers[p]->height);
+        players[p]->speed = fixedPlayers[p]->speed >> fixedShift;
+    }
+
+    const FixedBall *fixedBalls[2] = { &fixed.ball1, &fixed.ball2 };
+    Ball *balls[2] = { &game.ball1, &game.ball2 };
+    for (int b = 0; b < 2; b++)
+    {
+        balls[b]->position.x = FromFixed(fixedBalls[b]->x);
+        balls[b]->position.y = FromFixed(fixedBalls[b]->y);
+        balls[b]->velocity.x = FromFixed(fixedBalls[b]->vx);
+        balls[b]->velocity.y = FromFixed(fixedBalls[b]->vy);
+        balls[b]->radius = FromFixed(fixedBalls[b]->radius);
+        balls[b]->visible = fixedBalls[b]->visible;
+    }
+
+    game.player1LeftScore = fixed.player1LeftScore;
+    game.player2RightScore = fixed.player2RightScore;
+    game.frameCounterBall2 = fixed.frameCounterBall2;
+    game.gameWon = fixed.gameWon;
+    game.winner = fixed.winner;
+    game.tick = fixed.tick;
+}
+
+// Put the changing parts of a fixed-point match in the canonical layout of statehash.h (its raw 16.16 words, not floats)
+inline void CanonicaliseFixedState(const FixedGame &game, CanonicalState &state)
+{
+    unsigned int *w = state.words;
+    w[0] = (unsigned int)game.player1Left.y;
+    w[1] = (unsigned int)game.player2Right.y;
+    w[2] = (unsigned int)game.ball1.x;
+    w[3] = (unsigned int)game.ball1.y;
+    w[4] = (unsigned int)game.ball1.vx;
+    w[5] = (unsigned int)game.ball1.vy;
+    w[6] = (unsigned int)game.ball2.x;
+    w[7] = (unsigned int)game.ball2.y;
+    w[8] = (unsigned int)game.ball2.vx;
+    w[9] = (unsigned int)game.ball2.vy;
+    w[10] = (game.ball1.visible ? 1u : 0u) | (game.ball2.visible ? 2u : 0u) | (game.gameWon ? 4u : 0u);
+    w[11] = (unsigned int)game.player1LeftScore;
+    w[12] = (unsigned int)game.player2RightScore;
+    w[13] = (unsigned int)game.frameCounterBall2;
+    w[14] = (unsigned int)game.winner;
+    w[15] = (unsigned int)game.tick;
+}
+
+inline unsigned long long HashFixedState(const FixedGame &game)
+{
+    CanonicalState state;
+    CanonicaliseFixedState(game, state);
+    return HashCanonicalState(state);
+}
+
+#endif // FIXEDSIM_H
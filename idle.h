@@ -0,0 +1,118 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium idle rendering: frames that wouldn't change aren't drawn
+*
+*   On the title and controls screens and once a game is won nothing on screen moves, yet the game
+*   used to clear and redraw the whole frame 60 times a second. When the state that is drawn hasn't
+*   changed since the last frame, the game now sleeps in the window's event queue instead (the
+*   display keeps showing the last frame) and wakes on input, when the music needs refilling, when
+*   the title screen times out or to repaint the window once a second. --no-idle turns this off.
+*
+*   --power measures it: for each screen, the frames drawn and wake-ups per second and the CPU
+*   used by the whole process (all threads, as a percentage of one core). Compare a run with
+*   --no-idle to see what idle rendering saves.
+*
+******************************************************************************************************/
+
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <stdio.h>
+#include <string.h>
+#include "include/raylib.h"
+
+#if defined(_WIN32)
+    // Declared here rather than including windows.h, which clashes with raylib's names
+    extern "C" __declspec(dllimport) void *__stdcall GetCurrentProcess(void);
+    extern "C" __declspec(dllimport) int __stdcall GetProcessTimes(void *process, unsigned long long *creation, unsigned long long *exit, unsigned long long *kernel, unsigned long long *user);
+#else
+    #include <time.h>
+#endif
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const double idleRedrawPeriod = 1.0;        // Longest time an unchanged frame is left on screen before redrawing it anyway
+const double idleMusicPeriod = 0.05;        // Longest sleep before refilling the music stream
+const int musicBufferFrames = 8192;         // Size of the music stream's buffers (samples), enough to last idleMusicPeriod several times over
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create an enum of the states the game spends its time in, as far as power is concerned
+enum PowerState { POWER_TITLE, POWER_CONTROLS, POWER_PLAYING, POWER_WON, POWER_STATE_COUNT };
+
+// Create a structure for what the power measurement keeps track of
+struct PowerMonitor
+{
+    double seconds[POWER_STATE_COUNT];      // time spent in each state
+    double cpuSeconds[POWER_STATE_COUNT];   // CPU time used by the process in each state
+    int frames[POWER_STATE_COUNT];          // frames drawn in each state
+    int wakeups[POWER_STATE_COUNT];         // times the main loop woke up in each state
+    double lastTime;                        // time of the last wake-up
+    double lastCpuTime;                     // CPU time used by the process at the last wake-up
+};
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+//----------------------------------------------------------------------------------------------------
+static PowerMonitor powerMonitor;
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Get the CPU time used so far by every thread of the process (seconds)
+inline double ProcessCpuTime()
+{
+#if defined(_WIN32)
+    unsigned long long creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) return 0;
+    return (kernel + user) * 1e-7;         // 100 ns units
+#else
+    timespec time;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+#endif
+}
+
+// Start measuring power
+inline void StartPowerMonitor()
+{
+    memset(&powerMonitor, 0, sizeof(powerMonitor));
+    powerMonitor.lastTime = GetTime();
+    powerMonitor.lastCpuTime = ProcessCpuTime();
+}
+
+// Count one wake-up of the main loop, charging the time since the last one to a state, call at the end of each loop
+inline void PowerWakeup(PowerState state, bool drewFrame)
+{
+    PowerMonitor &monitor = powerMonitor;
+    double now = GetTime(), cpuTime = ProcessCpuTime();
+
+    monitor.seconds[state] += now - monitor.lastTime;
+    monitor.cpuSeconds[state] += cpuTime - monitor.lastCpuTime;
+    monitor.wakeups[state]++;
+    if (drewFrame) monitor.frames[state]++;
+
+    monitor.lastTime = now;
+    monitor.lastCpuTime = cpuTime;
+}
+
+// Print the frames, wake-ups and CPU use of each state
+inline void WritePowerReport(bool idleRendering)
+{
+    const PowerMonitor &monitor = powerMonitor;
+    const char *stateNames[POWER_STATE_COUNT] = { "title", "controls", "playing", "won" };
+
+    printf("Power (idle rendering %s)\n", idleRendering ? "on" : "off");
+    printf("%-10s %9s %10s %10s %8s\n", "state", "seconds", "frames/s", "wakeups/s", "cpu %");
+    for (int s = 0; s < POWER_STATE_COUNT; s++)
+    {
+        double seconds = monitor.seconds[s];
+        if (seconds <= 0) continue;
+        printf("%-10s %9.1f %10.1f %10.1f %8.1f\n", stateNames[s], seconds, monitor.frames[s] / seconds,
+               monitor.wakeups[s] / seconds, 100 * monitor.cpuSeconds[s] / seconds);
+    }
+}
+
+#endif // IDLE_H
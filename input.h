@@ -0,0 +1,299 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium input: key transitions sampled between frames and applied inside simulation ticks
+*
+*   raylib samples the keyboard once per frame, so a key pressed just after sampling waits a whole
+*   frame and paddles only move in whole frames. Instead, a GLFW key callback chained in front of
+*   raylib's timestamps every transition and pushes it onto a lock-free single-producer
+*   single-consumer queue, and the game keeps polling for input (every millisecond) while it waits
+*   for the next frame. Each fixed simulation tick then pops the transitions that fall inside it
+*   and works out for what fraction of the tick each paddle key was held, so a paddle moves exactly
+*   as far as its key was held for.
+*
+*   Frame pacing, picked with --pacing <strategy>:
+*       fps     no vsync, frames 1/60 s apart, input sampled while waiting for the next frame (default)
+*       vsync   vsync on, the swap blocks until the display is ready, input sampled after the swap
+*       late    vsync on, input sampled until just before the next vblank (late latching)
+*
+******************************************************************************************************/
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <atomic>
+#include "include/raylib.h"
+#include "pongsim.h"
+
+// GLFW functions bundled in libraylib.a (GLFW key codes are the same as raylib's KEY_* values)
+extern "C"
+{
+    typedef struct GLFWwindow GLFWwindow;
+    typedef void (*GLFWkeyfun)(GLFWwindow *window, int key, int scancode, int action, int mods);
+
+    GLFWwindow *glfwGetCurrentContext(void);
+    GLFWkeyfun glfwSetKeyCallback(GLFWwindow *window, GLFWkeyfun callback);
+    double glfwGetTime(void);
+    void glfwWaitEventsTimeout(double timeout);
+    void glfwPostEmptyEvent(void);
+}
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int inputQueueSize = 1024;            // Transitions the queue can hold (must be a power of two)
+const int inputKeyCount = 512;              // Number of key codes tracked for presses
+const double inputSamplePeriod = 0.001;     // Time between input samples while waiting for a frame (1 ms)
+const double framePeriod = 1.0 / 60;        // Time between frames when pacing to 60 FPS
+
+// Keys that move the paddles, in the order they are kept in PaddleKeys
+const int paddleKeyCodes[4] = { KEY_W, KEY_S, KEY_UP, KEY_DOWN };
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create an enum of the ways frames can be paced
+enum FramePacing { PACING_FPS, PACING_VSYNC, PACING_LATE };
+
+// Create a structure for one key going down or up
+struct InputEvent
+{
+    int key;                        // raylib key code
+    bool down;                      // true if the key was pressed, false if it was released
+    double time;                    // time the transition was received (seconds, same clock as GetTime)
+};
+
+// Create a structure for a lock-free queue with one thread pushing and one thread popping
+struct InputQueue
+{
+    InputEvent events[inputQueueSize];
+    std::atomic<unsigned int> head;         // next slot to write, only changed by the pushing thread
+    std::atomic<unsigned int> tail;         // next slot to read, only changed by the popping thread
+};
+
+// Create a structure for the held state of the paddle keys, kept by whoever pops the queue
+struct PaddleKeys
+{
+    bool held[4];                   // W, S, UP, DOWN
+};
+
+// Create a structure for everything the input sampler keeps track of
+struct InputSampler
+{
+    GLFWkeyfun raylibCallback;              // raylib's key callback, called after ours
+    InputQueue queue;                       // paddle key transitions waiting for a simulation tick
+    int dropped;                            // transitions lost because the queue was full
+    double pressTime[inputKeyCount];        // time each key was last pressed
+    double frameFrom, frameTo;              // presses between these times belong to the current frame
+    void (*listener)(const InputEvent &event);      // optional extra consumer (latency measurement)
+
+    FramePacing pacing;                     // how frames are paced
+    double nextFrameTime;                   // time the next frame is due when pacing to 60 FPS
+    double swapTime;                        // time the last buffer swap finished
+    double workTime;                        // smoothed time from the start of a frame to the end of its swap
+    double lastWorkTime;                    // time from the start of the last frame to the end of its swap
+    double lastFrameInterval;               // time between the last two buffer swaps
+    double refreshPeriod;                   // time between vblanks of the display
+};
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+//----------------------------------------------------------------------------------------------------
+static InputSampler inputSampler;           // Single sampler, the GLFW callback has no user pointer to find it
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Push a transition onto the queue, returns false if the queue is full
+inline bool PushInputEvent(InputQueue &queue, const InputEvent &event)
+{
+    unsigned int head = queue.head.load(std::memory_order_relaxed);
+    if (head - queue.tail.load(std::memory_order_acquire) == (unsigned int)inputQueueSize) return false;
+
+    queue.events[head & (inputQueueSize - 1)] = event;
+    queue.head.store(head + 1, std::memory_order_release);     // Publish the event after it is written
+    return true;
+}
+
+// Look at the oldest transition in the queue without removing it, returns false if the queue is empty
+inline bool PeekInputEvent(InputQueue &queue, InputEvent &event)
+{
+    unsigned int tail = queue.tail.load(std::memory_order_relaxed);
+    if (tail == queue.head.load(std::memory_order_acquire)) return false;
+
+    event = queue.events[tail & (inputQueueSize - 1)];
+    return true;
+}
+
+// Remove the oldest transition from the queue (after PeekInputEvent returned it)
+inline void PopInputEvent(InputQueue &queue)
+{
+    queue.tail.store(queue.tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// Get the index of a paddle key in PaddleKeys, or -1 if the key doesn't move a paddle
+inline int PaddleKeyIndex(int key)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        if (paddleKeyCodes[i] == key) return i;
+    }
+    return -1;
+}
+
+// Key callback chained in front of raylib's - timestamps the transition, then lets raylib handle it
+inline void InputKeyCallback(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+    InputSampler &sampler = inputSampler;
+
+    if (action != 2)        // Ignore key repeats (GLFW_REPEAT), they don't change what is held
+    {
+        InputEvent event = { key, action == 1, glfwGetTime() };
+
+        if (PaddleKeyIndex(key) >= 0 && !PushInputEvent(sampler.queue, event)) sampler.dropped++;
+        if (event.down && key >= 0 && key < inputKeyCount) sampler.pressTime[key] = event.time;
+        if (sampler.listener) sampler.listener(event);
+    }
+
+    if (sampler.raylibCallback) sampler.raylibCallback(window, key, scancode, action, mods);
+}
+
+// Start sampling input, must be called after InitWindow
+inline void InstallInputSampler(FramePacing pacing)
+{
+    InputSampler &sampler = inputSampler;
+    sampler.queue.head.store(0);
+    sampler.queue.tail.store(0);
+    sampler.dropped = 0;
+    for (int i = 0; i < inputKeyCount; i++) sampler.pressTime[i] = -1;
+    sampler.listener = 0;
+
+    sampler.pacing = pacing;
+    sampler.frameFrom = sampler.frameTo = sampler.swapTime = sampler.nextFrameTime = GetTime();
+    sampler.workTime = sampler.lastWorkTime = sampler.lastFrameInterval = 0;
+
+    int refreshRate = GetMonitorRefreshRate(GetCurrentMonitor());
+    sampler.refreshPeriod = 1.0 / ((refreshRate > 0) ? refreshRate : 60);
+
+    sampler.raylibCallback = glfwSetKeyCallback(glfwGetCurrentContext(), InputKeyCallback);
+}
+
+// Keep polling for input until a given time
+inline void SampleInputUntil(double wakeTime)
+{
+    for (double now = GetTime(); now < wakeTime; now = GetTime())
+    {
+        double wait = wakeTime - now;
+        WaitTime((wait < inputSamplePeriod) ? wait : inputSamplePeriod);
+        PollInputEvents();
+    }
+}
+
+// Wait until the next frame is due, sampling input meanwhile, call at the start of the frame
+inline void WaitForNextFrame()
+{
+    InputSampler &sampler = inputSampler;
+    double now = GetTime();
+
+    if (sampler.pacing == PACING_FPS)
+    {
+        sampler.nextFrameTime += framePeriod;
+        if (sampler.nextFrameTime < now - framePeriod) sampler.nextFrameTime = now;    // Fell behind - don't rush to catch up
+        SampleInputUntil(sampler.nextFrameTime);
+    }
+    else if (sampler.pacing == PACING_LATE)
+    {
+        // Leave just enough time to update, draw and reach the next vblank, plus a millisecond of slack
+        SampleInputUntil(sampler.swapTime + sampler.refreshPeriod - 1.5 * sampler.workTime - 0.001);
+    }
+    // PACING_VSYNC: the swap already waited for the display and EndDrawing sampled input after it
+
+    // Presses received since the last frame started belong to this frame
+    sampler.frameFrom = sampler.frameTo;
+    sampler.frameTo = GetTime();
+}
+
+// Sleep until input arrives or a given time, call instead of WaitForNextFrame when the last frame is still up to date
+// Unlike the 1 ms sampling in WaitForNextFrame, the thread doesn't wake until something happens
+inline void WaitForInputOrTime(double wakeTime)
+{
+    InputSampler &sampler = inputSampler;
+    double wait = wakeTime - GetTime();
+    if (wait > 0) glfwWaitEventsTimeout(wait);
+    else PollInputEvents();
+
+    sampler.frameFrom = sampler.frameTo;
+    sampler.frameTo = GetTime();
+}
+
+// Mark the end of the frame's buffer swap, call just after EndDrawing
+inline void FrameSwapped()
+{
+    InputSampler &sampler = inputSampler;
+    double now = GetTime();
+    double work = now - sampler.frameTo;
+
+    sampler.workTime = (sampler.workTime == 0) ? work : 0.9 * sampler.workTime + 0.1 * work;
+    sampler.lastWorkTime = work;
+    sampler.lastFrameInterval = now - sampler.swapTime;
+    sampler.swapTime = now;
+}
+
+// Check if a key was pressed since the last frame
+// Used instead of IsKeyPressed, as sampling input several times a frame can hide a press from raylib
+inline bool InputKeyPressed(int key)
+{
+    double time = inputSampler.pressTime[key];
+    return time > inputSampler.frameFrom && time <= inputSampler.frameTo;
+}
+
+// Pop the transitions that happened before a time without simulating them (e.g. while not playing)
+inline void SkipInput(InputQueue &queue, PaddleKeys &keys, double until)
+{
+    InputEvent event;
+    while (PeekInputEvent(queue, event) && event.time < until)
+    {
+        keys.held[PaddleKeyIndex(event.key)] = event.down;
+        PopInputEvent(queue);
+    }
+}
+
+// Pop the transitions that happened during one simulation tick and work out the paddle inputs for it
+// Each input is the fraction of the tick the key was held, so a press half way through a tick moves a paddle half as far
+inline void ReadTickInput(InputQueue &queue, PaddleKeys &keys, double tickStart, double tickTime, PaddleInput &left, PaddleInput &right)
+{
+    double tickEnd = tickStart + tickTime;
+    double heldTime[4] = { 0, 0, 0, 0 };
+    bool changed[4] = { false, false, false, false };
+    double segmentStart = tickStart;
+
+    InputEvent event;
+    while (PeekInputEvent(queue, event) && event.time < tickEnd)
+    {
+        double time = (event.time > tickStart) ? event.time : tickStart;     // Late transitions count from the start of the tick
+        for (int k = 0; k < 4; k++)
+        {
+            if (keys.held[k]) heldTime[k] += time - segmentStart;
+        }
+        segmentStart = time;
+
+        int index = PaddleKeyIndex(event.key);
+        changed[index] = true;
+        keys.held[index] = event.down;
+        PopInputEvent(queue);
+    }
+
+    float fractions[4];
+    for (int k = 0; k < 4; k++)
+    {
+        if (keys.held[k]) heldTime[k] += tickEnd - segmentStart;
+        // Keys that didn't change were held for all or none of the tick - keep those exact
+        fractions[k] = changed[k] ? (float)(heldTime[k] / tickTime) : (keys.held[k] ? 1.0f : 0.0f);
+    }
+
+    left.up = fractions[0];
+    left.down = fractions[1];
+    right.up = fractions[2];
+    right.down = fractions[3];
+}
+
+#endif // INPUT_H
@@ -0,0 +1,301 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium lane simulation: UpdateGame for several matches at once, one match per SIMD lane
+*
+*   GameLanes holds simLanes matches field by field (every ball x together, every left paddle y
+*   together, ...) in vectors, and UpdateGameLanes steps all of them by one tick with vector
+*   operations: each branch of UpdateGame becomes a compare and a select, so lanes that hit a wall,
+*   a paddle or a goal this tick take the other side of it without holding up the rest. Each lane
+*   can have its own rules and tick length, and a lane whose match is won (or that holds no match)
+*   is left as it is.
+*
+*   Only a few ticks have a ball level with a paddle or off the court, so the collisions, scoring and
+*   the win check are skipped for every lane at once unless some lane needs them, as is ball 2 until
+*   it is in play in some lane.
+*
+*   Every lane does exactly the float operations UpdateGame does, in the same order, so a lane's
+*   match is the scalar match bit for bit (statehash.h); only a build contracting multiply-adds
+*   (-ffp-contract=fast with FMA) may fuse them differently. Meant for working through many matches
+*   at once (replaystats re-simulating a corpus of replays), not for speeding up one.
+*
+*   Uses the GCC/Clang vector extensions, which compile to whatever SIMD the target has (SSE2,
+*   AVX, NEON) or to plain scalar code.
+*
+******************************************************************************************************/
+
+#ifndef LANESIM_H
+#define LANESIM_H
+
+#include <string.h>
+#include "pongsim.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+// Matches stepped together, one register a field: wider vectors than the target has are split up element by element
+#if defined(__AVX__)
+const int simLanes = 8;
+#else
+const int simLanes = 4;
+#endif
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+typedef float LaneFloats __attribute__((vector_size(simLanes * sizeof(float))));
+typedef int LaneInts __attribute__((vector_size(simLanes * sizeof(int))));         // counters, and masks: -1 true, 0 false
+typedef double LaneDoubles __attribute__((vector_size(simLanes * sizeof(double))));
+
+// Create a structure for one ball of every lane
+struct BallLanes
+{
+    LaneFloats x, y, vx, vy;
+    LaneInts visible;
+};
+
+// Create a structure for the matches in the lanes, rules first, then state
+struct GameLanes
+{
+    LaneInts active;                        // lane holds a match (its inputs are read and it is stepped until won)
+    LaneFloats frameTime;                   // tick length of each lane's match
+    LaneFloats ballSpeed, speedCap, radius;
+    LaneDoubles speedUp;
+    LaneFloats halfWidth, halfHeight;       // paddle size / 2
+    LaneFloats paddleStep;                  // paddle speed * tick length, as MovePlayer works it out
+    LaneFloats leftX, rightX;               // paddle x positions (they never change)
+    LaneInts ball2Score, ball2DelayTicks, winScore;
+
+    LaneFloats leftY, rightY;
+    BallLanes balls[2];
+    LaneInts leftScore, rightScore, frameCounterBall2, gameWon, winner, tick;
+};
+
+// Create a structure for the keys held in each lane during one tick (as PaddleInput)
+struct LaneInputs
+{
+    LaneFloats leftUp, leftDown, rightUp, rightDown;
+};
+
+// Create a structure for what happened in each lane during one tick, as masks (TickEvents' hitMask and resetMask)
+struct LaneEvents
+{
+    LaneInts hits[2];       // ball 1 / ball 2 bounced off a player
+    LaneInts resets[2];     // ball 1 / ball 2 was scored
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Check whether any lane of a mask is set
+inline bool AnyLane(const LaneInts &mask)
+{
+    unsigned long long words[simLanes / 2];
+    memcpy(words, &mask, sizeof(words));
+    unsigned long long any = 0;
+    for (int i = 0; i < simLanes / 2; i++) any |= words[i];
+    return any != 0;
+}
+
+// Put a game into a lane, to be stepped with a tick length
+inline void LoadGameLane(GameLanes &lanes, int lane, const Game &game, float frameTime)
+{
+    lanes.active[lane] = -1;
+    lanes.frameTime[lane] = frameTime;
+    lanes.ballSpeed[lane] = game.rules.ballSpeed;
+    lanes.speedCap[lane] = game.rules.speedCap;
+    lanes.radius[lane] = game.ball1.radius;
+    lanes.speedUp[lane] = game.rules.speedUp;
+    lanes.halfWidth[lane] = game.player1Left.size.x / 2;
+    lanes.halfHeight[lane] = game.player1Left.size.y / 2;
+    lanes.paddleStep[lane] = game.player1Left.speed * frameTime;
+    lanes.leftX[lane] = game.player1Left.position.x;
+    lanes.rightX[lane] = game.player2Right.position.x;
+    lanes.ball2Score[lane] = game.rules.ball2Score;
+    lanes.ball2DelayTicks[lane] = (int)(game.rules.ball2Delay / (60.0f * frameTime) + 0.5f);
+    if (lanes.ball2DelayTicks[lane] < 1) lanes.ball2DelayTicks[lane] = 1;      // as UpdateGame, at least a tick
+    lanes.winScore[lane] = game.rules.winScore;
+
+    lanes.leftY[lane] = game.player1Left.position.y;
+    lanes.rightY[lane] = game.player2Right.position.y;
+    const Ball *balls[2] = { &game.ball1, &game.ball2 };
+    for (int b = 0; b < 2; b++)
+    {
+        lanes.balls[b].x[lane] = balls[b]->position.x;
+        lanes.balls[b].y[lane] = balls[b]->position.y;
+        lanes.balls[b].vx[lane] = balls[b]->velocity.x;
+        lanes.balls[b].vy[lane] = balls[b]->velocity.y;
+        lanes.balls[b].visible[lane] = balls[b]->visible ? -1 : 0;
+    }
+    lanes.leftScore[lane] = game.player1LeftScore;
+    lanes.rightScore[lane] = game.player2RightScore;
+    lanes.frameCounterBall2[lane] = game.frameCounterBall2;
+    lanes.gameWon[lane] = game.gameWon ? -1 : 0;
+    lanes.winner[lane] = game.winner;
+    lanes.tick[lane] = game.tick;
+}
+
+// Take the lane out of play, it is no longer stepped
+inline void ClearGameLane(GameLanes &lanes, int lane)
+{
+    lanes.active[lane] = 0;
+}
+
+// Get the state of a lane's match into a game of the same match (the rules, sizes and speeds are left as they are)
+inline void StoreGameLane(const GameLanes &lanes, int lane, Game &game)
+{
+    game.player1Left.position.y = lanes.leftY[lane];
+    game.player2Right.position.y = lanes.rightY[lane];
+    Ball *balls[2] = { &game.ball1, &game.ball2 };
+    for (int b = 0; b < 2; b++)
+    {
+        balls[b]->position.x = lanes.balls[b].x[lane];
+        balls[b]->position.y = lanes.balls[b].y[lane];
+        balls[b]->velocity.x = lanes.balls[b].vx[lane];
+        balls[b]->velocity.y = lanes.balls[b].vy[lane];
+        balls[b]->visible = lanes.balls[b].visible[lane] != 0;
+    }
+    game.player1LeftScore = lanes.leftScore[lane];
+    game.player2RightScore = lanes.rightScore[lane];
+    game.frameCounterBall2 = lanes.frameCounterBall2[lane];
+    game.gameWon = lanes.gameWon[lane] != 0;
+    game.winner = lanes.winner[lane];
+    game.tick = lanes.tick[lane];
+}
+
+// Keep the players inside the top and bottom of the screen (ClampPlayer)
+inline void ClampPlayerLanes(LaneFloats &y, const LaneFloats &halfHeight, const LaneInts &moving)
+{
+    LaneFloats bottom = (float)screenHeight - halfHeight, top = 0 + halfHeight;
+    LaneFloats clamped = (y > bottom) ? bottom : (y < top) ? top : y;
+    y = moving ? clamped : y;
+}
+
+// Move the balls and bounce them off the top and bottom of the screen (MoveBall)
+inline void MoveBallLanes(BallLanes &ball, const GameLanes &lanes, const LaneInts &moving)
+{
+    LaneFloats x = ball.x + ball.vx * lanes.frameTime;
+    LaneFloats y = ball.y + ball.vy * lanes.frameTime;
+
+    LaneFloats bottom = (float)screenHeight - lanes.radius, top = 0 + lanes.radius;
+    LaneInts below = y > bottom, above = (y < top) & ~below;
+    ball.x = moving ? x : ball.x;
+    ball.y = moving ? ((below) ? bottom : (above) ? top : y) : ball.y;
+    ball.vy = (moving & (below | above)) ? ball.vy * -1 : ball.vy;
+}
+
+// Move the players up or down by the keys held (MovePlayer)
+inline void MovePlayerLanes(LaneFloats &y, const LaneFloats &up, const LaneFloats &down, const LaneFloats &step, const LaneInts &moving)
+{
+    LaneFloats zero = {};
+    y = (moving & (down > zero)) ? y + step * down : y;
+    y = (moving & (up > zero)) ? y - step * up : y;
+}
+
+// Bounce the balls off a player where they collide (CheckCollisionBallPlayer and BounceBallOffPlayer), adding the lanes that bounced to hits
+inline void BounceBallLanes(BallLanes &ball, const LaneFloats &playerX, const LaneFloats &playerY, float direction, const GameLanes &lanes,
+                            const LaneInts &moving, LaneInts &hits)
+{
+    // The rectangle's centre, rounded towards zero as raylib does
+    LaneFloats centreX = __builtin_convertvector(__builtin_convertvector((playerX - lanes.halfWidth) + lanes.halfWidth, LaneInts), LaneFloats);
+    LaneFloats centreY = __builtin_convertvector(__builtin_convertvector((playerY - lanes.halfHeight) + lanes.halfHeight, LaneInts), LaneFloats);
+
+    LaneFloats dx = ball.x - centreX, dy = ball.y - centreY;
+    dx = (dx < 0) ? -dx : dx;
+    dy = (dy < 0) ? -dy : dy;
+
+    LaneFloats cornerX = dx - lanes.halfWidth, cornerY = dy - lanes.halfHeight;
+    LaneFloats cornerDistanceSq = cornerX * cornerX + cornerY * cornerY;
+    LaneInts collide = (dx <= lanes.halfWidth + lanes.radius) & (dy <= lanes.halfHeight + lanes.radius) &
+                       ((dx <= lanes.halfWidth) | (dy <= lanes.halfHeight) | (cornerDistanceSq <= lanes.radius * lanes.radius));
+
+    // Only a ball travelling towards the player is sent back
+    LaneInts bounce = moving & ball.visible & collide & (ball.vx * direction < 0);
+
+    LaneFloats vx = ball.vx * -1;
+    LaneInts speedUp = bounce & ((vx <= lanes.speedCap) | (ball.vy <= lanes.speedCap));
+    LaneFloats fasterVx = __builtin_convertvector(__builtin_convertvector(vx, LaneDoubles) * lanes.speedUp, LaneFloats);
+    LaneFloats angledVy = (direction * fasterVx) * ((ball.y - playerY) / lanes.halfHeight);
+
+    ball.vx = speedUp ? fasterVx : bounce ? vx : ball.vx;
+    ball.vy = speedUp ? angledVy : ball.vy;
+    hits |= bounce;
+}
+
+// Score the balls that have left the screen and put them back in the centre (ScoreBall), setting the lanes that scored in resets
+inline void ScoreBallLanes(BallLanes &ball, GameLanes &lanes, const LaneInts &moving, LaneInts &resets)
+{
+    LaneInts right = moving & ball.visible & (ball.x > (float)screenWidth);
+    LaneInts left = moving & ball.visible & (ball.x < 0) & ~right;
+    LaneInts scored = left | right;
+
+    lanes.leftScore -= right;           // Masks are -1, so subtracting one adds one
+    lanes.rightScore -= left;
+    ball.x = scored ? (float)(screenWidth / 2) : ball.x;
+    ball.y = scored ? (float)(screenHeight / 2) : ball.y;
+    ball.vx = scored ? lanes.ballSpeed : ball.vx;
+    ball.vy = scored ? lanes.ballSpeed : ball.vy;
+    resets = scored;
+}
+
+// Update every lane's match by one tick, UpdateGame with the lane's rules, tick length and keys
+inline void UpdateGameLanes(GameLanes &lanes, const LaneInputs &inputs, LaneEvents &events)
+{
+    LaneInts moving = lanes.active & ~lanes.gameWon;
+
+    ClampPlayerLanes(lanes.leftY, lanes.halfHeight, moving);
+    ClampPlayerLanes(lanes.rightY, lanes.halfHeight, moving);
+
+    // Ball 1 is visible until the match is won, ball 2 sits still in the centre until it comes into play
+    LaneInts none = {};
+    LaneInts ball2Moving = moving & lanes.balls[1].visible;
+    bool ball2InPlay = AnyLane(ball2Moving);
+    MoveBallLanes(lanes.balls[0], lanes, moving);
+    if (ball2InPlay) MoveBallLanes(lanes.balls[1], lanes, ball2Moving);
+
+    MovePlayerLanes(lanes.leftY, inputs.leftUp, inputs.leftDown, lanes.paddleStep, moving);
+    MovePlayerLanes(lanes.rightY, inputs.rightUp, inputs.rightDown, lanes.paddleStep, moving);
+
+    // A ball can only touch a paddle within half its width and a radius of the paddle's centre (rounded, so a pixel more)
+    LaneFloats reach = lanes.halfWidth + lanes.radius + 1;
+    LaneInts level = (lanes.balls[0].x <= lanes.leftX + reach) | (lanes.balls[0].x >= lanes.rightX - reach);
+    if (ball2InPlay) level |= ball2Moving & ((lanes.balls[1].x <= lanes.leftX + reach) | (lanes.balls[1].x >= lanes.rightX - reach));
+
+    // The same order as UpdateGame: both balls off the left player, then both off the right player
+    events.hits[0] = events.hits[1] = none;
+    if (AnyLane(moving & level))
+    {
+        BounceBallLanes(lanes.balls[0], lanes.leftX, lanes.leftY, 1, lanes, moving, events.hits[0]);
+        if (ball2InPlay) BounceBallLanes(lanes.balls[1], lanes.leftX, lanes.leftY, 1, lanes, moving, events.hits[1]);
+        BounceBallLanes(lanes.balls[0], lanes.rightX, lanes.rightY, -1, lanes, moving, events.hits[0]);
+        if (ball2InPlay) BounceBallLanes(lanes.balls[1], lanes.rightX, lanes.rightY, -1, lanes, moving, events.hits[1]);
+    }
+
+    LaneInts out = (lanes.balls[0].x > (float)screenWidth) | (lanes.balls[0].x < 0);
+    if (ball2InPlay) out |= ball2Moving & ((lanes.balls[1].x > (float)screenWidth) | (lanes.balls[1].x < 0));
+    events.resets[0] = events.resets[1] = none;
+    bool scored = AnyLane(moving & out);
+    if (scored)
+    {
+        ScoreBallLanes(lanes.balls[0], lanes, moving, events.resets[0]);
+        if (ball2InPlay) ScoreBallLanes(lanes.balls[1], lanes, moving, events.resets[1]);
+    }
+
+    LaneInts counting = moving & ((lanes.leftScore >= lanes.ball2Score) | (lanes.rightScore >= lanes.ball2Score));
+    lanes.frameCounterBall2 -= counting;
+    lanes.balls[1].visible |= counting & (lanes.frameCounterBall2 >= lanes.ball2DelayTicks);
+
+    // Scores only change when a ball is scored
+    if (scored)
+    {
+        LaneInts leftWon = lanes.leftScore >= lanes.winScore;
+        LaneInts won = moving & (leftWon | (lanes.rightScore >= lanes.winScore));
+        lanes.gameWon |= won;
+        lanes.winner = won ? (leftWon ? 1 : 2) : lanes.winner;
+        lanes.balls[0].visible &= ~won;
+        lanes.balls[1].visible &= ~won;
+    }
+
+    lanes.tick -= moving;
+}
+
+#endif // LANESIM_H
@@ -0,0 +1,196 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium latency mode: measures input-to-photon latency stage by stage
+*
+*   Every key transition is timestamped by the input sampler's GLFW key callback (see input.h).
+*   The transition is followed to the first frame that draws a game snapshot including it, then
+*   to the end of that frame's buffer swap, and each stage is added to a histogram:
+*
+*       input -> update     waiting for a simulation tick to read the input and publish its result
+*       update -> submit    waiting for a frame to draw that result and building the frame
+*       submit -> swap      flushing the draw batch and swapping buffers (blocks on vsync)
+*       input -> swap       the whole chain, everything up to the frame leaving for the display
+*
+*   Scan-out of the swapped frame on the display itself can't be seen from software, so the
+*   numbers are the latency up to the photons leaving the GPU. Run with each --pacing strategy
+*   to compare them.
+*
+******************************************************************************************************/
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdio.h>
+#include <string.h>
+#include "include/raylib.h"
+#include "input.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int latencyMaxTransitions = 256;      // Key transitions that can wait for a frame at once
+const int latencyBuckets = 200;             // Histogram buckets, the last one also counts anything slower
+const double latencyBucketSize = 0.00025;   // Width of a histogram bucket (0.25 ms)
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create an enum of the stages a key transition goes through before it is displayed
+enum LatencyStage { STAGE_INPUT_TO_UPDATE, STAGE_UPDATE_TO_SUBMIT, STAGE_SUBMIT_TO_SWAP, STAGE_INPUT_TO_SWAP, STAGE_COUNT };
+
+// Create a structure for a histogram of latencies
+struct LatencyHistogram
+{
+    int counts[latencyBuckets];     // number of samples in each 0.25 ms bucket
+    int samples;                    // total number of samples
+    double sum;                     // sum of all samples (seconds)
+    double max;                     // slowest sample (seconds)
+};
+
+// Create a structure for everything the latency mode keeps track of
+struct LatencyMonitor
+{
+    InputEvent waiting[latencyMaxTransitions];      // transitions not yet read by an update
+    int waitingCount;
+    InputEvent inFlight[latencyMaxTransitions];     // transitions read by this frame's update
+    int inFlightCount;
+    int dropped;                            // transitions lost because too many arrived in one frame
+    double updateTime;                      // time this frame's update read the input
+    double submitTime;                      // time this frame's drawing was submitted
+    double swapTime;                        // time the last buffer swap finished
+    int frames;                             // frames measured
+    LatencyHistogram stages[STAGE_COUNT];   // latency of each stage
+    LatencyHistogram frameTimes;            // time between buffer swaps
+};
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+//----------------------------------------------------------------------------------------------------
+static LatencyMonitor latencyMonitor;       // Single monitor, fed by the input sampler's callback
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Check if a key's transitions can change what is on screen (and so have a latency worth measuring)
+inline bool IsLatencyKey(int key)
+{
+    return key == KEY_W || key == KEY_S || key == KEY_UP || key == KEY_DOWN || key == KEY_ENTER;
+}
+
+// Add a sample to a latency histogram
+inline void AddLatencySample(LatencyHistogram &histogram, double seconds)
+{
+    int bucket = (int)(seconds / latencyBucketSize);
+    if (bucket < 0) bucket = 0;
+    if (bucket >= latencyBuckets) bucket = latencyBuckets - 1;
+
+    histogram.counts[bucket]++;
+    histogram.samples++;
+    histogram.sum += seconds;
+    if (seconds > histogram.max) histogram.max = seconds;
+}
+
+// Get a percentile of a latency histogram (upper edge of the bucket it falls in), in milliseconds
+inline double LatencyPercentile(const LatencyHistogram &histogram, double fraction)
+{
+    int target = (int)(fraction * histogram.samples + 0.5), seen = 0;
+    for (int b = 0; b < latencyBuckets; b++)
+    {
+        seen += histogram.counts[b];
+        if (seen >= target && seen > 0) return (b + 1) * latencyBucketSize * 1000;
+    }
+    return histogram.max * 1000;
+}
+
+// Keep a key transition until the frame that reads it (called from the input sampler's key callback)
+inline void LatencyRecordTransition(const InputEvent &event)
+{
+    LatencyMonitor &monitor = latencyMonitor;
+    if (!IsLatencyKey(event.key)) return;
+
+    if (monitor.waitingCount < latencyMaxTransitions) monitor.waiting[monitor.waitingCount++] = event;
+    else monitor.dropped++;
+}
+
+// Start measuring, must be called after InstallInputSampler
+inline void InstallLatencyMonitor()
+{
+    memset(&latencyMonitor, 0, sizeof(latencyMonitor));
+    latencyMonitor.swapTime = GetTime();
+    inputSampler.listener = LatencyRecordTransition;
+}
+
+// Mark the input up to a time as read by the update this frame draws, call once the frame has its game state
+// The simulation runs on its own thread, so the update is the snapshot being drawn: its simulation time and publish time
+inline void LatencyInputRead(double readUpTo, double updateTime)
+{
+    LatencyMonitor &monitor = latencyMonitor;
+    monitor.updateTime = updateTime;
+
+    // Transitions before the simulation time are read by this frame's update, the rest wait for a later one
+    int kept = 0;
+    for (int i = 0; i < monitor.waitingCount; i++)
+    {
+        if (monitor.waiting[i].time < readUpTo) monitor.inFlight[monitor.inFlightCount++] = monitor.waiting[i];
+        else monitor.waiting[kept++] = monitor.waiting[i];
+    }
+    monitor.waitingCount = kept;
+}
+
+// Mark the frame's drawing as submitted, call just before EndDrawing
+inline void LatencyDrawSubmitted()
+{
+    latencyMonitor.submitTime = GetTime();
+}
+
+// Mark the buffer swap as finished and add this frame's transitions to the histograms, call just after EndDrawing
+inline void LatencyFrameEnd()
+{
+    LatencyMonitor &monitor = latencyMonitor;
+    double now = GetTime();
+
+    for (int i = 0; i < monitor.inFlightCount; i++)
+    {
+        AddLatencySample(monitor.stages[STAGE_INPUT_TO_UPDATE], monitor.updateTime - monitor.inFlight[i].time);
+        AddLatencySample(monitor.stages[STAGE_UPDATE_TO_SUBMIT], monitor.submitTime - monitor.updateTime);
+        AddLatencySample(monitor.stages[STAGE_SUBMIT_TO_SWAP], now - monitor.submitTime);
+        AddLatencySample(monitor.stages[STAGE_INPUT_TO_SWAP], now - monitor.inFlight[i].time);
+    }
+    monitor.inFlightCount = 0;
+
+    if (monitor.frames > 0) AddLatencySample(monitor.frameTimes, now - monitor.swapTime);
+    monitor.swapTime = now;
+    monitor.frames++;
+}
+
+// Print the histograms' percentiles and write every bucket to a CSV file
+inline void WriteLatencyReport(const char *fileName)
+{
+    const LatencyMonitor &monitor = latencyMonitor;
+    const char *pacingNames[] = { "fps", "vsync", "late" };
+    const char *stageNames[STAGE_COUNT] = { "input_to_update", "update_to_submit", "submit_to_swap", "input_to_swap" };
+
+    printf("Latency (%s pacing, %d frames, %d transitions dropped)\n", pacingNames[inputSampler.pacing], monitor.frames, monitor.dropped);
+    printf("%-18s %8s %8s %8s %8s %8s %8s\n", "stage (ms)", "samples", "mean", "p50", "p95", "p99", "max");
+    for (int s = 0; s <= STAGE_COUNT; s++)
+    {
+        const LatencyHistogram &h = (s < STAGE_COUNT) ? monitor.stages[s] : monitor.frameTimes;
+        printf("%-18s %8d %8.2f %8.2f %8.2f %8.2f %8.2f\n", (s < STAGE_COUNT) ? stageNames[s] : "frame_time", h.samples,
+               h.samples ? 1000 * h.sum / h.samples : 0, LatencyPercentile(h, 0.5), LatencyPercentile(h, 0.95),
+               LatencyPercentile(h, 0.99), 1000 * h.max);
+    }
+
+    FILE *file = fopen(fileName, "w");
+    if (!file) return;
+
+    fprintf(file, "bucket_ms,%s,%s,%s,%s,frame_time\n", stageNames[0], stageNames[1], stageNames[2], stageNames[3]);
+    for (int b = 0; b < latencyBuckets; b++)
+    {
+        fprintf(file, "%.2f", b * latencyBucketSize * 1000);
+        for (int s = 0; s < STAGE_COUNT; s++) fprintf(file, ",%d", monitor.stages[s].counts[b]);
+        fprintf(file, ",%d\n", monitor.frameTimes.counts[b]);
+    }
+    fclose(file);
+}
+
+#endif // LATENCY_H
@@ -0,0 +1,556 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium load generator: plays thousands of clients against the match server over UDP
+*
+*   Each thread runs its share of the clients over a handful of non-blocking sockets (packets carry
+*   a client id, see protocol.h, so many clients can share a socket). Every client joins and sends
+*   its input every tick, and the thread decodes the states coming back (acknowledging each, so the
+*   server can delta encode the next against it). Clients play one of a few ways, given by --play
+*   and shared out in turn:
+*
+*       random      holds random keys that change a couple of times a second
+*       scripted    sweeps its paddle up and down the screen
+*       <bot>       any controllers.h bot, e.g. predict or "search:reaction=6", playing from the states received
+*
+*   At the end it prints how many matches were served, the tick latency (from sending an input to
+*   receiving the first state the server applied it in), the jitter of the states' arrival, how
+*   many states were lost (gaps in the server ticks a client saw) and, given the server's process
+*   id, how much of its CPU each match took.
+*
+*   Usage: loadgen [options]
+*       --server HOST:PORT  server to load (default 127.0.0.1:7777)
+*       --matches N         matches to play, two clients each (default 1000)
+*       --threads N         client threads (default 1)
+*       --sockets N         sockets per thread (default 16)
+*       --seconds N         time to play for once every client has joined (default 10)
+*       --tick-rate N       inputs sent per second by each client, the server's tick rate (default 60)
+*       --play KIND         how clients play, repeat to mix several (default random)
+*       --server-pid N      process id of the server, to measure its CPU time
+*
+*   Linux only. Build: g++ loadgen.cpp -o loadgen -O2 -pthread
+*
+******************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "controllers.h"
+#include "protocol.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int batchSize = 64;                   // Packets received per system call
+const double joinRetryTime = 0.5;           // Seconds before a JOIN without an answer is sent again
+const int joinsPerTick = 500;               // JOINs a thread sends per tick, so joining doesn't flood the server
+const double joinTimeout = 30;              // Seconds to wait for every client to join
+const int sentTimeSlots = 64;               // Inputs a client remembers the send time of, for the tick latency
+const int scriptedSweepTicks = 45;          // Ticks a scripted client holds each direction for
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create an enum of the ways a client can play
+enum PlayKind { PLAY_RANDOM, PLAY_SCRIPTED, PLAY_BOT };
+
+// Create a structure for one way of playing given with --play
+struct PlayStyle
+{
+    PlayKind kind;
+    Controller controller;          // the bot, for PLAY_BOT
+};
+
+// Create a structure for the command line options
+struct Options
+{
+    sockaddr_in server;
+    int matches;
+    int threads;
+    int sockets;
+    double seconds;
+    int tickRate;
+    std::vector<PlayStyle> styles;
+    int serverPid;                  // 0 if not given
+};
+
+// Create a structure for one simulated client
+struct VirtualClient
+{
+    int socket;                     // socket the client sends from
+    unsigned int nonce;             // nonce of its JOIN (thread in the high bits, index in the low bits)
+    unsigned int id;                // id handed out by the server, 0 until joined
+    int side;                       // side played, from JOINED
+    int style;                      // index of the way it plays in options.styles
+    double joinSent;                // time the last JOIN was sent
+    unsigned int sequence;          // sequence of the last input sent
+    double sentTimes[sentTimeSlots];        // send time of the last few inputs, by sequence
+    unsigned int ackedSequence;     // newest input the server has acknowledged
+    bool up, down;                  // keys held (random and scripted clients)
+    int ticksUntilChange;           // ticks until the keys change
+    ControllerState bot;            // state of the bot (bot clients)
+    long long states;               // states received
+    long long missed;               // server ticks skipped between states received
+    unsigned int lastTick;          // server tick of the newest state received
+    double lastArrival;             // time the newest state arrived
+    double jitter;                  // smoothed variation of the time between states, as RFC 3550 works it out
+    QuantisedState latest;          // newest state received, what a bot plays from
+    SnapshotHistory history;        // states received, to decode the next ones against
+};
+
+// Create a structure for what a thread reports at the end
+struct ThreadResult
+{
+    int joined;
+    long long states;
+    long long missed;
+    long long undecodable;          // states whose baseline the client didn't have
+    long long stateBytes;           // bytes of encoded snapshots received
+    long long inputsSent;
+    double playSeconds;
+    std::vector<float> latencies;   // tick latency of every acknowledged input, in milliseconds
+    std::vector<float> jitters;     // jitter of every client at the end, in milliseconds
+    double serverCpuSeconds;        // CPU time the server used while the thread played (thread 0 only)
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Get a monotonic time in seconds
+double NowSeconds()
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+// Get the CPU time a process has used, in seconds, or -1 if it can't be read
+double ProcessCpuSeconds(int pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE *file = fopen(path, "r");
+    if (!file) return -1;
+
+    // The command name is in brackets and can hold spaces, the fields counted from its closing bracket
+    char line[1024];
+    size_t length = fread(line, 1, sizeof(line) - 1, file);
+    fclose(file);
+    line[length] = 0;
+    const char *fields = strrchr(line, ')');
+    unsigned long long user = 0, system = 0;
+    if (!fields || sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &user, &system) != 2) return -1;
+    return (double)(user + system) / sysconf(_SC_CLK_TCK);
+}
+
+// Get the value a fraction of the way through sorted values
+float Percentile(const std::vector<float> &sorted, double fraction)
+{
+    if (sorted.empty()) return 0;
+    size_t index = (size_t)(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+void SendPacket(const Options &options, int socket, const unsigned char *data, int size)
+{
+    sendto(socket, data, size, MSG_DONTWAIT, (const sockaddr *)&options.server, sizeof(options.server));
+}
+
+// Receive everything waiting on a socket and hand it to the clients it is for
+void ReceivePackets(const Options &options, int socket, std::vector<VirtualClient> &clients, std::unordered_map<unsigned int, int> &byId,
+                    int &joined, int threadIndex, ThreadResult &result)
+{
+    double now = NowSeconds();
+    unsigned char buffers[batchSize][maxPacketSize];
+    iovec vectors[batchSize];
+    mmsghdr headers[batchSize];
+
+    for (;;)
+    {
+        for (int i = 0; i < batchSize; i++)
+        {
+            vectors[i].iov_base = buffers[i];
+            vectors[i].iov_len = maxPacketSize;
+            memset(&headers[i], 0, sizeof(mmsghdr));
+            headers[i].msg_hdr.msg_iov = &vectors[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+        int received = recvmmsg(socket, headers, batchSize, MSG_DONTWAIT, 0);
+        if (received <= 0) break;
+
+        for (int i = 0; i < received; i++)
+        {
+            PacketReader reader;
+            int type = BeginReading(reader, buffers[i], headers[i].msg_len);
+
+            if (type == PACKET_JOINED)
+            {
+                unsigned int nonce = ReadU32(reader);
+                unsigned int id = ReadU32(reader);
+                int side = (int)ReadU8(reader);
+                unsigned int index = nonce & 0xFFFFF;
+                if (reader.overflow || (int)(nonce >> 20) != threadIndex || index >= clients.size()) continue;
+                if (clients[index].id == 0)
+                {
+                    clients[index].id = id;
+                    clients[index].side = side;
+                    byId[id] = (int)index;
+                    joined++;
+                }
+            }
+            else if (type == PACKET_STATE)
+            {
+                StateMessage message;
+                if (!ReadStatePacket(reader, message)) continue;
+                std::unordered_map<unsigned int, int>::iterator found = byId.find(message.clientId);
+                if (found == byId.end()) continue;
+
+                VirtualClient &client = clients[found->second];
+                QuantisedState state;
+                if (!DecodeStateSnapshot(message, client.history, state))
+                {
+                    result.undecodable++;
+                    continue;
+                }
+                StoreSnapshot(client.history, message.tick, state);
+                result.stateBytes += message.snapshotSize;
+
+                // The first state acknowledging an input ends its tick latency
+                if ((int)(message.ack - client.ackedSequence) > 0)
+                {
+                    if (client.sequence - message.ack < (unsigned int)sentTimeSlots)
+                    {
+                        result.latencies.push_back((float)((now - client.sentTimes[message.ack % sentTimeSlots]) * 1000));
+                    }
+                    client.ackedSequence = message.ack;
+                }
+
+                bool newer = client.states == 0 || (int)(message.tick - client.lastTick) > 0;
+                if (client.states > 0 && newer)
+                {
+                    client.missed += message.tick - client.lastTick - 1;
+
+                    // How far the gap since the last state is from the ticks between them
+                    double difference = (now - client.lastArrival) - (message.tick - client.lastTick) / (double)options.tickRate;
+                    client.jitter += (fabs(difference) - client.jitter) / 16;
+                }
+                if (newer)
+                {
+                    client.lastTick = message.tick;
+                    client.lastArrival = now;
+                    client.latest = state;
+                }
+                client.states++;
+            }
+        }
+        if (received < batchSize) break;
+    }
+}
+
+// Body of a client thread
+void RunClients(const Options &options, int threadIndex, int firstClient, int clientCount, ThreadResult &result)
+{
+    std::vector<int> sockets;
+    int epoll = epoll_create1(0);
+    for (int s = 0; s < options.sockets; s++)
+    {
+        int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        int size = 4 << 20;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+        sockets.push_back(fd);
+    }
+
+    int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    long long period = (long long)(1e9 / options.tickRate);
+    itimerspec interval = { { period / 1000000000, period % 1000000000 }, { period / 1000000000, period % 1000000000 } };
+    timerfd_settime(timer, 0, &interval, 0);
+    epoll_event timerEvent;
+    timerEvent.events = EPOLLIN;
+    timerEvent.data.fd = timer;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, timer, &timerEvent);
+
+    unsigned int random = 0x2545F491u * (threadIndex + 1);
+    std::vector<VirtualClient> clients(clientCount);
+    for (int c = 0; c < clientCount; c++)
+    {
+        VirtualClient &client = clients[c];
+        memset(&client, 0, sizeof(client));
+        ClearSnapshotHistory(client.history);
+        client.socket = sockets[c % sockets.size()];
+        client.nonce = ((unsigned int)threadIndex << 20) | (unsigned int)c;
+        client.style = (firstClient + c) % (int)options.styles.size();
+        client.joinSent = -joinRetryTime;
+        InitialiseControllerState(client.bot, MixSeed(threadIndex, c, 0, 0));
+    }
+    std::unordered_map<unsigned int, int> byId;
+
+    int joined = 0;
+    double start = NowSeconds(), playStart = 0, playEnd = 0, serverCpuStart = 0;
+    unsigned char packet[maxPacketSize];
+    Game view;                      // a bot's view of its match, rebuilt from the newest state each tick
+    InitialiseGame(view);
+    std::vector<epoll_event> events(sockets.size() + 1);
+
+    while (true)
+    {
+        double now = NowSeconds();
+        if (playStart == 0 && (joined == clientCount || now - start > joinTimeout))
+        {
+            // Everyone is in - start counting from here
+            playStart = now;
+            playEnd = now + options.seconds;
+            for (int c = 0; c < clientCount; c++) clients[c].states = clients[c].missed = 0;
+            result.inputsSent = result.undecodable = result.stateBytes = 0;
+            result.latencies.clear();
+            if (threadIndex == 0 && options.serverPid) serverCpuStart = ProcessCpuSeconds(options.serverPid);
+        }
+        if (playStart > 0 && now >= playEnd) break;
+
+        int count = epoll_wait(epoll, events.data(), (int)events.size(), 100);
+        for (int e = 0; e < count; e++)
+        {
+            int fd = events[e].data.fd;
+            if (fd != timer)
+            {
+                ReceivePackets(options, fd, clients, byId, joined, threadIndex, result);
+                continue;
+            }
+
+            unsigned long long expirations;
+            if (read(timer, &expirations, sizeof(expirations)) != sizeof(expirations)) continue;
+
+            int joinsSent = 0;
+            for (int c = 0; c < clientCount; c++)
+            {
+                VirtualClient &client = clients[c];
+                if (client.id == 0)
+                {
+                    // Not joined yet - (re)send the JOIN, a few hundred per tick at most
+                    if (joinsSent < joinsPerTick && now - client.joinSent >= joinRetryTime)
+                    {
+                        PacketWriter writer = BeginPacket(packet, sizeof(packet), PACKET_JOIN);
+                        WriteU32(writer, client.nonce);
+                        SendPacket(options, client.socket, packet, writer.size);
+                        client.joinSent = now;
+                        joinsSent++;
+                    }
+                    continue;
+                }
+
+                PaddleInput input = { 0, 0 };
+                const PlayStyle &style = options.styles[client.style];
+                if (style.kind == PLAY_RANDOM)
+                {
+                    // Hold random keys for a random number of ticks
+                    if (--client.ticksUntilChange <= 0)
+                    {
+                        unsigned int r = NextRandom(random);
+                        client.up = (r & 3) == 1;
+                        client.down = (r & 3) == 2;
+                        client.ticksUntilChange = 10 + (int)((r >> 8) % 40);
+                    }
+                    input.up = client.up;
+                    input.down = client.down;
+                }
+                else if (style.kind == PLAY_SCRIPTED)
+                {
+                    // Sweep the paddle up and down, the same every time
+                    if (--client.ticksUntilChange <= 0)
+                    {
+                        client.up = !client.up;
+                        client.ticksUntilChange = scriptedSweepTicks;
+                    }
+                    input.up = client.up;
+                    input.down = !client.up;
+                }
+                else if (client.lastTick != 0)
+                {
+                    // Play the bot from the newest state received, as a remote player sees the match
+                    view.tick = 0;
+                    DequantiseState(client.latest, view);
+                    input = ControlPaddle(style.controller, client.bot, view, client.side);
+                }
+
+                unsigned int sequence = ++client.sequence;
+                client.sentTimes[sequence % sentTimeSlots] = now;
+
+                PacketWriter writer = BeginPacket(packet, sizeof(packet), PACKET_INPUT);
+                WriteU32(writer, client.id);
+                WriteU32(writer, sequence);
+                WriteU32(writer, client.lastTick);      // Newest state received, the baseline for the next ones
+                WriteU8(writer, QuantiseHeld(input.up));
+                WriteU8(writer, QuantiseHeld(input.down));
+                SendPacket(options, client.socket, packet, writer.size);
+                result.inputsSent++;
+            }
+        }
+    }
+
+    // Leave, so the server frees the places straight away
+    for (int c = 0; c < clientCount; c++)
+    {
+        if (clients[c].id == 0) continue;
+        PacketWriter writer = BeginPacket(packet, sizeof(packet), PACKET_LEAVE);
+        WriteU32(writer, clients[c].id);
+        SendPacket(options, clients[c].socket, packet, writer.size);
+    }
+
+    result.joined = joined;
+    result.playSeconds = NowSeconds() - playStart;
+    if (threadIndex == 0 && options.serverPid) result.serverCpuSeconds = ProcessCpuSeconds(options.serverPid) - serverCpuStart;
+    for (int c = 0; c < clientCount; c++)
+    {
+        result.states += clients[c].states;
+        result.missed += clients[c].missed;
+        if (clients[c].states > 1) result.jitters.push_back((float)(clients[c].jitter * 1000));
+    }
+
+    for (size_t s = 0; s < sockets.size(); s++) close(sockets[s]);
+    close(timer);
+    close(epoll);
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    memset(&options.server, 0, sizeof(options.server));
+    options.server.sin_family = AF_INET;
+    options.server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    options.server.sin_port = htons(defaultServerPort);
+    options.matches = 1000;
+    options.threads = 1;
+    options.sockets = 16;
+    options.seconds = 10;
+    options.tickRate = 60;
+    options.serverPid = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--server") == 0 && i + 1 < argc)
+        {
+            char host[256];
+            int port = defaultServerPort;
+            if (sscanf(argv[++i], "%255[^:]:%d", host, &port) < 1 || inet_pton(AF_INET, host, &options.server.sin_addr) != 1)
+            {
+                fprintf(stderr, "Invalid server address %s\n", argv[i]);
+                return 1;
+            }
+            options.server.sin_port = htons(port);
+        }
+        else if (strcmp(argv[i], "--matches") == 0 && i + 1 < argc) options.matches = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) options.threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--sockets") == 0 && i + 1 < argc) options.sockets = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) options.seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc) options.tickRate = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--server-pid") == 0 && i + 1 < argc) options.serverPid = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--play") == 0 && i + 1 < argc)
+        {
+            PlayStyle style;
+            memset(&style, 0, sizeof(style));
+            const char *kind = argv[++i];
+            if (strcmp(kind, "random") == 0) style.kind = PLAY_RANDOM;
+            else if (strcmp(kind, "scripted") == 0) style.kind = PLAY_SCRIPTED;
+            else if (ParseController(style.controller, kind)) style.kind = PLAY_BOT;
+            else
+            {
+                fprintf(stderr, "Unknown way to play %s\n", kind);
+                return 1;
+            }
+            options.styles.push_back(style);
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (options.matches < 1 || options.threads < 1 || options.sockets < 1 || options.tickRate < 1)
+    {
+        fprintf(stderr, "Invalid options\n");
+        return 1;
+    }
+    if (options.styles.empty())
+    {
+        PlayStyle style;
+        memset(&style, 0, sizeof(style));
+        style.kind = PLAY_RANDOM;
+        options.styles.push_back(style);
+    }
+
+    // Share the clients out between the threads
+    int clients = options.matches * 2;
+    std::vector<ThreadResult> results(options.threads);
+    std::vector<std::thread> threads;
+    int first = 0;
+    for (int t = 0; t < options.threads; t++)
+    {
+        int count = clients / options.threads + (t < clients % options.threads ? 1 : 0);
+        threads.push_back(std::thread(RunClients, std::cref(options), t, first, count, std::ref(results[t])));
+        first += count;
+    }
+    for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+
+    ThreadResult total = ThreadResult();
+    for (int t = 0; t < options.threads; t++)
+    {
+        total.latencies.insert(total.latencies.end(), results[t].latencies.begin(), results[t].latencies.end());
+        total.jitters.insert(total.jitters.end(), results[t].jitters.begin(), results[t].jitters.end());
+        total.serverCpuSeconds += results[t].serverCpuSeconds;
+        total.joined += results[t].joined;
+        total.states += results[t].states;
+        total.missed += results[t].missed;
+        total.undecodable += results[t].undecodable;
+        total.stateBytes += results[t].stateBytes;
+        total.inputsSent += results[t].inputsSent;
+        if (results[t].playSeconds > total.playSeconds) total.playSeconds = results[t].playSeconds;
+    }
+
+    double seconds = (total.playSeconds > 0) ? total.playSeconds : 1;
+    double statesPerClient = total.states / seconds / (total.joined ? total.joined : 1);
+    printf("clients joined     %d of %d\n", total.joined, clients);
+    printf("inputs sent/s      %.0f\n", total.inputsSent / seconds);
+    printf("states received/s  %.0f (%.1f per client, server ticks at %d)\n", total.states / seconds, statesPerClient, options.tickRate);
+    double matchesServed = total.states / seconds / 2 / options.tickRate;
+    printf("matches served     %.0f\n", matchesServed);
+    printf("snapshot bytes     %.2f per state\n", total.states ? (double)total.stateBytes / total.states : 0.0);
+    printf("states lost        %.3f%%\n", 100.0 * total.missed / ((total.states + total.missed) ? total.states + total.missed : 1));
+    printf("states undecodable %lld\n", total.undecodable);
+
+    std::sort(total.latencies.begin(), total.latencies.end());
+    std::sort(total.jitters.begin(), total.jitters.end());
+    printf("tick latency       p50 %.2f ms  p99 %.2f ms  max %.2f ms (%zu inputs)\n", Percentile(total.latencies, 0.5),
+           Percentile(total.latencies, 0.99), total.latencies.empty() ? 0.0f : total.latencies.back(), total.latencies.size());
+    printf("state jitter       p50 %.2f ms  p99 %.2f ms  max %.2f ms (per client)\n", Percentile(total.jitters, 0.5),
+           Percentile(total.jitters, 0.99), total.jitters.empty() ? 0.0f : total.jitters.back());
+
+    if (options.serverPid && total.serverCpuSeconds >= 0 && matchesServed > 0)
+    {
+        // /proc counts CPU time in clock ticks (10 ms), so a short or light run can come out as none at all
+        double cores = total.serverCpuSeconds / seconds;
+        if (cores > 0)
+        {
+            printf("server CPU         %.1f%% of a core, %.2f us per match tick, %.0f matches per core\n", 100 * cores,
+                   cores / (matchesServed * options.tickRate) * 1e6, matchesServed / cores);
+        }
+        else
+        {
+            printf("server CPU         too little CPU to measure (under one %.0f ms clock tick), run longer or with more matches\n",
+                   1000.0 / sysconf(_SC_CLK_TCK));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,257 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium mixer: the sound effects mixed by the game itself, panned to where they happen
+*
+*   Sounds are loaded as mono floats and played as voices with a gain for each side of a stereo
+*   stream, so a hit is panned by the ball's x across the court and every voice has its own volume.
+*   The main thread starts a voice by pushing it onto a lock-free single-producer single-consumer
+*   queue (as input.h does for keys); raylib's audio thread calls MixerCallback for every buffer of
+*   the stream, which starts the queued voices and mixes the playing ones into it.
+*
+*   A voice is mixed into a left and a right accumulator with vector multiply-adds, several samples
+*   at a time (GCC/Clang vector extensions, so AVX, SSE2 or NEON, as lanesim.h), then the two are
+*   clamped and interleaved once for the whole buffer. Voices of the same sound started for the same
+*   buffer start on the same sample, so they are merged into one voice with their gains added: a
+*   frame with hundreds of hits mixes one hit voice, not hundreds. At most mixerVoices play at once
+*   (starting another cuts the one furthest through its sound), so mixing never costs more than that.
+*
+******************************************************************************************************/
+
+#ifndef MIXER_H
+#define MIXER_H
+
+#include <atomic>
+#include <string.h>
+#include <vector>
+#include "include/raylib.h"
+#include "pongsim.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int mixerSampleRate = 44100;
+const int mixerVoices = 32;                 // Voices playing at once
+const int mixerQueueSize = 1024;            // Voices that can be started between two buffers (must be a power of two)
+const int mixerBlockFrames = 1024;          // Frames mixed at a time (a multiple of mixerLanes)
+
+// Samples of a voice mixed at once, one register
+#if defined(__AVX__)
+const int mixerLanes = 8;
+#else
+const int mixerLanes = 4;
+#endif
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+typedef float MixerFloats __attribute__((vector_size(mixerLanes * sizeof(float))));
+
+// Create a structure for a loaded sound, mono at mixerSampleRate
+struct MixerSound
+{
+    std::vector<float> samples;     // followed by mixerLanes zeros, so a voice can be mixed a whole register at a time
+    int frames;
+};
+
+// Create a structure for a voice to be started
+struct MixerStart
+{
+    int sound;
+    float gainLeft, gainRight;
+};
+
+// Create a structure for the voices playing, field by field
+struct MixerVoices
+{
+    int sound[mixerVoices];
+    int position[mixerVoices];      // frames of its sound mixed so far
+    float gainLeft[mixerVoices], gainRight[mixerVoices];
+    int count;
+};
+
+// Create a structure for the mixer: the sounds, the queue of voices to start, and what the audio thread keeps
+struct Mixer
+{
+    std::vector<MixerSound> sounds;             // all loaded before the stream starts playing
+    MixerStart starts[mixerQueueSize];
+    std::atomic<unsigned int> head;             // next start to write, only changed by the main thread
+    std::atomic<unsigned int> tail;             // next start to read, only changed by the audio thread
+    int dropped;                                // voices not started because the queue was full
+
+    MixerVoices voices;                         // only touched by the audio thread
+    alignas(32) float left[mixerBlockFrames];   // accumulators of the block being mixed
+    alignas(32) float right[mixerBlockFrames];
+    AudioStream stream;
+};
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+//----------------------------------------------------------------------------------------------------
+static Mixer mixer;                         // Single mixer, raylib's audio callback has no user pointer to find it
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Load a sound from a file (any format LoadWave reads), returns its number or -1 if it couldn't be loaded
+inline int LoadMixerSound(Mixer &m, const char *fileName)
+{
+    Wave wave = LoadWave(fileName);
+    if (wave.data == 0) return -1;
+    WaveFormat(&wave, mixerSampleRate, 32, 1);
+
+    MixerSound sound;
+    sound.frames = (int)wave.frameCount;
+    sound.samples.assign(sound.frames + mixerLanes, 0.0f);
+    memcpy(sound.samples.data(), wave.data, sound.frames * sizeof(float));
+    UnloadWave(wave);
+
+    m.sounds.push_back(sound);
+    return (int)m.sounds.size() - 1;
+}
+
+// Start a sound on the next buffer, panned to an x position on the court (0 is hard left, screenWidth hard right)
+inline void PlayMixerSound(Mixer &m, int sound, float x, float gain)
+{
+    if (sound < 0) return;
+
+    // The centre plays at the gain on both sides (as an unpanned sound), each side fades out towards the other
+    float pan = x / screenWidth;
+    pan = (pan < 0) ? 0 : (pan > 1) ? 1 : pan;
+    float gainLeft = gain * ((pan < 0.5f) ? 1 : 2 * (1 - pan));
+    float gainRight = gain * ((pan > 0.5f) ? 1 : 2 * pan);
+
+    unsigned int head = m.head.load(std::memory_order_relaxed);
+    if (head - m.tail.load(std::memory_order_acquire) == (unsigned int)mixerQueueSize)
+    {
+        m.dropped++;
+        return;
+    }
+    m.starts[head & (mixerQueueSize - 1)] = MixerStart{ sound, gainLeft, gainRight };
+    m.head.store(head + 1, std::memory_order_release);
+}
+
+// Start the voices queued since the last buffer (audio thread)
+inline void StartMixerVoices(Mixer &m)
+{
+    MixerVoices &v = m.voices;
+    unsigned int head = m.head.load(std::memory_order_acquire);
+    unsigned int tail = m.tail.load(std::memory_order_relaxed);
+    for (; tail != head; tail++)
+    {
+        const MixerStart &start = m.starts[tail & (mixerQueueSize - 1)];
+
+        // A voice of the same sound that hasn't been mixed yet would play in step with this one: play it louder instead
+        int voice = -1;
+        for (int i = 0; i < v.count; i++)
+        {
+            if (v.sound[i] == start.sound && v.position[i] == 0) voice = i;
+        }
+        if (voice >= 0)
+        {
+            v.gainLeft[voice] += start.gainLeft;
+            v.gainRight[voice] += start.gainRight;
+            continue;
+        }
+
+        if (v.count < mixerVoices)
+        {
+            voice = v.count++;
+        }
+        else
+        {
+            // Every voice is playing: cut the one furthest through its sound
+            voice = 0;
+            for (int i = 1; i < v.count; i++)
+            {
+                if (v.position[i] > v.position[voice]) voice = i;
+            }
+        }
+        v.sound[voice] = start.sound;
+        v.position[voice] = 0;
+        v.gainLeft[voice] = start.gainLeft;
+        v.gainRight[voice] = start.gainRight;
+    }
+    m.tail.store(tail, std::memory_order_release);
+}
+
+// Mix the playing voices into interleaved stereo floats, at most mixerBlockFrames frames (audio thread)
+inline void MixVoices(Mixer &m, float *output, int frames)
+{
+    MixerVoices &v = m.voices;
+    int rounded = (frames + mixerLanes - 1) / mixerLanes * mixerLanes;
+    memset(m.left, 0, rounded * sizeof(float));
+    memset(m.right, 0, rounded * sizeof(float));
+
+    MixerFloats *left = (MixerFloats *)m.left;
+    MixerFloats *right = (MixerFloats *)m.right;
+    for (int i = 0; i < v.count; i++)
+    {
+        const MixerSound &sound = m.sounds[v.sound[i]];
+        int count = sound.frames - v.position[i];
+        if (count > frames) count = frames;
+
+        // Whole registers, past the end of the sound into its zeros
+        const float *samples = sound.samples.data() + v.position[i];
+        MixerFloats gainLeft = MixerFloats{} + v.gainLeft[i];
+        MixerFloats gainRight = MixerFloats{} + v.gainRight[i];
+        for (int j = 0; j < (count + mixerLanes - 1) / mixerLanes; j++)
+        {
+            MixerFloats s;
+            memcpy(&s, samples + j * mixerLanes, sizeof(s));
+            left[j] += s * gainLeft;
+            right[j] += s * gainRight;
+        }
+        v.position[i] += frames;
+    }
+
+    // Voices that have finished make way for the last one
+    for (int i = 0; i < v.count;)
+    {
+        if (v.position[i] < m.sounds[v.sound[i]].frames)
+        {
+            i++;
+            continue;
+        }
+        v.count--;
+        v.sound[i] = v.sound[v.count];
+        v.position[i] = v.position[v.count];
+        v.gainLeft[i] = v.gainLeft[v.count];
+        v.gainRight[i] = v.gainRight[v.count];
+    }
+
+    for (int i = 0; i < frames; i++)
+    {
+        float l = m.left[i], r = m.right[i];
+        output[2 * i] = (l > 1) ? 1 : (l < -1) ? -1 : l;
+        output[2 * i + 1] = (r > 1) ? 1 : (r < -1) ? -1 : r;
+    }
+}
+
+// Fill a buffer of the stream (raylib calls this on its audio thread)
+inline void MixerCallback(void *buffer, unsigned int frames)
+{
+    StartMixerVoices(mixer);
+    float *output = (float *)buffer;
+    while (frames > 0)
+    {
+        int block = (frames < (unsigned int)mixerBlockFrames) ? (int)frames : mixerBlockFrames;
+        MixVoices(mixer, output, block);
+        output += 2 * block;
+        frames -= block;
+    }
+}
+
+// Start playing the mixer's stream, after InitAudioDevice and loading its sounds
+inline void StartMixer(Mixer &m)
+{
+    m.stream = LoadAudioStream(mixerSampleRate, 32, 2);
+    SetAudioStreamCallback(m.stream, MixerCallback);
+    PlayAudioStream(m.stream);
+}
+
+inline void StopMixer(Mixer &m)
+{
+    UnloadAudioStream(m.stream);
+}
+
+#endif // MIXER_H
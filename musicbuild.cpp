@@ -0,0 +1,94 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium music builder: transcodes the game music to PCM, so playing it costs no decoding
+*
+*   The music ships as an MP3, which the game would decode a buffer at a time all the while it
+*   plays. This decodes it once, at build time, with raylib's own MP3 decoder and writes it as a
+*   16 bit PCM WAV alongside it; raylib streams a WAV by reading its samples straight from the file,
+*   so playing it is a copy. The game plays the WAV when it's there and the MP3 otherwise, so a
+*   build without the WAV still has music.
+*
+*   Both files are then decoded in full a few times and the CPU time a second of audio took to decode
+*   is printed for each (the fastest run, with the file already read once so it's cached), which is
+*   the cost UpdateMusicStream has every second of play with either.
+*
+*   Usage: musicbuild [MP3] [WAV]      transcode MP3 (default resources/8-Bit-Retro-Funk-David-Renda.mp3)
+*                                      to WAV (default the MP3's name with .wav), run when the music changes
+*
+*   Build: g++ musicbuild.cpp -o musicbuild.exe -O2 -Iinclude/ -Llib/ -lraylib -lopengl32 -lgdi32 -lwinmm
+*
+******************************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include "include/raylib.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const char *const musicDefaultFile = "resources/8-Bit-Retro-Funk-David-Renda.mp3";
+const int musicDecodeRuns = 3;                  // Times each file is decoded to measure it, the fastest counts
+const int musicSampleSize = 16;                 // Bits a sample of the WAV written
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Decode a file in full a few times, returns the fastest decode's CPU time a second of audio (seconds), or a negative if it couldn't be read
+double MeasureDecode(const char *fileName)
+{
+    double fastest = -1, seconds = 0;
+    for (int run = 0; run < musicDecodeRuns; run++)
+    {
+        clock_t start = clock();
+        Wave wave = LoadWave(fileName);
+        clock_t end = clock();
+        if (wave.data == 0 || wave.sampleRate == 0) return -1;
+
+        seconds = (double)wave.frameCount / wave.sampleRate;
+        double time = (double)(end - start) / CLOCKS_PER_SEC;
+        if (fastest < 0 || time < fastest) fastest = time;
+        UnloadWave(wave);
+    }
+    return fastest / seconds;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *source = (argc >= 2) ? argv[1] : musicDefaultFile;
+    const char *extension = GetFileExtension(source);
+    std::string destination = (argc >= 3) ? argv[2] : std::string(source, strlen(source) - (extension ? strlen(extension) : 0)) + ".wav";
+    SetTraceLogLevel(LOG_WARNING);
+
+    Wave wave = LoadWave(source);
+    if (wave.data == 0 || wave.sampleRate == 0)
+    {
+        fprintf(stderr, "Couldn't decode %s\n", source);
+        return 1;
+    }
+    WaveFormat(&wave, wave.sampleRate, musicSampleSize, wave.channels);
+    bool written = ExportWave(wave, destination.c_str());
+    printf("%s: %.1f s of %d Hz, %d channel audio\n", source, (double)wave.frameCount / wave.sampleRate, wave.sampleRate, wave.channels);
+    UnloadWave(wave);
+    if (!written)
+    {
+        fprintf(stderr, "Couldn't write %s\n", destination.c_str());
+        return 1;
+    }
+    printf("Wrote %s (%d bit PCM, %d bytes)\n", destination.c_str(), musicSampleSize, GetFileLength(destination.c_str()));
+
+    // CPU time to decode a second of audio, before (the MP3) and after (the WAV)
+    double before = MeasureDecode(source);
+    double after = MeasureDecode(destination.c_str());
+    if (before < 0 || after < 0)
+    {
+        fprintf(stderr, "Couldn't decode the files again to measure them\n");
+        return 1;
+    }
+    printf("Decode CPU a second of audio: %8.3f ms %s\n", 1000 * before, GetFileName(source));
+    printf("                              %8.3f ms %s", 1000 * after, GetFileName(destination.c_str()));
+    if (after > 0) printf(" (%.0fx less)", before / after);
+    printf("\n");
+    return 0;
+}
@@ -0,0 +1,262 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium particles: sparks where a ball hits a paddle and bursts where one is scored
+*
+*   Particles live in a fixed pool, field by field, and every particle lives for particleLife
+*   seconds, so the live particles are always a run of the pool in the order they were spawned:
+*   spawning writes after the newest, and particles die by moving the start of the run past the
+*   oldest. Nothing is allocated or moved once the pool is set up, and a full pool spawns over the
+*   oldest particles. Moving them is a vector multiply-add a field, several particles at a time
+*   (GCC/Clang vector extensions, as lanesim.h).
+*
+*   rlgl's batch would take a draw call and a flush every 8192 quads and a few function calls a
+*   vertex, so particles don't go through it: each frame their quads are written straight into the
+*   vertex and colour arrays of dynamic meshes of particleMeshQuads quads each (their index buffers
+*   never change) and each mesh used is drawn with DrawMesh, one draw call per 16384 particles.
+*   Particles only move on the main thread, as frames are drawn, so they never hold up the
+*   simulation's ticks.
+*
+******************************************************************************************************/
+
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include <math.h>
+#include <string.h>
+#include "include/raylib.h"
+#include "pongsim.h"
+#include "drawcount.h"
+
+// rlgl function bundled in libraylib.a (DrawMesh draws straight away, so the batch before it is drawn first)
+extern "C"
+{
+    void rlDrawRenderBatchActive(void);
+}
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int particleCapacity = 1 << 18;           // Particles alive at once (a power of two, a multiple of particleMeshQuads)
+const int particleMeshQuads = 16384;            // Particles drawn by one mesh (4 vertices each, indexed with unsigned shorts)
+const int particleMeshes = particleCapacity / particleMeshQuads;
+const float particleLife = 0.75f;               // Seconds a particle lives, fading out all the way
+const float particleDrag = 3.0f;                // Fraction of its speed a particle loses a second (as an exponential decay rate)
+const float particleMaxStep = 0.1f;             // Longest time one update moves particles on (after a stall)
+const float particleHalfSize = 1.5f;            // A particle is a square 3 pixels across
+const int particleHitCount = 40;                // Particles from a ball hitting a paddle
+const int particleGoalCount = 400;              // Particles from a ball being scored
+
+// Particles moved at once, one register
+#if defined(__AVX__)
+const int particleLanes = 8;
+#else
+const int particleLanes = 4;
+#endif
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+typedef float ParticleFloats __attribute__((vector_size(particleLanes * sizeof(float))));
+
+// Create a structure for the particle pool, field by field, and the meshes they are drawn with
+struct ParticleSystem
+{
+    alignas(32) float x[particleCapacity];
+    alignas(32) float y[particleCapacity];
+    alignas(32) float vx[particleCapacity];
+    alignas(32) float vy[particleCapacity];
+    double birth[particleCapacity];             // time each particle was spawned (GetTime uptime, too coarse as a float after hours)
+    Color colour[particleCapacity];             // colour each particle starts at
+
+    unsigned int head;                          // particles spawned so far, the newest is at (head - 1) % particleCapacity
+    unsigned int tail;                          // particles that have died, the oldest alive is at tail % particleCapacity
+    double lastUpdate;                          // time the particles were last moved to
+    unsigned int random;                        // state of the random directions and speeds
+
+    Mesh meshes[particleMeshes];
+    Material material;
+};
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+//----------------------------------------------------------------------------------------------------
+static ParticleSystem particles;                // Single particle system, the pool is too big for the stack
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Set up the meshes the particles are drawn with (after the window is initialised, as OpenGL is required)
+inline void LoadParticleMeshes(ParticleSystem &p)
+{
+    p.head = p.tail = 0;
+    p.lastUpdate = 0;
+    p.random = 0x2545F491u;
+
+    for (int m = 0; m < particleMeshes; m++)
+    {
+        Mesh &mesh = p.meshes[m];
+        mesh = Mesh();
+        mesh.vertexCount = 4 * particleMeshQuads;
+        mesh.triangleCount = 2 * particleMeshQuads;
+        mesh.vertices = (float *)MemAlloc(mesh.vertexCount * 3 * sizeof(float));
+        mesh.colors = (unsigned char *)MemAlloc(mesh.vertexCount * 4);
+        mesh.indices = (unsigned short *)MemAlloc(mesh.triangleCount * 3 * sizeof(unsigned short));
+
+        // Quads wound as rlgl winds them: top left, bottom left, bottom right, top right
+        for (int q = 0; q < particleMeshQuads; q++)
+        {
+            unsigned short *index = mesh.indices + 6 * q;
+            unsigned short first = (unsigned short)(4 * q);
+            index[0] = first;
+            index[1] = first + 1;
+            index[2] = first + 2;
+            index[3] = first;
+            index[4] = first + 2;
+            index[5] = first + 3;
+        }
+        UploadMesh(&mesh, true);
+    }
+    p.material = LoadMaterialDefault();
+}
+
+inline void UnloadParticleMeshes(ParticleSystem &p)
+{
+    for (int m = 0; m < particleMeshes; m++) UnloadMesh(p.meshes[m]);
+    UnloadMaterial(p.material);
+}
+
+// Let every particle die at once
+inline void ClearParticles(ParticleSystem &p)
+{
+    p.tail = p.head;
+}
+
+inline int LiveParticles(const ParticleSystem &p)
+{
+    return (int)(p.head - p.tail);
+}
+
+inline float RandomParticleFloat(ParticleSystem &p)
+{
+    p.random ^= p.random << 13;
+    p.random ^= p.random >> 17;
+    p.random ^= p.random << 5;
+    return (p.random >> 8) / 16777216.0f;
+}
+
+// Spawn particles at a point, flying out within spread radians either side of an angle at speeds from speedMin to speedMax
+inline void SpawnParticles(ParticleSystem &p, float x, float y, float angle, float spread, float speedMin, float speedMax,
+                           int count, Color colour, double time)
+{
+    if (LiveParticles(p) == 0) p.lastUpdate = time;       // Nothing to move on from the last update
+    for (int i = 0; i < count; i++)
+    {
+        if (LiveParticles(p) == particleCapacity) p.tail++;   // Full: the oldest particle makes way
+        unsigned int slot = p.head++ & (particleCapacity - 1);
+
+        float direction = angle + spread * (2 * RandomParticleFloat(p) - 1);
+        float speed = speedMin + (speedMax - speedMin) * RandomParticleFloat(p);
+        p.x[slot] = x;
+        p.y[slot] = y;
+        p.vx[slot] = speed * cosf(direction);
+        p.vy[slot] = speed * sinf(direction);
+        p.birth[slot] = time;
+        p.colour[slot] = colour;
+    }
+}
+
+// Spawn the particles for a ball hitting a paddle (sparks off the paddle, in its colour) or being scored (a burst into the court, in the scorer's colour)
+inline void SpawnBallEventParticles(ParticleSystem &p, bool scored, float x, float y, double time)
+{
+    const float pi = 3.14159265f;
+    bool leftSide = x < screenWidth / 2;
+    float intoCourt = leftSide ? 0 : pi;
+    if (scored) SpawnParticles(p, x, y, intoCourt, pi / 2, 50, 450, particleGoalCount, leftSide ? RED : BLUE, time);
+    else SpawnParticles(p, x, y, intoCourt, pi / 3, 30, 250, particleHitCount, leftSide ? BLUE : RED, time);
+}
+
+// Move the particles from a range of the pool on, whole registers at a time (the pool is a whole number of them)
+inline void MoveParticles(ParticleSystem &p, unsigned int from, unsigned int to, float frameTime, float drag)
+{
+    ParticleFloats step = ParticleFloats{} + frameTime;
+    ParticleFloats slow = ParticleFloats{} + drag;
+    for (unsigned int i = from / particleLanes; i < (to + particleLanes - 1) / particleLanes; i++)
+    {
+        ParticleFloats *x = (ParticleFloats *)p.x + i, *y = (ParticleFloats *)p.y + i;
+        ParticleFloats *vx = (ParticleFloats *)p.vx + i, *vy = (ParticleFloats *)p.vy + i;
+        *x += *vx * step;
+        *y += *vy * step;
+        *vx *= slow;
+        *vy *= slow;
+    }
+}
+
+// Let the particles that have lived their life die and move the rest on to a time
+inline void UpdateParticles(ParticleSystem &p, double time)
+{
+    while (p.tail != p.head && time - p.birth[p.tail & (particleCapacity - 1)] >= particleLife) p.tail++;
+
+    float frameTime = (float)(time - p.lastUpdate);
+    if (frameTime > particleMaxStep) frameTime = particleMaxStep;
+    p.lastUpdate = time;
+    if (p.tail == p.head || frameTime <= 0) return;
+
+    // The live particles wrap round the end of the pool at most once
+    // (when both ends are in one register, the first range moves it and the second stops short of it)
+    float drag = expf(-particleDrag * frameTime);
+    unsigned int from = p.tail & (particleCapacity - 1), to = p.head & (particleCapacity - 1);
+    if (from < to)
+    {
+        MoveParticles(p, from, to, frameTime, drag);
+    }
+    else
+    {
+        unsigned int fromRegister = from & ~(unsigned int)(particleLanes - 1);
+        MoveParticles(p, from, particleCapacity, frameTime, drag);
+        MoveParticles(p, 0, (to < fromRegister) ? to : fromRegister, frameTime, drag);
+    }
+}
+
+// Draw the live particles as quads fading out over their life, call between BeginDrawing and EndDrawing
+inline void DrawParticles(ParticleSystem &p, double time)
+{
+    int live = LiveParticles(p);
+    if (live == 0) return;
+
+    rlDrawRenderBatchActive();      // What was drawn before the particles goes under them
+    const Matrix identity = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    const float fade = 255 / particleLife;
+
+    for (int m = 0; m * particleMeshQuads < live; m++)
+    {
+        Mesh &mesh = p.meshes[m];
+        int quads = (live - m * particleMeshQuads < particleMeshQuads) ? live - m * particleMeshQuads : particleMeshQuads;
+        for (int q = 0; q < quads; q++)
+        {
+            unsigned int slot = (p.tail + m * particleMeshQuads + q) & (particleCapacity - 1);
+            float left = p.x[slot] - particleHalfSize, right = p.x[slot] + particleHalfSize;
+            float top = p.y[slot] - particleHalfSize, bottom = p.y[slot] + particleHalfSize;
+
+            float *vertex = mesh.vertices + 12 * q;
+            vertex[0] = left;   vertex[1] = top;     vertex[2] = 0;
+            vertex[3] = left;   vertex[4] = bottom;  vertex[5] = 0;
+            vertex[6] = right;  vertex[7] = bottom;  vertex[8] = 0;
+            vertex[9] = right;  vertex[10] = top;    vertex[11] = 0;
+
+            float alpha = (particleLife - (float)(time - p.birth[slot])) * fade;
+            Color colour = p.colour[slot];
+            colour.a = (unsigned char)((alpha < 0) ? 0 : (alpha > 255) ? 255 : alpha);
+            Color *colours = (Color *)(mesh.colors + 16 * q);
+            colours[0] = colours[1] = colours[2] = colours[3] = colour;
+        }
+
+        UpdateMeshBuffer(mesh, 0, mesh.vertices, quads * 12 * sizeof(float), 0);
+        UpdateMeshBuffer(mesh, 3, mesh.colors, quads * 16, 0);
+        Mesh used = mesh;
+        used.triangleCount = 2 * quads;
+        DrawMesh(used, p.material, identity);
+        CountMesh(4 * quads);
+    }
+}
+
+#endif // PARTICLES_H
@@ -0,0 +1,335 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium physics benchmark: the generic float simulation against its specialisations
+*   (specsim.h) and the fixed-point simulation (fixedsim.h)
+*
+*   Records matches between the same simple bots with each simulation, under the classic rules and
+*   a quick match's, then replays them through UpdateGame, the specialisation SelectUpdateGame picks
+*   and UpdateFixedGame and times a tick of each. It also prints the chained state hash (statehash.h)
+*   of each replay: a specialisation's chain must be the generic one's. The fixed-point bots use only
+*   integers, so the fixed-point chain must be the same whatever compiler, flags or machine built
+*   physbench; the float chains are free to change with them (try -O0, -O2 and
+*   -O2 -march=native -ffp-contract=fast).
+*
+*   Last it plays matches between the fast bots of fastforward.h tick by tick and by fast-forwarding
+*   from event to event, checks the two agree at every jump and times a match each way.
+*
+*   Usage: physbench [--matches N] [--seconds S]
+*
+*   Build: g++ physbench.cpp -o physbench.exe -O2
+*
+******************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "controllers.h"
+#include "fastforward.h"
+#include "fixedsim.h"
+#include "specsim.h"
+#include "statehash.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int maxMatchTicks = 60 * 60 * 10;         // A match still going after 10 minutes of game time is cut short
+const int benchRounds = 5;                      // Timing rounds per simulation, the fastest counts
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for the inputs of matches recorded with the float simulation under some rules
+struct FloatMatches
+{
+    MatchRules rules;
+    std::vector<std::vector<PaddleInput> > left, right;
+};
+
+// Create a structure for the inputs of matches recorded with the fixed-point simulation
+struct FixedMatches
+{
+    std::vector<std::vector<FixedInput> > left, right;
+};
+
+// Create a structure for one simulation being timed
+struct BenchRow
+{
+    const char *name;
+    const FloatMatches *matches;        // 0 for the fixed-point simulation
+    UpdateGameFunction update;
+    double best;                        // fastest time a tick took over the rounds, seconds
+    long long ticks;
+    unsigned long long chain;
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Get the keys a bot holds: it chases the nearest ball for a whole, half or quarter tick, and looks away now and
+// then so points are scored. The fixed-point bot uses only integers, so its inputs are the same on every build
+FixedInput FollowBallInput(const FixedGame &game, int side, unsigned int &random)
+{
+    const FixedPlayer &player = (side == 1) ? game.player1Left : game.player2Right;
+    const FixedBall *ball = &game.ball1;
+    if (game.ball2.visible && abs(game.ball2.x - player.x) < abs(game.ball1.x - player.x)) ball = &game.ball2;
+
+    FixedInput input = { 0, 0 };
+    unsigned int roll = NextRandom(random);
+    if (roll % 8 == 0) return input;
+
+    int hold = fixedOne >> (roll / 8 % 3);
+    if (ball->y > player.y + 8 * fixedOne) input.down = hold;
+    else if (ball->y < player.y - 8 * fixedOne) input.up = hold;
+    return input;
+}
+
+PaddleInput FollowBallInput(const Game &game, int side, unsigned int &random)
+{
+    const Player &player = ControlledPlayer(game, side);
+    const Ball *ball = &game.ball1;
+    if (game.ball2.visible && fabsf(game.ball2.position.x - player.position.x) < fabsf(game.ball1.position.x - player.position.x)) ball = &game.ball2;
+
+    PaddleInput input = { 0, 0 };
+    unsigned int roll = NextRandom(random);
+    if (roll % 8 == 0) return input;
+
+    float hold = 1.0f / (1 << (roll / 8 % 3));
+    if (ball->position.y > player.position.y + 8) input.down = hold;
+    else if (ball->position.y < player.position.y - 8) input.up = hold;
+    return input;
+}
+
+// Play a match with the float simulation under some rules and keep the inputs
+void RecordFloatMatch(FloatMatches &matches, unsigned int seed)
+{
+    Game game;
+    InitialiseGame(game, matches.rules);
+    std::vector<PaddleInput> left, right;
+    unsigned int leftRandom = seed, rightRandom = seed ^ 0x5BD1E995u;
+    while (!game.gameWon && game.tick < maxMatchTicks)
+    {
+        left.push_back(FollowBallInput(game, 1, leftRandom));
+        right.push_back(FollowBallInput(game, 2, rightRandom));
+        UpdateGame(game, left.back(), right.back(), simTickTime);
+    }
+    matches.left.push_back(left);
+    matches.right.push_back(right);
+}
+
+// Play a match with the fixed-point simulation between the same bots and keep the inputs
+void RecordFixedMatch(FixedMatches &matches, unsigned int seed)
+{
+    FixedGame game;
+    InitialiseFixedGame(game);
+    std::vector<FixedInput> left, right;
+    unsigned int leftRandom = seed, rightRandom = seed ^ 0x5BD1E995u;
+    while (!game.gameWon && game.tick < maxMatchTicks)
+    {
+        left.push_back(FollowBallInput(game, 1, leftRandom));
+        right.push_back(FollowBallInput(game, 2, rightRandom));
+        UpdateFixedGame(game, left.back(), right.back());
+    }
+    matches.left.push_back(left);
+    matches.right.push_back(right);
+}
+
+// Replay every float match once with an update, returns the number of ticks
+long long ReplayFloat(const FloatMatches &matches, UpdateGameFunction update, unsigned long long &chain, bool hashing)
+{
+    long long ticks = 0;
+    for (size_t m = 0; m < matches.left.size(); m++)
+    {
+        const std::vector<PaddleInput> &left = matches.left[m], &right = matches.right[m];
+        Game game;
+        InitialiseGame(game, matches.rules);
+        for (size_t t = 0; t < left.size(); t++)
+        {
+            update(game, left[t], right[t], simTickTime);
+            if (hashing) chain = ChainStateHash(chain, HashState(game));
+        }
+        chain += (unsigned long long)game.player1LeftScore;
+        ticks += game.tick;
+    }
+    return ticks;
+}
+
+// Replay every fixed-point match once, returns the number of ticks
+long long ReplayFixed(const FixedMatches &matches, unsigned long long &chain, bool hashing)
+{
+    long long ticks = 0;
+    for (size_t m = 0; m < matches.left.size(); m++)
+    {
+        const std::vector<FixedInput> &left = matches.left[m], &right = matches.right[m];
+        FixedGame game;
+        InitialiseFixedGame(game);
+        for (size_t t = 0; t < left.size(); t++)
+        {
+            UpdateFixedGame(game, left[t], right[t]);
+            if (hashing) chain = ChainStateHash(chain, HashFixedState(game));
+        }
+        chain += (unsigned long long)game.player1LeftScore;
+        ticks += game.tick;
+    }
+    return ticks;
+}
+
+long long ReplayRow(const BenchRow &row, const FixedMatches &fixedMatches, unsigned long long &chain, bool hashing)
+{
+    return row.matches ? ReplayFloat(*row.matches, row.update, chain, hashing) : ReplayFixed(fixedMatches, chain, hashing);
+}
+
+// Play a match between fast bots tick by tick, keeping the hash of the state after every tick
+MatchResult PlaySteppedFastBotMatch(unsigned int seed, std::vector<unsigned long long> *hashes)
+{
+    FixedGame game;
+    InitialiseFixedGame(game);
+    FastBotState leftState, rightState;
+    InitialiseFastBot(leftState, seed);
+    InitialiseFastBot(rightState, seed ^ 0x5BD1E995u);
+
+    while (!game.gameWon && game.tick < maxMatchTicks)
+    {
+        int steady;
+        FixedInput leftInput = FastBotInput(game, 1, leftState, steady);
+        FixedInput rightInput = FastBotInput(game, 2, rightState, steady);
+        UpdateFixedGame(game, leftInput, rightInput);
+        if (hashes) hashes->push_back(HashFixedState(game));
+    }
+
+    MatchResult result = { game.winner, game.player1LeftScore, game.player2RightScore, game.tick };
+    return result;
+}
+
+// Check a fast-forwarded match lands on the same state as stepping it after every jump, returns the first tick it doesn't or 0
+int CheckFastForward(unsigned int seed, const std::vector<unsigned long long> &hashes)
+{
+    FixedGame game;
+    InitialiseFixedGame(game);
+    FastBotState leftState, rightState;
+    InitialiseFastBot(leftState, seed);
+    InitialiseFastBot(rightState, seed ^ 0x5BD1E995u);
+
+    while (!game.gameWon && game.tick < maxMatchTicks)
+    {
+        int leftSteady, rightSteady;
+        FixedInput leftInput = FastBotInput(game, 1, leftState, leftSteady);
+        FixedInput rightInput = FastBotInput(game, 2, rightState, rightSteady);
+        int limit = maxMatchTicks - game.tick;
+        if (leftSteady < limit) limit = leftSteady;
+        if (rightSteady < limit) limit = rightSteady;
+        FastForwardFixedGame(game, leftInput, rightInput, limit);
+
+        if (game.tick > (int)hashes.size() || HashFixedState(game) != hashes[game.tick - 1]) return game.tick;
+    }
+    return game.tick == (int)hashes.size() ? 0 : game.tick;
+}
+
+// Time whole fast bot matches stepped tick by tick and fast-forwarded, after checking the two agree
+void BenchFastForward(int matchCount, double seconds)
+{
+    long long ticks = 0;
+    for (int m = 0; m < matchCount; m++)
+    {
+        std::vector<unsigned long long> hashes;
+        ticks += PlaySteppedFastBotMatch(1000 + m, &hashes).ticks;
+        int tick = CheckFastForward(1000 + m, hashes);
+        if (tick) printf("fast-forward disagrees with stepping in match %d at tick %d\n", m, tick);
+    }
+
+    double best[2] = { 1e9, 1e9 };
+    long long jumps = 0, checksum = 0;
+    for (int round = 0; round < benchRounds; round++)
+    {
+        for (int fast = 0; fast < 2; fast++)
+        {
+            double elapsed = 0;
+            long long played = 0;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            while (elapsed < seconds / benchRounds)
+            {
+                for (int m = 0; m < matchCount; m++)
+                {
+                    MatchResult result = fast ? PlayFastBotMatch(1000 + m, maxMatchTicks, MatchRules(), &jumps) : PlaySteppedFastBotMatch(1000 + m, 0);
+                    checksum += result.ticks;
+                }
+                played += matchCount;
+                elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            if (elapsed / played < best[fast]) best[fast] = elapsed / played;
+        }
+    }
+    jumps = 0;
+    for (int m = 0; m < matchCount; m++) PlayFastBotMatch(1000 + m, maxMatchTicks, MatchRules(), &jumps);
+
+    printf("\n%d fast bot matches, %lld ticks a match (checksum %04llX)\n", matchCount, ticks / matchCount, checksum & 0xFFFF);
+    printf("stepped      %8.1f us a match\n", best[0] * 1e6);
+    printf("fast-forward %8.1f us a match  %lld jumps a match\n", best[1] * 1e6, jumps / matchCount);
+}
+
+int main(int argc, char *argv[])
+{
+    int matchCount = 10;
+    double seconds = 2.0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--matches") == 0 && i + 1 < argc) matchCount = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) seconds = atof(argv[++i]);
+        else
+        {
+            fprintf(stderr, "Usage: physbench [--matches N] [--seconds S]\n");
+            return 1;
+        }
+    }
+    if (matchCount < 1) matchCount = 1;
+
+    FloatMatches classicMatches, quickMatches;
+    quickMatches.rules.winScore = QuickConfig::winScore;
+    FixedMatches fixedMatches;
+    for (int m = 0; m < matchCount; m++)
+    {
+        RecordFloatMatch(classicMatches, 1000 + m);
+        RecordFloatMatch(quickMatches, 1000 + m);
+        RecordFixedMatch(fixedMatches, 1000 + m);
+    }
+
+    // The specialisations are reached through SelectUpdateGame, the way the match runners reach them
+    BenchRow rows[] = {
+        { "classic  generic     ", &classicMatches, UpdateGame, 1e9, 0, 0 },
+        { "classic  specialised ", &classicMatches, SelectUpdateGame(classicMatches.rules), 1e9, 0, 0 },
+        { "quick    generic     ", &quickMatches, UpdateGame, 1e9, 0, 0 },
+        { "quick    specialised ", &quickMatches, SelectUpdateGame(quickMatches.rules), 1e9, 0, 0 },
+        { "classic  fixed point ", 0, 0, 1e9, 0, 0 },
+    };
+    const int rowCount = sizeof(rows) / sizeof(rows[0]);
+
+    // Time the simulations taking turns, best of several rounds so other work on the machine doesn't count,
+    // then hash every state of a replay
+    unsigned long long checksum = 0;
+    for (int round = 0; round < benchRounds; round++)
+    {
+        for (int r = 0; r < rowCount; r++)
+        {
+            double elapsed = 0;
+            long long replayed = 0;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            while (elapsed < seconds / benchRounds)
+            {
+                replayed += ReplayRow(rows[r], fixedMatches, checksum, false);
+                elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            if (elapsed / replayed < rows[r].best) rows[r].best = elapsed / replayed;
+        }
+    }
+    for (int r = 0; r < rowCount; r++) rows[r].ticks = ReplayRow(rows[r], fixedMatches, rows[r].chain, true);
+
+    printf("%d matches of each between the same bots (checksum %04llX)\n", matchCount, checksum & 0xFFFF);
+    for (int r = 0; r < rowCount; r++)
+    {
+        printf("%s %6lld ticks  %6.1f ns a tick  chain %016llX\n", rows[r].name, rows[r].ticks, rows[r].best * 1e9, rows[r].chain);
+    }
+
+    BenchFastForward(matchCount, seconds);
+    return 0;
+}
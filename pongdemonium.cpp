@@ -9,148 +9,355 @@
 *
 ******************************************************************************************************/
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "include/raylib.h"
+#include "resources/uiatlas.h"      // Where each UI image is in the atlas (written by atlasbuild)
+#include "pongsim.h"        // Game rules, shared with the headless tools
+#include "input.h"          // Input sampled between frames and applied inside simulation ticks
+#include "latency.h"        // Input-to-photon latency measurement (--latency)
+#include "simthread.h"      // Simulation ticks on their own thread, handed to drawing through a triple buffer
+#include "idle.h"           // Frames that wouldn't change aren't drawn, power measurement (--power)
+#include "resolution.h"     // Gameplay drawn at a lower resolution when frames run late
+#include "drawcount.h"      // Draw calls and batch flushes counted as rlgl batches them
+#include "renderbench.h"    // Fixed scenes drawn as fast as they go (--bench-render)
+#include "mixer.h"          // Sound effects mixed by the game, panned to where they happen
+#include "particles.h"      // Sparks off paddle hits and bursts at goals, drawn a mesh at a time
+#include "trails.h"         // The last few positions of each ball drawn behind it
+#include "alloctrack.h"     // Heap allocations counted per frame and per call site (built with TRACK_ALLOCATIONS)
 
 //----------------------------------------------------------------------------------------------------
 // Definition of constants
 //----------------------------------------------------------------------------------------------------
-const int screenWidth = 1000;       // Set creen width
-const int screenHeight = 600;       // Set screen height
+const double titleScreenTime = 1.5;     // Time the title screen is shown for (seconds)
+const char *const musicPcmFile = "resources/8-Bit-Retro-Funk-David-Renda.wav";    // Game music as PCM (written by musicbuild), no decoding to play
+const char *const musicMp3File = "resources/8-Bit-Retro-Funk-David-Renda.mp3";    // Game music as shipped, played when there's no PCM
 
 //----------------------------------------------------------------------------------------------------
 // Definition of custom types
 //----------------------------------------------------------------------------------------------------
-// Create a structure for a ball and its variables
-struct Ball
+// Create an enum of different screens to transition between
+enum Screen { TITLE, CONTROLS, GAMEPLAY };
+
+const char *const screenNames[] = { "title", "controls", "gameplay" };     // Names of the screens in reports
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+//----------------------------------------------------------------------------------------------------
+SimulationThread simulation;            // Create the simulation thread (it owns the game state: players, balls, scores)
+Screen currentScreen = TITLE;           // Create screen object and initialise
+double titleTime = 0;                   // Create time the title screen was first shown
+int ballEventsPlayed = 0;               // Create count of ball events a sound has been played for
+FramePacing pacing = PACING_FPS;        // Create frame pacing strategy (--pacing)
+bool measureLatency = false;            // Create latency measurement switch (--latency)
+int simRate = 60;                       // Create simulation tick rate, ticks per second (--sim-rate)
+bool idleRendering = true;              // Create switch for skipping unchanged frames (--no-idle turns it off)
+bool measurePower = false;              // Create power measurement switch (--power)
+float minScale = 0.5f, maxScale = 1.0f; // Create bounds of the gameplay resolution scale (--scale-range)
+const char *recordPath = 0;             // Create file name the replay of each match is written to (--record)
+const char *benchPath = 0;              // Create file name the render benchmark results are written to (--bench-render)
+int benchFrames = benchDefaultFrames;   // Create frames measured of each benchmark scene (--bench-frames)
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+void DrawTitleScreen()
+{
+    // Draw title game text (using default font) in the middle of the screen
+    DrawTextCounted("PONGDEMONIUM", (screenWidth / 2) - (MeasureText("PONGDEMONIUM", 60) / 2), (screenHeight / 2) - 35, 60, GOLD);
+}
+
+void DrawControlsScreen(Texture2D uiAtlas)
 {
-    Vector2 position;       // vector containing the x and y position of a ball
-    Vector2 velocity;       // vector containing the x and y velocity of a ball
-    float radius;           // radius of a ball
-    bool visible;           // boolean to store whether a ball is active
+    // Draw control screen text (using default font) and textures relating keyboard bindings to the user in specific locations on the screen
+    // All the text comes first and then all the key images, so the screen is one draw call from the font texture and one from the atlas
+    int keysX = ((screenWidth / 2) - (MeasureText("Press ENTER", 25) / 2)) / 2;
+    int upperKeyY = screenHeight * 0.425, lowerKeyY = screenHeight * 0.525;
+
+    DrawTextCounted("CONTROLS", (screenWidth / 2) - (MeasureText("CONTROLS", 50) / 2), (screenHeight / 8), 50, GOLD);
+    DrawTextCounted("Press ENTER", (screenWidth / 2) - (MeasureText("Press ENTER", 25) / 2), (screenHeight / 2), 25, MAGENTA);
+    DrawTextCounted("PLAYER 1", keysX - 35, (screenHeight * 0.325), 30, BLUE);
+    DrawTextCounted("PLAYER 2", keysX - 35 + screenWidth / 2, (screenHeight * 0.325), 30, RED);
+    DrawTextCounted("Hold R to rewind", (screenWidth / 2) - (MeasureText("Hold R to rewind", 20) / 2), (screenHeight * 0.85), 20, GRAY);
+
+    DrawTextureRecCounted(uiAtlas, uiAtlasRects[SPRITE_W], Vector2{ (float)keysX, (float)upperKeyY }, WHITE);
+    DrawTextureRecCounted(uiAtlas, uiAtlasRects[SPRITE_S], Vector2{ (float)keysX, (float)lowerKeyY }, WHITE);
+    DrawTextureRecCounted(uiAtlas, uiAtlasRects[SPRITE_UP_ARROW], Vector2{ (float)(keysX + screenWidth / 2), (float)upperKeyY }, WHITE);
+    DrawTextureRecCounted(uiAtlas, uiAtlasRects[SPRITE_DOWN_ARROW], Vector2{ (float)(keysX + screenWidth / 2), (float)lowerKeyY }, WHITE);
+}
+
+// Add where each ball is to its trail (a ball out of play has none), once a frame
+void RecordBallTrails(const Game &game)
+{
+    trails.slots = 2;
+    if (game.ball1.visible) RecordTrail(trails, 0, game.ball1.position.x, game.ball1.position.y, game.ball1.radius, GOLD);
+    else ClearTrail(trails, 0);
+    if (game.ball2.visible) RecordTrail(trails, 1, game.ball2.position.x, game.ball2.position.y, game.ball2.radius, MAGENTA);
+    else ClearTrail(trails, 1);
+}
+
+void DrawGameplayScreen(const Game &game, const ResolutionScaler &scaler, bool rewinding, double time)
+{
+    BeginScaledDrawing(scaler);     // Draw gameplay offscreen at the current resolution scale
+
+    // Draw centre court line
+    DrawLineCounted(screenWidth / 2, 0, screenWidth / 2, screenHeight, GREEN);     // Draw a line
 
-    // Function to conveniently draw a circular ball
-    void Draw(Color colour)
+    DrawParticles(particles, time);         // Draw the particles as they are at this time, under the players and balls
+    DrawTrails(trails);                     // Draw the balls' trails, under the balls
+
+    DrawRectangleRecCounted(game.player1Left.GetRectangle(), BLUE);         // Draw the rectangle for player 1
+    DrawRectangleRecCounted(game.player2Right.GetRectangle(), RED);         // Draw the rectangle for player 2
+
+    // If ball 1 is active i.e. not the end of the game
+    if (game.ball1.visible)
     {
-        DrawCircle(position.x, position.y, radius, colour);     // Draw a colour filled circle
+        DrawCircleCounted(game.ball1.position.x, game.ball1.position.y, game.ball1.radius, GOLD);          // Draw the circle for ball 1
     }
-
-    // Function to conveniently reinitialise a ball's variables to starting values
-    void Reset()
+    // If ball 2 is active i.e. after either player reaches a score of 3
+    if (game.ball2.visible)
     {
-        position.x = screenWidth / 2;
-        position.y = screenHeight / 2;
-        velocity.x = 400;
-        velocity.y = 400;
+        DrawCircleCounted(game.ball2.position.x, game.ball2.position.y, game.ball2.radius, MAGENTA);       // Draw the circle for ball 2
     }
-};
 
-// Create a structure for a player and its variables
-struct Player
-{
-    Vector2 position;       // vector containing the x and y position of a player
-    Vector2 size;           // vector containing the width and height of a player (rectangle)
-    int speed;              // speed a player can move at
+    DrawTextCounted(TextFormat("%i", game.player1LeftScore), (screenWidth / 2) - 40, 10, 40, BLUE);     // Draw text to display player 1's score (using default font)
+    DrawTextCounted(TextFormat("%i", game.player2RightScore), (screenWidth / 2) + 20, 10, 40, RED);     // Draw text to display player 2's score (using default font)
 
-    // Function to conveniently draw a rectangular player
-    void Draw(Color colour)
+    // Mark the game as playing backwards while it is being rewound
+    if (rewinding)
     {
-        DrawRectangleRec(GetRectangle(), colour);       // Draw a colour filled rectangle
+        DrawTextCounted("<< REWIND", (screenWidth / 2) - (MeasureText("<< REWIND", 30) / 2), screenHeight - 50, 30, GRAY);
     }
 
-    // Function to conveniently get a player, defined by it's position and size
-    Rectangle GetRectangle()
+    // If either player has reached a score of 10 - they won the game
+    if (game.gameWon && !rewinding)
     {
-        return Rectangle{ position.x - (size.x / 2), position.y - (size.y / 2), size.x, size.y };
+        // Draw text informing the players of the win and how to restart
+        const char *winText = (game.winner == 1) ? "PLAYER 1 WINS!" : "PLAYER 2 WINS!";
+        DrawTextCounted(winText, (screenWidth / 2) - (MeasureText(winText, 50) / 2), (screenHeight / 2) - 50, 50, GOLD);
+        DrawTextCounted("Press ENTER to play again", (screenWidth / 2) - (MeasureText("Press ENTER to play again", 25) / 2), (screenHeight / 2) + 25, 25, MAGENTA);
     }
-};
 
-// Create an enum of different screens to transition between
-enum Screen { TITLE, CONTROLS, GAMEPLAY };
-
-//----------------------------------------------------------------------------------------------------
-// Variables
-//----------------------------------------------------------------------------------------------------
-Player player1Left, player2Right;       // Create two player objects
-Ball ball1, ball2;                      // Create two ball objects
-Screen currentScreen = TITLE;           // Create screen object and initialise
-int player1LeftScore, player2RightScore, frameCounter = 0, frameCounterBall2;       // Create counters for scores and frames
-bool gameWon = false;                   // Create boolean to store game won state
+    EndScaledDrawing(scaler);       // Stretch the offscreen gameplay over the window
+}
 
-//----------------------------------------------------------------------------------------------------
-// Functions
-//----------------------------------------------------------------------------------------------------
-// Set the starting values of the objects and variables in the game
-// and group in a method to be able to easily reset the game on restart
-void InitialiseGameObjects()
+// Draw every benchmark scene as fast as it goes and write the results, returns false if they couldn't be written
+bool RunRenderBenchmark(Texture2D uiAtlas, const ResolutionScaler &scaler)
 {
-    // Initialise variables of player 1
-    player1Left.position.x = 25;
-    player1Left.position.y = screenHeight / 2;
-    player1Left.size.x = 15;
-    player1Left.size.y = 150;
-    player1Left.speed = 1000;
-
-    // Initialise variables of player 2
-    player2Right.position.x = screenWidth - 25;
-    player2Right.position.y = screenHeight / 2;
-    player2Right.size.x = 15;
-    player2Right.size.y = 150;
-    player2Right.speed = 1000;
-    
-    // Initialise variables of ball 1
-    ball1.position.x = screenWidth / 2;
-    ball1.position.y = screenHeight/ 2;
-    ball1.radius = 10;
-    ball1.velocity.x = 400;
-    ball1.velocity.y = 400;
-    ball1.visible = true;
-
-    // Initialise variables of ball 2
-    ball2.position.x = screenWidth / 2;
-    ball2.position.y = screenHeight/ 2;
-    ball2.radius = 10;
-    ball2.velocity.x = 400;
-    ball2.velocity.y = 400;
-    ball2.visible = false;
-
-    // Initialise counters
-    player1LeftScore = 0;
-    player2RightScore = 0;
-    frameCounterBall2 = 0;
+    const float frameTime = 1.0f / 60;      // Game time a frame moves the balls on, whatever the frame really takes
+    std::vector<BenchResult> results;
+
+    for (int s = 0; s < BENCH_SCENE_COUNT && !WindowShouldClose(); s++)
+    {
+        BenchScene scene = (BenchScene)s;
+        Game game;
+        InitialiseGame(game);
+        game.ball2.visible = true;      // Both balls in play from the start
+        StressBalls balls;
+        if (scene == BENCH_STRESS_1K || scene == BENCH_STRESS_100K || scene == BENCH_TRAILS_4K) InitialiseStressBalls(balls, benchSceneBalls[scene]);
+        ClearParticles(particles);
+        ClearTrails(trails);
+
+        BenchResult result;
+        result.scene = scene;
+        for (int frame = 0; frame < benchWarmupFrames + benchFrames && !WindowShouldClose(); frame++)
+        {
+            double time = frame * frameTime;
+            if (scene == BENCH_GAMEPLAY || scene == BENCH_PARTICLES_200K)
+            {
+                UpdateGame(game, PaddleInput{ 0, 0 }, PaddleInput{ 0, 0 }, frameTime);
+                if (game.gameWon)
+                {
+                    InitialiseGame(game);
+                    game.ball2.visible = true;
+                }
+            }
+            UpdateStressBalls(balls, frameTime);
+            if (scene == BENCH_GAMEPLAY || scene == BENCH_PARTICLES_200K) RecordBallTrails(game);
+            if (scene == BENCH_TRAILS_4K) RecordStressTrails(trails, balls);
+
+            if (frame == benchWarmupFrames) ResetDrawCounters();
+            double start = GetTime();
+            TopUpParticles(particles, benchSceneParticles[scene], time);
+            UpdateParticles(particles, time);
+
+            BeginDrawing();
+                ClearBackground(BLACK);
+                switch (scene)
+                {
+                    case BENCH_TITLE: DrawTitleScreen(); break;
+                    case BENCH_CONTROLS: DrawControlsScreen(uiAtlas); break;
+                    case BENCH_GAMEPLAY:
+                    case BENCH_PARTICLES_200K: DrawGameplayScreen(game, scaler, false, time); break;
+                    case BENCH_TRAILS_4K:
+                        DrawTrails(trails);
+                        DrawStressBalls(balls);
+                        break;
+                    default: DrawStressBalls(balls); break;
+                }
+            EndDrawing();
+            CountFlush();
+
+            if (frame >= benchWarmupFrames) result.frameTimes.push_back(GetTime() - start);
+        }
+
+        result.drawCalls = drawCounters.drawCalls;
+        result.flushes = drawCounters.flushes;
+        result.vertices = drawCounters.vertices;
+        results.push_back(result);
+    }
+
+    return WriteRenderBenchmark(results, benchFrames, benchPath);
 }
 
 //----------------------------------------------------------------------------------------------------
 // Main entry point of program
 //----------------------------------------------------------------------------------------------------
-int main()
+int main(int argc, char *argv[])
 {
+    // Read the command line: --pacing fps|vsync|late picks the frame pacing, --latency measures input latency,
+    // --sim-rate N runs the simulation at N ticks per second (60 is the classic game),
+    // --no-idle redraws unchanged frames, --power measures frames, wake-ups and CPU use,
+    // --scale-range MIN:MAX bounds the gameplay resolution scale (1:1 always draws at full resolution),
+    // --record FILE writes the replay of the match (inputs and state hashes) to FILE for replaycheck,
+    // --bench-render FILE draws the benchmark scenes (--bench-frames N frames each) and writes the results to FILE as JSON
+    //------------------------------------------------------------------------------------------------
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--pacing") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "vsync") == 0) pacing = PACING_VSYNC;
+            else if (strcmp(argv[i], "late") == 0) pacing = PACING_LATE;
+            else pacing = PACING_FPS;
+        }
+        else if (strcmp(argv[i], "--latency") == 0) measureLatency = true;
+        else if (strcmp(argv[i], "--sim-rate") == 0 && i + 1 < argc)
+        {
+            simRate = atoi(argv[++i]);
+            if (simRate < 1) simRate = 60;
+        }
+        else if (strcmp(argv[i], "--no-idle") == 0) idleRendering = false;
+        else if (strcmp(argv[i], "--power") == 0) measurePower = true;
+        else if (strcmp(argv[i], "--scale-range") == 0 && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%f:%f", &minScale, &maxScale) != 2 || minScale <= 0 || maxScale > 1 || minScale > maxScale)
+            {
+                minScale = 0.5f;
+                maxScale = 1.0f;
+            }
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) recordPath = argv[++i];
+        else if (strcmp(argv[i], "--bench-render") == 0 && i + 1 < argc) benchPath = argv[++i];
+        else if (strcmp(argv[i], "--bench-frames") == 0 && i + 1 < argc)
+        {
+            benchFrames = atoi(argv[++i]);
+            if (benchFrames < 1) benchFrames = benchDefaultFrames;
+        }
+    }
+
+    if (benchPath)
+    {
+        pacing = PACING_FPS;        // Vsync off (the benchmark loop doesn't pace its frames at all)
+    }
+
     // Initialise game settings and assets
     //------------------------------------------------------------------------------------------------
+    if (pacing != PACING_FPS)
+    {
+        SetConfigFlags(FLAG_VSYNC_HINT);        // Swap buffers in step with the display
+    }
     InitWindow(screenWidth, screenHeight, "Pongdemonium");      // Initialise window and OpenGL context
     InitAudioDevice();      // Initialise audio device and context
 
-    SetTargetFPS(60);       // Set the game to run at 60 frames per second
+    // The game paces itself to 60 frames per second (instead of SetTargetFPS) so it can sample input while it waits
+    InstallInputSampler(pacing);
+    if (measureLatency)
+    {
+        InstallLatencyMonitor();
+        idleRendering = false;      // Latency is measured on frames paced the same on every screen
+    }
+    if (measurePower)
+    {
+        StartPowerMonitor();
+    }
 
-    Sound hitBallFX = LoadSound("resources/hitBall.wav");           // Load sound from WAV file for ball and player collision
-    Sound spawnBallFX = LoadSound("resources/spawnBall.wav");       // Load sound from WAV file for sound of a new ball
-    Music music = LoadMusicStream("resources/8-Bit-Retro-Funk-David-Renda.mp3");    // Load sound from mp3 file for game music
+    int hitBallFX = LoadMixerSound(mixer, "resources/hitBall.wav");         // Load sound from WAV file for ball and player collision
+    int spawnBallFX = LoadMixerSound(mixer, "resources/spawnBall.wav");     // Load sound from WAV file for sound of a new ball
+    StartMixer(mixer);                                              // Start mixing the sound effects on the audio thread
+    SetAudioStreamBufferSizeDefault(musicBufferFrames);             // Let the music play through the main loop sleeping on an unchanged frame
+    Music music = LoadMusicStream(FileExists(musicPcmFile) ? musicPcmFile : musicMp3File);     // Load game music, from PCM if it has been built
 
     // Textures must be loaded after window initialisation (as OpenGL context is required)
-    Texture2D upArrow = LoadTexture("resources/upArrow.png");       // Load texture for up arrow
-    Texture2D downArrow = LoadTexture("resources/downArrow.png");   // Load texture for down arrow
-    Texture2D wKey = LoadTexture("resources/w.png");                // Load texture for W key
-    Texture2D sKey = LoadTexture("resources/s.png");                // Load texture for S key
+    Texture2D uiAtlas = LoadTexture(uiAtlasFile);                   // Load texture for the UI images (arrows and keys), packed by atlasbuild
+
+    LoadParticleMeshes(particles);                                  // Load the meshes the particles are drawn with
+    LoadTrailMeshes(trails);                                        // Load the meshes the balls' trails are drawn with
+
+    ResolutionScaler scaler;
+    InitialiseResolutionScaler(scaler, minScale, maxScale);         // Load offscreen texture for drawing gameplay
     
-    SetMusicVolume(music, 0.5);     // Set volume for music to 50% (1.0 is max level)
-    PlayMusicStream(music);         // Play game music
+    if (benchPath)
+    {
+        // Draw the benchmark scenes instead of playing: the simulation is never started and the main loop is skipped
+        if (!RunRenderBenchmark(uiAtlas, scaler)) printf("Couldn't write %s\n", benchPath);
+    }
+    else
+    {
+        SetMusicVolume(music, 0.5);     // Set volume for music to 50% (1.0 is max level)
+        PlayMusicStream(music);         // Play game music
 
-    InitialiseGameObjects();        // Set the variables (position, speed etc) of game objects
+        StartSimulation(simulation, simRate, recordPath);       // Start simulating the game objects (position, speed etc) on their own thread
+    }
+    titleTime = GetTime();
+
+    bool idle = false;                  // Whether the frame on screen is up to date and nothing is moving
+    int drawnVersion = -1;              // Version of the game state the frame on screen shows
+    Screen drawnScreen = TITLE;         // Screen the frame on screen shows
+    double drawnTime = 0;               // Time the frame on screen was drawn
+    bool lastFramePlaying = false;      // Whether the last frame drawn was of a game being played
+    StartAllocationRecording();         // Everything is loaded, any allocation from here on is made while running
 
     // Main game loop
-    while (!WindowShouldClose())        // While game window is not closed or ESC key is not pressed
+    while (!benchPath && !WindowShouldClose())      // While game window is not closed or ESC key is not pressed (and not benchmarking)
     {
+        AllocationFrame(currentScreen);     // Count this frame's allocations against the screen it starts on
+
         // Update game state (one frame at a time)
         //------------------------------------------------------------------------------------------------
+        if (idle)
+        {
+            // Sleep until input arrives, the music needs refilling, the title screen is over or the frame needs repainting
+            double wakeTime = GetTime() + idleMusicPeriod;
+            if (drawnTime + idleRedrawPeriod < wakeTime) wakeTime = drawnTime + idleRedrawPeriod;
+            if (currentScreen == TITLE && titleTime + titleScreenTime < wakeTime) wakeTime = titleTime + titleScreenTime;
+            WaitForInputOrTime(wakeTime);
+        }
+        else
+        {
+            WaitForNextFrame();         // Wait for the frame (depending on the pacing strategy), sampling input meanwhile
+        }
+
+        // Take the newest state of the game the simulation has published (never waits for the simulation)
+        AcquireSlot(simulation.snapshots);
+        const GameSnapshot &snapshot = ReadSlot(simulation.snapshots);
+        const Game &game = snapshot.game;
+        if (measureLatency)
+        {
+            // While the game isn't being played the simulation sleeps, so this frame's update reads all the input
+            bool playing = currentScreen == GAMEPLAY && !game.gameWon;
+            LatencyInputRead(playing ? snapshot.simTime : inputSampler.frameTo, snapshot.publishTime);
+        }
+
+        // Play sounds for what happened in the ticks simulated since the last frame, panned to where it happened
+        if (ballEventsPlayed < snapshot.eventCount - ballEventCapacity) ballEventsPlayed = snapshot.eventCount - ballEventCapacity;
+        for (; ballEventsPlayed < snapshot.eventCount; ballEventsPlayed++)
+        {
+            const BallEvent &event = snapshot.events[ballEventsPlayed % ballEventCapacity];
+            PlayMixerSound(mixer, (event.type == BALL_HIT) ? hitBallFX : spawnBallFX, event.x, 1.0f);
+            SpawnBallEventParticles(particles, event.type == BALL_SCORED, event.x, event.y, GetTime());
+        }
 
         UpdateMusicStream(music);      // Update music buffer with new stream data
 
@@ -159,9 +366,8 @@ int main()
         {
             case TITLE:
             {
-                frameCounter++;     // Count the number of frames that have been rendered
-                // Wait 1.5 seconds (90 frames) before changing to the controls screen
-                if (frameCounter > 90)
+                // Wait 1.5 seconds before changing to the controls screen
+                if (GetTime() - titleTime >= titleScreenTime)
                 {
                     currentScreen = CONTROLS;
                 }
@@ -169,207 +375,49 @@ int main()
             case CONTROLS:
             {
                 // Change to the gameplay screen when the user presses enter
-                if (IsKeyPressed(KEY_ENTER))
+                if (InputKeyPressed(KEY_ENTER))
                 {
                     currentScreen = GAMEPLAY;
+                    PlaySimulation(simulation);     // The game starts being simulated
                 }
             }   break;
             case GAMEPLAY:
-                // Stay on this screen for the rest of the program lifetime
-                break;
+            {
+                // Stay on this screen for the rest of the program lifetime, the game plays backwards while R is held
+                bool rewindHeld = IsKeyDown(KEY_R);
+                if (rewindHeld != simulation.rewinding.load()) RewindSimulation(simulation, rewindHeld);
+            }   break;
             default:
                 break;
         }
 
-        // Each time a frame is rendered, if the game has not yet been won, continue playing the game
-        if (!gameWon)
+        // Logic for new game/round reset
+        //------------------------------------------------------------------------------------------------
+        if (currentScreen == GAMEPLAY && game.gameWon && InputKeyPressed(KEY_ENTER))     // Game updates do not happen until the user presses enter
         {
-            // Logic for position of game objects (sprites)
-            //------------------------------------------------------------------------------------------------
-            // Set bottom bound for player 1
-            if (player1Left.position.y > screenHeight - (player1Left.size.y / 2))
-            {
-                player1Left.position.y = screenHeight - (player1Left.size.y / 2);
-            }
-            // Set top bound for player 1
-            else if (player1Left.position.y < 0 + (player1Left.size.y / 2))
-            {
-                player1Left.position.y = 0 + (player1Left.size.y / 2);
-            }
-
-            // Set bottom bound for player 2
-            if (player2Right.position.y > screenHeight - (player2Right.size.y / 2))
-            {
-                player2Right.position.y = screenHeight - (player2Right.size.y / 2);
-            }
-            // Set top bound for player 2
-            else if (player2Right.position.y < 0 + (player2Right.size.y / 2))
-            {
-                player2Right.position.y = 0 + (player2Right.size.y / 2);
-            }
-
-            // Move ball 1 around the screen - change position by adding velocity in x and y directions
-            ball1.position.x += ball1.velocity.x * GetFrameTime();      // Get time in seconds from last frame drawn (delta time) i.e. amount of time between frames
-            ball1.position.y += ball1.velocity.y * GetFrameTime();      // to keep change of position (velocity) in sync with frame speed
-
-            // Set bottom bound for ball 1
-            if (ball1.position.y > screenHeight - ball1.radius)
-            {
-                ball1.position.y = screenHeight - ball1.radius;
-                // Change the direction of the ball, so that it bounces up from the bottom of the screen
-                ball1.velocity.y *= -1;
-            }
-            // Set top bound for ball 1
-            else if (ball1.position.y < 0 + ball1.radius)
-            {
-                ball1.position.y = 0 + ball1.radius;
-                // Change the direction of the ball, so that it bounces down from the top of the screen
-                ball1.velocity.y *= -1;
-            }
-
-            // If ball 2 is active, then move it around
-            // Ball 1 is active from the start but ball 2 only becomes active after either player reaches a score of 3
-            if (ball2.visible)
-            {
-                // Move ball 2 around the screen - change position by adding velocity in x and y directions
-                ball2.position.x += ball2.velocity.x * GetFrameTime();      // Get time in seconds from last frame drawn (delta time) i.e. amount of time between frames
-                ball2.position.y += ball2.velocity.y * GetFrameTime();      // to keep change of position (velocity) in sync with frame speed
-
-                // Set bottom bound for ball 1
-                if (ball2.position.y > screenHeight - ball2.radius)
-                {
-                    ball2.position.y = screenHeight - ball2.radius;
-                    // Change the direction of the ball, so that it bounces up from the bottom of the screen
-                    ball2.velocity.y *= -1;
-                }
-                // Set top bound for ball 1
-                else if (ball2.position.y < 0 + ball2.radius)
-                {
-                    ball2.position.y = 0 + ball2.radius;
-                    // Change the direction of the ball, so that it bounces down from the top of the screen
-                    ball2.velocity.y *= -1;
-                }
-            }
-
-            // Logic for user input controls
-            //------------------------------------------------------------------------------------------------
-            // Set controls for player 1
-            if (IsKeyDown(KEY_S))
-            {
-                // Move player 1 down by increasing it's y postion by it's speed
-                player1Left.position.y += player1Left.speed * GetFrameTime();
-            }
-            if (IsKeyDown(KEY_W))
-            {
-                // Move player 1 up by decreasing it's y postion by it's speed
-                player1Left.position.y -= player1Left.speed * GetFrameTime();
-            }
-
-            // Set controls for player 2
-            if (IsKeyDown(KEY_DOWN))
-            {
-                // Move player 2 down by increasing it's y postion by it's speed
-                player2Right.position.y += player2Right.speed * GetFrameTime();
-            }
-            if (IsKeyDown(KEY_UP))
-            {
-                // Move player 2 up by decreasing it's y postion by it's speed
-                player2Right.position.y -= player2Right.speed * GetFrameTime();
-            }
+            RestartSimulation(simulation);      // The simulation resets the game objects to their starting positions etc.
+        }
 
-            // Logic for collisions of sprites
-            //------------------------------------------------------------------------------------------------
-            // Check for collision between player 1 and ball 1
-            if (CheckCollisionCircleRec(ball1.position, ball1.radius, player1Left.GetRectangle()))      // Check collision between circle and rectangle
-            {
-                // If ball 1 is travelling to the left i.e. negative x velocity
-                if (ball1.velocity.x < 0)
-                {
-                    // Make ball 1 travel right - change its direction
-                    ball1.velocity.x *= -1;
-                    // If the ball's speed is less than max velocity limits for the ball (so that the ball doesn't reach unplayable speeds)
-                    if (ball1.velocity.x <= 800 || ball1.velocity.y <= 800)
-                    {
-                        // Increase the horizontal velocity of ball 1 by 10%
-                        ball1.velocity.x *= 1.1;
-                        // Give ball 1 postive or negative y velocity if it hits the top or bottom half of player 1 respectively
-                        ball1.velocity.y = ball1.velocity.x * ((ball1.position.y - player1Left.position.y) / (player1Left.size.y / 2));
-                    }
-                }
-                PlaySound(hitBallFX);      // Play WAV sound to mark the collision of ball and player
-            }
+        // Only draw the frame if it would look different to the one on screen
+        bool redraw = !idleRendering || snapshot.version != drawnVersion || currentScreen != drawnScreen
+                      || GetTime() - drawnTime >= idleRedrawPeriod || LiveParticles(particles) > 0;
 
-            // Check for collision between player 1 and ball 2
-            if (CheckCollisionCircleRec(ball2.position, ball2.radius, player1Left.GetRectangle()))      // Check collision between circle and rectangle
-            {
-                // If ball 2 is travelling to the left i.e. negative x velocity
-                if (ball2.velocity.x < 0)
-                {
-                    // Make ball 2 travel right - change its direction
-                    ball2.velocity.x *= -1;
-                    // If the ball's speed is less than max velocity limits for the ball (so that the ball doesn't reach unplayable speeds)
-                    if (ball2.velocity.x <= 800 || ball2.velocity.y <= 800)
-                    {
-                        // Increase the horizontal velocity of ball 2 by 10%
-                        ball2.velocity.x *= 1.1;
-                        // Give ball 2 postive or negative y velocity if it hits the top or bottom half of player 1 respectively
-                        ball2.velocity.y = ball2.velocity.x * ((ball2.position.y - player1Left.position.y) / (player1Left.size.y / 2));
-                    }
-                }
-                PlaySound(hitBallFX);      // Play WAV sound to mark the collision of ball and player
-            }
+        // Nothing moves on the title and controls screens or once the game is won (unless it is being rewound), so sleep until something changes
+        idle = !redraw && (currentScreen != GAMEPLAY || (game.gameWon && !simulation.rewinding.load()));
 
-            // Check for collision between player 2 and ball 1
-            if (CheckCollisionCircleRec(ball1.position, ball1.radius, player2Right.GetRectangle()))     // Check collision between circle and rectangle
-            {
-                // If ball 1 is travelling to the right i.e. positive x velocity
-                if (ball1.velocity.x > 0)
-                {
-                    // Make ball 1 travel left - change its direction
-                    ball1.velocity.x *= -1;
-                    // If the ball's speed is less than max velocity limits for the ball (so that the ball doesn't reach unplayable speeds)
-                    if (ball1.velocity.x <= 800 || ball1.velocity.y <= 800)
-                    {
-                        // Increase the horizontal velocity of ball 1 by 10%
-                        ball1.velocity.x *= 1.1;
-                        // Give ball 1 postive or negative y velocity if it hits the top or bottom half of player 2 respectively
-                        ball1.velocity.y =  (-ball1.velocity.x) * ((ball1.position.y - player2Right.position.y) / (player2Right.size.y / 2));
-                    }
-                }
-                PlaySound(hitBallFX);      // Play WAV sound to mark the collision of ball and player
-            }
-
-            // Check for collision between player 2 and ball 2
-            if (CheckCollisionCircleRec(ball2.position, ball2.radius, player2Right.GetRectangle()))     // Check collision between circle and rectangle
-            {
-                // If ball 2 is travelling to the right i.e. positive x velocity
-                if (ball2.velocity.x > 0)
-                {
-                    // Make ball 2 travel left - change its direction
-                    ball2.velocity.x *= -1;
-                    // If the ball's speed is less than max velocity limits for the ball (so that the ball doesn't reach unplayable speeds)
-                    if (ball2.velocity.x <= 800 || ball2.velocity.y <= 800)
-                    {
-                        // Increase the horizontal velocity of ball 2 by 10%
-                        ball2.velocity.x *= 1.1;
-                        // Give ball 2 postive or negative y velocity if it hits the top or bottom half of player 2 respectively
-                        ball2.velocity.y =  (-ball2.velocity.x) * ((ball2.position.y - player2Right.position.y) / (player2Right.size.y / 2));
-                    }
-                }
-                PlaySound(hitBallFX);      // Play WAV sound to mark the collision of ball and player
-            }
-        }
-        else        // The game has been won (in the previous frame)
+        if (measurePower)
         {
-            // Logic for new game/round reset
-            //------------------------------------------------------------------------------------------------
-            if (IsKeyPressed(KEY_ENTER))        // Game updates do not happen until the user presses enter
-            {
-                InitialiseGameObjects();        // Reset the game objects to their starting positions etc.
-                gameWon = false;                // Reset the game won state to false i.e. new game
-            }
+            PowerState state = (currentScreen == TITLE) ? POWER_TITLE : (currentScreen == CONTROLS) ? POWER_CONTROLS
+                               : game.gameWon ? POWER_WON : POWER_PLAYING;
+            PowerWakeup(state, redraw);
         }
 
+        if (!redraw) continue;      // The display keeps showing the last frame
+
+        drawnVersion = snapshot.version;
+        drawnScreen = currentScreen;
+        drawnTime = GetTime();
+
         // Draw game (one frame at a time)
         //------------------------------------------------------------------------------------------------
         BeginDrawing();     // Set up canvas (framebuffer) to start drawing
@@ -380,124 +428,62 @@ int main()
             switch (currentScreen)
             {
                 case TITLE:
-                    // Draw title game text (using default font) in the middle of the screen
-                    DrawText("PONGDEMONIUM", (screenWidth / 2) - (MeasureText("PONGDEMONIUM", 60) / 2), (screenHeight / 2) - 35, 60, GOLD);
+                    DrawTitleScreen();
                     break;
                 case CONTROLS:
-                {
-                    // Draw control screen text (using default font) and textures relating keyboard bindings to the user in specific locations on the screen
-                    DrawText("CONTROLS", (screenWidth / 2) - (MeasureText("CONTROLS", 50) / 2), (screenHeight / 8), 50, GOLD);
-                    DrawText("Press ENTER", (screenWidth / 2) - (MeasureText("Press ENTER", 25) / 2), (screenHeight / 2), 25, MAGENTA);
-
-                    DrawText("PLAYER 1", (((screenWidth / 2) - (MeasureText("Press ENTER", 25) / 2)) / 2 - 35), (screenHeight * 0.325), 30, BLUE);
-                    DrawTexture(wKey, (((screenWidth / 2) - (MeasureText("Press ENTER", 25) / 2)) / 2), (screenHeight * 0.425), WHITE);
-                    DrawTexture(sKey, (((screenWidth / 2) - (MeasureText("Press ENTER", 25) / 2)) / 2), (screenHeight * 0.525), WHITE);
-
-                    DrawText("PLAYER 2", (((screenWidth / 2) - (MeasureText("Press ENTER", 25) / 2)) / 2 - 35) + screenWidth / 2, (screenHeight * 0.325), 30, RED);
-                    DrawTexture(upArrow, (((screenWidth / 2) - (MeasureText("Press ENTER", 25) / 2)) / 2) + screenWidth / 2, (screenHeight * 0.425), WHITE);
-                    DrawTexture(downArrow, (((screenWidth / 2) - (MeasureText("Press ENTER", 25) / 2)) / 2) + screenWidth / 2, (screenHeight * 0.525), WHITE);
-                }   break;
+                    DrawControlsScreen(uiAtlas);
+                    break;
                 case GAMEPLAY:
-                {
-                    // Draw centre court line
-                    DrawLine(screenWidth / 2, 0, screenWidth / 2, screenHeight, GREEN);     // Draw a line
-
-                    player1Left.Draw(BLUE);     // Draw the rectangle for player 1 (Draw is calling DrawRectangleRec)
-                    player2Right.Draw(RED);     // Draw the rectangle for player 2 (Draw is calling DrawRectangleRec)
-
-                    // If ball 1 is active i.e. not the end of the game
-                    if (ball1.visible)
-                    {
-                        ball1.Draw(GOLD);       // Draw the circle for ball 1 (Draw is calling DrawCircle)
-                    }
-                    // If ball 2 is active i.e. after either player reaches a score of 3
-                    if (ball2.visible)
-                    {
-                        ball2.Draw(MAGENTA);    // Draw the circle for ball 2 (Draw is calling DrawCircle)
-                    }
-
-                    DrawText(TextFormat("%i", player1LeftScore), (screenWidth / 2) - 40, 10, 40, BLUE);     // Draw text to display player 1's score (using default font)
-                    DrawText(TextFormat("%i", player2RightScore), (screenWidth / 2) + 20, 10, 40, RED);     // Draw text to display player 2's score (using default font)
-
-                    // When either player 1 or player 2 reaches a score of 3
-                    if (player1LeftScore >= 3 || player2RightScore >= 3)
-                    {
-                        frameCounterBall2++;            // Count the number of frames that have been rendered
-                        if (frameCounterBall2 == 60)    // Wait one second (60 frames) before making ball 2 active
-                        {
-                            ball2.visible = true;       // This will allow ball 2 to be drawn on screen and move around etc.
-                        }
-                    }
-
-                    // If player 1 reaches a score of 10 - they win the game
-                    if (player1LeftScore == 10)
-                    {
-                        // Draw text informing the players of the win and how to restart
-                        DrawText("PLAYER 1 WINS!", (screenWidth / 2) - (MeasureText("PLAYER 1 WINS!", 50) / 2), (screenHeight / 2) - 50, 50, GOLD);
-                        DrawText("Press ENTER to play again", (screenWidth / 2) - (MeasureText("Press ENTER to play again", 25) / 2), (screenHeight / 2) + 25, 25, MAGENTA);
-                        gameWon = true;             // Stop the game i.e. stop updating it, but continue to draw it
-                        ball1.visible = false;      // Don't draw ball 1 until the game restarts
-                        ball2.visible = false;      // Don't draw ball 2 until the game restarts
-                    }
-                    // If player 2 reaches a score of 10 - they win the game
-                    if (player2RightScore == 10)
-                    {
-                        // Draw text informing the players of the win and how to restart
-                        DrawText("PLAYER 2 WINS!", (screenWidth / 2) - (MeasureText("PLAYER 2 WINS!", 50) / 2), (screenHeight / 2) - 50, 50, GOLD);
-                        DrawText("Press ENTER to play again", (screenWidth / 2) - (MeasureText("Press ENTER to play again", 25) / 2), (screenHeight / 2) + 25, 25, MAGENTA);
-                        gameWon = true;             // Stop the game i.e. stop updating it, but continue to draw it
-                        ball1.visible = false;      // Don't draw ball 1 until the game restarts
-                        ball2.visible = false;      // Don't draw ball 2 until the game restarts
-                    }
-
-                    // Logic for scoring and auto ball reset
-                    //------------------------------------------------------------------------------------------------
-                    // If ball 1 passes player 2 (exits the screen on the right)
-                    if (ball1.position.x > screenWidth)
-                    {
-                        player1LeftScore++;         // Player 1 scores
-                        ball1.Reset();              // Reset position of ball 1
-                        PlaySound(spawnBallFX);     // Play WAV sound to mark ball 1 coming back into play
-                    }
-                    // If ball 2 passes player 2 (exits the screen on the right)
-                    if (ball2.position.x > screenWidth)
-                    {
-                        player1LeftScore++;         // Player 1 scores
-                        ball2.Reset();              // Reset position of ball 2
-                        PlaySound(spawnBallFX);     // Play WAV sound to mark ball 2 coming back into play
-                    }
-                    // If ball 1 passes player 1 (exits the screen on the left)
-                    if (ball1.position.x < 0)
-                    {
-                        player2RightScore++;        // Player 2 scores
-                        ball1.Reset();              // Reset position of ball 1
-                        PlaySound(spawnBallFX);     // Play WAV sound to mark ball 1 coming back into play
-                    }
-                    // If ball 2 passes player 1 (exits the screen on the left)
-                    if (ball2.position.x < 0)
-                    {
-                        player2RightScore++;        // Player 2 scores
-                        ball2.Reset();              // Reset position of ball 2
-                        PlaySound(spawnBallFX);     // Play WAV sound to mark ball 2 coming back into play
-                    }
-                }   break;
+                    UpdateParticles(particles, drawnTime);      // Move the particles on to this frame
+                    RecordBallTrails(game);
+                    DrawGameplayScreen(game, scaler, simulation.rewinding.load(), drawnTime);
+                    break;
                 default:
                     break;
             }
 
+        if (measureLatency) LatencyDrawSubmitted();
+
         EndDrawing();       // End canvas drawing and swap buffers (double buffering)
+        CountFlush();
+
+        FrameSwapped();
+        if (measureLatency) LatencyFrameEnd();
+
+        // Adjust the gameplay resolution to the cost of this frame (the first frame of a game has no previous swap to go by)
+        bool framePlaying = currentScreen == GAMEPLAY && !game.gameWon;
+        if (framePlaying && lastFramePlaying)
+        {
+            if (pacing == PACING_VSYNC) UpdateResolutionScale(scaler, inputSampler.lastFrameInterval, 1.5 * inputSampler.refreshPeriod);
+            else UpdateResolutionScale(scaler, inputSampler.lastWorkTime, (pacing == PACING_FPS) ? framePeriod : inputSampler.refreshPeriod);
+        }
+        lastFramePlaying = framePlaying;
+    }
+
+    AllocationFrame(-1);            // Stop counting frames before shutting down frees everything
+    StopSimulation(simulation);     // Stop the simulation thread
+
+    if (measurePower)
+    {
+        WritePowerReport(idleRendering);        // Print frames, wake-ups and CPU use on each screen
     }
 
+    if (measureLatency)
+    {
+        WriteLatencyReport("latency.csv");      // Print latency percentiles and save the histograms
+    }
+
+    WriteAllocationReport(screenNames, 3);      // Print allocations on each screen and where they were made (nothing without TRACK_ALLOCATIONS)
+
     // Deinitialise game
     //------------------------------------------------------------------------------------------------
-    UnloadSound(hitBallFX);         // Unload hitBallFX sound data
-    UnloadSound(spawnBallFX);       // Unload spawnBallFX sound data
+    StopMixer(mixer);               // Unload the sound effects' stream (the sounds themselves are freed with the mixer)
     UnloadMusicStream(music);       // Unload music stream from RAM
 
-    UnloadTexture(upArrow);         // Unload upArrow texture from GPU memory (VRAM)
-    UnloadTexture(downArrow);       // Unload downArrow texture from GPU memory (VRAM)
-    UnloadTexture(wKey);            // Unload wKey texture from GPU memory (VRAM)
-    UnloadTexture(sKey);            // Unload sKey texture from GPU memory (VRAM)
+    UnloadTexture(uiAtlas);         // Unload UI atlas texture from GPU memory (VRAM)
+    UnloadParticleMeshes(particles);    // Unload the particle meshes from RAM and GPU memory
+    UnloadTrailMeshes(trails);          // Unload the trail meshes from RAM and GPU memory
+    UnloadResolutionScaler(scaler); // Unload offscreen gameplay texture from GPU memory (VRAM)
 
     CloseAudioDevice();     // Close the audio device and context
 
@@ -0,0 +1,343 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium simulation: the rules of the game without any window, audio or keyboard
+*
+*   Shared by the game (pongdemonium.cpp) and the headless tools (tournament.cpp etc.), so a bot
+*   match run on a server steps exactly the same code as a match played at the keyboard.
+*   Only raylib types are used here, no raylib functions, so headless tools don't link raylib.
+*
+******************************************************************************************************/
+
+#ifndef PONGSIM_H
+#define PONGSIM_H
+
+#include <math.h>
+#include "include/raylib.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int screenWidth = 1000;       // Set screen width
+const int screenHeight = 600;       // Set screen height
+
+const float simTickTime = 1.0f / 60.0f;     // Length of one headless simulation tick (the game's 60 FPS)
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for a ball and its variables
+struct Ball
+{
+    Vector2 position;       // vector containing the x and y position of a ball
+    Vector2 velocity;       // vector containing the x and y velocity of a ball
+    float radius;           // radius of a ball
+    bool visible;           // boolean to store whether a ball is active
+
+    // Function to conveniently reinitialise a ball's variables to starting values
+    void Reset(float startSpeed)
+    {
+        position.x = screenWidth / 2;
+        position.y = screenHeight / 2;
+        velocity.x = startSpeed;
+        velocity.y = startSpeed;
+    }
+};
+
+// Create a structure for a player and its variables
+struct Player
+{
+    Vector2 position;       // vector containing the x and y position of a player
+    Vector2 size;           // vector containing the width and height of a player (rectangle)
+    int speed;              // speed a player can move at
+
+    // Function to conveniently get a player, defined by it's position and size
+    Rectangle GetRectangle() const
+    {
+        return Rectangle{ position.x - (size.x / 2), position.y - (size.y / 2), size.x, size.y };
+    }
+};
+
+// Create a structure for the balance constants of a match, the defaults are the classic game
+struct MatchRules
+{
+    float ballSpeed = 400;          // starting x and y velocity of a ball
+    double speedUp = 1.1;           // factor a ball's x velocity is multiplied by when it hits a player
+    float speedCap = 800;           // velocity a ball stops speeding up at
+    float paddleWidth = 15;         // width of a player
+    float paddleHeight = 150;       // height of a player
+    int paddleSpeed = 1000;         // speed a player can move at
+    int ball2Score = 3;             // score either player needs before ball 2 comes into play
+    int ball2Delay = 60;            // 60 FPS frames to wait after that score before ball 2 comes into play
+    int winScore = 10;              // score that wins the game
+};
+
+// Create a structure for the keys a player is holding down during one tick
+// Each is the fraction of the tick the key was held for: 1 for the whole tick, 0 if not held
+struct PaddleInput
+{
+    float up;       // W or UP arrow
+    float down;     // S or DOWN arrow
+};
+
+// Create a structure counting what happened during one tick, so the caller can play sounds etc.
+struct TickEvents
+{
+    int ballHits;       // number of times a ball bounced off a player
+    int ballResets;     // number of times a ball was scored and put back in the centre
+    int hitMask;        // which balls bounced off a player (bit 0 is ball 1, bit 1 is ball 2)
+    int resetMask;      // which balls were scored (bit 0 is ball 1, bit 1 is ball 2)
+};
+
+// Create a structure holding the complete state of one match
+struct Game
+{
+    MatchRules rules;                       // The balance constants the match is played with
+    Player player1Left, player2Right;       // The two player objects
+    Ball ball1, ball2;                      // The two ball objects
+    int player1LeftScore, player2RightScore, frameCounterBall2;     // Counters for scores and frames
+    bool gameWon;                           // Boolean to store game won state
+    int winner;                             // 1 or 2 once the game is won, otherwise 0
+    int tick;                               // Number of ticks simulated since the game started
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Set the starting values of the objects and variables in the game
+// and group in a method to be able to easily reset the game on restart
+inline void InitialiseGame(Game &game, const MatchRules &rules = MatchRules())
+{
+    game.rules = rules;
+
+    // Initialise variables of player 1
+    game.player1Left.position.x = 25;
+    game.player1Left.position.y = screenHeight / 2;
+    game.player1Left.size.x = rules.paddleWidth;
+    game.player1Left.size.y = rules.paddleHeight;
+    game.player1Left.speed = rules.paddleSpeed;
+
+    // Initialise variables of player 2
+    game.player2Right.position.x = screenWidth - 25;
+    game.player2Right.position.y = screenHeight / 2;
+    game.player2Right.size.x = rules.paddleWidth;
+    game.player2Right.size.y = rules.paddleHeight;
+    game.player2Right.speed = rules.paddleSpeed;
+
+    // Initialise variables of ball 1
+    game.ball1.position.x = screenWidth / 2;
+    game.ball1.position.y = screenHeight / 2;
+    game.ball1.radius = 10;
+    game.ball1.velocity.x = rules.ballSpeed;
+    game.ball1.velocity.y = rules.ballSpeed;
+    game.ball1.visible = true;
+
+    // Initialise variables of ball 2
+    game.ball2.position.x = screenWidth / 2;
+    game.ball2.position.y = screenHeight / 2;
+    game.ball2.radius = 10;
+    game.ball2.velocity.x = rules.ballSpeed;
+    game.ball2.velocity.y = rules.ballSpeed;
+    game.ball2.visible = false;
+
+    // Initialise counters
+    game.player1LeftScore = 0;
+    game.player2RightScore = 0;
+    game.frameCounterBall2 = 0;
+    game.gameWon = false;
+    game.winner = 0;
+    game.tick = 0;
+}
+
+// Check collision between a ball and a player rectangle
+// Same test as raylib's CheckCollisionCircleRec (v4.2), kept here so headless tools don't need raylib
+inline bool CheckCollisionBallPlayer(const Ball &ball, const Player &player)
+{
+    Rectangle rec = player.GetRectangle();
+
+    int recCenterX = (int)(rec.x + rec.width / 2.0f);
+    int recCenterY = (int)(rec.y + rec.height / 2.0f);
+
+    float dx = fabsf(ball.position.x - (float)recCenterX);
+    float dy = fabsf(ball.position.y - (float)recCenterY);
+
+    if (dx > (rec.width / 2.0f + ball.radius)) return false;
+    if (dy > (rec.height / 2.0f + ball.radius)) return false;
+
+    if (dx <= (rec.width / 2.0f)) return true;
+    if (dy <= (rec.height / 2.0f)) return true;
+
+    float cornerDistanceSq = (dx - rec.width / 2.0f) * (dx - rec.width / 2.0f) + (dy - rec.height / 2.0f) * (dy - rec.height / 2.0f);
+
+    return (cornerDistanceSq <= (ball.radius * ball.radius));
+}
+
+// Keep a player inside the top and bottom of the screen
+inline void ClampPlayer(Player &player)
+{
+    // Set bottom bound for the player
+    if (player.position.y > screenHeight - (player.size.y / 2))
+    {
+        player.position.y = screenHeight - (player.size.y / 2);
+    }
+    // Set top bound for the player
+    else if (player.position.y < 0 + (player.size.y / 2))
+    {
+        player.position.y = 0 + (player.size.y / 2);
+    }
+}
+
+// Move a ball around the screen and bounce it off the top and bottom of the screen
+inline void MoveBall(Ball &ball, float frameTime)
+{
+    // Change position by adding velocity in x and y directions, scaled by the time between frames
+    ball.position.x += ball.velocity.x * frameTime;
+    ball.position.y += ball.velocity.y * frameTime;
+
+    // Set bottom bound for the ball
+    if (ball.position.y > screenHeight - ball.radius)
+    {
+        ball.position.y = screenHeight - ball.radius;
+        // Change the direction of the ball, so that it bounces up from the bottom of the screen
+        ball.velocity.y *= -1;
+    }
+    // Set top bound for the ball
+    else if (ball.position.y < 0 + ball.radius)
+    {
+        ball.position.y = 0 + ball.radius;
+        // Change the direction of the ball, so that it bounces down from the top of the screen
+        ball.velocity.y *= -1;
+    }
+}
+
+// Move a player up or down depending on the keys held
+inline void MovePlayer(Player &player, PaddleInput input, float frameTime)
+{
+    if (input.down > 0)
+    {
+        // Move the player down by increasing it's y postion by it's speed (for as long as the key was held)
+        player.position.y += player.speed * frameTime * input.down;
+    }
+    if (input.up > 0)
+    {
+        // Move the player up by decreasing it's y postion by it's speed (for as long as the key was held)
+        player.position.y -= player.speed * frameTime * input.up;
+    }
+}
+
+// Bounce a ball off a player if they collide, returns true if the ball was sent back
+// direction is 1 for the left player (ball is sent right) and -1 for the right player (ball is sent left)
+inline bool BounceBallOffPlayer(Ball &ball, const Player &player, int direction, const MatchRules &rules)
+{
+    if (!CheckCollisionBallPlayer(ball, player))
+    {
+        return false;
+    }
+
+    // Only bounce a ball travelling towards the player, i.e. against the direction it is sent back in
+    if (ball.velocity.x * direction >= 0)
+    {
+        return false;
+    }
+
+    // Make the ball travel back the other way - change its direction
+    ball.velocity.x *= -1;
+    // If the ball's speed is less than max velocity limits for the ball (so that the ball doesn't reach unplayable speeds)
+    if (ball.velocity.x <= rules.speedCap || ball.velocity.y <= rules.speedCap)
+    {
+        // Increase the horizontal velocity of the ball (by 10% in the classic game)
+        ball.velocity.x *= rules.speedUp;
+        // Give the ball postive or negative y velocity if it hits the top or bottom half of the player respectively
+        ball.velocity.y = (direction * ball.velocity.x) * ((ball.position.y - player.position.y) / (player.size.y / 2));
+    }
+    return true;
+}
+
+// Score a ball that has left the screen and put it back in the centre, returns true if it was scored
+inline bool ScoreBall(Game &game, Ball &ball)
+{
+    // If the ball passes player 2 (exits the screen on the right)
+    if (ball.position.x > screenWidth)
+    {
+        game.player1LeftScore++;        // Player 1 scores
+        ball.Reset(game.rules.ballSpeed);       // Reset position of the ball
+        return true;
+    }
+    // If the ball passes player 1 (exits the screen on the left)
+    if (ball.position.x < 0)
+    {
+        game.player2RightScore++;       // Player 2 scores
+        ball.Reset(game.rules.ballSpeed);       // Reset position of the ball
+        return true;
+    }
+    return false;
+}
+
+// Update game state by one tick - the whole of one frame of gameplay
+inline TickEvents UpdateGame(Game &game, PaddleInput left, PaddleInput right, float frameTime)
+{
+    TickEvents events = { 0, 0, 0, 0 };
+
+    // Game updates do not happen once the game has been won
+    if (game.gameWon)
+    {
+        return events;
+    }
+
+    // Logic for position of game objects (sprites)
+    //------------------------------------------------------------------------------------------------
+    ClampPlayer(game.player1Left);
+    ClampPlayer(game.player2Right);
+
+    MoveBall(game.ball1, frameTime);
+    // Ball 1 is active from the start but ball 2 only becomes active after either player reaches a score of 3
+    if (game.ball2.visible)
+    {
+        MoveBall(game.ball2, frameTime);
+    }
+
+    // Logic for user input controls
+    //------------------------------------------------------------------------------------------------
+    MovePlayer(game.player1Left, left, frameTime);
+    MovePlayer(game.player2Right, right, frameTime);
+
+    // Logic for collisions of sprites
+    //------------------------------------------------------------------------------------------------
+    if (BounceBallOffPlayer(game.ball1, game.player1Left, 1, game.rules)) { events.ballHits++; events.hitMask |= 1; }
+    if (BounceBallOffPlayer(game.ball2, game.player1Left, 1, game.rules)) { events.ballHits++; events.hitMask |= 2; }
+    if (BounceBallOffPlayer(game.ball1, game.player2Right, -1, game.rules)) { events.ballHits++; events.hitMask |= 1; }
+    if (BounceBallOffPlayer(game.ball2, game.player2Right, -1, game.rules)) { events.ballHits++; events.hitMask |= 2; }
+
+    // Logic for scoring and auto ball reset
+    //------------------------------------------------------------------------------------------------
+    if (ScoreBall(game, game.ball1)) { events.ballResets++; events.resetMask |= 1; }
+    if (ScoreBall(game, game.ball2)) { events.ballResets++; events.resetMask |= 2; }
+
+    // When either player 1 or player 2 reaches a score of 3 (in the classic game)
+    if (game.player1LeftScore >= game.rules.ball2Score || game.player2RightScore >= game.rules.ball2Score)
+    {
+        game.frameCounterBall2++;       // Count the number of ticks that have been simulated
+
+        // Wait (one second in the classic game) before making ball 2 active, converted to ticks so any tick rate waits as long
+        // (at least one tick, and from then on, so a delay the counter has already passed still brings it into play)
+        int ball2DelayTicks = (int)(game.rules.ball2Delay / (60.0f * frameTime) + 0.5f);
+        if (ball2DelayTicks < 1) ball2DelayTicks = 1;
+        if (game.frameCounterBall2 >= ball2DelayTicks)
+        {
+            game.ball2.visible = true;          // This will allow ball 2 to be drawn on screen and move around etc.
+        }
+    }
+
+    // If either player reaches the winning score (10 in the classic game) - they win the game
+    if (game.player1LeftScore >= game.rules.winScore || game.player2RightScore >= game.rules.winScore)
+    {
+        game.gameWon = true;                // Stop the game i.e. stop updating it, but continue to draw it
+        game.winner = (game.player1LeftScore >= game.rules.winScore) ? 1 : 2;
+        game.ball1.visible = false;         // Don't draw ball 1 until the game restarts
+        game.ball2.visible = false;         // Don't draw ball 2 until the game restarts
+    }
+
+    game.tick++;
+    return events;
+}
+
+#endif // PONGSIM_H
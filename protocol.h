@@ -0,0 +1,222 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium protocol: the UDP packets between the match server and its clients
+*
+*   Every packet starts with a 4 byte header (magic, type, protocol version). Values are written
+*   little-endian one at a time, so the layout doesn't depend on struct padding or the machine.
+*
+*       JOIN     client -> server   nonce                       ask for a place in a match
+*       JOINED   server -> client   nonce, clientId, side       the place given (side 1 is left, 2 is right)
+*       INPUT    client -> server   clientId, sequence, stateAck, up, down
+*                                   keys held (0-255, fraction of a tick) and the newest state received
+*       STATE    server -> client   clientId, tick, ack, snapshot   state of the match after a tick
+*       LEAVE    client -> server   clientId                    give the place up
+*       WATCH    spectator -> server  nonce, table              watch a table (a match slot), repeated to stay
+*       WATCHING server -> spectator  nonce, spectatorId, table, ticksPerFrame
+*       SPECTATE server -> spectator  table, tick, snapshot     the same packet for every spectator of the table
+*       UNWATCH  spectator -> server  spectatorId               stop watching
+*
+*   After joining, every packet carries the client id the server handed out, so a client is found
+*   by its id rather than its address and a load generator can run many clients over one socket.
+*   INPUT is sent whenever the keys change (and regularly anyway, since packets can be lost); the
+*   server keeps applying the newest input it has seen, and acknowledges its sequence in STATE.
+*   STATE carries a snapshot (snapshot.h) delta encoded against the newest state the client has
+*   acknowledged, or a keyframe if the server no longer has that state. Spectators don't acknowledge
+*   anything: a SPECTATE snapshot is a keyframe or a delta against the latest keyframe of its table.
+*
+******************************************************************************************************/
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <string.h>
+#include "pongsim.h"
+#include "snapshot.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const unsigned short protocolMagic = 0x4F50;        // "PO" in the first two bytes of every packet
+const unsigned char protocolVersion = 2;
+const int defaultServerPort = 7777;
+const int maxPacketSize = 1200;                     // Stays under the usual MTU
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create an enum of the packet types
+enum PacketType { PACKET_JOIN = 1, PACKET_JOINED, PACKET_INPUT, PACKET_STATE, PACKET_LEAVE,
+                  PACKET_WATCH, PACKET_WATCHING, PACKET_SPECTATE, PACKET_UNWATCH };
+
+// Create a structure for writing a packet
+struct PacketWriter
+{
+    unsigned char *data;
+    int size;                       // bytes written so far
+    int capacity;
+    bool overflow;                  // set if a write didn't fit
+};
+
+// Create a structure for reading a packet
+struct PacketReader
+{
+    const unsigned char *data;
+    int size;
+    int position;                   // next byte to read
+    bool overflow;                  // set if a read ran past the end - the packet is malformed
+};
+
+// Create a structure for the fields of a STATE packet
+struct StateMessage
+{
+    unsigned int clientId;
+    unsigned int tick;              // server tick the state is from
+    unsigned int ack;               // newest input sequence the server has applied from this client
+    const unsigned char *snapshot;  // encoded snapshot, points into the packet
+    int snapshotSize;
+};
+
+// Create a structure for the fields of a SPECTATE packet
+struct SpectateMessage
+{
+    unsigned int table;
+    unsigned int tick;
+    const unsigned char *snapshot;  // encoded snapshot, points into the packet
+    int snapshotSize;
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Start writing a packet of a type into a buffer
+inline PacketWriter BeginPacket(unsigned char *buffer, int capacity, PacketType type)
+{
+    PacketWriter writer = { buffer, 0, capacity, false };
+    if (capacity < 4)
+    {
+        writer.overflow = true;
+        return writer;
+    }
+    buffer[0] = protocolMagic & 0xFF;
+    buffer[1] = protocolMagic >> 8;
+    buffer[2] = (unsigned char)type;
+    buffer[3] = protocolVersion;
+    writer.size = 4;
+    return writer;
+}
+
+inline void WriteU8(PacketWriter &writer, unsigned int value)
+{
+    if (writer.size + 1 > writer.capacity)
+    {
+        writer.overflow = true;
+        return;
+    }
+    writer.data[writer.size++] = (unsigned char)value;
+}
+
+inline void WriteU32(PacketWriter &writer, unsigned int value)
+{
+    if (writer.size + 4 > writer.capacity)
+    {
+        writer.overflow = true;
+        return;
+    }
+    for (int i = 0; i < 4; i++) writer.data[writer.size++] = (unsigned char)(value >> (8 * i));
+}
+
+// Start reading a packet, returns its type or 0 if it isn't a packet of this protocol
+inline int BeginReading(PacketReader &reader, const unsigned char *data, int size)
+{
+    reader.data = data;
+    reader.size = size;
+    reader.position = 4;
+    reader.overflow = false;
+
+    if (size < 4 || data[0] != (protocolMagic & 0xFF) || data[1] != (protocolMagic >> 8) || data[3] != protocolVersion) return 0;
+    return data[2];
+}
+
+inline unsigned int ReadU8(PacketReader &reader)
+{
+    if (reader.position + 1 > reader.size)
+    {
+        reader.overflow = true;
+        return 0;
+    }
+    return reader.data[reader.position++];
+}
+
+inline unsigned int ReadU32(PacketReader &reader)
+{
+    if (reader.position + 4 > reader.size)
+    {
+        reader.overflow = true;
+        return 0;
+    }
+    unsigned int value = 0;
+    for (int i = 0; i < 4; i++) value |= (unsigned int)reader.data[reader.position++] << (8 * i);
+    return value;
+}
+
+// Write a STATE packet, encoding the state against a baseline from some ticks before (or as a keyframe if baseline is 0)
+// Returns the packet's size or 0 if it didn't fit
+inline int WriteStatePacket(unsigned char *buffer, int capacity, unsigned int clientId, unsigned int tick, unsigned int ack,
+                            const QuantisedState &state, const QuantisedState *baseline, int ticksSinceBaseline)
+{
+    PacketWriter writer = BeginPacket(buffer, capacity, PACKET_STATE);
+    WriteU32(writer, clientId);
+    WriteU32(writer, tick);
+    WriteU32(writer, ack);
+    if (writer.overflow) return 0;
+
+    int size = EncodeSnapshot(state, baseline, ticksSinceBaseline, buffer + writer.size, capacity - writer.size);
+    return size ? writer.size + size : 0;
+}
+
+// Read the rest of a STATE packet (after BeginReading), the snapshot is decoded by the caller
+inline bool ReadStatePacket(PacketReader &reader, StateMessage &state)
+{
+    state.clientId = ReadU32(reader);
+    state.tick = ReadU32(reader);
+    state.ack = ReadU32(reader);
+    state.snapshot = reader.data + reader.position;
+    state.snapshotSize = reader.size - reader.position;
+    return !reader.overflow && state.snapshotSize > 0;
+}
+
+// Decode the snapshot of a STATE packet against the receiver's history, returns false if its baseline isn't kept
+inline bool DecodeStateSnapshot(const StateMessage &message, const SnapshotHistory &history, QuantisedState &state)
+{
+    int ticks = SnapshotBaselineTicks(message.snapshot, message.snapshotSize);
+    if (ticks < 0) return false;
+
+    const QuantisedState *baseline = ticks ? FindSnapshot(history, message.tick - ticks) : 0;
+    if (ticks && !baseline) return false;
+    return DecodeSnapshot(message.snapshot, message.snapshotSize, baseline, state);
+}
+
+// Read the rest of a SPECTATE packet (after BeginReading)
+inline bool ReadSpectatePacket(PacketReader &reader, SpectateMessage &message)
+{
+    message.table = ReadU32(reader);
+    message.tick = ReadU32(reader);
+    message.snapshot = reader.data + reader.position;
+    message.snapshotSize = reader.size - reader.position;
+    return !reader.overflow && message.snapshotSize > 0;
+}
+
+// Turn the fraction of a tick a key was held into the byte sent in INPUT, and back
+inline unsigned int QuantiseHeld(float fraction)
+{
+    if (fraction <= 0) return 0;
+    if (fraction >= 1) return 255;
+    return (unsigned int)(fraction * 255 + 0.5f);
+}
+
+inline float DequantiseHeld(unsigned int value)
+{
+    return value / 255.0f;
+}
+
+#endif // PROTOCOL_H
@@ -0,0 +1,180 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium render benchmark: fixed scenes drawn as fast as they go (--bench-render)
+*
+*   Every scene is drawn for a fixed number of frames with vsync off and no frame pacing, after a
+*   few frames of warm-up: the TITLE and CONTROLS screens, GAMEPLAY with both balls in play, a
+*   stress scene of 1000 and one of 100000 balls bouncing round the court, GAMEPLAY with the
+*   particle pool kept at 200000 live particles, and 4096 bouncing balls each with a trail. Frame
+*   time is from BeginDrawing to the end of EndDrawing (the buffer swap), plus moving the
+*   particles; draw calls, batch flushes and vertices are per frame, counted as rlgl would batch
+*   them (drawcount.h).
+*
+*   Results are printed and written as JSON, so the render path can be tracked across changes on
+*   hosts without a GPU, e.g. with Mesa's llvmpipe:
+*       LIBGL_ALWAYS_SOFTWARE=1 ./pongdemonium --bench-render render.json --bench-frames 300
+*
+******************************************************************************************************/
+
+#ifndef RENDERBENCH_H
+#define RENDERBENCH_H
+
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include "include/raylib.h"
+#include "drawcount.h"
+#include "pongsim.h"
+#include "particles.h"
+#include "trails.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int benchWarmupFrames = 10;               // Frames drawn before a scene is measured
+const int benchDefaultFrames = 300;             // Frames measured of each scene (--bench-frames)
+const float benchStressRadius = 10;             // Radius of the stress scenes' balls, the game's ball size
+const int benchParticleBurst = 500;             // Particles a burst while keeping the particle scene topped up
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create an enum of the scenes the benchmark draws
+enum BenchScene { BENCH_TITLE, BENCH_CONTROLS, BENCH_GAMEPLAY, BENCH_STRESS_1K, BENCH_STRESS_100K, BENCH_PARTICLES_200K, BENCH_TRAILS_4K, BENCH_SCENE_COUNT };
+
+const char *const benchSceneNames[BENCH_SCENE_COUNT] = { "title", "controls", "gameplay", "stress_1k", "stress_100k", "particles_200k", "trails_4k" };
+const int benchSceneBalls[BENCH_SCENE_COUNT] = { 0, 0, 2, 1000, 100000, 2, 4096 };
+const int benchSceneParticles[BENCH_SCENE_COUNT] = { 0, 0, 0, 0, 0, 200000, 0 };
+
+// Create a structure for the balls of a stress scene, field by field
+struct StressBalls
+{
+    std::vector<float> x, y, vx, vy;
+};
+
+// Create a structure for the measurements of one scene
+struct BenchResult
+{
+    BenchScene scene;
+    std::vector<double> frameTimes;         // seconds, one per measured frame
+    long long drawCalls, flushes, vertices; // over all measured frames
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Scatter balls over the court at random speeds and directions, the same every run
+inline void InitialiseStressBalls(StressBalls &balls, int count)
+{
+    balls.x.resize(count);
+    balls.y.resize(count);
+    balls.vx.resize(count);
+    balls.vy.resize(count);
+
+    unsigned int state = 0x9E3779B9u;
+    auto random = [&]()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (state >> 8) / 16777216.0f;
+    };
+    for (int i = 0; i < count; i++)
+    {
+        balls.x[i] = benchStressRadius + random() * (screenWidth - 2 * benchStressRadius);
+        balls.y[i] = benchStressRadius + random() * (screenHeight - 2 * benchStressRadius);
+        balls.vx[i] = (random() < 0.5f ? -1 : 1) * (100 + 300 * random());
+        balls.vy[i] = (random() < 0.5f ? -1 : 1) * (100 + 300 * random());
+    }
+}
+
+// Move the balls, bouncing them off every side of the court
+inline void UpdateStressBalls(StressBalls &balls, float frameTime)
+{
+    const float right = screenWidth - benchStressRadius, bottom = screenHeight - benchStressRadius;
+    for (size_t i = 0; i < balls.x.size(); i++)
+    {
+        balls.x[i] += balls.vx[i] * frameTime;
+        balls.y[i] += balls.vy[i] * frameTime;
+        if (balls.x[i] < benchStressRadius || balls.x[i] > right) balls.vx[i] = -balls.vx[i];
+        if (balls.y[i] < benchStressRadius || balls.y[i] > bottom) balls.vy[i] = -balls.vy[i];
+    }
+}
+
+inline void DrawStressBalls(const StressBalls &balls)
+{
+    for (size_t i = 0; i < balls.x.size(); i++)
+    {
+        DrawCircleCounted((int)balls.x[i], (int)balls.y[i], benchStressRadius, (i & 1) ? MAGENTA : GOLD);
+    }
+}
+
+// Add every ball's position to its trail, a slot each
+inline void RecordStressTrails(TrailPool &t, const StressBalls &balls)
+{
+    t.slots = (balls.x.size() < (size_t)trailCapacity) ? (int)balls.x.size() : trailCapacity;
+    for (int i = 0; i < t.slots; i++) RecordTrail(t, i, balls.x[i], balls.y[i], benchStressRadius, (i & 1) ? MAGENTA : GOLD);
+}
+
+// Spawn bursts of particles all over the court until a number of them are alive
+inline void TopUpParticles(ParticleSystem &p, int count, double time)
+{
+    const float pi = 3.14159265f;
+    while (LiveParticles(p) < count)
+    {
+        float x = screenWidth * RandomParticleFloat(p), y = screenHeight * RandomParticleFloat(p);
+        SpawnParticles(p, x, y, 0, pi, 50, 450, benchParticleBurst, (RandomParticleFloat(p) < 0.5f) ? BLUE : RED, time);
+    }
+}
+
+// Get a percentile of sorted frame times, in milliseconds
+inline double BenchPercentile(const std::vector<double> &sorted, double fraction)
+{
+    if (sorted.empty()) return 0;
+    size_t index = (size_t)(fraction * (sorted.size() - 1) + 0.5);
+    return 1000 * sorted[index];
+}
+
+// Print every scene's frame times and counts and write them to a JSON file, returns false if it couldn't be written
+inline bool WriteRenderBenchmark(std::vector<BenchResult> &results, int frames, const char *fileName)
+{
+    FILE *file = fopen(fileName, "w");
+    if (file)
+    {
+        fprintf(file, "{\n  \"raylib\": \"%s\",\n  \"width\": %d,\n  \"height\": %d,\n  \"frames\": %d,\n  \"scenes\": [\n",
+                RAYLIB_VERSION, screenWidth, screenHeight, frames);
+    }
+
+    printf("Render benchmark (%d frames a scene, vsync off)\n", frames);
+    printf("%-14s %7s %9s %8s %8s %8s %8s %8s %8s %8s %10s\n", "scene (ms)", "balls", "particles", "mean", "p50", "p95", "p99",
+           "max", "draws", "flushes", "vertices");
+    for (size_t r = 0; r < results.size(); r++)
+    {
+        BenchResult &result = results[r];
+        std::vector<double> &times = result.frameTimes;
+        std::sort(times.begin(), times.end());
+        double sum = 0;
+        for (size_t i = 0; i < times.size(); i++) sum += times[i];
+        double count = times.empty() ? 1 : (double)times.size();
+        double mean = 1000 * sum / count, maximum = times.empty() ? 0 : 1000 * times.back();
+
+        const char *name = benchSceneNames[result.scene];
+        int balls = benchSceneBalls[result.scene], particleCount = benchSceneParticles[result.scene];
+        printf("%-14s %7d %9d %8.3f %8.3f %8.3f %8.3f %8.3f %8.1f %8.1f %10.0f\n", name, balls, particleCount, mean, BenchPercentile(times, 0.5),
+               BenchPercentile(times, 0.95), BenchPercentile(times, 0.99), maximum, result.drawCalls / count,
+               result.flushes / count, result.vertices / count);
+
+        if (!file) continue;
+        fprintf(file, "    {\"name\": \"%s\", \"balls\": %d, \"particles\": %d, \"frames\": %zu, \"frameMs\": {\"mean\": %.4f, \"p50\": %.4f, "
+                "\"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}, \"drawCallsPerFrame\": %.2f, \"batchFlushesPerFrame\": %.2f, "
+                "\"verticesPerFrame\": %.1f}%s\n", name, balls, particleCount, times.size(), mean, BenchPercentile(times, 0.5),
+                BenchPercentile(times, 0.95), BenchPercentile(times, 0.99), maximum, result.drawCalls / count,
+                result.flushes / count, result.vertices / count, (r + 1 < results.size()) ? "," : "");
+    }
+
+    if (!file) return false;
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+#endif // RENDERBENCH_H
@@ -0,0 +1,252 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium replays: the inputs of a match and the hash of its state after every tick
+*
+*   A replay holds the rules and tick length a match was played with and, for every tick, both
+*   players' inputs (exactly, as the floats the simulation was given) and the chained hash of the
+*   states up to and including the tick (statehash.h). Replaying the inputs must give the same
+*   hashes; replaycheck does that and compares replays recorded by different runs or builds.
+*
+*   File layout, all little-endian: "PDRP", version, the MatchRules fields, tick length, tick
+*   count, then per tick the four input floats and the 64 bit hash (24 bytes a tick).
+*
+*   A replay can be saved into bytes the caller keeps, so a recording game that reserves them
+*   saves each won match without allocating; the file is written with the C library's low-level
+*   I/O, as fopen allocates a stream for every file it opens.
+*
+******************************************************************************************************/
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#if defined(_WIN32)
+    #include <io.h>
+#else
+    #include <unistd.h>
+    #define O_BINARY 0
+#endif
+#include "pongsim.h"
+#include "statehash.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const unsigned int replayMagic = 0x50524450;        // "PDRP" in the first four bytes of a replay file
+const unsigned int replayVersion = 1;
+const int replayHeaderBytes = 56;
+const int replayTickBytes = 24;
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for one tick of a replay
+struct ReplayTick
+{
+    PaddleInput left, right;        // inputs the tick was simulated with
+    unsigned long long hash;        // chained hash of the states after every tick so far
+};
+
+// Create a structure for a recorded match
+struct Replay
+{
+    MatchRules rules;
+    float tickTime;                 // frame time every tick was simulated with
+    std::vector<ReplayTick> ticks;
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Start recording a new match
+inline void BeginReplay(Replay &replay, const MatchRules &rules, float tickTime)
+{
+    replay.rules = rules;
+    replay.tickTime = tickTime;
+    replay.ticks.clear();
+}
+
+// Record a tick, after UpdateGame has simulated it
+inline void RecordReplayTick(Replay &replay, PaddleInput left, PaddleInput right, const Game &game)
+{
+    unsigned long long chain = replay.ticks.empty() ? 0 : replay.ticks.back().hash;
+    ReplayTick tick = { left, right, ChainStateHash(chain, HashState(game)) };
+    replay.ticks.push_back(tick);
+}
+
+inline void PutReplayU32(std::vector<unsigned char> &bytes, unsigned int value)
+{
+    for (int i = 0; i < 4; i++) bytes.push_back((unsigned char)(value >> (8 * i)));
+}
+
+inline void PutReplayU64(std::vector<unsigned char> &bytes, unsigned long long value)
+{
+    for (int i = 0; i < 8; i++) bytes.push_back((unsigned char)(value >> (8 * i)));
+}
+
+inline void PutReplayFloat(std::vector<unsigned char> &bytes, float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    PutReplayU32(bytes, bits);
+}
+
+// On a little-endian machine the bytes are already the value, so it is copied in one load
+inline unsigned int GetReplayU32(const unsigned char *&data)
+{
+    unsigned int value = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(&value, data, sizeof(value));
+    data += sizeof(value);
+#else
+    for (int i = 0; i < 4; i++) value |= (unsigned int)*data++ << (8 * i);
+#endif
+    return value;
+}
+
+inline unsigned long long GetReplayU64(const unsigned char *&data)
+{
+    unsigned long long value = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(&value, data, sizeof(value));
+    data += sizeof(value);
+#else
+    for (int i = 0; i < 8; i++) value |= (unsigned long long)*data++ << (8 * i);
+#endif
+    return value;
+}
+
+inline float GetReplayFloat(const unsigned char *&data)
+{
+    unsigned int bits = GetReplayU32(data);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Bytes a replay of a number of ticks takes
+inline size_t ReplayBytes(size_t ticks)
+{
+    return replayHeaderBytes + ticks * replayTickBytes;
+}
+
+// Write a replay to a file, encoding it into bytes (only allocates if they have less room than ReplayBytes), returns false if it couldn't be written
+inline bool SaveReplay(const Replay &replay, const char *fileName, std::vector<unsigned char> &bytes)
+{
+    bytes.clear();
+    bytes.reserve(ReplayBytes(replay.ticks.size()));
+
+    PutReplayU32(bytes, replayMagic);
+    PutReplayU32(bytes, replayVersion);
+    PutReplayFloat(bytes, replay.rules.ballSpeed);
+    unsigned long long speedUp;
+    memcpy(&speedUp, &replay.rules.speedUp, sizeof(speedUp));
+    PutReplayU64(bytes, speedUp);
+    PutReplayFloat(bytes, replay.rules.speedCap);
+    PutReplayFloat(bytes, replay.rules.paddleWidth);
+    PutReplayFloat(bytes, replay.rules.paddleHeight);
+    PutReplayU32(bytes, (unsigned int)replay.rules.paddleSpeed);
+    PutReplayU32(bytes, (unsigned int)replay.rules.ball2Score);
+    PutReplayU32(bytes, (unsigned int)replay.rules.ball2Delay);
+    PutReplayU32(bytes, (unsigned int)replay.rules.winScore);
+    PutReplayFloat(bytes, replay.tickTime);
+    PutReplayU32(bytes, (unsigned int)replay.ticks.size());
+
+    for (size_t t = 0; t < replay.ticks.size(); t++)
+    {
+        const ReplayTick &tick = replay.ticks[t];
+        PutReplayFloat(bytes, tick.left.up);
+        PutReplayFloat(bytes, tick.left.down);
+        PutReplayFloat(bytes, tick.right.up);
+        PutReplayFloat(bytes, tick.right.down);
+        PutReplayU64(bytes, tick.hash);
+    }
+
+    int file = open(fileName, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    if (file < 0) return false;
+    size_t written = 0;
+    while (written < bytes.size())
+    {
+        int chunk = (int)write(file, bytes.data() + written, (unsigned int)(bytes.size() - written));
+        if (chunk <= 0) break;
+        written += chunk;
+    }
+    if (close(file) != 0) return false;
+    return written == bytes.size();
+}
+
+inline bool SaveReplay(const Replay &replay, const char *fileName)
+{
+    std::vector<unsigned char> bytes;
+    return SaveReplay(replay, fileName, bytes);
+}
+
+// Read the header of a replay held in memory, leaving data at the first tick
+// Returns the number of ticks, or -1 if it isn't a replay or is cut short
+inline int ReadReplayHeader(const unsigned char *&data, size_t size, MatchRules &rules, float &tickTime)
+{
+    if (size < (size_t)replayHeaderBytes) return -1;
+    if (GetReplayU32(data) != replayMagic || GetReplayU32(data) != replayVersion) return -1;
+
+    rules.ballSpeed = GetReplayFloat(data);
+    unsigned long long speedUp = GetReplayU64(data);
+    memcpy(&rules.speedUp, &speedUp, sizeof(speedUp));
+    rules.speedCap = GetReplayFloat(data);
+    rules.paddleWidth = GetReplayFloat(data);
+    rules.paddleHeight = GetReplayFloat(data);
+    rules.paddleSpeed = (int)GetReplayU32(data);
+    rules.ball2Score = (int)GetReplayU32(data);
+    rules.ball2Delay = (int)GetReplayU32(data);
+    rules.winScore = (int)GetReplayU32(data);
+    tickTime = GetReplayFloat(data);
+    unsigned int count = GetReplayU32(data);
+    if ((size - replayHeaderBytes) / replayTickBytes < count || count > 0x7FFFFFFFu) return -1;
+    return (int)count;
+}
+
+// Read the next tick of a replay held in memory
+inline void ReadReplayTick(const unsigned char *&data, ReplayTick &tick)
+{
+    tick.left.up = GetReplayFloat(data);
+    tick.left.down = GetReplayFloat(data);
+    tick.right.up = GetReplayFloat(data);
+    tick.right.down = GetReplayFloat(data);
+    tick.hash = GetReplayU64(data);
+}
+
+// Read a replay from a file, returns false if it couldn't be read or isn't a replay
+inline bool LoadReplay(Replay &replay, const char *fileName)
+{
+    FILE *file = fopen(fileName, "rb");
+    if (!file) return false;
+    std::vector<unsigned char> bytes;
+    unsigned char buffer[65536];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) bytes.insert(bytes.end(), buffer, buffer + read);
+    fclose(file);
+
+    const unsigned char *data = bytes.data();
+    int count = ReadReplayHeader(data, bytes.size(), replay.rules, replay.tickTime);
+    if (count < 0) return false;
+
+    replay.ticks.resize(count);
+    for (int t = 0; t < count; t++) ReadReplayTick(data, replay.ticks[t]);
+    return true;
+}
+
+// Simulate a replay's first ticks with this build, returns the game after them
+inline Game ReplayGame(const Replay &replay, int ticks)
+{
+    Game game;
+    InitialiseGame(game, replay.rules);
+    for (int t = 0; t < ticks && t < (int)replay.ticks.size(); t++)
+    {
+        UpdateGame(game, replay.ticks[t].left, replay.ticks[t].right, replay.tickTime);
+    }
+    return game;
+}
+
+#endif // REPLAY_H
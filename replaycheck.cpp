@@ -0,0 +1,354 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium replay check: finds where runs of a match stop agreeing (desyncs)
+*
+*   With one replay it simulates the replay's inputs with this build and checks the state hash
+*   after every tick against the one recorded, stopping at the first tick that disagrees (e.g. a
+*   replay recorded by another compiler or optimisation level). With two replays of the same match
+*   (e.g. recorded by two peers) it bisects their hashes for the first tick they disagree on. Either
+*   way it prints the states around that tick, word by word, with the words that differ marked.
+*
+*   A replay only holds hashes, so when the same inputs drift apart the states it can print are this
+*   build's, before and after the tick. To see how the runs' states differ, dump the state after
+*   every tick of the replay with each build (--dump) and compare the dumps (--diff).
+*
+*   Usage: replaycheck FILE                 check a replay against this build
+*          replaycheck FILE OTHER           find the first tick two replays disagree on
+*          replaycheck --dump FILE STATES   write this build's state after every tick of a replay
+*          replaycheck --diff STATES OTHER  find the first tick two state dumps disagree on
+*          replaycheck --record FILE [--left C] [--right C] [--seed N]
+*                                           record a bot match (default predict and search, see controllers.h)
+*          replaycheck --bench              time hashing the state
+*
+*   Build: g++ replaycheck.cpp -o replaycheck.exe -O2
+*
+******************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "controllers.h"
+#include "replay.h"
+#include "statehash.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int maxMatchTicks = 60 * 60 * 10;         // A bot match still going after 10 minutes of game time is cut short
+const int benchMatches = 10;                    // Bot matches replayed by --bench
+const double benchSeconds = 1.0;                // Time each --bench measurement runs for at least
+const unsigned int stateDumpMagic = 0x54534450; // "PDST" in the first four bytes of a state dump, then the tick count and
+                                                // the canonical state after every tick (little-endian words)
+const int stateDumpHeaderBytes = 8;
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Play a bot match and record it
+Replay RecordBotMatch(const Controller &left, const Controller &right, unsigned int seed)
+{
+    Replay replay;
+    BeginReplay(replay, MatchRules(), simTickTime);
+
+    Game game;
+    InitialiseGame(game);
+    ControllerState leftState, rightState;
+    InitialiseControllerState(leftState, seed);
+    InitialiseControllerState(rightState, seed ^ 0x5BD1E995u);
+
+    while (!game.gameWon && game.tick < maxMatchTicks)
+    {
+        PaddleInput leftInput = ControlPaddle(left, leftState, game, 1);
+        PaddleInput rightInput = ControlPaddle(right, rightState, game, 2);
+        UpdateGame(game, leftInput, rightInput, simTickTime);
+        RecordReplayTick(replay, leftInput, rightInput, game);
+    }
+    return replay;
+}
+
+// Compare rules field by field (MatchRules has padding, which memcmp would compare too)
+bool SameRules(const MatchRules &a, const MatchRules &b)
+{
+    return a.ballSpeed == b.ballSpeed && a.speedUp == b.speedUp && a.speedCap == b.speedCap && a.paddleWidth == b.paddleWidth &&
+           a.paddleHeight == b.paddleHeight && a.paddleSpeed == b.paddleSpeed && a.ball2Score == b.ball2Score &&
+           a.ball2Delay == b.ball2Delay && a.winScore == b.winScore;
+}
+
+bool SameInputs(const ReplayTick &a, const ReplayTick &b)
+{
+    return memcmp(&a.left, &b.left, sizeof(PaddleInput)) == 0 && memcmp(&a.right, &b.right, sizeof(PaddleInput)) == 0;
+}
+
+// Simulate a replay with this build, returns 0 if every hash agrees
+int CheckReplay(const Replay &replay)
+{
+    Game game, previous;
+    InitialiseGame(game, replay.rules);
+    unsigned long long hash = 0;
+    for (size_t t = 0; t < replay.ticks.size(); t++)
+    {
+        previous = game;
+        UpdateGame(game, replay.ticks[t].left, replay.ticks[t].right, replay.tickTime);
+        hash = ChainStateHash(hash, HashState(game));
+        if (hash != replay.ticks[t].hash)
+        {
+            printf("Desync at tick %zu: recorded chain %016llX, this build %016llX\n", t + 1, replay.ticks[t].hash, hash);
+            printf("This build's state before and after the tick, * marking what the tick changed (not how the runs differ,\n");
+            printf("for that --dump the replay with both builds and --diff the dumps):\n");
+            PrintStateDifference(stdout, previous, "this build, before", game, "this build, after");
+            return 2;
+        }
+    }
+    printf("All %zu ticks agree\n", replay.ticks.size());
+    return 0;
+}
+
+// Find the first tick two replays disagree on, returns 0 if they never do
+int CompareReplays(const Replay &a, const Replay &b)
+{
+    if (!SameRules(a.rules, b.rules) || a.tickTime != b.tickTime)
+    {
+        printf("The replays were played with different rules or tick lengths\n");
+        return 2;
+    }
+
+    int count = (int)(a.ticks.size() < b.ticks.size() ? a.ticks.size() : b.ticks.size());
+    std::vector<unsigned long long> hashesA(count), hashesB(count);
+    int inputDivergence = -1;
+    for (int t = 0; t < count; t++)
+    {
+        hashesA[t] = a.ticks[t].hash;
+        hashesB[t] = b.ticks[t].hash;
+        if (inputDivergence < 0 && !SameInputs(a.ticks[t], b.ticks[t])) inputDivergence = t;
+    }
+
+    int t = FindFirstDivergence(hashesA.data(), hashesB.data(), count);
+    if (t < 0)
+    {
+        printf("The replays agree on all %d ticks they share (%zu and %zu ticks long)\n", count, a.ticks.size(), b.ticks.size());
+        return 0;
+    }
+
+    printf("Desync at tick %d: chains %016llX and %016llX\n", t + 1, hashesA[t], hashesB[t]);
+    if (inputDivergence >= 0 && inputDivergence <= t)
+    {
+        // The peers disagreed on the inputs - replay each one's inputs to show where that led
+        printf("The inputs already differ at tick %d, states from each replay's inputs:\n", inputDivergence + 1);
+        PrintStateDifference(stdout, ReplayGame(a, t + 1), "first replay", ReplayGame(b, t + 1), "second replay");
+    }
+    else
+    {
+        // Same inputs, different states: one run drifted, see which one this build agrees with
+        Game before = ReplayGame(a, t), after = ReplayGame(a, t + 1);
+        unsigned long long here = ChainStateHash(t > 0 ? hashesA[t - 1] : 0, HashState(after));
+        printf("The inputs agree, so a run drifted; this build's hash is %016llX (%s)\n", here,
+               here == hashesA[t] ? "agrees with the first" : here == hashesB[t] ? "agrees with the second" : "agrees with neither");
+        printf("This build's state before and after the tick, * marking what the tick changed (not how the runs differ,\n");
+        printf("for that --dump either replay with both builds and --diff the dumps):\n");
+        PrintStateDifference(stdout, before, "this build, before", after, "this build, after");
+    }
+    return 2;
+}
+
+// Write this build's canonical state after every tick of a replay, returns false if it couldn't be written
+bool DumpStates(const Replay &replay, const char *fileName)
+{
+    std::vector<unsigned char> bytes;
+    bytes.reserve(stateDumpHeaderBytes + replay.ticks.size() * canonicalWords * 4);
+    PutReplayU32(bytes, stateDumpMagic);
+    PutReplayU32(bytes, (unsigned int)replay.ticks.size());
+
+    Game game;
+    InitialiseGame(game, replay.rules);
+    for (size_t t = 0; t < replay.ticks.size(); t++)
+    {
+        UpdateGame(game, replay.ticks[t].left, replay.ticks[t].right, replay.tickTime);
+        CanonicalState state;
+        CanonicaliseState(game, state);
+        for (int w = 0; w < canonicalWords; w++) PutReplayU32(bytes, state.words[w]);
+    }
+
+    FILE *file = fopen(fileName, "wb");
+    if (!file) return false;
+    size_t written = fwrite(bytes.data(), 1, bytes.size(), file);
+    return fclose(file) == 0 && written == bytes.size();
+}
+
+// Read a state dump, returns false if it couldn't be read or isn't one
+bool LoadStateDump(std::vector<CanonicalState> &states, const char *fileName)
+{
+    FILE *file = fopen(fileName, "rb");
+    if (!file) return false;
+    std::vector<unsigned char> bytes;
+    unsigned char buffer[65536];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) bytes.insert(bytes.end(), buffer, buffer + read);
+    fclose(file);
+
+    if (bytes.size() < (size_t)stateDumpHeaderBytes) return false;
+    const unsigned char *data = bytes.data();
+    if (GetReplayU32(data) != stateDumpMagic) return false;
+    unsigned int count = GetReplayU32(data);
+    if ((bytes.size() - stateDumpHeaderBytes) / (canonicalWords * 4) < count) return false;
+
+    states.resize(count);
+    for (unsigned int t = 0; t < count; t++)
+    {
+        for (int w = 0; w < canonicalWords; w++) states[t].words[w] = GetReplayU32(data);
+    }
+    return true;
+}
+
+// Find the first tick two state dumps disagree on and print both runs' states there, returns 0 if they never do
+int CompareStateDumps(const std::vector<CanonicalState> &a, const std::vector<CanonicalState> &b)
+{
+    size_t count = a.size() < b.size() ? a.size() : b.size();
+    for (size_t t = 0; t < count; t++)
+    {
+        if (memcmp(a[t].words, b[t].words, sizeof(a[t].words)) == 0) continue;
+        printf("The states first differ after tick %zu, * marking the words that differ:\n", t + 1);
+        PrintCanonicalDifference(stdout, a[t], "first dump", b[t], "second dump");
+        return 2;
+    }
+    printf("The dumps agree on all %zu ticks they share (%zu and %zu ticks long)\n", count, a.size(), b.size());
+    return 0;
+}
+
+// Time the hash the way the simulation pays for it: replaying bot matches with and without hashing every tick
+int BenchHash()
+{
+    Controller left, right;
+    ParseController(left, "predict");
+    ParseController(right, "search");
+
+    std::vector<Replay> replays;
+    size_t ticks = 0;
+    for (int m = 0; m < benchMatches; m++)
+    {
+        replays.push_back(RecordBotMatch(left, right, 1000 + m));
+        ticks += replays.back().ticks.size();
+    }
+
+    double seconds[2] = { 0, 0 };
+    long long replayed[2] = { 0, 0 };
+    unsigned long long checksum = 0;
+    for (int hashing = 0; hashing < 2; hashing++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while (seconds[hashing] < benchSeconds)
+        {
+            for (size_t r = 0; r < replays.size(); r++)
+            {
+                const Replay &replay = replays[r];
+                Game game;
+                InitialiseGame(game, replay.rules);
+                for (size_t t = 0; t < replay.ticks.size(); t++)
+                {
+                    UpdateGame(game, replay.ticks[t].left, replay.ticks[t].right, replay.tickTime);
+                    if (hashing) checksum = ChainStateHash(checksum, HashState(game));
+                }
+                checksum += (unsigned long long)game.tick;
+            }
+            replayed[hashing] += (long long)ticks;
+            seconds[hashing] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+    double updateTime = seconds[0] / replayed[0], hashedTime = seconds[1] / replayed[1];
+
+    printf("%zu ticks of %d bot matches\n", ticks, benchMatches);
+    printf("update          %6.1f ns a tick\n", updateTime * 1e9);
+    printf("update and hash %6.1f ns a tick\n", hashedTime * 1e9);
+    printf("hash            %6.1f ns a tick   (checksum %04llX)\n", (hashedTime - updateTime) * 1e9, checksum & 0xFFFF);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0) return BenchHash();
+
+    if (argc >= 3 && strcmp(argv[1], "--record") == 0)
+    {
+        const char *fileName = argv[2];
+        const char *leftText = "predict", *rightText = "search";
+        unsigned int seed = 1;
+        for (int i = 3; i < argc; i++)
+        {
+            if (strcmp(argv[i], "--left") == 0 && i + 1 < argc) leftText = argv[++i];
+            else if (strcmp(argv[i], "--right") == 0 && i + 1 < argc) rightText = argv[++i];
+            else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = (unsigned int)strtoul(argv[++i], 0, 10);
+            else
+            {
+                fprintf(stderr, "Unknown option %s\n", argv[i]);
+                return 1;
+            }
+        }
+        Controller left, right;
+        if (!ParseController(left, leftText) || !ParseController(right, rightText))
+        {
+            fprintf(stderr, "Invalid controller\n");
+            return 1;
+        }
+        Replay replay = RecordBotMatch(left, right, seed);
+        if (!SaveReplay(replay, fileName))
+        {
+            fprintf(stderr, "Couldn't write %s\n", fileName);
+            return 1;
+        }
+        printf("Recorded %zu ticks to %s\n", replay.ticks.size(), fileName);
+        return 0;
+    }
+
+    if (argc == 4 && strcmp(argv[1], "--dump") == 0)
+    {
+        Replay replay;
+        if (!LoadReplay(replay, argv[2]))
+        {
+            fprintf(stderr, "Couldn't read replay %s\n", argv[2]);
+            return 1;
+        }
+        if (!DumpStates(replay, argv[3]))
+        {
+            fprintf(stderr, "Couldn't write %s\n", argv[3]);
+            return 1;
+        }
+        printf("Dumped the state after each of %zu ticks to %s\n", replay.ticks.size(), argv[3]);
+        return 0;
+    }
+
+    if (argc == 4 && strcmp(argv[1], "--diff") == 0)
+    {
+        std::vector<CanonicalState> a, b;
+        for (int i = 2; i < 4; i++)
+        {
+            if (!LoadStateDump(i == 2 ? a : b, argv[i]))
+            {
+                fprintf(stderr, "Couldn't read state dump %s\n", argv[i]);
+                return 1;
+            }
+        }
+        return CompareStateDumps(a, b);
+    }
+
+    if (argc < 2 || argc > 3 || argv[1][0] == '-')
+    {
+        fprintf(stderr, "Usage: replaycheck FILE [OTHER] | --dump FILE STATES | --diff STATES OTHER | --record FILE [--left C] [--right C] [--seed N] | --bench\n");
+        return 1;
+    }
+
+    Replay a, b;
+    if (!LoadReplay(a, argv[1]))
+    {
+        fprintf(stderr, "Couldn't read replay %s\n", argv[1]);
+        return 1;
+    }
+    if (argc == 2) return CheckReplay(a);
+
+    if (!LoadReplay(b, argv[2]))
+    {
+        fprintf(stderr, "Couldn't read replay %s\n", argv[2]);
+        return 1;
+    }
+    return CompareReplays(a, b);
+}
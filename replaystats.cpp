@@ -0,0 +1,701 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium replay statistics: analytics over a whole corpus of replays (replay.h)
+*
+*   Every replay file is memory mapped and re-simulated headless from its inputs, on all cores, each
+*   worker taking the next file. A worker adds what it sees into its own histograms - rally length
+*   (paddle hits before a ball is scored), where on the paddle a ball hits it (the offset
+*   (ball.y - paddle.y) / (height / 2) that sets the bounce angle), ball speed when scored - and
+*   what ball 2 did to the match (who led when it came into play, who won, the goals it scored).
+*   The workers' histograms are merged once they finish and written as columnar tables
+*   (columnar.h), with one row per replay in the matches table.
+*
+*   A worker re-simulates simLanes replays at once, one in each lane of the lane simulation
+*   (lanesim.h), reading their inputs straight from the mapped files; a lane whose replay ends takes
+*   the next file. Only the few ticks a ball is hit or scored in are looked at lane by lane. The
+*   state hashes recorded in the replays are only checked with --verify.
+*
+*   Usage: replaystats [options] FILE|DIRECTORY...     analyse replays (*.rpl in a directory)
+*          replaystats --generate N DIRECTORY          record N bot matches into a directory to try it on
+*       --threads N         worker threads (default all cores)
+*       --verify            check every tick's state hash against the replay (slower)
+*       --scalar            re-simulate one replay at a time with UpdateGame (specsim.h) instead of in lanes
+*       --out DIRECTORY     where to write the tables (default replaystats_out)
+*       --left/--right C    controllers playing --generate matches (default "predict:reaction=4,noise=40", see controllers.h)
+*       --seed N            seed for the --generate bots (default 1)
+*
+*   Linux only. Build: g++ replaystats.cpp -o replaystats -O2 -pthread
+*   With AVX (8 lanes instead of 4): g++ replaystats.cpp -o replaystats -O2 -march=native -ffp-contract=off -pthread
+*   (fused multiply-adds would no longer match the recorded matches, and --verify would fail them all)
+*
+******************************************************************************************************/
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "columnar.h"
+#include "controllers.h"
+#include "lanesim.h"
+#include "replay.h"
+#include "specsim.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int maxMatchTicks = 60 * 60 * 10;         // A --generate match still going after 10 minutes of game time is cut short
+const int rallyBins = 64;                       // Rally lengths 0 to 62 hits, and 63 or more
+const int offsetBins = 48;                      // Paddle offsets from -1.2 to 1.2 (a ball can hit the paddle's corner)
+const float offsetRange = 1.2f;
+const int goalSpeedBins = 64;                   // Speeds at goal from 0 to 3200 px/s
+const float goalSpeedBinWidth = 50;
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for what a worker has seen, merged with the other workers' at the end
+struct ReplayStats
+{
+    long long replays;                      // replays analysed
+    long long failed;                       // replays that couldn't be read (or disagreed with their hashes under --verify)
+    long long ticks;
+    double replaySeconds;                   // game time simulated
+    long long rallyLengths[rallyBins];
+    long long hitOffsets[offsetBins];
+    long long goalSpeeds[goalSpeedBins];
+    long long ball2Matches;                 // decided matches ball 2 came into play in
+    long long ball2LeaderWins;              // of those, won by the player leading when it came into play
+    long long ball2Ties;                    // of those, level when it came into play
+    long long goals[2];                     // goals scored by ball 1 and by ball 2
+};
+
+// Create a structure for one replay's row of the matches table
+struct MatchRow
+{
+    int ticks, winner, leftScore, rightScore;
+    int ball2Tick;                          // tick ball 2 came into play, -1 if it never did
+    int ball2Leader;                        // player leading then (1 or 2), 0 if level
+    int ball2GoalsLeft, ball2GoalsRight;    // goals ball 2 scored for each player
+    float rallyMean;
+    float tickTime;
+};
+
+// Create a structure for what is kept about a replay while it is re-simulated
+struct ReplayAnalysis
+{
+    MatchRow row;
+    int rallyHits[2];                       // paddle hits so far in each ball's current rally
+    int rallies, hits;
+};
+
+// Create a structure for a replay file mapped into memory
+struct MappedReplay
+{
+    void *mapping;
+    size_t size;
+};
+
+// Create a structure for the replay a lane of the lane simulation is working through
+struct LaneReplay
+{
+    MappedReplay file;
+    size_t index;                           // replay's place in the file list
+    const unsigned char *data;              // its next tick
+    int ticks;
+    Game game;                              // the match, only brought up to date from the lane when needed
+    ReplayAnalysis analysis;
+    unsigned long long recordedHash;        // hash the replay recorded for the tick being simulated (--verify)
+    unsigned long long chain;               // chained hash of the lane's states so far (--verify)
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+void MergeReplayStats(ReplayStats &total, const ReplayStats &stats)
+{
+    total.replays += stats.replays;
+    total.failed += stats.failed;
+    total.ticks += stats.ticks;
+    total.replaySeconds += stats.replaySeconds;
+    for (int i = 0; i < rallyBins; i++) total.rallyLengths[i] += stats.rallyLengths[i];
+    for (int i = 0; i < offsetBins; i++) total.hitOffsets[i] += stats.hitOffsets[i];
+    for (int i = 0; i < goalSpeedBins; i++) total.goalSpeeds[i] += stats.goalSpeeds[i];
+    total.ball2Matches += stats.ball2Matches;
+    total.ball2LeaderWins += stats.ball2LeaderWins;
+    total.ball2Ties += stats.ball2Ties;
+    total.goals[0] += stats.goals[0];
+    total.goals[1] += stats.goals[1];
+}
+
+int HistogramBin(float value, float low, float width, int bins)
+{
+    int bin = (int)floorf((value - low) / width);
+    return (bin < 0) ? 0 : (bin >= bins) ? bins - 1 : bin;
+}
+
+void BeginReplayAnalysis(ReplayAnalysis &analysis, float tickTime)
+{
+    memset(&analysis, 0, sizeof(analysis));
+    analysis.row.ball2Tick = -1;
+    analysis.row.tickTime = tickTime;
+}
+
+// Count a ball bouncing off a paddle, offset is where on the paddle it hit (-1 top edge, 1 bottom edge)
+void AnalyseHit(ReplayStats &stats, ReplayAnalysis &analysis, int ball, float offset)
+{
+    stats.hitOffsets[HistogramBin(offset, -offsetRange, 2 * offsetRange / offsetBins, offsetBins)]++;
+    analysis.rallyHits[ball]++;
+}
+
+// Count a ball being scored, from its velocity before the tick it was scored in
+void AnalyseGoal(ReplayStats &stats, ReplayAnalysis &analysis, int ball, float vx, float vy)
+{
+    stats.goalSpeeds[HistogramBin(sqrtf(vx * vx + vy * vy), 0, goalSpeedBinWidth, goalSpeedBins)]++;
+    int hits = analysis.rallyHits[ball];
+    stats.rallyLengths[(hits < rallyBins - 1) ? hits : rallyBins - 1]++;
+    stats.goals[ball]++;
+    analysis.rallies++;
+    analysis.hits += hits;
+    analysis.rallyHits[ball] = 0;
+
+    // A ball leaving by the right edge scores for the left player
+    if (ball == 1 && vx > 0) analysis.row.ball2GoalsLeft++;
+    else if (ball == 1) analysis.row.ball2GoalsRight++;
+}
+
+// Note ball 2 coming into play, and who was leading then
+void AnalyseBall2(ReplayAnalysis &analysis, int tick, int leftScore, int rightScore)
+{
+    analysis.row.ball2Tick = tick;
+    analysis.row.ball2Leader = (leftScore > rightScore) ? 1 : (leftScore < rightScore) ? 2 : 0;
+}
+
+// Finish a replay's row and count its match, game is its state after the last tick
+void FinishReplayAnalysis(ReplayStats &stats, ReplayAnalysis &analysis, const Game &game, int ticks)
+{
+    MatchRow &row = analysis.row;
+    row.ticks = game.tick;
+    row.winner = game.winner;
+    row.leftScore = game.player1LeftScore;
+    row.rightScore = game.player2RightScore;
+    row.rallyMean = analysis.rallies ? (float)analysis.hits / analysis.rallies : 0;
+
+    stats.replays++;
+    stats.ticks += ticks;
+    stats.replaySeconds += (double)ticks * row.tickTime;
+    if (row.ball2Tick >= 0 && row.winner != 0)
+    {
+        stats.ball2Matches++;
+        if (row.ball2Leader == 0) stats.ball2Ties++;
+        else if (row.ball2Leader == row.winner) stats.ball2LeaderWins++;
+    }
+}
+
+// Map a replay file into memory, returns false if it couldn't be
+bool MapReplayFile(const char *fileName, MappedReplay &file)
+{
+    int descriptor = open(fileName, O_RDONLY);
+    if (descriptor < 0) return false;
+
+    struct stat info;
+    if (fstat(descriptor, &info) != 0 || info.st_size == 0)
+    {
+        close(descriptor);
+        return false;
+    }
+
+    // The whole file is read once from start to end, so fault it all in up front
+    file.size = (size_t)info.st_size;
+    file.mapping = mmap(0, file.size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, descriptor, 0);
+    close(descriptor);
+    return file.mapping != MAP_FAILED;
+}
+
+void UnmapReplayFile(MappedReplay &file)
+{
+    munmap(file.mapping, file.size);
+}
+
+// Re-simulate one replay on its own, adding what happens to the stats, returns false if it isn't a replay
+// (or, checking hashes, if a tick disagrees)
+bool AnalyseReplay(const unsigned char *data, size_t size, bool verify, ReplayStats &stats, MatchRow &row)
+{
+    MatchRules rules;
+    float tickTime;
+    int count = ReadReplayHeader(data, size, rules, tickTime);
+    if (count < 0) return false;
+
+    Game game;
+    InitialiseGame(game, rules);
+    UpdateGameFunction update = SelectUpdateGame(rules);
+    ReplayAnalysis analysis;
+    BeginReplayAnalysis(analysis, tickTime);
+    unsigned long long chain = 0;
+
+    for (int t = 0; t < count; t++)
+    {
+        ReplayTick tick;
+        ReadReplayTick(data, tick);
+
+        // Velocities before the tick, a scored ball's is gone after it
+        Vector2 velocities[2] = { game.ball1.velocity, game.ball2.velocity };
+        TickEvents events = update(game, tick.left, tick.right, tickTime);
+
+        if (verify)
+        {
+            chain = ChainStateHash(chain, HashState(game));
+            if (chain != tick.hash) return false;
+        }
+
+        for (int b = 0; b < 2 && (events.hitMask | events.resetMask); b++)
+        {
+            const Ball &ball = b ? game.ball2 : game.ball1;
+            if (events.hitMask & (1 << b))
+            {
+                // The bounce sent the ball away from the player it hit
+                const Player &player = (ball.velocity.x > 0) ? game.player1Left : game.player2Right;
+                AnalyseHit(stats, analysis, b, (ball.position.y - player.position.y) / (rules.paddleHeight / 2));
+            }
+            if (events.resetMask & (1 << b)) AnalyseGoal(stats, analysis, b, velocities[b].x, velocities[b].y);
+        }
+
+        if (analysis.row.ball2Tick < 0 && game.ball2.visible) AnalyseBall2(analysis, game.tick, game.player1LeftScore, game.player2RightScore);
+    }
+
+    FinishReplayAnalysis(stats, analysis, game, count);
+    row = analysis.row;
+    return true;
+}
+
+// Analyse replay files one at a time until there are none left
+void AnalyseReplaysScalar(const std::vector<std::string> &files, std::atomic<size_t> &nextFile, bool verify, ReplayStats &stats,
+                          std::vector<MatchRow> &rows, std::vector<char> &analysed)
+{
+    for (size_t f = nextFile++; f < files.size(); f = nextFile++)
+    {
+        MappedReplay file;
+        analysed[f] = MapReplayFile(files[f].c_str(), file);
+        if (analysed[f])
+        {
+            analysed[f] = AnalyseReplay((const unsigned char *)file.mapping, file.size, verify, stats, rows[f]);
+            UnmapReplayFile(file);
+        }
+        if (!analysed[f]) stats.failed++;
+    }
+}
+
+// Put the next replay that can be read into a lane, returns false once there are none left (the lane is cleared)
+bool StartLaneReplay(GameLanes &lanes, int lane, LaneReplay &replay, const std::vector<std::string> &files, std::atomic<size_t> &nextFile,
+                     ReplayStats &stats, std::vector<MatchRow> &rows, std::vector<char> &analysed)
+{
+    for (size_t f = nextFile++; f < files.size(); f = nextFile++)
+    {
+        if (!MapReplayFile(files[f].c_str(), replay.file))
+        {
+            stats.failed++;
+            continue;
+        }
+
+        MatchRules rules;
+        float tickTime;
+        replay.data = (const unsigned char *)replay.file.mapping;
+        replay.ticks = ReadReplayHeader(replay.data, replay.file.size, rules, tickTime);
+        if (replay.ticks < 0)
+        {
+            UnmapReplayFile(replay.file);
+            stats.failed++;
+            continue;
+        }
+
+        InitialiseGame(replay.game, rules);
+        BeginReplayAnalysis(replay.analysis, tickTime);
+        replay.index = f;
+        replay.recordedHash = replay.chain = 0;
+        if (replay.ticks == 0)
+        {
+            // Nothing to simulate
+            FinishReplayAnalysis(stats, replay.analysis, replay.game, 0);
+            rows[f] = replay.analysis.row;
+            analysed[f] = true;
+            UnmapReplayFile(replay.file);
+            continue;
+        }
+
+        LoadGameLane(lanes, lane, replay.game, tickTime);
+        return true;
+    }
+    ClearGameLane(lanes, lane);
+    return false;
+}
+
+// Analyse replay files simLanes at a time, each in a lane of the lane simulation (lanesim.h), until there are none left
+// A lane whose replay ends takes the next file straight away, so the lanes stay full until the last few replays
+void AnalyseReplayLanes(const std::vector<std::string> &files, std::atomic<size_t> &nextFile, bool verify, ReplayStats &stats,
+                        std::vector<MatchRow> &rows, std::vector<char> &analysed)
+{
+    static thread_local GameLanes lanes;
+    static thread_local LaneReplay replays[simLanes];
+    memset(&lanes, 0, sizeof(lanes));
+
+    LaneInts ticksLeft = {}, ball2Seen = {};
+    int running = 0;
+    for (int l = 0; l < simLanes; l++)
+    {
+        if (!StartLaneReplay(lanes, l, replays[l], files, nextFile, stats, rows, analysed)) continue;
+        ticksLeft[l] = replays[l].ticks;
+        running++;
+    }
+
+    LaneInputs inputs = {};
+    while (running > 0)
+    {
+        for (int l = 0; l < simLanes; l++)
+        {
+            if (!lanes.active[l]) continue;
+            ReplayTick tick;
+            ReadReplayTick(replays[l].data, tick);
+            inputs.leftUp[l] = tick.left.up;
+            inputs.leftDown[l] = tick.left.down;
+            inputs.rightUp[l] = tick.right.up;
+            inputs.rightDown[l] = tick.right.down;
+
+            if (verify) replays[l].recordedHash = tick.hash;
+        }
+
+        // Velocities before the tick, a scored ball's is gone after it
+        LaneFloats vx[2] = { lanes.balls[0].vx, lanes.balls[1].vx }, vy[2] = { lanes.balls[0].vy, lanes.balls[1].vy };
+        LaneEvents events;
+        UpdateGameLanes(lanes, inputs, events);
+        ticksLeft += lanes.active;
+        LaneInts done = lanes.active & (ticksLeft == 0);
+
+        // Nearly every tick nothing happens in any lane
+        if (AnyLane(events.hits[0] | events.hits[1] | events.resets[0] | events.resets[1]))
+        {
+            for (int l = 0; l < simLanes; l++)
+            {
+                for (int b = 0; b < 2; b++)
+                {
+                    const BallLanes &ball = lanes.balls[b];
+                    if (events.hits[b][l])
+                    {
+                        float playerY = (ball.vx[l] > 0) ? lanes.leftY[l] : lanes.rightY[l];
+                        AnalyseHit(stats, replays[l].analysis, b, (ball.y[l] - playerY) / lanes.halfHeight[l]);
+                    }
+                    if (events.resets[b][l]) AnalyseGoal(stats, replays[l].analysis, b, vx[b][l], vy[b][l]);
+                }
+            }
+        }
+
+        LaneInts ball2Started = lanes.balls[1].visible & ~ball2Seen;
+        if (AnyLane(ball2Started))
+        {
+            for (int l = 0; l < simLanes; l++)
+            {
+                if (ball2Started[l]) AnalyseBall2(replays[l].analysis, lanes.tick[l], lanes.leftScore[l], lanes.rightScore[l]);
+            }
+            ball2Seen |= ball2Started;
+        }
+
+        if (verify)
+        {
+            // A lane that disagrees with its replay's hash is dropped as failed
+            for (int l = 0; l < simLanes; l++)
+            {
+                if (!lanes.active[l]) continue;
+                LaneReplay &replay = replays[l];
+                StoreGameLane(lanes, l, replay.game);
+                replay.chain = ChainStateHash(replay.chain, HashState(replay.game));
+                if (replay.chain == replay.recordedHash) continue;
+
+                stats.failed++;
+                UnmapReplayFile(replay.file);
+                done[l] = 0;
+                ball2Seen[l] = 0;
+                ticksLeft[l] = 0;
+                if (StartLaneReplay(lanes, l, replay, files, nextFile, stats, rows, analysed)) ticksLeft[l] = replay.ticks;
+                else running--;
+            }
+        }
+
+        if (AnyLane(done))
+        {
+            for (int l = 0; l < simLanes; l++)
+            {
+                if (!done[l]) continue;
+                LaneReplay &replay = replays[l];
+                StoreGameLane(lanes, l, replay.game);
+                FinishReplayAnalysis(stats, replay.analysis, replay.game, replay.ticks);
+                rows[replay.index] = replay.analysis.row;
+                analysed[replay.index] = true;
+                UnmapReplayFile(replay.file);
+
+                ball2Seen[l] = 0;
+                if (StartLaneReplay(lanes, l, replay, files, nextFile, stats, rows, analysed)) ticksLeft[l] = replay.ticks;
+                else running--;
+            }
+        }
+    }
+}
+
+// Add a replay file, or every *.rpl file in a directory, to a list
+void AddReplayFiles(const char *path, std::vector<std::string> &files)
+{
+    DIR *directory = opendir(path);
+    if (!directory)
+    {
+        files.push_back(path);
+        return;
+    }
+
+    std::vector<std::string> found;
+    while (dirent *entry = readdir(directory))
+    {
+        size_t length = strlen(entry->d_name);
+        if (length > 4 && strcmp(entry->d_name + length - 4, ".rpl") == 0) found.push_back(std::string(path) + "/" + entry->d_name);
+    }
+    closedir(directory);
+
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
+
+// Record bot matches into a directory on all threads, returns false if any couldn't be written
+bool GenerateReplays(int count, const char *directory, const Controller &left, const Controller &right, unsigned int seed, int threadCount)
+{
+    MakeDirectory(directory);
+    std::atomic<int> nextMatch(0), failed(0);
+
+    auto worker = [&]()
+    {
+        Replay replay;
+        replay.ticks.reserve(maxMatchTicks);
+        for (int m = nextMatch++; m < count; m = nextMatch++)
+        {
+            BeginReplay(replay, MatchRules(), simTickTime);
+            Game game;
+            InitialiseGame(game);
+            ControllerState leftState, rightState;
+            unsigned int matchSeed = MixSeed(seed, m, 0, 0);
+            InitialiseControllerState(leftState, matchSeed);
+            InitialiseControllerState(rightState, matchSeed ^ 0x5BD1E995u);
+
+            while (!game.gameWon && game.tick < maxMatchTicks)
+            {
+                PaddleInput leftInput = ControlPaddle(left, leftState, game, 1);
+                PaddleInput rightInput = ControlPaddle(right, rightState, game, 2);
+                UpdateGame(game, leftInput, rightInput, simTickTime);
+                RecordReplayTick(replay, leftInput, rightInput, game);
+            }
+
+            char path[512];
+            snprintf(path, sizeof(path), "%s/match%06d.rpl", directory, m);
+            if (!SaveReplay(replay, path)) failed++;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < threadCount; t++) threads.push_back(std::thread(worker));
+    worker();
+    for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+    return failed.load() == 0;
+}
+
+double ThreadCpuSeconds()
+{
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Main entry point of program
+//----------------------------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    int threadCount = (int)std::thread::hardware_concurrency();
+    int generateCount = 0;
+    bool verify = false, scalar = false;
+    unsigned int seed = 1;
+    const char *outDirectory = "replaystats_out";
+    const char *leftText = "predict:reaction=4,noise=40", *rightText = leftText;
+    std::vector<std::string> files;
+    std::vector<const char *> paths;
+
+    // Read the command line
+    //------------------------------------------------------------------------------------------------
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if (strcmp(arg, "--threads") == 0 && hasValue) threadCount = atoi(argv[++i]);
+        else if (strcmp(arg, "--generate") == 0 && hasValue) generateCount = atoi(argv[++i]);
+        else if (strcmp(arg, "--verify") == 0) verify = true;
+        else if (strcmp(arg, "--scalar") == 0) scalar = true;
+        else if (strcmp(arg, "--out") == 0 && hasValue) outDirectory = argv[++i];
+        else if (strcmp(arg, "--left") == 0 && hasValue) leftText = argv[++i];
+        else if (strcmp(arg, "--right") == 0 && hasValue) rightText = argv[++i];
+        else if (strcmp(arg, "--seed") == 0 && hasValue) seed = (unsigned int)strtoul(argv[++i], 0, 10);
+        else if (arg[0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return 1;
+        }
+        else paths.push_back(arg);
+    }
+    if (threadCount < 1) threadCount = 1;
+
+    if (generateCount > 0)
+    {
+        Controller left, right;
+        if (paths.size() != 1 || !ParseController(left, leftText) || !ParseController(right, rightText))
+        {
+            fprintf(stderr, "Expected --generate N DIRECTORY and valid controllers\n");
+            return 1;
+        }
+        if (!GenerateReplays(generateCount, paths[0], left, right, seed, threadCount))
+        {
+            fprintf(stderr, "Could not write the replays to %s\n", paths[0]);
+            return 1;
+        }
+        printf("Recorded %d matches (%s vs %s) to %s\n", generateCount, leftText, rightText, paths[0]);
+        return 0;
+    }
+
+    for (size_t p = 0; p < paths.size(); p++) AddReplayFiles(paths[p], files);
+    if (files.empty())
+    {
+        fprintf(stderr, "No replays given\n");
+        return 1;
+    }
+
+    // Analyse every replay, each worker taking the next file into its own stats
+    //------------------------------------------------------------------------------------------------
+    std::vector<ReplayStats> workerStats(threadCount);
+    std::vector<double> workerCpu(threadCount);
+    std::vector<MatchRow> rows(files.size());
+    std::vector<char> analysed(files.size());
+    std::atomic<size_t> nextFile(0);
+
+    auto worker = [&](int w)
+    {
+        ReplayStats &stats = workerStats[w];
+        memset(&stats, 0, sizeof(stats));
+        double cpuStart = ThreadCpuSeconds();
+
+        if (scalar) AnalyseReplaysScalar(files, nextFile, verify, stats, rows, analysed);
+        else AnalyseReplayLanes(files, nextFile, verify, stats, rows, analysed);
+        workerCpu[w] = ThreadCpuSeconds() - cpuStart;
+    };
+
+    auto startWall = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 1; t < threadCount; t++) threads.push_back(std::thread(worker, t));
+    worker(0);
+    for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startWall).count();
+
+    ReplayStats total;
+    memset(&total, 0, sizeof(total));
+    double cpuSeconds = 0;
+    for (int w = 0; w < threadCount; w++)
+    {
+        MergeReplayStats(total, workerStats[w]);
+        cpuSeconds += workerCpu[w];
+    }
+
+    printf("%lld replays (%lld failed%s), %lld ticks, %.0f s of game time\n", total.replays, total.failed,
+           verify ? " to read or verify" : " to read", total.ticks, total.replaySeconds);
+    printf("%.2f s on %d threads, %.2f core-seconds: %.2f M replay-seconds per core-second, %.1f ns a tick\n",
+           wallSeconds, threadCount, cpuSeconds, total.replaySeconds / cpuSeconds / 1e6, 1e9 * cpuSeconds / total.ticks);
+
+    long long rallyCount = 0, rallyHits = 0;
+    for (int i = 0; i < rallyBins; i++)
+    {
+        rallyCount += total.rallyLengths[i];
+        rallyHits += i * total.rallyLengths[i];
+    }
+    printf("rallies %lld, %.2f hits each; goals by ball 1 %lld, by ball 2 %lld\n", rallyCount,
+           rallyCount ? (double)rallyHits / rallyCount : 0, total.goals[0], total.goals[1]);
+    if (total.ball2Matches) printf("ball 2 came into play in %lld decided matches: the leader then won %.1f%%, %.1f%% were level\n",
+                                   total.ball2Matches, 100.0 * total.ball2LeaderWins / total.ball2Matches,
+                                   100.0 * total.ball2Ties / total.ball2Matches);
+
+    // Write the tables
+    //------------------------------------------------------------------------------------------------
+    ColumnTable rallies, offsets, speeds, matches;
+    int rallyColumns[2] = { AddColumn(rallies, "hits", false), AddColumn(rallies, "count", false) };
+    for (int i = 0; i < rallyBins; i++)
+    {
+        AppendInt(rallies, rallyColumns[0], i);
+        AppendInt(rallies, rallyColumns[1], (int)total.rallyLengths[i]);
+    }
+
+    int offsetColumns[2] = { AddColumn(offsets, "offset", true), AddColumn(offsets, "count", false) };
+    for (int i = 0; i < offsetBins; i++)
+    {
+        AppendFloat(offsets, offsetColumns[0], -offsetRange + (i + 0.5f) * 2 * offsetRange / offsetBins);
+        AppendInt(offsets, offsetColumns[1], (int)total.hitOffsets[i]);
+    }
+
+    int speedColumns[2] = { AddColumn(speeds, "speed", true), AddColumn(speeds, "count", false) };
+    for (int i = 0; i < goalSpeedBins; i++)
+    {
+        AppendFloat(speeds, speedColumns[0], (i + 0.5f) * goalSpeedBinWidth);
+        AppendInt(speeds, speedColumns[1], (int)total.goalSpeeds[i]);
+    }
+
+    int columns[11] = { AddColumn(matches, "file", false), AddColumn(matches, "ticks", false),
+                        AddColumn(matches, "seconds", true), AddColumn(matches, "winner", false),
+                        AddColumn(matches, "leftScore", false), AddColumn(matches, "rightScore", false),
+                        AddColumn(matches, "ball2Tick", false), AddColumn(matches, "ball2Leader", false),
+                        AddColumn(matches, "ball2GoalsLeft", false), AddColumn(matches, "ball2GoalsRight", false),
+                        AddColumn(matches, "rallyMean", true) };
+    for (size_t f = 0; f < files.size(); f++)
+    {
+        if (!analysed[f]) continue;
+        const MatchRow &row = rows[f];
+        AppendInt(matches, columns[0], (int)f);
+        AppendInt(matches, columns[1], row.ticks);
+        AppendFloat(matches, columns[2], row.ticks * row.tickTime);
+        AppendInt(matches, columns[3], row.winner);
+        AppendInt(matches, columns[4], row.leftScore);
+        AppendInt(matches, columns[5], row.rightScore);
+        AppendInt(matches, columns[6], row.ball2Tick);
+        AppendInt(matches, columns[7], row.ball2Leader);
+        AppendInt(matches, columns[8], row.ball2GoalsLeft);
+        AppendInt(matches, columns[9], row.ball2GoalsRight);
+        AppendFloat(matches, columns[10], row.rallyMean);
+    }
+
+    MakeDirectory(outDirectory);
+    const char *names[4] = { "rallies", "hitOffsets", "goalSpeeds", "matches" };
+    const ColumnTable *tables[4] = { &rallies, &offsets, &speeds, &matches };
+    bool ok = true;
+    for (int i = 0; i < 4; i++)
+    {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", outDirectory, names[i]);
+        if (!WriteColumnTable(*tables[i], path)) ok = false;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Could not write the tables to %s\n", outDirectory);
+        return 1;
+    }
+    printf("Tables written to %s (rallies, hitOffsets, goalSpeeds, matches; file is the replay's index in name order)\n", outDirectory);
+    return 0;
+}
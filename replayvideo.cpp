@@ -0,0 +1,374 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium replay video: exports a replay as video without a GPU or OpenGL
+*
+*   The replay is re-simulated first, keeping the game as it is at every video frame, then every
+*   frame is drawn on the CPU (softraster.h) as it is on the GAMEPLAY screen. A frame is cut into
+*   tiles that the worker threads take in order, drawing a tile and converting it to the output
+*   format straight into the frame's slot; the main thread writes the slots out in order as their
+*   tiles finish, so a few frames are always being drawn while one is written.
+*
+*   Frames are written as a YUV4MPEG2 stream (4:2:0, full range BT.601) or as back to back binary
+*   PPMs, to stdout or a file, e.g. replayvideo match.rpl | ffmpeg -i - match.mp4
+*
+*   Usage: replayvideo FILE [options]
+*       --out FILE          where to write the video (default - for stdout)
+*       --format y4m|ppm    video format (default y4m)
+*       --fps N             frames per second (default the replay's tick rate)
+*       --hold SECONDS      time the final frame is held for (default 2)
+*       --threads N         drawing threads (default all cores)
+*
+*   Build: g++ replayvideo.cpp -o replayvideo.exe -O2 -pthread
+*
+******************************************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
+#include "replay.h"
+#include "softraster.h"
+#include "specsim.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int tileWidth = 200;                  // Tile size, both even so a tile holds whole 2x2 chroma blocks
+const int tileHeight = 40;
+const int tilesAcross = (screenWidth + tileWidth - 1) / tileWidth;
+const int tilesDown = (screenHeight + tileHeight - 1) / tileHeight;
+const int tilesPerFrame = tilesAcross * tilesDown;
+const int slotsPerThread = 2;               // Frames being drawn at once for each thread
+const float defaultHoldSeconds = 2.0f;
+
+enum VideoFormat { VIDEO_Y4M, VIDEO_PPM };
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for a frame being drawn
+struct FrameSlot
+{
+    std::vector<unsigned char> pixels;      // palette indices (softraster.h)
+    std::vector<unsigned char> bytes;       // the frame in the output format, without its header
+    std::atomic<int> tilesDone;
+};
+
+// Create a structure shared by the drawing threads and the writer
+struct VideoExport
+{
+    const std::vector<Game> *frames;
+    VideoFormat format;
+    std::vector<FrameSlot> slots;
+    std::atomic<long long> nextTile;        // tiles of every frame, in order
+    long long frameCount;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    long long framesWritten;
+};
+
+// Create a structure for the palette in the output formats
+struct VideoPalette
+{
+    unsigned char rgb[RASTER_COLOURS][3];
+    unsigned char y[RASTER_COLOURS];
+    int u[RASTER_COLOURS], v[RASTER_COLOURS];
+};
+
+VideoPalette videoPalette;
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+void BuildVideoPalette()
+{
+    for (int c = 0; c < RASTER_COLOURS; c++)
+    {
+        float r = rasterPalette[c].r, g = rasterPalette[c].g, b = rasterPalette[c].b;
+        videoPalette.rgb[c][0] = rasterPalette[c].r;
+        videoPalette.rgb[c][1] = rasterPalette[c].g;
+        videoPalette.rgb[c][2] = rasterPalette[c].b;
+        videoPalette.y[c] = (unsigned char)lrintf(0.299f * r + 0.587f * g + 0.114f * b);
+        videoPalette.u[c] = (int)lrintf(128.0f - 0.168736f * r - 0.331264f * g + 0.5f * b);
+        videoPalette.v[c] = (int)lrintf(128.0f + 0.5f * r - 0.418688f * g - 0.081312f * b);
+    }
+}
+
+size_t VideoFrameBytes(VideoFormat format)
+{
+    size_t pixels = (size_t)screenWidth * screenHeight;
+    return (format == VIDEO_Y4M) ? pixels + 2 * (pixels / 4) : 3 * pixels;
+}
+
+// Re-simulate a replay and keep the game as it is at the start of every frame, then hold the last one
+void SimulateFrames(const Replay &replay, int fps, float holdSeconds, std::vector<Game> &frames)
+{
+    Game game;
+    InitialiseGame(game, replay.rules);
+    UpdateGameFunction update = SelectUpdateGame(replay.rules);
+
+    int ticks = (int)replay.ticks.size();
+    for (long long frame = 0; ; frame++)
+    {
+        // The tick a frame shows, nudged so a frame rate equal to the tick rate lands on every tick
+        long long tick = (long long)floor((double)frame / fps / replay.tickTime + 1e-6);
+        if (tick > ticks) break;
+        while (game.tick < tick) update(game, replay.ticks[game.tick].left, replay.ticks[game.tick].right, replay.tickTime);
+        frames.push_back(game);
+    }
+
+    // The match may end between frames, the last frame always shows its end
+    if (game.tick < ticks)
+    {
+        while (game.tick < ticks) update(game, replay.ticks[game.tick].left, replay.ticks[game.tick].right, replay.tickTime);
+        frames.push_back(game);
+    }
+
+    int holdFrames = (int)lrintf(holdSeconds * fps);
+    for (int i = 0; i < holdFrames; i++) frames.push_back(game);
+}
+
+// Check if 8 pixels in a row are all black
+inline bool IsBlackRun(const unsigned char *pixels)
+{
+    unsigned long long run;
+    memcpy(&run, pixels, sizeof(run));
+    return run == 0;
+}
+
+// Convert a drawn tile into the output format
+void ConvertTile(VideoFormat format, const unsigned char *pixels, int left, int top, int right, int bottom, unsigned char *bytes)
+{
+    if (format == VIDEO_PPM)
+    {
+        for (int y = top; y < bottom; y++)
+        {
+            const unsigned char *row = pixels + (size_t)y * screenWidth;
+            unsigned char *out = bytes + 3 * ((size_t)y * screenWidth + left);
+            for (int x = left; x < right; x++, out += 3)
+            {
+                // Most of the court is black, which is all zero in RGB
+                if (((x - left) & 7) == 0 && x + 8 <= right && IsBlackRun(row + x))
+                {
+                    memset(out, 0, 24);
+                    x += 7;
+                    out += 21;
+                    continue;
+                }
+                memcpy(out, videoPalette.rgb[row[x]], 3);
+            }
+        }
+        return;
+    }
+
+    // Y for every pixel, U and V averaged over every 2x2 block
+    const int chromaWidth = screenWidth / 2;
+    unsigned char *planeU = bytes + (size_t)screenWidth * screenHeight;
+    unsigned char *planeV = planeU + (size_t)chromaWidth * (screenHeight / 2);
+    for (int y = top; y < bottom; y += 2)
+    {
+        const unsigned char *row0 = pixels + (size_t)y * screenWidth;
+        const unsigned char *row1 = row0 + screenWidth;
+        unsigned char *luma0 = bytes + (size_t)y * screenWidth;
+        unsigned char *luma1 = luma0 + screenWidth;
+        size_t chroma = (size_t)(y / 2) * chromaWidth;
+        for (int x = left; x < right; x += 2)
+        {
+            // Most of the court is black, 4 blocks of which are converted at once
+            if (((x - left) & 7) == 0 && x + 8 <= right && IsBlackRun(row0 + x) && IsBlackRun(row1 + x))
+            {
+                memset(luma0 + x, videoPalette.y[RASTER_BLACK], 8);
+                memset(luma1 + x, videoPalette.y[RASTER_BLACK], 8);
+                memset(planeU + chroma + x / 2, videoPalette.u[RASTER_BLACK], 4);
+                memset(planeV + chroma + x / 2, videoPalette.v[RASTER_BLACK], 4);
+                x += 6;
+                continue;
+            }
+            int a = row0[x], b = row0[x + 1], c = row1[x], d = row1[x + 1];
+            luma0[x] = videoPalette.y[a];
+            luma0[x + 1] = videoPalette.y[b];
+            luma1[x] = videoPalette.y[c];
+            luma1[x + 1] = videoPalette.y[d];
+            planeU[chroma + x / 2] = (unsigned char)((videoPalette.u[a] + videoPalette.u[b] + videoPalette.u[c] + videoPalette.u[d] + 2) >> 2);
+            planeV[chroma + x / 2] = (unsigned char)((videoPalette.v[a] + videoPalette.v[b] + videoPalette.v[c] + videoPalette.v[d] + 2) >> 2);
+        }
+    }
+}
+
+// Draw tiles until every frame's tiles are taken, never getting further ahead of the writer than the slots allow
+void DrawTiles(VideoExport &video)
+{
+    long long slotCount = (long long)video.slots.size();
+    long long totalTiles = video.frameCount * tilesPerFrame;
+    for (;;)
+    {
+        long long tile = video.nextTile.fetch_add(1);
+        if (tile >= totalTiles) return;
+        long long frame = tile / tilesPerFrame;
+        int index = (int)(tile % tilesPerFrame);
+
+        if (frame >= video.framesWritten + slotCount)
+        {
+            std::unique_lock<std::mutex> lock(video.mutex);
+            video.changed.wait(lock, [&] { return frame < video.framesWritten + slotCount; });
+        }
+
+        FrameSlot &slot = video.slots[frame % slotCount];
+        RasterTarget target;
+        target.pixels = slot.pixels.data();
+        target.stride = screenWidth;
+        target.left = (index % tilesAcross) * tileWidth;
+        target.top = (index / tilesAcross) * tileHeight;
+        target.right = (target.left + tileWidth < screenWidth) ? target.left + tileWidth : screenWidth;
+        target.bottom = (target.top + tileHeight < screenHeight) ? target.top + tileHeight : screenHeight;
+
+        DrawGameRaster(target, (*video.frames)[frame]);
+        ConvertTile(video.format, slot.pixels.data(), target.left, target.top, target.right, target.bottom, slot.bytes.data());
+
+        if (slot.tilesDone.fetch_add(1) + 1 == tilesPerFrame)
+        {
+            std::lock_guard<std::mutex> lock(video.mutex);
+            video.changed.notify_all();
+        }
+    }
+}
+
+// Write the frames in order as their slots finish, returns false if the output couldn't be written
+bool WriteFrames(VideoExport &video, FILE *out, int fps)
+{
+    bool ok = true;
+    if (video.format == VIDEO_Y4M) ok = fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", screenWidth, screenHeight, fps) > 0;
+
+    long long slotCount = (long long)video.slots.size();
+    for (long long frame = 0; frame < video.frameCount; frame++)
+    {
+        FrameSlot &slot = video.slots[frame % slotCount];
+        {
+            std::unique_lock<std::mutex> lock(video.mutex);
+            video.changed.wait(lock, [&] { return slot.tilesDone.load() == tilesPerFrame; });
+        }
+
+        if (ok)
+        {
+            if (video.format == VIDEO_Y4M) fputs("FRAME\n", out);
+            else fprintf(out, "P6\n%d %d\n255\n", screenWidth, screenHeight);
+            ok = fwrite(slot.bytes.data(), 1, slot.bytes.size(), out) == slot.bytes.size();
+        }
+
+        // Even after a write fails the frames are let through, so the drawing threads finish
+        slot.tilesDone = 0;
+        {
+            std::lock_guard<std::mutex> lock(video.mutex);
+            video.framesWritten = frame + 1;
+        }
+        video.changed.notify_all();
+    }
+    return ok && fflush(out) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argv[1][0] == '-')
+    {
+        fprintf(stderr, "Usage: replayvideo FILE [--out FILE] [--format y4m|ppm] [--fps N] [--hold SECONDS] [--threads N]\n");
+        return 1;
+    }
+
+    const char *outName = "-";
+    VideoFormat format = VIDEO_Y4M;
+    int fps = 0;
+    float holdSeconds = defaultHoldSeconds;
+    int threadCount = (int)std::thread::hardware_concurrency();
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) outName = argv[++i];
+        else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+        {
+            const char *name = argv[++i];
+            if (strcmp(name, "y4m") == 0) format = VIDEO_Y4M;
+            else if (strcmp(name, "ppm") == 0) format = VIDEO_PPM;
+            else
+            {
+                fprintf(stderr, "Unknown format %s\n", name);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) fps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--hold") == 0 && i + 1 < argc) holdSeconds = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threadCount = atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (threadCount < 1) threadCount = 1;
+    if (holdSeconds < 0) holdSeconds = 0;
+
+    Replay replay;
+    if (!LoadReplay(replay, argv[1]))
+    {
+        fprintf(stderr, "Couldn't read replay %s\n", argv[1]);
+        return 1;
+    }
+    if (fps <= 0) fps = (int)lrintf(1.0f / replay.tickTime);
+    if (fps <= 0) fps = 60;
+
+    FILE *out = stdout;
+    if (strcmp(outName, "-") != 0) out = fopen(outName, "wb");
+    if (!out)
+    {
+        fprintf(stderr, "Couldn't write %s\n", outName);
+        return 1;
+    }
+#if defined(_WIN32)
+    if (out == stdout) _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    auto start = std::chrono::steady_clock::now();
+    BuildVideoPalette();
+    std::vector<Game> frames;
+    SimulateFrames(replay, fps, holdSeconds, frames);
+
+    VideoExport video;
+    video.frames = &frames;
+    video.format = format;
+    video.slots = std::vector<FrameSlot>(slotsPerThread * threadCount);
+    for (size_t s = 0; s < video.slots.size(); s++)
+    {
+        video.slots[s].pixels.resize((size_t)screenWidth * screenHeight);
+        video.slots[s].bytes.resize(VideoFrameBytes(format));
+        video.slots[s].tilesDone = 0;
+    }
+    video.nextTile = 0;
+    video.frameCount = (long long)frames.size();
+    video.framesWritten = 0;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; t++) threads.push_back(std::thread(DrawTiles, std::ref(video)));
+    bool written = WriteFrames(video, out, fps);
+    for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+    if (out != stdout) written = (fclose(out) == 0) && written;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double videoSeconds = (double)frames.size() / fps;
+    fprintf(stderr, "%zu frames (%.1f s of video at %d fps) in %.2f s on %d threads: %.1f frames a second, %.1fx real time\n",
+            frames.size(), videoSeconds, fps, seconds, threadCount, frames.size() / seconds, videoSeconds / seconds);
+    if (!written)
+    {
+        fprintf(stderr, "Couldn't write %s\n", outName);
+        return 1;
+    }
+    return 0;
+}
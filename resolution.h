@@ -0,0 +1,139 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium dynamic resolution: gameplay drawn at a lower resolution when frames run late
+*
+*   Gameplay is drawn into an offscreen render texture through a camera zoomed by the current scale,
+*   so the game keeps its 1000x600 coordinates while only the top-left scale x scale part of the
+*   texture is filled. That part is then stretched over the window. The texture is allocated once
+*   at full size, so changing the scale never reallocates anything.
+*
+*   The scale follows the frame cost: a few frames in a row over budget step it down, a long run
+*   of frames well under budget steps it back up. Costs between the two thresholds change nothing
+*   (hysteresis), and a step up that is undone soon after makes the next step up wait twice as long,
+*   so the scale settles instead of flickering between two sizes.
+*
+*   The frame cost is the time from the start of a frame to the end of its buffer swap. With
+*   --pacing vsync the swap also waits for the display, so there the cost is the time between
+*   swaps and a frame is over budget once it misses a vblank.
+*
+******************************************************************************************************/
+
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+#include "include/raylib.h"
+#include "drawcount.h"
+#include "pongsim.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const float resolutionStep = 0.1f;              // Change of scale in one step
+const double resolutionLowWater = 0.7;          // Fraction of the budget a frame must stay under to count towards a step up
+const int resolutionDownFrames = 3;             // Frames over budget in a row before stepping down
+const int resolutionUpFrames = 60;              // Frames under the low water mark in a row before stepping up
+const int resolutionMaxUpFrames = 480;          // Longest wait before stepping up, after repeated failed steps up
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for the offscreen gameplay texture and the controller choosing its scale
+struct ResolutionScaler
+{
+    RenderTexture2D target;         // full size texture, gameplay fills the top-left scale x scale part
+    float scale;                    // fraction of the full resolution gameplay is drawn at
+    float minScale, maxScale;       // bounds of the scale
+    int overFrames;                 // frames over budget in a row
+    int underFrames;                // frames under the low water mark in a row
+    int upFrames;                   // frames under the low water mark needed to step up
+    int framesSinceUp;              // frames since the last step up
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Create the offscreen texture, must be called after InitWindow
+inline void InitialiseResolutionScaler(ResolutionScaler &scaler, float minScale, float maxScale)
+{
+    scaler.target = LoadRenderTexture(screenWidth, screenHeight);
+    SetTextureFilter(scaler.target.texture, TEXTURE_FILTER_BILINEAR);      // Smooth the upscale
+    scaler.minScale = minScale;
+    scaler.maxScale = maxScale;
+    scaler.scale = maxScale;
+    scaler.overFrames = scaler.underFrames = 0;
+    scaler.upFrames = resolutionUpFrames;
+    scaler.framesSinceUp = resolutionMaxUpFrames;
+}
+
+// Feed the cost of the last frame to the controller, which may change the scale for the next one
+inline void UpdateResolutionScale(ResolutionScaler &scaler, double frameCost, double budget)
+{
+    if (frameCost > budget)
+    {
+        scaler.overFrames++;
+        scaler.underFrames = 0;
+    }
+    else if (frameCost < resolutionLowWater * budget)
+    {
+        scaler.underFrames++;
+        scaler.overFrames = 0;
+    }
+    else
+    {
+        scaler.overFrames = scaler.underFrames = 0;     // Close to the budget - leave the scale alone
+    }
+    scaler.framesSinceUp++;
+
+    if (scaler.overFrames >= resolutionDownFrames && scaler.scale > scaler.minScale)
+    {
+        // A step up that didn't last means the scale above is too much - wait longer before trying it again
+        if (scaler.framesSinceUp < resolutionUpFrames)
+        {
+            scaler.upFrames = (scaler.upFrames * 2 < resolutionMaxUpFrames) ? scaler.upFrames * 2 : resolutionMaxUpFrames;
+        }
+        scaler.scale -= resolutionStep;
+        scaler.overFrames = 0;
+    }
+    else if (scaler.underFrames >= scaler.upFrames && scaler.scale < scaler.maxScale)
+    {
+        scaler.scale += resolutionStep;
+        scaler.underFrames = 0;
+        scaler.framesSinceUp = 0;
+    }
+
+    if (scaler.scale < scaler.minScale) scaler.scale = scaler.minScale;
+    if (scaler.scale > scaler.maxScale) scaler.scale = scaler.maxScale;
+}
+
+// Start drawing gameplay into the offscreen texture, using the game's coordinates
+inline void BeginScaledDrawing(const ResolutionScaler &scaler)
+{
+    CountFlush();
+    BeginTextureMode(scaler.target);
+    ClearBackground(BLACK);
+
+    Camera2D camera = { { 0, 0 }, { 0, 0 }, 0, scaler.scale };     // Zoom the court into the scaled part of the texture
+    BeginMode2D(camera);
+}
+
+// Finish drawing gameplay and stretch it over the window, call between BeginDrawing and EndDrawing
+inline void EndScaledDrawing(const ResolutionScaler &scaler)
+{
+    CountFlush();
+    EndMode2D();
+    EndTextureMode();
+
+    // Render textures are upside down, so take the scaled part from the bottom of the texture and flip it
+    float width = screenWidth * scaler.scale, height = screenHeight * scaler.scale;
+    Rectangle source = { 0, screenHeight - height, width, -height };
+    Rectangle destination = { 0, 0, (float)screenWidth, (float)screenHeight };
+    DrawTextureProCounted(scaler.target.texture, source, destination, Vector2{ 0, 0 }, 0, WHITE);
+}
+
+// Free the offscreen texture
+inline void UnloadResolutionScaler(ResolutionScaler &scaler)
+{
+    UnloadRenderTexture(scaler.target);
+}
+
+#endif // RESOLUTION_H
@@ -0,0 +1,35 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium UI atlas: written by atlasbuild from the PNGs in resources, don't edit (run atlasbuild instead)
+*
+*   Include after raylib.h. Draw a sprite with DrawTextureRec(atlas, uiAtlasRects[SPRITE_...], ...).
+*
+******************************************************************************************************/
+
+#ifndef UIATLAS_H
+#define UIATLAS_H
+
+const char *const uiAtlasFile = "resources/uiAtlas.qoi";
+const int uiAtlasWidth = 64;
+const int uiAtlasHeight = 262;
+
+// Create an enum of the images in the atlas
+enum AtlasSprite
+{
+    SPRITE_DOWN_ARROW,
+    SPRITE_S,
+    SPRITE_UP_ARROW,
+    SPRITE_W,
+    SPRITE_COUNT
+};
+
+// Where each image is in the atlas
+const Rectangle uiAtlasRects[SPRITE_COUNT] =
+{
+    { 0, 0, 64, 64 },     // downArrow.png
+    { 0, 66, 64, 64 },     // s.png
+    { 0, 132, 64, 64 },     // upArrow.png
+    { 0, 198, 64, 64 },     // w.png
+};
+
+#endif // UIATLAS_H
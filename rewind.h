@@ -0,0 +1,271 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium rewind: the last 30 seconds of a match, every tick, in a fixed-size ring buffer
+*
+*   Every tick's state (paddles, balls, scores, ball 2's counter, won and winner) is packed as the
+*   bits of its fields. Every 32nd tick is kept whole as a keyframe; the ticks in between are kept
+*   XORed against their block's keyframe. Within a block the scores, flags and velocities rarely
+*   change and positions only change in their low mantissa bits, so a tick keeps a mask of the words
+*   that differ and only the low bytes of each XOR that aren't zero: about 20 bytes instead of 60.
+*
+*   The encoded ticks go round a byte ring; when it (or 30 seconds of ticks) is full the oldest
+*   block is dropped. Any tick still held is restored from its keyframe and its own record alone,
+*   so rewinding to it takes well under a microsecond, whatever the tick.
+*
+*   Layout of a tick: changed word mask (2 bytes), the byte count - 1 of each changed word's XOR
+*   (2 bits each, packed 4 to a byte), then those bytes, lowest first.
+*
+******************************************************************************************************/
+
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <string.h>
+#include "pongsim.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int rewindSeconds = 30;                   // Game time a rewind can go back
+const int rewindMaxTickRate = 240;              // Highest tick rate the whole 30 seconds are kept at
+const int rewindTickCapacity = rewindSeconds * rewindMaxTickRate;
+const int rewindKeyframeInterval = 32;          // Ticks from one keyframe to the next
+const int rewindKeyframeSlots = rewindTickCapacity / rewindKeyframeInterval + 2;    // Blocks held at most (the ends may be partial)
+const int rewindBufferBytes = 1 << 18;          // Encoded ticks held (256 KB, must be a power of two)
+const int rewindWords = 15;                     // Words of state kept per tick
+const int maxRewindRecordBytes = 2 + (rewindWords + 3) / 4 + 4 * rewindWords;
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for the changing parts of a game as the bits of their fields
+struct RewindState
+{
+    unsigned int words[rewindWords];
+};
+
+// Create a structure for the recent ticks of a match
+// Ticks firstTick to endTick - 1 are held; firstTick is always its block's keyframe
+struct RewindBuffer
+{
+    unsigned char bytes[rewindBufferBytes];             // ring of encoded ticks
+    unsigned int offsets[rewindTickCapacity];           // position in the ring of each held tick's record
+    RewindState keyframes[rewindKeyframeSlots];         // keyframe of each held block
+    int keyframeTicks[rewindKeyframeSlots];             // tick each keyframe is of
+    unsigned int blockOffsets[rewindKeyframeSlots];     // position in the ring of each block's first record
+    unsigned int writePosition;                         // position the next record goes at (wraps around the ring)
+    int firstTick, endTick;
+    int maxTicks;                                       // ticks held at most, 30 seconds at the tick rate
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+inline unsigned int RewindFloatBits(float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline float RewindBitsFloat(unsigned int bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline void PackRewindState(const Game &game, RewindState &state)
+{
+    unsigned int *w = state.words;
+    w[0] = RewindFloatBits(game.player1Left.position.y);
+    w[1] = RewindFloatBits(game.player2Right.position.y);
+    w[2] = RewindFloatBits(game.ball1.position.x);
+    w[3] = RewindFloatBits(game.ball1.position.y);
+    w[4] = RewindFloatBits(game.ball1.velocity.x);
+    w[5] = RewindFloatBits(game.ball1.velocity.y);
+    w[6] = RewindFloatBits(game.ball2.position.x);
+    w[7] = RewindFloatBits(game.ball2.position.y);
+    w[8] = RewindFloatBits(game.ball2.velocity.x);
+    w[9] = RewindFloatBits(game.ball2.velocity.y);
+    w[10] = (game.ball1.visible ? 1u : 0u) | (game.ball2.visible ? 2u : 0u) | (game.gameWon ? 4u : 0u);
+    w[11] = (unsigned int)game.player1LeftScore;
+    w[12] = (unsigned int)game.player2RightScore;
+    w[13] = (unsigned int)game.frameCounterBall2;
+    w[14] = (unsigned int)game.winner;
+}
+
+// Put a packed state back into a game of the same match (the rules, sizes and speeds are left as they are)
+inline void UnpackRewindState(const RewindState &state, int tick, Game &game)
+{
+    const unsigned int *w = state.words;
+    game.player1Left.position.y = RewindBitsFloat(w[0]);
+    game.player2Right.position.y = RewindBitsFloat(w[1]);
+    game.ball1.position.x = RewindBitsFloat(w[2]);
+    game.ball1.position.y = RewindBitsFloat(w[3]);
+    game.ball1.velocity.x = RewindBitsFloat(w[4]);
+    game.ball1.velocity.y = RewindBitsFloat(w[5]);
+    game.ball2.position.x = RewindBitsFloat(w[6]);
+    game.ball2.position.y = RewindBitsFloat(w[7]);
+    game.ball2.velocity.x = RewindBitsFloat(w[8]);
+    game.ball2.velocity.y = RewindBitsFloat(w[9]);
+    game.ball1.visible = (w[10] & 1u) != 0;
+    game.ball2.visible = (w[10] & 2u) != 0;
+    game.gameWon = (w[10] & 4u) != 0;
+    game.player1LeftScore = (int)w[11];
+    game.player2RightScore = (int)w[12];
+    game.frameCounterBall2 = (int)w[13];
+    game.winner = (int)w[14];
+    game.tick = tick;
+}
+
+// Encode a state XORed against its keyframe, returns the bytes written (at most maxRewindRecordBytes)
+inline int EncodeRewindRecord(const RewindState &state, const RewindState &keyframe, unsigned char *record)
+{
+    unsigned int changes[rewindWords];
+    int lengths[rewindWords];
+    unsigned int mask = 0;
+    int changed = 0;
+    for (int i = 0; i < rewindWords; i++)
+    {
+        unsigned int change = state.words[i] ^ keyframe.words[i];
+        if (change == 0) continue;
+        mask |= 1u << i;
+        changes[changed] = change;
+        lengths[changed] = (change > 0xFFFFFFu) ? 4 : (change > 0xFFFFu) ? 3 : (change > 0xFFu) ? 2 : 1;
+        changed++;
+    }
+
+    int size = 0;
+    record[size++] = (unsigned char)mask;
+    record[size++] = (unsigned char)(mask >> 8);
+
+    int lengthBytes = (changed + 3) / 4;
+    memset(record + size, 0, lengthBytes);
+    for (int c = 0; c < changed; c++) record[size + c / 4] |= (unsigned char)((lengths[c] - 1) << (2 * (c % 4)));
+    size += lengthBytes;
+
+    for (int c = 0; c < changed; c++)
+    {
+        for (int b = 0; b < lengths[c]; b++) record[size++] = (unsigned char)(changes[c] >> (8 * b));
+    }
+    return size;
+}
+
+// Start holding ticks afresh, at a tick rate (ticks per second)
+inline void ClearRewind(RewindBuffer &buffer, int tickRate)
+{
+    buffer.writePosition = 0;
+    buffer.firstTick = buffer.endTick = 0;
+    buffer.maxTicks = rewindSeconds * tickRate;
+    if (buffer.maxTicks > rewindTickCapacity) buffer.maxTicks = rewindTickCapacity;
+    if (buffer.maxTicks < 2 * rewindKeyframeInterval) buffer.maxTicks = 2 * rewindKeyframeInterval;
+}
+
+inline int RewindSlot(int tick)
+{
+    return (tick / rewindKeyframeInterval) % rewindKeyframeSlots;
+}
+
+// Drop the oldest block of ticks
+inline void DropRewindBlock(RewindBuffer &buffer)
+{
+    buffer.firstTick = (buffer.firstTick / rewindKeyframeInterval + 1) * rewindKeyframeInterval;
+    if (buffer.firstTick > buffer.endTick) buffer.firstTick = buffer.endTick;
+}
+
+// Bytes of the ring in use
+inline unsigned int RewindBytesUsed(const RewindBuffer &buffer)
+{
+    if (buffer.firstTick == buffer.endTick) return 0;
+    return buffer.writePosition - buffer.blockOffsets[RewindSlot(buffer.firstTick)];
+}
+
+// Keep the state after a tick, game.tick must follow the last tick kept (anything else starts afresh from it)
+inline void RecordRewindTick(RewindBuffer &buffer, const Game &game)
+{
+    int tick = game.tick;
+    if (tick != buffer.endTick || buffer.firstTick == buffer.endTick)
+    {
+        buffer.firstTick = buffer.endTick = tick;
+    }
+    while (buffer.endTick - buffer.firstTick >= buffer.maxTicks) DropRewindBlock(buffer);
+
+    RewindState state;
+    PackRewindState(game, state);
+    int slot = RewindSlot(tick);
+
+    if (tick % rewindKeyframeInterval == 0 || tick == buffer.firstTick)
+    {
+        buffer.keyframes[slot] = state;
+        buffer.keyframeTicks[slot] = tick;
+        buffer.blockOffsets[slot] = buffer.writePosition;
+    }
+    else
+    {
+        unsigned char record[maxRewindRecordBytes];
+        int size = EncodeRewindRecord(state, buffer.keyframes[slot], record);
+
+        // Make room in the ring by dropping the oldest blocks (a block is far smaller than the ring, so never this one)
+        while (buffer.writePosition + size - buffer.blockOffsets[RewindSlot(buffer.firstTick)] > (unsigned int)rewindBufferBytes)
+        {
+            DropRewindBlock(buffer);
+        }
+
+        buffer.offsets[tick % rewindTickCapacity] = buffer.writePosition;
+        for (int i = 0; i < size; i++) buffer.bytes[(buffer.writePosition + i) & (rewindBufferBytes - 1)] = record[i];
+        buffer.writePosition += size;
+    }
+    buffer.endTick = tick + 1;
+}
+
+// Get the state after a held tick into a game of the same match, returns false if the tick isn't held
+inline bool RestoreRewindTick(const RewindBuffer &buffer, int tick, Game &game)
+{
+    if (tick < buffer.firstTick || tick >= buffer.endTick) return false;
+
+    int slot = RewindSlot(tick);
+    RewindState state = buffer.keyframes[slot];
+    if (tick != buffer.keyframeTicks[slot])
+    {
+        unsigned int position = buffer.offsets[tick % rewindTickCapacity];
+        const unsigned int ring = rewindBufferBytes - 1;
+        unsigned int mask = buffer.bytes[position & ring] | ((unsigned int)buffer.bytes[(position + 1) & ring] << 8);
+
+        int changed = 0;
+        for (unsigned int m = mask; m; m &= m - 1) changed++;
+        unsigned int lengths = position + 2, data = lengths + (changed + 3) / 4;
+
+        int c = 0;
+        for (int i = 0; i < rewindWords; i++)
+        {
+            if (!(mask & (1u << i))) continue;
+            int length = ((buffer.bytes[(lengths + c / 4) & ring] >> (2 * (c % 4))) & 3) + 1;
+            unsigned int change = 0;
+            for (int b = 0; b < length; b++) change |= (unsigned int)buffer.bytes[data++ & ring] << (8 * b);
+            state.words[i] ^= change;
+            c++;
+        }
+    }
+
+    UnpackRewindState(state, tick, game);
+    return true;
+}
+
+// Forget the ticks after a tick, so play carries on from it (its space in the ring is used again)
+inline void TruncateRewind(RewindBuffer &buffer, int tick)
+{
+    int end = tick + 1;
+    if (end >= buffer.endTick) return;
+    if (end <= buffer.firstTick)
+    {
+        buffer.firstTick = buffer.endTick = end;
+        return;
+    }
+
+    int slot = RewindSlot(end);
+    buffer.writePosition = (end == buffer.keyframeTicks[slot]) ? buffer.blockOffsets[slot] : buffer.offsets[end % rewindTickCapacity];
+    buffer.endTick = end;
+}
+
+#endif // REWIND_H
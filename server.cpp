@@ -0,0 +1,922 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium server: hosts thousands of online matches on one Linux box
+*
+*   The server is split into shards, one per core. Each shard is a thread pinned to its core with
+*   its own UDP socket bound to the shared port (SO_REUSEPORT, so the kernel spreads clients over
+*   the shards and a client always reaches the same one), its own epoll set and a timerfd firing at
+*   the tick rate. A shard owns its clients and matches outright, so shards never share or lock.
+*
+*   Whenever its socket is readable a shard drains it in batches (recvmmsg). On every tick it steps
+*   each of its matches with UpdateGame, the same code the game runs, and sends both clients of
+*   each match the new state in batches (sendmmsg). The packets are described in protocol.h; each
+*   state is a snapshot delta encoded against the newest one its client acknowledged (snapshot.h),
+*   so a match keeps its last few quantised states and the shard's tick number identifies them.
+*
+*   Clients are paired into matches in the order they join their shard. A won match restarts
+*   after a few seconds, and a client that hasn't been heard from for a while is dropped.
+*
+*   Spectators watch a table (a match slot) of the shard they reach. Every spectator of a table
+*   gets the same bytes, so a few times a second the shard encodes the table's state once into a
+*   reference counted frame and queues that one frame to all of them, sendmmsg reading it straight
+*   from the frame with no copy per spectator. Frames are keyframes now and then, and deltas against
+*   the latest keyframe in between, so a late joiner is sent that keyframe and decodes from there,
+*   and a lost frame costs a spectator nothing but that frame.
+*
+*   Usage: server [options]
+*       --port N            UDP port (default 7777)
+*       --shards N          shards, one thread pinned to each core (default all cores)
+*       --tick-rate N       ticks per second (default 60)
+*       --max-clients N     clients a shard can hold (default 65536)
+*       --spectator-rate N  frames per second sent to spectators (default 20)
+*       --max-spectators N  spectators a shard can hold (default 65536)
+*
+*   Linux only. Build: g++ server.cpp -o server -O2 -pthread
+*
+******************************************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "pongsim.h"
+#include "protocol.h"
+#include "specsim.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int batchSize = 64;                   // Packets received or sent per system call
+const int clientIndexBits = 20;             // Low bits of a client id are its slot in the shard, the rest are random
+const double clientTimeout = 5.0;           // Seconds of silence before a client is dropped
+const double matchRestartDelay = 3.0;       // Seconds a won match shows its result before restarting
+const int maxCatchUpTicks = 4;              // Ticks a late shard runs at once before giving up on the missed ones
+const int socketBufferSize = 8 << 20;       // Kernel buffer for each shard's socket
+const int spectatorKeyframeTicks = 30;      // Ticks between the keyframes sent to spectators
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for the command line options
+struct Options
+{
+    int port;
+    int shards;
+    int tickRate;
+    int maxClients;
+    int spectatorRate;
+    int maxSpectators;
+};
+
+// Create a structure for a connected client
+struct Client
+{
+    bool used;
+    unsigned int id;                // id handed out in JOINED (slot in the low bits)
+    unsigned int nonce;             // nonce of the JOIN that created the client, to answer repeated JOINs
+    sockaddr_in address;            // where to send the client's packets
+    int match;                      // match the client plays in
+    int side;                       // 1 for the left paddle, 2 for the right
+    PaddleInput input;              // newest input received
+    unsigned int sequence;          // sequence of the newest input received
+    unsigned int stateAck;          // newest shard tick the client has received the state of
+    unsigned int seatedTick;        // first shard tick of the client's current match, older acks are from another match
+    double lastHeard;               // time the client last sent a packet
+};
+
+// Create a structure for a packet shared by every spectator of a table
+// Each queued send holds a reference, and so does a table for its latest keyframe; the shard's thread is the only user
+struct SpectatorFrame
+{
+    int references;
+    int size;
+    unsigned char data[maxPacketSize];
+};
+
+// Create a structure for a spectator
+struct Spectator
+{
+    bool used;
+    unsigned int id;                // id handed out in WATCHING (slot in the low bits)
+    unsigned int nonce;             // nonce of the WATCH that created the spectator
+    sockaddr_in address;
+    int table;                      // match slot watched
+    int position;                   // place in the table's list of spectators
+    double lastHeard;
+};
+
+// Create a structure for a match hosted by a shard
+struct Match
+{
+    bool used;
+    Game game;
+    UpdateGameFunction update;      // UpdateGame specialised for the match's rules (specsim.h)
+    int clients[2];                 // left and right client, -1 while waiting for one
+    int restartTicks;               // ticks left before a won match restarts
+    SnapshotHistory history;        // quantised states of the last few ticks, baselines for the clients
+
+    std::vector<int> spectators;    // spectators watching the table, they stay when the match is replaced
+    SpectatorFrame *keyframe;       // latest keyframe sent to them, 0 if none
+    unsigned int keyframeTick;
+    QuantisedState keyframeState;
+};
+
+// Create a structure for the packets a shard is about to send in one batch
+struct SendBatch
+{
+    mmsghdr headers[batchSize];
+    iovec vectors[batchSize];
+    sockaddr_in addresses[batchSize];
+    unsigned char buffers[batchSize][maxPacketSize];
+    int count;
+};
+
+// Create a structure for the spectator frames a shard is about to send in one batch
+struct SpectatorBatch
+{
+    mmsghdr headers[batchSize];
+    iovec vectors[batchSize];
+    SpectatorFrame *frames[batchSize];      // frame of each packet, released once sent
+    int count;
+};
+
+// Create a structure for one shard: a thread, its socket and everything it hosts
+struct Shard
+{
+    int index;
+    int socket;
+    int epoll;
+    int timer;
+    std::thread thread;
+    double tickTime;
+    int ticksPerFrame;              // ticks between the frames sent to spectators
+    unsigned int tick;              // number of the shard's current tick, identifies the states sent
+    unsigned int random;            // for client ids
+
+    std::vector<Client> clients;
+    std::vector<int> freeClients;
+    std::vector<Match> matches;
+    std::vector<int> freeMatches;
+    int waitingMatch;               // match with one client waiting for an opponent, or -1
+    std::unordered_map<unsigned long long, int> joins;     // (address, nonce) of each client's JOIN -> client
+    SendBatch batch;
+
+    std::vector<Spectator> spectators;
+    std::vector<int> freeSpectators;
+    std::unordered_map<unsigned long long, int> watches;   // (address, nonce) of each spectator's WATCH -> spectator
+    std::vector<SpectatorFrame *> freeFrames;
+    SpectatorBatch spectatorBatch;
+
+    // Counters read by the main thread for the statistics
+    std::atomic<long long> ticks;
+    std::atomic<long long> packetsIn;
+    std::atomic<long long> packetsOut;
+    std::atomic<long long> packetsDropped;      // packets the socket couldn't take
+    std::atomic<long long> stateBytes;          // bytes of encoded snapshots sent
+    std::atomic<long long> spectatorPackets;    // frames sent to spectators
+    std::atomic<long long> busyNanoseconds;     // time spent handling packets and ticks
+    std::atomic<long long> overruns;            // ticks skipped because the shard fell behind
+    std::atomic<int> clientCount;
+    std::atomic<int> matchCount;                // matches with two clients
+    std::atomic<int> spectatorCount;
+};
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+//----------------------------------------------------------------------------------------------------
+std::atomic<bool> running(true);            // Cleared by Ctrl+C
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Get a monotonic time in seconds
+double NowSeconds()
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+void HandleInterrupt(int)
+{
+    running.store(false);
+}
+
+// Key for the joins map, so a repeated JOIN (its JOINED was lost) gets the same client back
+unsigned long long JoinKey(const sockaddr_in &address, unsigned int nonce)
+{
+    unsigned long long endpoint = ((unsigned long long)address.sin_addr.s_addr << 16) | address.sin_port;
+    return (endpoint * 0x9E3779B97F4A7C15ull) ^ nonce;
+}
+
+// Queue a packet to a client, sending the batch when it is full
+void FlushBatch(Shard &shard);
+
+unsigned char *QueuePacket(Shard &shard, const sockaddr_in &address)
+{
+    if (shard.batch.count == batchSize) FlushBatch(shard);
+    shard.batch.addresses[shard.batch.count] = address;
+    return shard.batch.buffers[shard.batch.count];
+}
+
+void CommitPacket(Shard &shard, int size)
+{
+    SendBatch &batch = shard.batch;
+    int i = batch.count;
+    batch.vectors[i].iov_base = batch.buffers[i];
+    batch.vectors[i].iov_len = size;
+    memset(&batch.headers[i], 0, sizeof(mmsghdr));
+    batch.headers[i].msg_hdr.msg_name = &batch.addresses[i];
+    batch.headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    batch.headers[i].msg_hdr.msg_iov = &batch.vectors[i];
+    batch.headers[i].msg_hdr.msg_iovlen = 1;
+    batch.count++;
+}
+
+// Send every queued packet (whatever the socket can't take is dropped, as a busy network would)
+void FlushBatch(Shard &shard)
+{
+    SendBatch &batch = shard.batch;
+    int sent = 0;
+    while (sent < batch.count)
+    {
+        int result = sendmmsg(shard.socket, batch.headers + sent, batch.count - sent, MSG_DONTWAIT);
+        if (result <= 0)
+        {
+            if (result < 0 && errno == EINTR) continue;
+            break;
+        }
+        sent += result;
+    }
+    shard.packetsOut += sent;
+    shard.packetsDropped += batch.count - sent;
+    batch.count = 0;
+}
+
+SpectatorFrame *AcquireFrame(Shard &shard)
+{
+    SpectatorFrame *frame;
+    if (!shard.freeFrames.empty())
+    {
+        frame = shard.freeFrames.back();
+        shard.freeFrames.pop_back();
+    }
+    else
+    {
+        frame = new SpectatorFrame();
+    }
+    frame->references = 0;
+    frame->size = 0;
+    return frame;
+}
+
+void ReleaseFrame(Shard &shard, SpectatorFrame *frame)
+{
+    if (--frame->references == 0) shard.freeFrames.push_back(frame);
+}
+
+// Queue a frame to a spectator (the packet points at the frame, nothing is copied), sending the batch when it is full
+void FlushSpectators(Shard &shard);
+
+void QueueFrame(Shard &shard, Spectator &spectator, SpectatorFrame *frame)
+{
+    SpectatorBatch &batch = shard.spectatorBatch;
+    if (batch.count == batchSize)
+    {
+        FlushBatch(shard);          // Packets queued before a frame go out before it (a WATCHING before its keyframe)
+        FlushSpectators(shard);
+    }
+
+    int i = batch.count++;
+    frame->references++;
+    batch.frames[i] = frame;
+    batch.vectors[i].iov_base = frame->data;
+    batch.vectors[i].iov_len = frame->size;
+    memset(&batch.headers[i], 0, sizeof(mmsghdr));
+    batch.headers[i].msg_hdr.msg_name = &spectator.address;
+    batch.headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    batch.headers[i].msg_hdr.msg_iov = &batch.vectors[i];
+    batch.headers[i].msg_hdr.msg_iovlen = 1;
+}
+
+void FlushSpectators(Shard &shard)
+{
+    SpectatorBatch &batch = shard.spectatorBatch;
+    int sent = 0;
+    while (sent < batch.count)
+    {
+        int result = sendmmsg(shard.socket, batch.headers + sent, batch.count - sent, MSG_DONTWAIT);
+        if (result <= 0)
+        {
+            if (result < 0 && errno == EINTR) continue;
+            break;
+        }
+        sent += result;
+    }
+    shard.packetsOut += sent;
+    shard.spectatorPackets += sent;
+    shard.packetsDropped += batch.count - sent;
+    for (int i = 0; i < batch.count; i++) ReleaseFrame(shard, batch.frames[i]);
+    batch.count = 0;
+}
+
+// Find the client a packet is from by its id, returns -1 if there is no such client
+int FindClient(Shard &shard, unsigned int id)
+{
+    unsigned int index = id & ((1u << clientIndexBits) - 1);
+    if (index >= shard.clients.size()) return -1;
+    const Client &client = shard.clients[index];
+    return (client.used && client.id == id) ? (int)index : -1;
+}
+
+int AllocateMatch(Shard &shard)
+{
+    int index;
+    if (!shard.freeMatches.empty())
+    {
+        index = shard.freeMatches.back();
+        shard.freeMatches.pop_back();
+    }
+    else
+    {
+        index = (int)shard.matches.size();
+        shard.matches.push_back(Match());
+    }
+    Match &match = shard.matches[index];
+    match.used = true;
+    match.clients[0] = match.clients[1] = -1;
+    match.restartTicks = 0;
+    InitialiseGame(match.game);
+    match.update = SelectUpdateGame(match.game.rules);
+    ClearSnapshotHistory(match.history);
+    if (match.keyframe) ReleaseFrame(shard, match.keyframe);
+    match.keyframe = 0;                     // The table's spectators start again from a keyframe of the new match
+    return index;
+}
+
+// Put a client into the match waiting for an opponent, or into a new match to wait for one
+void SeatClient(Shard &shard, int clientIndex)
+{
+    Client &client = shard.clients[clientIndex];
+    if (shard.waitingMatch < 0)
+    {
+        shard.waitingMatch = AllocateMatch(shard);
+    }
+
+    Match &match = shard.matches[shard.waitingMatch];
+    int seat = (match.clients[0] < 0) ? 0 : 1;
+    match.clients[seat] = clientIndex;
+    client.match = shard.waitingMatch;
+    client.side = seat + 1;
+    client.input = PaddleInput{ 0, 0 };
+    client.seatedTick = shard.tick + 1;
+    client.stateAck = 0;
+
+    if (match.clients[0] >= 0 && match.clients[1] >= 0)
+    {
+        InitialiseGame(match.game);         // Both players are here - start the match
+        shard.waitingMatch = -1;
+        shard.matchCount++;
+    }
+}
+
+// Handle a JOIN, giving the client a place in a match (or its old place if the JOIN was repeated)
+void HandleJoin(Shard &shard, const sockaddr_in &address, PacketReader &reader, double now)
+{
+    unsigned int nonce = ReadU32(reader);
+    if (reader.overflow) return;
+
+    unsigned long long key = JoinKey(address, nonce);
+    std::unordered_map<unsigned long long, int>::iterator found = shard.joins.find(key);
+    int clientIndex = (found != shard.joins.end()) ? found->second : -1;
+
+    if (clientIndex < 0)
+    {
+        if (shard.freeClients.empty()) return;      // Full - the client will retry or go elsewhere
+
+        clientIndex = shard.freeClients.back();
+        shard.freeClients.pop_back();
+
+        Client &client = shard.clients[clientIndex];
+        shard.random ^= shard.random << 13;
+        shard.random ^= shard.random >> 17;
+        shard.random ^= shard.random << 5;
+        client.used = true;
+        client.id = (shard.random << clientIndexBits) | (unsigned int)clientIndex;
+        client.nonce = nonce;
+        client.address = address;
+        client.sequence = 0;
+        client.lastHeard = now;
+        shard.joins[key] = clientIndex;
+        shard.clientCount++;
+
+        SeatClient(shard, clientIndex);
+    }
+
+    const Client &client = shard.clients[clientIndex];
+    PacketWriter writer = BeginPacket(QueuePacket(shard, address), maxPacketSize, PACKET_JOINED);
+    WriteU32(writer, nonce);
+    WriteU32(writer, client.id);
+    WriteU8(writer, client.side);
+    CommitPacket(shard, writer.size);
+}
+
+// Handle a WATCH, seating a new spectator at a table (a repeated WATCH keeps it there)
+void HandleWatch(Shard &shard, const sockaddr_in &address, PacketReader &reader, double now)
+{
+    unsigned int nonce = ReadU32(reader);
+    unsigned int table = ReadU32(reader);
+    if (reader.overflow || shard.matches.empty()) return;
+
+    unsigned long long key = JoinKey(address, nonce);
+    std::unordered_map<unsigned long long, int>::iterator found = shard.watches.find(key);
+    int spectatorIndex = (found != shard.watches.end()) ? found->second : -1;
+    bool joined = spectatorIndex < 0;
+
+    if (joined)
+    {
+        if (shard.freeSpectators.empty()) return;
+
+        spectatorIndex = shard.freeSpectators.back();
+        shard.freeSpectators.pop_back();
+
+        Spectator &spectator = shard.spectators[spectatorIndex];
+        shard.random ^= shard.random << 13;
+        shard.random ^= shard.random >> 17;
+        shard.random ^= shard.random << 5;
+        spectator.used = true;
+        spectator.id = (shard.random << clientIndexBits) | (unsigned int)spectatorIndex;
+        spectator.nonce = nonce;
+        spectator.address = address;
+        spectator.table = (int)(table % shard.matches.size());
+        shard.watches[key] = spectatorIndex;
+        shard.spectatorCount++;
+
+        Match &match = shard.matches[spectator.table];
+        spectator.position = (int)match.spectators.size();
+        match.spectators.push_back(spectatorIndex);
+    }
+
+    Spectator &spectator = shard.spectators[spectatorIndex];
+    spectator.lastHeard = now;
+
+    PacketWriter writer = BeginPacket(QueuePacket(shard, address), maxPacketSize, PACKET_WATCHING);
+    WriteU32(writer, nonce);
+    WriteU32(writer, spectator.id);
+    WriteU32(writer, spectator.table);
+    WriteU8(writer, shard.ticksPerFrame);
+    CommitPacket(shard, writer.size);
+
+    // A late joiner gets the latest keyframe after the WATCHING, the frames that follow are deltas against it
+    Match &match = shard.matches[spectator.table];
+    if (joined && match.keyframe) QueueFrame(shard, spectator, match.keyframe);
+}
+
+void RemoveSpectator(Shard &shard, int spectatorIndex)
+{
+    Spectator &spectator = shard.spectators[spectatorIndex];
+    std::vector<int> &watching = shard.matches[spectator.table].spectators;
+
+    // Move the table's last spectator into the leaver's place
+    int last = watching.back();
+    watching[spectator.position] = last;
+    shard.spectators[last].position = spectator.position;
+    watching.pop_back();
+
+    shard.watches.erase(JoinKey(spectator.address, spectator.nonce));
+    spectator.used = false;
+    shard.freeSpectators.push_back(spectatorIndex);
+    shard.spectatorCount--;
+}
+
+// Send a table's state to its spectators, encoded once into a frame they all share
+void SendToSpectators(Shard &shard, int table, unsigned int tick, const QuantisedState &state)
+{
+    Match &match = shard.matches[table];
+    bool keyframe = !match.keyframe || tick - match.keyframeTick >= (unsigned int)spectatorKeyframeTicks;
+
+    SpectatorFrame *frame = AcquireFrame(shard);
+    PacketWriter writer = BeginPacket(frame->data, maxPacketSize, PACKET_SPECTATE);
+    WriteU32(writer, table);
+    WriteU32(writer, tick);
+    int size = keyframe ? EncodeSnapshot(state, 0, 0, frame->data + writer.size, maxPacketSize - writer.size)
+                        : EncodeSnapshot(state, &match.keyframeState, tick - match.keyframeTick, frame->data + writer.size, maxPacketSize - writer.size);
+    frame->size = writer.size + size;
+
+    if (keyframe)
+    {
+        if (match.keyframe) ReleaseFrame(shard, match.keyframe);
+        frame->references++;
+        match.keyframe = frame;
+        match.keyframeTick = tick;
+        match.keyframeState = state;
+    }
+
+    frame->references++;        // Held while queueing, so a batch flushed part way through can't free it
+    for (size_t s = 0; s < match.spectators.size(); s++) QueueFrame(shard, shard.spectators[match.spectators[s]], frame);
+    ReleaseFrame(shard, frame);
+}
+
+// Remove a client, its opponent goes back to waiting for a new one
+void RemoveClient(Shard &shard, int clientIndex)
+{
+    Client &client = shard.clients[clientIndex];
+    Match &match = shard.matches[client.match];
+    int opponent = match.clients[2 - client.side];
+    bool wasPlaying = match.clients[0] >= 0 && match.clients[1] >= 0;
+
+    shard.joins.erase(JoinKey(client.address, client.nonce));
+    client.used = false;
+    shard.freeClients.push_back(clientIndex);
+    shard.clientCount--;
+    if (wasPlaying) shard.matchCount--;
+
+    // Free the match, unless it is the one waiting for an opponent (it keeps waiting, now empty)
+    int matchIndex = client.match;
+    match.clients[client.side - 1] = -1;
+    if (matchIndex != shard.waitingMatch)
+    {
+        match.used = false;
+        match.clients[0] = match.clients[1] = -1;
+        shard.freeMatches.push_back(matchIndex);
+    }
+
+    if (opponent >= 0) SeatClient(shard, opponent);
+}
+
+// Handle one received packet
+void HandlePacket(Shard &shard, const unsigned char *data, int size, const sockaddr_in &address, double now)
+{
+    PacketReader reader;
+    int type = BeginReading(reader, data, size);
+
+    if (type == PACKET_JOIN)
+    {
+        HandleJoin(shard, address, reader, now);
+        return;
+    }
+    if (type == PACKET_WATCH)
+    {
+        HandleWatch(shard, address, reader, now);
+        return;
+    }
+    if (type == PACKET_UNWATCH)
+    {
+        unsigned int id = ReadU32(reader);
+        unsigned int index = id & ((1u << clientIndexBits) - 1);
+        if (!reader.overflow && index < shard.spectators.size() && shard.spectators[index].used && shard.spectators[index].id == id)
+        {
+            RemoveSpectator(shard, (int)index);
+        }
+        return;
+    }
+    if (type != PACKET_INPUT && type != PACKET_LEAVE) return;
+
+    int clientIndex = FindClient(shard, ReadU32(reader));
+    if (clientIndex < 0) return;
+    Client &client = shard.clients[clientIndex];
+    client.lastHeard = now;
+    client.address = address;       // Follow the client if its address changes (e.g. NAT rebinding)
+
+    if (type == PACKET_LEAVE)
+    {
+        RemoveClient(shard, clientIndex);
+        return;
+    }
+
+    unsigned int sequence = ReadU32(reader);
+    unsigned int stateAck = ReadU32(reader);
+    unsigned int up = ReadU8(reader), down = ReadU8(reader);
+    if (reader.overflow) return;
+
+    if ((int)(stateAck - client.stateAck) > 0) client.stateAck = stateAck;
+
+    // Inputs can arrive out of order - only a newer one replaces the current input
+    if ((int)(sequence - client.sequence) > 0 || client.sequence == 0)
+    {
+        client.sequence = sequence;
+        client.input.up = DequantiseHeld(up);
+        client.input.down = DequantiseHeld(down);
+    }
+}
+
+// Receive every packet waiting on the shard's socket
+void ReceivePackets(Shard &shard)
+{
+    static thread_local unsigned char buffers[batchSize][maxPacketSize];
+    static thread_local sockaddr_in addresses[batchSize];
+    static thread_local iovec vectors[batchSize];
+    static thread_local mmsghdr headers[batchSize];
+
+    double now = NowSeconds();
+    for (;;)
+    {
+        for (int i = 0; i < batchSize; i++)
+        {
+            vectors[i].iov_base = buffers[i];
+            vectors[i].iov_len = maxPacketSize;
+            memset(&headers[i], 0, sizeof(mmsghdr));
+            headers[i].msg_hdr.msg_name = &addresses[i];
+            headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            headers[i].msg_hdr.msg_iov = &vectors[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int received = recvmmsg(shard.socket, headers, batchSize, MSG_DONTWAIT, 0);
+        if (received <= 0) break;
+
+        shard.packetsIn += received;
+        for (int i = 0; i < received; i++)
+        {
+            HandlePacket(shard, buffers[i], headers[i].msg_len, addresses[i], now);
+        }
+        if (received < batchSize) break;
+    }
+    FlushBatch(shard);
+    FlushSpectators(shard);
+}
+
+// Step every match of the shard by one tick and send the new states
+void TickShard(Shard &shard)
+{
+    int restartTicks = (int)(matchRestartDelay / shard.tickTime);
+    unsigned int tick = ++shard.tick;
+    long long stateBytes = 0;
+
+    for (size_t m = 0; m < shard.matches.size(); m++)
+    {
+        Match &match = shard.matches[m];
+        if (!match.used || match.clients[0] < 0 || match.clients[1] < 0) continue;
+
+        Client &left = shard.clients[match.clients[0]];
+        Client &right = shard.clients[match.clients[1]];
+
+        if (!match.game.gameWon)
+        {
+            match.update(match.game, left.input, right.input, (float)shard.tickTime);
+            if (match.game.gameWon) match.restartTicks = restartTicks;
+        }
+        else if (--match.restartTicks <= 0)
+        {
+            InitialiseGame(match.game);     // Rematch
+        }
+
+        QuantisedState state;
+        QuantiseState(match.game, FindSnapshot(match.history, tick - 1), state);
+        StoreSnapshot(match.history, tick, state);
+
+        for (int side = 0; side < 2; side++)
+        {
+            // Encode against the newest state the client has, if it is from this match and still kept
+            const Client &client = side ? right : left;
+            const QuantisedState *baseline = 0;
+            if ((int)(client.stateAck - client.seatedTick) >= 0 && tick - client.stateAck < (unsigned int)snapshotHistory)
+            {
+                baseline = FindSnapshot(match.history, client.stateAck);
+            }
+
+            int size = WriteStatePacket(QueuePacket(shard, client.address), maxPacketSize, client.id, tick, client.sequence,
+                                        state, baseline, tick - client.stateAck);
+            CommitPacket(shard, size);
+            stateBytes += size;
+        }
+
+        if (!match.spectators.empty() && tick % shard.ticksPerFrame == 0) SendToSpectators(shard, (int)m, tick, state);
+    }
+    FlushBatch(shard);
+    FlushSpectators(shard);
+    shard.ticks++;
+    shard.stateBytes += stateBytes;
+}
+
+// Drop clients and spectators that haven't sent anything for a while
+void DropSilentClients(Shard &shard, double now)
+{
+    for (size_t c = 0; c < shard.clients.size(); c++)
+    {
+        if (shard.clients[c].used && now - shard.clients[c].lastHeard > clientTimeout) RemoveClient(shard, (int)c);
+    }
+    for (size_t s = 0; s < shard.spectators.size(); s++)
+    {
+        if (shard.spectators[s].used && now - shard.spectators[s].lastHeard > clientTimeout) RemoveSpectator(shard, (int)s);
+    }
+}
+
+// Body of a shard's thread
+void RunShard(Shard &shard, int cores)
+{
+    // Pin the shard to its own core, so its matches stay in that core's caches
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(shard.index % cores, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+    epoll_event events[2];
+    double lastSweep = NowSeconds();
+
+    while (running.load())
+    {
+        int count = epoll_wait(shard.epoll, events, 2, 100);
+        double start = NowSeconds();
+
+        for (int e = 0; e < count; e++)
+        {
+            if (events[e].data.fd == shard.socket)
+            {
+                ReceivePackets(shard);
+            }
+            else if (events[e].data.fd == shard.timer)
+            {
+                unsigned long long expirations = 0;
+                if (read(shard.timer, &expirations, sizeof(expirations)) != sizeof(expirations)) continue;
+
+                // Run the ticks that are due, a shard that fell far behind skips the rest instead of spiralling
+                unsigned long long ticks = (expirations < (unsigned long long)maxCatchUpTicks) ? expirations : maxCatchUpTicks;
+                shard.overruns += expirations - ticks;
+                for (unsigned long long t = 0; t < ticks; t++) TickShard(shard);
+            }
+        }
+
+        if (start - lastSweep > 1.0)
+        {
+            DropSilentClients(shard, start);
+            lastSweep = start;
+        }
+        shard.busyNanoseconds += (long long)((NowSeconds() - start) * 1e9);
+    }
+}
+
+// Set up a shard's socket, epoll set and timer, returns false on failure
+bool OpenShard(Shard &shard, const Options &options)
+{
+    shard.socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (shard.socket < 0) return false;
+
+    int on = 1;
+    setsockopt(shard.socket, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+    setsockopt(shard.socket, SOL_SOCKET, SO_RCVBUF, &socketBufferSize, sizeof(socketBufferSize));
+    setsockopt(shard.socket, SOL_SOCKET, SO_SNDBUF, &socketBufferSize, sizeof(socketBufferSize));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(options.port);
+    if (bind(shard.socket, (sockaddr *)&address, sizeof(address)) < 0) return false;
+
+    shard.timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    long long period = (long long)(1e9 / options.tickRate);
+    itimerspec interval = { { period / 1000000000, period % 1000000000 }, { period / 1000000000, period % 1000000000 } };
+    if (shard.timer < 0 || timerfd_settime(shard.timer, 0, &interval, 0) < 0) return false;
+
+    shard.epoll = epoll_create1(0);
+    if (shard.epoll < 0) return false;
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = shard.socket;
+    epoll_ctl(shard.epoll, EPOLL_CTL_ADD, shard.socket, &event);
+    event.data.fd = shard.timer;
+    epoll_ctl(shard.epoll, EPOLL_CTL_ADD, shard.timer, &event);
+
+    shard.tickTime = 1.0 / options.tickRate;
+    shard.ticksPerFrame = (int)((double)options.tickRate / options.spectatorRate + 0.5);
+    if (shard.ticksPerFrame < 1) shard.ticksPerFrame = 1;
+    shard.random = 0x9E3779B9u * (shard.index + 1) ^ (unsigned int)time(0);
+    if (shard.random == 0) shard.random = 1;
+    shard.clients.resize(options.maxClients);
+    for (int c = options.maxClients - 1; c >= 0; c--)
+    {
+        shard.clients[c].used = false;
+        shard.freeClients.push_back(c);
+    }
+    shard.spectators.resize(options.maxSpectators);
+    for (int s = options.maxSpectators - 1; s >= 0; s--)
+    {
+        shard.spectators[s].used = false;
+        shard.freeSpectators.push_back(s);
+    }
+    shard.matches.reserve(options.maxClients / 2 + 1);
+    shard.waitingMatch = -1;
+    shard.batch.count = 0;
+    shard.spectatorBatch.count = 0;
+    shard.tick = 0;
+    shard.ticks = shard.packetsIn = shard.packetsOut = shard.packetsDropped = shard.stateBytes = shard.busyNanoseconds = shard.overruns = 0;
+    shard.spectatorPackets = 0;
+    shard.clientCount = shard.matchCount = shard.spectatorCount = 0;
+    return true;
+}
+
+// Print a line of statistics covering every shard, since the last line
+void PrintStatistics(const std::vector<Shard *> &shards, std::vector<long long> &last, double elapsed)
+{
+    long long totals[7] = { 0, 0, 0, 0, 0, 0, 0 };  // ticks, in, out, dropped, overruns, state bytes, spectator frames
+    int clients = 0, matches = 0, spectators = 0;
+    double maxBusy = 0, sumBusy = 0;
+
+    for (size_t s = 0; s < shards.size(); s++)
+    {
+        const Shard &shard = *shards[s];
+        long long values[8] = { shard.ticks.load(), shard.packetsIn.load(), shard.packetsOut.load(), shard.packetsDropped.load(),
+                                shard.overruns.load(), shard.stateBytes.load(), shard.spectatorPackets.load(), shard.busyNanoseconds.load() };
+        for (int v = 0; v < 7; v++) totals[v] += values[v] - last[s * 8 + v];
+
+        double busy = (values[7] - last[s * 8 + 7]) * 1e-9 / elapsed;
+        sumBusy += busy;
+        if (busy > maxBusy) maxBusy = busy;
+
+        for (int v = 0; v < 8; v++) last[s * 8 + v] = values[v];
+        clients += shard.clientCount.load();
+        matches += shard.matchCount.load();
+        spectators += shard.spectatorCount.load();
+    }
+
+    printf("matches %6d  clients %6d  spectators %6d  ticks/s %6.0f  in/s %8.0f  out/s %8.0f  frames/s %8.0f  state B/s %9.0f  dropped %lld  overruns %lld  busy %5.1f%% (max shard %5.1f%%)\n",
+           matches, clients, spectators, totals[0] / elapsed / shards.size(), totals[1] / elapsed, totals[2] / elapsed, totals[6] / elapsed,
+           totals[5] / elapsed, totals[3], totals[4], 100 * sumBusy / shards.size(), 100 * maxBusy);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    Options options = { defaultServerPort, (int)std::thread::hardware_concurrency(), 60, 65536, 20, 65536 };
+    if (options.shards < 1) options.shards = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) options.port = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) options.shards = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc) options.tickRate = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--max-clients") == 0 && i + 1 < argc) options.maxClients = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--spectator-rate") == 0 && i + 1 < argc) options.spectatorRate = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--max-spectators") == 0 && i + 1 < argc) options.maxSpectators = atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (options.shards < 1 || options.tickRate < 1 || options.maxClients < 2 || options.maxClients > (1 << clientIndexBits) ||
+        options.spectatorRate < 1 || options.maxSpectators < 0 || options.maxSpectators > (1 << clientIndexBits))
+    {
+        fprintf(stderr, "Invalid options\n");
+        return 1;
+    }
+
+    signal(SIGINT, HandleInterrupt);
+    signal(SIGTERM, HandleInterrupt);
+
+    int cores = (int)std::thread::hardware_concurrency();
+    if (cores < 1) cores = 1;
+
+    std::vector<Shard *> shards;
+    for (int s = 0; s < options.shards; s++)
+    {
+        Shard *shard = new Shard();
+        shard->index = s;
+        if (!OpenShard(*shard, options))
+        {
+            fprintf(stderr, "Couldn't open shard %d on port %d: %s\n", s, options.port, strerror(errno));
+            return 1;
+        }
+        shards.push_back(shard);
+    }
+    for (int s = 0; s < options.shards; s++) shards[s]->thread = std::thread(RunShard, std::ref(*shards[s]), cores);
+
+    printf("Serving on UDP port %d with %d shards at %d ticks per second\n", options.port, options.shards, options.tickRate);
+
+    std::vector<long long> last(shards.size() * 8, 0);
+    double lastPrint = NowSeconds();
+    while (running.load())
+    {
+        usleep(100000);
+        double now = NowSeconds();
+        if (now - lastPrint >= 1.0)
+        {
+            PrintStatistics(shards, last, now - lastPrint);
+            lastPrint = now;
+        }
+    }
+
+    for (size_t s = 0; s < shards.size(); s++)
+    {
+        shards[s]->thread.join();
+        close(shards[s]->socket);
+        close(shards[s]->timer);
+        close(shards[s]->epoll);
+        delete shards[s];
+    }
+    return 0;
+}
@@ -0,0 +1,320 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium simulation thread: the fixed simulation ticks run apart from drawing
+*
+*   The simulation runs on its own thread at its own tick rate (--sim-rate, e.g. 240 Hz) and after
+*   each batch of ticks publishes a snapshot of the game through a triple buffer (triplebuffer.h).
+*   The main thread draws the newest snapshot whenever the display is ready for a frame without
+*   ever waiting for the simulation, so the simulation keeps its rate whatever the display runs at
+*   (60 Hz, 144 Hz or a swap blocked on vsync) and a slow frame never holds up a tick.
+*
+*   Key transitions still arrive on the main thread (GLFW must be polled there) and reach the
+*   simulation thread through the input sampler's lock-free queue (input.h). While the game isn't
+*   being played the simulation thread sleeps until the main thread wakes it (or simIdlePeriod);
+*   between ticks it sleeps until the next one is due or the main thread wakes it, so a restart or
+*   a rewind is picked up straight away. The time comes from glfwGetTime, so a program without a
+*   window (alloccheck) can run the loop on a clock of its own.
+*
+*   With --record every tick's inputs and state hash go into a replay (replay.h), written out when
+*   the match is won or the game closes, so replaycheck can find where another run drifted from it.
+*   Room for replayReserveSeconds of ticks and their encoding is reserved as the thread starts, so
+*   recording a match that long and saving it never allocates.
+*
+*   Every tick also goes into a rewind buffer (rewind.h). While the main thread holds rewinding on,
+*   each tick that falls due steps the game back a tick instead of forward, so the last 30 seconds
+*   play backwards at normal speed; play carries on from wherever it is let go (a won match too).
+*
+******************************************************************************************************/
+
+#ifndef SIMTHREAD_H
+#define SIMTHREAD_H
+
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "pongsim.h"
+#include "input.h"
+#include "triplebuffer.h"
+#include "replay.h"
+#include "rewind.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const double simMaxStall = 0.25;        // Longest stall the simulation catches up on (e.g. the window being dragged)
+const double simIdlePeriod = 0.1;       // Longest sleep of the simulation while the game isn't being played
+const int replayReserveSeconds = 60 * 10;       // Match time a replay has room for before it grows (10 minutes, at any tick rate)
+const int ballEventCapacity = 64;       // Latest ball events a snapshot holds, many frames' worth
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create an enum of the things that happen to a ball that the main thread plays a sound for
+enum BallEventType { BALL_HIT, BALL_SCORED };
+
+// Create a structure for a ball bouncing off a player (where it bounced) or being scored (where it left the court)
+struct BallEvent
+{
+    BallEventType type;
+    float x, y;
+};
+
+// Create a structure for what the simulation hands to the main thread after a batch of ticks
+struct GameSnapshot
+{
+    Game game;                  // state of the game after the last tick
+    double simTime;             // time the simulation has reached, key transitions before it are in the snapshot
+    double publishTime;         // time the snapshot was published
+    BallEvent events[ballEventCapacity];    // the latest ball events, event n at n % ballEventCapacity
+    int eventCount;             // ball events since the program started
+    int version;                // bumped every time the game changes, so the main thread can skip redrawing it
+};
+
+// Create a structure for the simulation thread and what the main thread tells it
+struct SimulationThread
+{
+    TripleBuffer<GameSnapshot> snapshots;   // newest state of the game, written by the simulation thread
+    std::thread thread;
+    std::atomic<bool> running;              // cleared by the main thread to stop the simulation
+    std::atomic<bool> playing;              // set by the main thread once the gameplay screen is shown
+    std::atomic<int> restarts;              // bumped by the main thread to start a new game
+    std::atomic<bool> rewinding;            // set by the main thread while the game should play backwards
+    std::mutex mutex;                       // guards sleeping on wakeup
+    std::condition_variable wakeup;         // wakes the simulation when the main thread changes one of the above
+    double tickTime;                        // length of one simulation tick
+    const char *recordPath;                 // file the match's replay is written to, 0 if not recording
+    Replay replay;                          // replay of the match being played (only touched by the simulation thread)
+    std::vector<unsigned char> replayBytes; // the replay encoded for saving, room kept between saves
+    RewindBuffer rewind;                    // recent ticks of the match (only touched by the simulation thread)
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Publish the state of the game to the main thread
+inline void PublishGame(SimulationThread &sim, const Game &game, double simTime, const BallEvent *events, int eventCount, int version)
+{
+    GameSnapshot &snapshot = WriteSlot(sim.snapshots);
+    snapshot.game = game;
+    snapshot.simTime = simTime;
+    snapshot.publishTime = glfwGetTime();
+    memcpy(snapshot.events, events, sizeof(snapshot.events));
+    snapshot.eventCount = eventCount;
+    snapshot.version = version;
+    PublishSlot(sim.snapshots);
+}
+
+// Add the balls a tick bounced or scored to the ring of ball events (before is each ball as the tick started)
+inline void RecordBallEvents(BallEvent *events, int &eventCount, const TickEvents &tick, const Game &game, const Ball before[2])
+{
+    const Ball *balls[2] = { &game.ball1, &game.ball2 };
+    for (int b = 0; b < 2; b++)
+    {
+        if (!(tick.hitMask & (1 << b))) continue;
+        events[eventCount++ % ballEventCapacity] = BallEvent{ BALL_HIT, balls[b]->position.x, balls[b]->position.y };
+    }
+    for (int b = 0; b < 2; b++)
+    {
+        if (!(tick.resetMask & (1 << b))) continue;
+        events[eventCount++ % ballEventCapacity] = BallEvent{ BALL_SCORED, before[b].position.x, before[b].position.y };
+    }
+}
+
+// Run the simulation until the main thread stops it (body of the simulation thread)
+inline void SimulationLoop(SimulationThread &sim)
+{
+    Game game;
+    InitialiseGame(game);
+    PaddleKeys keys = {};
+    int restartsDone = 0, version = 0;
+    BallEvent events[ballEventCapacity] = {};
+    int eventCount = 0;
+    double simTime = glfwGetTime();
+    bool replaySaved = false;
+    bool rewound = false;               // Whether the game has been stepped back since it was last played forward
+    if (sim.recordPath) BeginReplay(sim.replay, game.rules, (float)sim.tickTime);
+    RecordRewindTick(sim.rewind, game);
+
+    while (sim.running.load())
+    {
+        double now = glfwGetTime();
+
+        // Logic for new game/round reset
+        int restarts = sim.restarts.load();
+        if (restarts != restartsDone)
+        {
+            InitialiseGame(game);       // Reset the game objects to their starting positions etc.
+            if (sim.recordPath) BeginReplay(sim.replay, game.rules, (float)sim.tickTime);
+            RecordRewindTick(sim.rewind, game);     // Tick 0 starts the rewind buffer afresh
+            replaySaved = false;
+            rewound = false;
+            restartsDone = restarts;
+            version++;
+            glfwPostEmptyEvent();       // The main thread may be sleeping on an unchanged frame
+        }
+
+        // Play carries on from the tick rewinding stopped at, so the ticks after it are forgotten
+        bool playing = sim.playing.load();
+        bool rewinding = playing && sim.rewinding.load();
+        if (rewound && !rewinding)
+        {
+            TruncateRewind(sim.rewind, game.tick);
+            if (sim.recordPath) sim.replay.ticks.resize(game.tick);
+            replaySaved = false;
+            rewound = false;
+        }
+
+        bool idle = !playing || (game.gameWon && !rewinding);
+        if (idle)
+        {
+            // Keep track of which keys are held while the game isn't being played
+            SkipInput(inputSampler.queue, keys, now);
+            simTime = now;
+        }
+        else if (rewinding)
+        {
+            if (now - simTime > simMaxStall) simTime = now;
+
+            // Step back a tick for every tick that is due, until the oldest tick held (keys pressed meanwhile are skipped)
+            while (simTime + sim.tickTime <= now)
+            {
+                simTime += sim.tickTime;
+                SkipInput(inputSampler.queue, keys, simTime);
+                if (RestoreRewindTick(sim.rewind, game.tick - 1, game))
+                {
+                    rewound = true;
+                    version++;
+                }
+            }
+        }
+        else
+        {
+            if (now - simTime > simMaxStall) simTime = now;     // Don't try to catch up after a long stall
+
+            // Run the fixed simulation ticks that are due
+            while (!game.gameWon && simTime + sim.tickTime <= now)
+            {
+                // How long each key was held during this tick
+                PaddleInput player1Input, player2Input;
+                ReadTickInput(inputSampler.queue, keys, simTime, sim.tickTime, player1Input, player2Input);
+
+                // Move, collide and score the game objects for this tick
+                Ball before[2] = { game.ball1, game.ball2 };
+                TickEvents tick = UpdateGame(game, player1Input, player2Input, (float)sim.tickTime);
+                simTime += sim.tickTime;
+                if (sim.recordPath) RecordReplayTick(sim.replay, player1Input, player2Input, game);
+                RecordRewindTick(sim.rewind, game);
+
+                RecordBallEvents(events, eventCount, tick, game, before);
+                version++;
+            }
+        }
+
+        PublishGame(sim, game, simTime, events, eventCount, version);
+
+        // Write the replay out once the match is won (the game is idle from then on)
+        if (sim.recordPath && game.gameWon && !replaySaved)
+        {
+            SaveReplay(sim.replay, sim.recordPath, sim.replayBytes);
+            replaySaved = true;
+        }
+
+        if (idle)
+        {
+            // Nothing to simulate - sleep until the main thread starts or restarts the game
+            std::unique_lock<std::mutex> lock(sim.mutex);
+            sim.wakeup.wait_for(lock, std::chrono::duration<double>(simIdlePeriod), [&]
+            {
+                return !sim.running.load() || sim.playing.load() != playing || sim.restarts.load() != restartsDone ||
+                       sim.rewinding.load() != rewinding;
+            });
+        }
+        else
+        {
+            // Sleep until the next tick is due, or the main thread changes something
+            double wait = simTime + sim.tickTime - glfwGetTime();
+            std::unique_lock<std::mutex> lock(sim.mutex);
+            if (wait > 0) sim.wakeup.wait_for(lock, std::chrono::duration<double>(wait), [&]
+            {
+                return !sim.running.load() || sim.playing.load() != playing || sim.restarts.load() != restartsDone ||
+                       sim.rewinding.load() != rewinding || glfwGetTime() >= simTime + sim.tickTime;
+            });
+        }
+    }
+
+    // The game was closed part way through a match - keep what was played of it
+    if (sim.recordPath && !replaySaved && !sim.replay.ticks.empty()) SaveReplay(sim.replay, sim.recordPath, sim.replayBytes);
+}
+
+// Start the simulation thread with a tick rate (ticks per second), must be called after InstallInputSampler
+// recordPath is the file to write the replay of each match to (each match overwrites the last), or 0
+inline void StartSimulation(SimulationThread &sim, int tickRate, const char *recordPath = 0)
+{
+    // Every slot starts as a new game, so the main thread has something to draw before the first publish
+    for (int i = 0; i < 3; i++)
+    {
+        GameSnapshot &snapshot = sim.snapshots.slots[i];
+        InitialiseGame(snapshot.game);
+        snapshot.simTime = snapshot.publishTime = glfwGetTime();
+        snapshot.eventCount = snapshot.version = 0;
+    }
+    InitialiseTripleBuffer(sim.snapshots);
+
+    sim.tickTime = 1.0 / tickRate;
+    sim.recordPath = recordPath;
+    if (recordPath)
+    {
+        sim.replay.ticks.reserve((size_t)replayReserveSeconds * tickRate);
+        sim.replayBytes.reserve(ReplayBytes((size_t)replayReserveSeconds * tickRate));
+    }
+    sim.running.store(true);
+    sim.playing.store(false);
+    sim.restarts.store(0);
+    sim.rewinding.store(false);
+    ClearRewind(sim.rewind, tickRate);
+    sim.thread = std::thread(SimulationLoop, std::ref(sim));
+}
+
+// Wake the simulation thread after changing running, playing, restarts or rewinding (or moving a program's own clock on)
+inline void WakeSimulation(SimulationThread &sim)
+{
+    {
+        std::lock_guard<std::mutex> lock(sim.mutex);        // Can't slip in between the simulation checking and sleeping
+    }
+    sim.wakeup.notify_one();
+}
+
+// Start playing the game (once the gameplay screen is shown)
+inline void PlaySimulation(SimulationThread &sim)
+{
+    sim.playing.store(true);
+    WakeSimulation(sim);
+}
+
+// Start a new game once the current one is won
+inline void RestartSimulation(SimulationThread &sim)
+{
+    sim.restarts.fetch_add(1);
+    WakeSimulation(sim);
+}
+
+// Play the game backwards (while the rewind key is held) or forwards again
+inline void RewindSimulation(SimulationThread &sim, bool rewinding)
+{
+    sim.rewinding.store(rewinding);
+    WakeSimulation(sim);
+}
+
+// Stop the simulation thread and wait for it to finish
+inline void StopSimulation(SimulationThread &sim)
+{
+    sim.running.store(false);
+    WakeSimulation(sim);
+    if (sim.thread.joinable()) sim.thread.join();
+}
+
+#endif // SIMTHREAD_H
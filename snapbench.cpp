@@ -0,0 +1,313 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium snapshot benchmark: size and speed of the snapshot codec (snapshot.h)
+*
+*   Records every tick of some bot matches, then encodes each tick against the tick a few ticks
+*   before it (the baseline a client would have acknowledged on a network with that much delay),
+*   checks every snapshot decodes back exactly, and prints the encoded sizes. It then times encoding
+*   and decoding on one core.
+*
+*   Last it plays the matches again at 240 ticks a second through the rewind buffer (rewind.h),
+*   checks every tick it still holds restores exactly, and prints its size and restore speed.
+*
+*   Usage: snapbench [options]
+*       --matches N         bot matches to record (default 20)
+*       --left/--right C    controllers playing them (default predict and search, see controllers.h)
+*
+*   Build: g++ snapbench.cpp -o snapbench.exe -O2
+*
+******************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "controllers.h"
+#include "rewind.h"
+#include "snapshot.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int maxMatchTicks = 60 * 60 * 10;         // A match still going after 10 minutes of game time is cut short
+const int baselineLags[] = { 1, 2, 4, 8, 16 };  // Ticks between a snapshot and its baseline
+const double timingSeconds = 1.0;               // Time each speed measurement runs for at least
+const int rewindTickRate = 240;                 // Tick rate the rewind buffer is measured at
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for the ticks of one recorded match
+struct Recording
+{
+    std::vector<QuantisedState> states;
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Play a bot match and keep the quantised state of every tick
+Recording RecordMatch(const Controller &left, const Controller &right, unsigned int seed)
+{
+    Recording recording;
+    Game game;
+    InitialiseGame(game);
+
+    ControllerState leftState, rightState;
+    InitialiseControllerState(leftState, seed);
+    InitialiseControllerState(rightState, seed ^ 0x5BD1E995u);
+
+    QuantisedState state;
+    QuantiseState(game, 0, state);
+    recording.states.push_back(state);
+
+    while (!game.gameWon && game.tick < maxMatchTicks)
+    {
+        PaddleInput leftInput = ControlPaddle(left, leftState, game, 1);
+        PaddleInput rightInput = ControlPaddle(right, rightState, game, 2);
+        UpdateGame(game, leftInput, rightInput, simTickTime);
+
+        QuantisedState next;
+        QuantiseState(game, &recording.states.back(), next);
+        recording.states.push_back(next);
+    }
+    return recording;
+}
+
+bool SameState(const QuantisedState &a, const QuantisedState &b)
+{
+    return memcmp(&a, &b, sizeof(QuantisedState)) == 0;
+}
+
+// Encode every tick against the tick lag ticks before it (a keyframe if lag is 0), returns false if any failed to decode exactly
+bool MeasureSizes(const std::vector<Recording> &recordings, int lag, std::vector<int> &sizes)
+{
+    unsigned char buffer[maxSnapshotBytes];
+    for (size_t r = 0; r < recordings.size(); r++)
+    {
+        const std::vector<QuantisedState> &states = recordings[r].states;
+        for (size_t t = lag; t < states.size(); t++)
+        {
+            const QuantisedState *baseline = lag ? &states[t - lag] : 0;
+            int size = EncodeSnapshot(states[t], baseline, lag, buffer, sizeof(buffer));
+
+            QuantisedState decoded;
+            if (size == 0 || !DecodeSnapshot(buffer, size, baseline, decoded) || !SameState(decoded, states[t])) return false;
+            sizes.push_back(size);
+        }
+    }
+    return true;
+}
+
+void PrintSizes(const char *label, std::vector<int> &sizes)
+{
+    std::sort(sizes.begin(), sizes.end());
+    double sum = 0;
+    for (size_t i = 0; i < sizes.size(); i++) sum += sizes[i];
+    printf("%-12s %9zu %8.2f %6d %6d %6d\n", label, sizes.size(), sum / sizes.size(), sizes[sizes.size() / 2],
+           sizes[(size_t)(sizes.size() * 0.99)], sizes.back());
+}
+
+bool SameRewindState(const Game &a, const Game &b)
+{
+    RewindState packedA, packedB;
+    PackRewindState(a, packedA);
+    PackRewindState(b, packedB);
+    return a.tick == b.tick && memcmp(&packedA, &packedB, sizeof(RewindState)) == 0;
+}
+
+// Play matches at the rewind tick rate through a rewind buffer, checking every held tick restores exactly
+// and printing the bytes it takes and how long a restore takes, returns false if a tick didn't restore
+bool MeasureRewind(const Controller &left, const Controller &right, int matches)
+{
+    static RewindBuffer buffer;         // Too big for the stack
+    float tickTime = 1.0f / rewindTickRate;
+    long long ticks = 0, restored = 0, checksum = 0;
+    double heldSeconds = 0, bytesPerTick = 0, restoreSeconds = 0;
+    unsigned int maxBytes = 0;
+    int fullMatches = 0;
+
+    for (int m = 0; m < matches; m++)
+    {
+        Game game;
+        InitialiseGame(game);
+        ControllerState leftState, rightState;
+        InitialiseControllerState(leftState, 1000 + m);
+        InitialiseControllerState(rightState, (1000 + m) ^ 0x5BD1E995u);
+
+        ClearRewind(buffer, rewindTickRate);
+        std::vector<Game> states;
+        states.push_back(game);
+        RecordRewindTick(buffer, game);
+        while (!game.gameWon && game.tick < maxMatchTicks * (rewindTickRate / 60))
+        {
+            PaddleInput leftInput = ControlPaddle(left, leftState, game, 1);
+            PaddleInput rightInput = ControlPaddle(right, rightState, game, 2);
+            UpdateGame(game, leftInput, rightInput, tickTime);
+            RecordRewindTick(buffer, game);
+            states.push_back(game);
+
+            if (RewindBytesUsed(buffer) > maxBytes) maxBytes = RewindBytesUsed(buffer);
+        }
+        ticks += game.tick;
+
+        // Every tick still held comes back exactly, from the newest to the oldest (as rewinding goes)
+        Game rewound = game;
+        for (int t = buffer.endTick - 1; t >= buffer.firstTick; t--)
+        {
+            if (!RestoreRewindTick(buffer, t, rewound) || !SameRewindState(rewound, states[t])) return false;
+        }
+
+        // Size once the buffer has been full for a while, and the time a restore takes
+        int held = buffer.endTick - buffer.firstTick;
+        if (held >= buffer.maxTicks - rewindKeyframeInterval)
+        {
+            fullMatches++;
+            heldSeconds += (double)held / rewindTickRate;
+            bytesPerTick += (double)RewindBytesUsed(buffer) / held;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int repeat = 0; repeat < 20; repeat++)
+        {
+            for (int t = buffer.endTick - 1; t >= buffer.firstTick; t--)
+            {
+                RestoreRewindTick(buffer, t, rewound);
+                checksum += rewound.player1LeftScore + (int)rewound.ball1.position.x;
+                restored++;
+            }
+        }
+        restoreSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    printf("\nrewind at %d Hz: %lld ticks in %d matches, every held tick restored exactly\n", rewindTickRate, ticks, matches);
+    if (fullMatches) printf("%5.1f s held in %u KB at most, %.1f bytes a tick (%zu byte state), %zu KB buffer in all\n",
+                            heldSeconds / fullMatches, (maxBytes + 1023) / 1024, bytesPerTick / fullMatches,
+                            sizeof(RewindState), sizeof(RewindBuffer) / 1024);
+    printf("restore %5.1f ns a tick   (checksum %lld)\n", 1e9 * restoreSeconds / restored, checksum & 0xFFFF);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    int matches = 20;
+    const char *leftText = "predict", *rightText = "search";
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--matches") == 0 && i + 1 < argc) matches = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--left") == 0 && i + 1 < argc) leftText = argv[++i];
+        else if (strcmp(argv[i], "--right") == 0 && i + 1 < argc) rightText = argv[++i];
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    Controller left, right;
+    if (!ParseController(left, leftText) || !ParseController(right, rightText))
+    {
+        fprintf(stderr, "Invalid controller\n");
+        return 1;
+    }
+
+    // Record the matches
+    std::vector<Recording> recordings;
+    size_t ticks = 0;
+    for (int m = 0; m < matches; m++)
+    {
+        recordings.push_back(RecordMatch(left, right, 1000 + m));
+        ticks += recordings.back().states.size();
+    }
+    printf("Recorded %d matches, %zu ticks (%s vs %s), %zu byte quantised state\n\n", matches, ticks, leftText, rightText, sizeof(QuantisedState));
+
+    // Sizes against each baseline lag, and as keyframes
+    printf("%-12s %9s %8s %6s %6s %6s\n", "baseline", "snapshots", "mean B", "p50", "p99", "max");
+    for (size_t l = 0; l < sizeof(baselineLags) / sizeof(baselineLags[0]); l++)
+    {
+        std::vector<int> sizes;
+        if (!MeasureSizes(recordings, baselineLags[l], sizes))
+        {
+            printf("Round trip failed with a baseline %d ticks back\n", baselineLags[l]);
+            return 1;
+        }
+        char label[32];
+        snprintf(label, sizeof(label), "%d tick%s back", baselineLags[l], baselineLags[l] > 1 ? "s" : "");
+        PrintSizes(label, sizes);
+    }
+    std::vector<int> keyframeSizes;
+    if (!MeasureSizes(recordings, 0, keyframeSizes))
+    {
+        printf("Keyframe round trip failed\n");
+        return 1;
+    }
+    PrintSizes("keyframe", keyframeSizes);
+
+    // Encode and decode speed, against the tick before, on one core
+    std::vector<unsigned char> encoded;
+    std::vector<int> offsets;
+    unsigned char buffer[maxSnapshotBytes];
+    for (size_t r = 0; r < recordings.size(); r++)
+    {
+        const std::vector<QuantisedState> &states = recordings[r].states;
+        for (size_t t = 1; t < states.size(); t++)
+        {
+            int size = EncodeSnapshot(states[t], &states[t - 1], 1, buffer, sizeof(buffer));
+            offsets.push_back((int)encoded.size());
+            encoded.insert(encoded.end(), buffer, buffer + size);
+        }
+    }
+    offsets.push_back((int)encoded.size());
+
+    long long encodedCount = 0, checksum = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double seconds = 0;
+    while (seconds < timingSeconds)
+    {
+        for (size_t r = 0; r < recordings.size(); r++)
+        {
+            const std::vector<QuantisedState> &states = recordings[r].states;
+            for (size_t t = 1; t < states.size(); t++)
+            {
+                int size = EncodeSnapshot(states[t], &states[t - 1], 1, buffer, sizeof(buffer));
+                checksum += size + buffer[0];       // Keep the encoder from being optimised away
+                encodedCount++;
+            }
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    double encodeRate = encodedCount / seconds;
+
+    long long decodedCount = 0;
+    start = std::chrono::steady_clock::now();
+    seconds = 0;
+    while (seconds < timingSeconds)
+    {
+        size_t i = 0;
+        for (size_t r = 0; r < recordings.size(); r++)
+        {
+            const std::vector<QuantisedState> &states = recordings[r].states;
+            for (size_t t = 1; t < states.size(); t++, i++)
+            {
+                QuantisedState decoded;
+                DecodeSnapshot(&encoded[offsets[i]], offsets[i + 1] - offsets[i], &states[t - 1], decoded);
+                checksum += decoded.balls[0].x;
+                decodedCount++;
+            }
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    double decodeRate = decodedCount / seconds;
+
+    printf("\nencode %6.2f M snapshots/s   %5.1f ns each\n", encodeRate / 1e6, 1e9 / encodeRate);
+    printf("decode %6.2f M snapshots/s   %5.1f ns each   (checksum %lld)\n", decodeRate / 1e6, 1e9 / decodeRate, checksum & 0xFFFF);
+
+    if (!MeasureRewind(left, right, matches))
+    {
+        printf("Rewind round trip failed\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,406 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium snapshots: the game state quantised, delta encoded and bit packed for the network
+*
+*   Positions are quantised to 1/8 of a court pixel and velocities to 1/8 pixel per second, so every
+*   field is a small integer. A snapshot is then encoded against a baseline the receiver already has
+*   (the last one it acknowledged), not against zero: the encoder predicts each field from the
+*   baseline - balls carry on at their velocity, paddles carry on at their last per-tick motion, the
+*   rest stays the same - and only writes how far the real value is from the prediction. Between
+*   bounces and key changes the prediction is off by rounding at most, so a field costs a bit or
+*   three, and whole objects that match their prediction cost a single bit.
+*
+*   Residuals are zigzagged (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...) and written as Exp-Golomb codes.
+*   A keyframe is the same encoding against the state of a new game, so it needs no baseline.
+*
+*   Layout: keyframe bit, [ticks since baseline], then per paddle a changed bit and y/motion
+*   residuals, per ball a changed bit and visible/x/y/vx/vy, then a changed bit and the scores.
+*
+******************************************************************************************************/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <math.h>
+#include <string.h>
+#include "pongsim.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const float positionScale = 8;              // Quantised units per court pixel
+const float velocityScale = 8;              // Quantised units per pixel per second
+const int snapshotTickRate = 60;            // Ticks per second the velocity prediction assumes (the server's tick rate)
+const int maxSnapshotBytes = 96;            // Largest encoded snapshot (a keyframe of a game far from the start)
+const int snapshotHistory = 32;             // Recent snapshots kept by each side, the oldest a baseline can be
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for a quantised ball
+struct QuantisedBall
+{
+    int x, y;                       // position in 1/8 pixels
+    int vx, vy;                     // velocity in 1/8 pixels per second
+    int visible;                    // 1 if the ball is in play
+};
+
+// Create a structure for the quantised state of a game, what a snapshot carries
+struct QuantisedState
+{
+    int paddleY[2];                 // y position of the left and right paddle in 1/8 pixels
+    int paddleMotion[2];            // how far each paddle moved in the tick before, in 1/8 pixels
+    QuantisedBall balls[2];
+    int scores[2];
+    int winner;                     // 0 while the game is being played
+};
+
+// Create a structure for the recent snapshots of a match, to encode against (sender) or decode against (receiver)
+struct SnapshotHistory
+{
+    QuantisedState states[snapshotHistory];
+    unsigned int ticks[snapshotHistory];        // tick of each state
+    bool valid[snapshotHistory];
+};
+
+// Create a structure for writing bits into a buffer, lowest bit first
+struct BitWriter
+{
+    unsigned char *data;
+    int capacity;                   // bytes
+    unsigned long long bits;        // bits not yet flushed to data
+    int bitCount;
+    int size;                       // bytes flushed
+    bool overflow;
+};
+
+// Create a structure for reading bits from a buffer, lowest bit first
+struct BitReader
+{
+    const unsigned char *data;
+    int size;                       // bytes
+    unsigned long long bits;        // bits loaded but not yet read
+    int bitCount;
+    int position;                   // next byte to load
+    bool overflow;                  // set if a read ran past the end
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+inline int QuantiseValue(float value, float scale)
+{
+    float scaled = value * scale;
+    if (scaled > 1e8f) scaled = 1e8f;           // Keep a runaway ball representable
+    if (scaled < -1e8f) scaled = -1e8f;
+    return (int)lrintf(scaled);
+}
+
+// Quantise a game, previous is the quantised state of the tick before (for the paddle motion) or 0
+inline void QuantiseState(const Game &game, const QuantisedState *previous, QuantisedState &state)
+{
+    const Player *players[2] = { &game.player1Left, &game.player2Right };
+    const Ball *balls[2] = { &game.ball1, &game.ball2 };
+
+    for (int p = 0; p < 2; p++)
+    {
+        state.paddleY[p] = QuantiseValue(players[p]->position.y, positionScale);
+        state.paddleMotion[p] = previous ? state.paddleY[p] - previous->paddleY[p] : 0;
+    }
+    for (int b = 0; b < 2; b++)
+    {
+        state.balls[b].x = QuantiseValue(balls[b]->position.x, positionScale);
+        state.balls[b].y = QuantiseValue(balls[b]->position.y, positionScale);
+        state.balls[b].vx = QuantiseValue(balls[b]->velocity.x, velocityScale);
+        state.balls[b].vy = QuantiseValue(balls[b]->velocity.y, velocityScale);
+        state.balls[b].visible = balls[b]->visible ? 1 : 0;
+    }
+    state.scores[0] = game.player1LeftScore;
+    state.scores[1] = game.player2RightScore;
+    state.winner = game.winner;
+}
+
+// Turn a quantised state back into a game (the fixed parts come from the rules of a new game)
+inline void DequantiseState(const QuantisedState &state, Game &game, const MatchRules &rules = MatchRules())
+{
+    int tick = game.tick;
+    InitialiseGame(game, rules);
+    game.tick = tick;
+
+    Player *players[2] = { &game.player1Left, &game.player2Right };
+    Ball *balls[2] = { &game.ball1, &game.ball2 };
+    for (int p = 0; p < 2; p++) players[p]->position.y = state.paddleY[p] / positionScale;
+    for (int b = 0; b < 2; b++)
+    {
+        balls[b]->position.x = state.balls[b].x / positionScale;
+        balls[b]->position.y = state.balls[b].y / positionScale;
+        balls[b]->velocity.x = state.balls[b].vx / velocityScale;
+        balls[b]->velocity.y = state.balls[b].vy / velocityScale;
+        balls[b]->visible = state.balls[b].visible != 0;
+    }
+    game.player1LeftScore = state.scores[0];
+    game.player2RightScore = state.scores[1];
+    game.winner = state.winner;
+    game.gameWon = state.winner != 0;
+}
+
+// Quantise a new game, the baseline keyframes are encoded against
+inline QuantisedState NewGameState()
+{
+    Game game;
+    InitialiseGame(game);
+    QuantisedState state;
+    QuantiseState(game, 0, state);
+    return state;
+}
+
+// Get the baseline keyframes are encoded against (worked out once, on first use)
+inline const QuantisedState &KeyframeBaseline()
+{
+    static const QuantisedState baseline = NewGameState();
+    return baseline;
+}
+
+// Forget every snapshot in a history
+inline void ClearSnapshotHistory(SnapshotHistory &history)
+{
+    for (int i = 0; i < snapshotHistory; i++) history.valid[i] = false;
+}
+
+// Keep the snapshot of a tick, replacing the one from snapshotHistory ticks before
+inline void StoreSnapshot(SnapshotHistory &history, unsigned int tick, const QuantisedState &state)
+{
+    int slot = tick % snapshotHistory;
+    history.states[slot] = state;
+    history.ticks[slot] = tick;
+    history.valid[slot] = true;
+}
+
+// Find the snapshot of a tick, returns 0 if it isn't (or is no longer) kept
+inline const QuantisedState *FindSnapshot(const SnapshotHistory &history, unsigned int tick)
+{
+    int slot = tick % snapshotHistory;
+    return (history.valid[slot] && history.ticks[slot] == tick) ? &history.states[slot] : 0;
+}
+
+// Predict a state some ticks after a baseline: balls move on at their velocity, paddles at their last motion
+inline void PredictState(const QuantisedState &baseline, int ticks, QuantisedState &prediction)
+{
+    prediction = baseline;
+    for (int p = 0; p < 2; p++)
+    {
+        prediction.paddleY[p] = baseline.paddleY[p] + baseline.paddleMotion[p] * ticks;
+    }
+    for (int b = 0; b < 2; b++)
+    {
+        const QuantisedBall &ball = baseline.balls[b];
+        if (!ball.visible) continue;
+
+        // Rounded integer division, identical on every machine (positionScale / velocityScale is 1)
+        long long dx = (long long)ball.vx * ticks, dy = (long long)ball.vy * ticks;
+        prediction.balls[b].x = ball.x + (int)((dx + (dx >= 0 ? snapshotTickRate / 2 : -snapshotTickRate / 2)) / snapshotTickRate);
+        prediction.balls[b].y = ball.y + (int)((dy + (dy >= 0 ? snapshotTickRate / 2 : -snapshotTickRate / 2)) / snapshotTickRate);
+    }
+}
+
+inline void WriteBits(BitWriter &writer, unsigned long long value, int count)
+{
+    writer.bits |= value << writer.bitCount;
+    writer.bitCount += count;
+    while (writer.bitCount >= 8)
+    {
+        if (writer.size == writer.capacity)
+        {
+            writer.overflow = true;
+            writer.bitCount = 0;
+            return;
+        }
+        writer.data[writer.size++] = (unsigned char)writer.bits;
+        writer.bits >>= 8;
+        writer.bitCount -= 8;
+    }
+}
+
+// Write a non-negative value as an Exp-Golomb code: n zero bits, then value + 1 in n + 1 bits
+inline void WriteUnsignedCode(BitWriter &writer, unsigned int value)
+{
+    unsigned long long coded = (unsigned long long)value + 1;
+    int length = 63 - __builtin_clzll(coded);           // bits after the leading 1
+    WriteBits(writer, 0, length);
+    // Written lowest bit first, so send the leading 1 first and the rest after it
+    WriteBits(writer, 1, 1);
+    WriteBits(writer, coded & ((1ull << length) - 1), length);
+}
+
+// Write a signed value zigzagged, so small values of either sign get short codes
+inline void WriteSignedCode(BitWriter &writer, int value)
+{
+    WriteUnsignedCode(writer, ((unsigned int)value << 1) ^ (unsigned int)(value >> 31));
+}
+
+// Flush the last partial byte, returns the encoded size or 0 if it didn't fit
+inline int FinishBits(BitWriter &writer)
+{
+    if (writer.bitCount > 0) WriteBits(writer, 0, 8 - writer.bitCount);
+    return writer.overflow ? 0 : writer.size;
+}
+
+inline void RefillBits(BitReader &reader)
+{
+    while (reader.bitCount <= 56 && reader.position < reader.size)
+    {
+        reader.bits |= (unsigned long long)reader.data[reader.position++] << reader.bitCount;
+        reader.bitCount += 8;
+    }
+}
+
+inline unsigned int ReadBits(BitReader &reader, int count)
+{
+    if (reader.bitCount < count) RefillBits(reader);
+    if (reader.bitCount < count)
+    {
+        reader.overflow = true;
+        return 0;
+    }
+    unsigned int value = (unsigned int)(reader.bits & ((1ull << count) - 1));
+    reader.bits >>= count;
+    reader.bitCount -= count;
+    return value;
+}
+
+inline unsigned int ReadUnsignedCode(BitReader &reader)
+{
+    if (reader.bitCount < 32) RefillBits(reader);
+    if (reader.bits == 0)
+    {
+        reader.overflow = true;             // 32 zero bits or the end of the data - not a code this encoder writes
+        return 0;
+    }
+
+    int length = __builtin_ctzll(reader.bits);
+    if (length > 31)
+    {
+        reader.overflow = true;
+        return 0;
+    }
+    reader.bits >>= length + 1;
+    reader.bitCount -= length + 1;
+    unsigned long long coded = (1ull << length) | ReadBits(reader, length);
+    return (unsigned int)(coded - 1);
+}
+
+inline int ReadSignedCode(BitReader &reader)
+{
+    unsigned int zigzag = ReadUnsignedCode(reader);
+    return (int)(zigzag >> 1) ^ -(int)(zigzag & 1);
+}
+
+// Encode a state against a baseline the receiver has from some ticks earlier, or as a keyframe if baseline is 0
+// Returns the encoded size in bytes, or 0 if it didn't fit
+inline int EncodeSnapshot(const QuantisedState &state, const QuantisedState *baseline, int ticksSinceBaseline, unsigned char *buffer, int capacity)
+{
+    BitWriter writer = { buffer, capacity, 0, 0, 0, false };
+
+    QuantisedState prediction;
+    WriteBits(writer, baseline ? 0 : 1, 1);
+    if (baseline)
+    {
+        WriteUnsignedCode(writer, ticksSinceBaseline - 1);
+        PredictState(*baseline, ticksSinceBaseline, prediction);
+    }
+    else
+    {
+        prediction = KeyframeBaseline();
+    }
+
+    for (int p = 0; p < 2; p++)
+    {
+        int dy = state.paddleY[p] - prediction.paddleY[p];
+        int dm = state.paddleMotion[p] - prediction.paddleMotion[p];
+        WriteBits(writer, (dy | dm) ? 1 : 0, 1);
+        if (!(dy | dm)) continue;
+        WriteSignedCode(writer, dy);
+        WriteSignedCode(writer, dm);
+    }
+
+    for (int b = 0; b < 2; b++)
+    {
+        const QuantisedBall &ball = state.balls[b], &predicted = prediction.balls[b];
+        int dx = ball.x - predicted.x, dy = ball.y - predicted.y, dvx = ball.vx - predicted.vx, dvy = ball.vy - predicted.vy;
+        bool changed = (dx | dy | dvx | dvy) || ball.visible != predicted.visible;
+        WriteBits(writer, changed ? 1 : 0, 1);
+        if (!changed) continue;
+        WriteBits(writer, ball.visible, 1);
+        WriteSignedCode(writer, dx);
+        WriteSignedCode(writer, dy);
+        WriteSignedCode(writer, dvx);
+        WriteSignedCode(writer, dvy);
+    }
+
+    bool scoresChanged = state.scores[0] != prediction.scores[0] || state.scores[1] != prediction.scores[1] || state.winner != prediction.winner;
+    WriteBits(writer, scoresChanged ? 1 : 0, 1);
+    if (scoresChanged)
+    {
+        WriteUnsignedCode(writer, state.scores[0]);
+        WriteUnsignedCode(writer, state.scores[1]);
+        WriteBits(writer, state.winner, 2);
+    }
+
+    return FinishBits(writer);
+}
+
+// Find out which baseline a snapshot was encoded against, returns the ticks since it or 0 for a keyframe
+inline int SnapshotBaselineTicks(const unsigned char *data, int size)
+{
+    BitReader reader = { data, size, 0, 0, 0, false };
+    if (ReadBits(reader, 1)) return 0;
+    int ticks = (int)ReadUnsignedCode(reader) + 1;
+    return reader.overflow ? -1 : ticks;
+}
+
+// Decode a snapshot, baseline must be the state it was encoded against (ignored for a keyframe)
+// Returns false if the data is malformed
+inline bool DecodeSnapshot(const unsigned char *data, int size, const QuantisedState *baseline, QuantisedState &state)
+{
+    BitReader reader = { data, size, 0, 0, 0, false };
+
+    if (ReadBits(reader, 1))
+    {
+        state = KeyframeBaseline();
+    }
+    else
+    {
+        int ticks = (int)ReadUnsignedCode(reader) + 1;
+        if (!baseline || reader.overflow) return false;
+        PredictState(*baseline, ticks, state);
+    }
+
+    for (int p = 0; p < 2; p++)
+    {
+        if (!ReadBits(reader, 1)) continue;
+        state.paddleY[p] += ReadSignedCode(reader);
+        state.paddleMotion[p] += ReadSignedCode(reader);
+    }
+
+    for (int b = 0; b < 2; b++)
+    {
+        if (!ReadBits(reader, 1)) continue;
+        QuantisedBall &ball = state.balls[b];
+        ball.visible = ReadBits(reader, 1);
+        ball.x += ReadSignedCode(reader);
+        ball.y += ReadSignedCode(reader);
+        ball.vx += ReadSignedCode(reader);
+        ball.vy += ReadSignedCode(reader);
+    }
+
+    if (ReadBits(reader, 1))
+    {
+        state.scores[0] = ReadUnsignedCode(reader);
+        state.scores[1] = ReadUnsignedCode(reader);
+        state.winner = ReadBits(reader, 2);
+    }
+
+    return !reader.overflow;
+}
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,188 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium software rasterizer: the GAMEPLAY screen drawn on the CPU, a tile at a time
+*
+*   The GAMEPLAY screen is a handful of flat colours on black, so a frame is drawn as one byte per
+*   pixel, an index into rasterPalette: clearing is a memset, every shape is a run of memsets a row,
+*   and turning a pixel into RGB or YUV is a table lookup. Every drawing function is clipped to a
+*   target rectangle, so threads can each draw their own tiles of the same frame.
+*
+*   Shapes are filled where raylib's would be: a pixel is inside when its centre is, and a circle's
+*   centre is truncated to whole pixels as DrawCircle takes ints. Text uses a 5x7 pixel font scaled
+*   to the size raylib's default font would be drawn at (the default font's glyphs are in raylib,
+*   not in this tree), with only the digits and the letters of the win text.
+*
+******************************************************************************************************/
+
+#ifndef SOFTRASTER_H
+#define SOFTRASTER_H
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "pongsim.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+// Colours a frame can have, as indices into rasterPalette
+enum RasterColour { RASTER_BLACK = 0, RASTER_GREEN, RASTER_BLUE, RASTER_RED, RASTER_GOLD, RASTER_MAGENTA, RASTER_COLOURS };
+
+const Color rasterPalette[RASTER_COLOURS] = { BLACK, GREEN, BLUE, RED, GOLD, MAGENTA };
+
+const int rasterGlyphWidth = 5;
+const int rasterGlyphHeight = 7;
+const int rasterFontBaseSize = 10;          // Text size a glyph pixel is one screen pixel at, as raylib's default font
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for the part of a frame being drawn
+struct RasterTarget
+{
+    unsigned char *pixels;          // palette index of every pixel of the whole frame
+    int stride;                     // pixels from one row to the next
+    int left, top, right, bottom;   // only pixels in [left, right) x [top, bottom) are drawn
+};
+
+// Create a structure for a glyph of the pixel font, a row of 5 bits (the leftmost pixel highest) per row
+struct RasterGlyph
+{
+    char character;
+    unsigned char rows[rasterGlyphHeight];
+};
+
+const RasterGlyph rasterGlyphs[] =
+{
+    { '0', { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E } },
+    { '1', { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E } },
+    { '2', { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F } },
+    { '3', { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E } },
+    { '4', { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 } },
+    { '5', { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E } },
+    { '6', { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E } },
+    { '7', { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 } },
+    { '8', { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E } },
+    { '9', { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C } },
+    { 'A', { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 } },
+    { 'E', { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F } },
+    { 'I', { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E } },
+    { 'L', { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F } },
+    { 'N', { 0x11, 0x19, 0x15, 0x13, 0x11, 0x11, 0x11 } },
+    { 'P', { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 } },
+    { 'R', { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 } },
+    { 'S', { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E } },
+    { 'W', { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A } },
+    { 'Y', { 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04 } },
+    { '!', { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 } },
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Fill the pixels of a row from x0 to x1 (exclusive) that are inside the target
+inline void FillRasterSpan(const RasterTarget &target, int y, int x0, int x1, unsigned char colour)
+{
+    if (y < target.top || y >= target.bottom) return;
+    if (x0 < target.left) x0 = target.left;
+    if (x1 > target.right) x1 = target.right;
+    if (x0 < x1) memset(target.pixels + (size_t)y * target.stride + x0, colour, x1 - x0);
+}
+
+// Fill the pixels whose centres are inside a rectangle, as DrawRectangleRec
+inline void FillRasterRectangle(const RasterTarget &target, Rectangle rec, unsigned char colour)
+{
+    int x0 = (int)ceilf(rec.x - 0.5f), x1 = (int)ceilf(rec.x + rec.width - 0.5f);
+    int y0 = (int)ceilf(rec.y - 0.5f), y1 = (int)ceilf(rec.y + rec.height - 0.5f);
+    if (y0 < target.top) y0 = target.top;
+    if (y1 > target.bottom) y1 = target.bottom;
+    for (int y = y0; y < y1; y++) FillRasterSpan(target, y, x0, x1, colour);
+}
+
+// Fill the pixels whose centres are inside a circle, as DrawCircle
+inline void FillRasterCircle(const RasterTarget &target, int centreX, int centreY, float radius, unsigned char colour)
+{
+    int y0 = (int)ceilf(centreY - radius - 0.5f), y1 = (int)floorf(centreY + radius - 0.5f) + 1;
+    if (y0 < target.top) y0 = target.top;
+    if (y1 > target.bottom) y1 = target.bottom;
+    for (int y = y0; y < y1; y++)
+    {
+        float dy = y + 0.5f - centreY;
+        float span = radius * radius - dy * dy;
+        if (span < 0) continue;
+        float halfWidth = sqrtf(span);
+        FillRasterSpan(target, y, (int)ceilf(centreX - halfWidth - 0.5f), (int)floorf(centreX + halfWidth - 0.5f) + 1, colour);
+    }
+}
+
+inline const RasterGlyph *FindRasterGlyph(char character)
+{
+    for (size_t i = 0; i < sizeof(rasterGlyphs) / sizeof(rasterGlyphs[0]); i++)
+    {
+        if (rasterGlyphs[i].character == character) return &rasterGlyphs[i];
+    }
+    return 0;
+}
+
+// Width of a text in pixels at a size, as MeasureText
+inline int MeasureRasterText(const char *text, int size)
+{
+    int scale = (size < rasterFontBaseSize) ? 1 : size / rasterFontBaseSize;
+    int length = (int)strlen(text);
+    return (length > 0) ? (length * (rasterGlyphWidth + 1) - 1) * scale : 0;
+}
+
+// Draw a text with its top left corner at x, y, as DrawText (characters without a glyph are left blank)
+inline void DrawRasterText(const RasterTarget &target, const char *text, int x, int y, int size, unsigned char colour)
+{
+    int scale = (size < rasterFontBaseSize) ? 1 : size / rasterFontBaseSize;
+    if (y >= target.bottom || y + rasterGlyphHeight * scale <= target.top) return;
+
+    for (; *text; text++, x += (rasterGlyphWidth + 1) * scale)
+    {
+        const RasterGlyph *glyph = FindRasterGlyph(*text);
+        if (!glyph || x >= target.right || x + rasterGlyphWidth * scale <= target.left) continue;
+
+        for (int row = 0; row < rasterGlyphHeight; row++)
+        {
+            for (int column = 0; column < rasterGlyphWidth; column++)
+            {
+                if (!(glyph->rows[row] & (0x10 >> column))) continue;
+                Rectangle cell = { (float)(x + column * scale), (float)(y + row * scale), (float)scale, (float)scale };
+                FillRasterRectangle(target, cell, colour);
+            }
+        }
+    }
+}
+
+// Draw the part of the GAMEPLAY screen inside the target as pongdemonium.cpp does (without the prompt to play again)
+inline void DrawGameRaster(const RasterTarget &target, const Game &game)
+{
+    for (int y = target.top; y < target.bottom; y++)
+    {
+        memset(target.pixels + (size_t)y * target.stride + target.left, RASTER_BLACK, target.right - target.left);
+    }
+
+    // Centre court line
+    for (int y = target.top; y < target.bottom; y++) FillRasterSpan(target, y, screenWidth / 2, screenWidth / 2 + 1, RASTER_GREEN);
+
+    FillRasterRectangle(target, game.player1Left.GetRectangle(), RASTER_BLUE);
+    FillRasterRectangle(target, game.player2Right.GetRectangle(), RASTER_RED);
+
+    if (game.ball1.visible) FillRasterCircle(target, (int)game.ball1.position.x, (int)game.ball1.position.y, game.ball1.radius, RASTER_GOLD);
+    if (game.ball2.visible) FillRasterCircle(target, (int)game.ball2.position.x, (int)game.ball2.position.y, game.ball2.radius, RASTER_MAGENTA);
+
+    char score[16];
+    snprintf(score, sizeof(score), "%i", game.player1LeftScore);
+    DrawRasterText(target, score, (screenWidth / 2) - 40, 10, 40, RASTER_BLUE);
+    snprintf(score, sizeof(score), "%i", game.player2RightScore);
+    DrawRasterText(target, score, (screenWidth / 2) + 20, 10, 40, RASTER_RED);
+
+    if (game.gameWon)
+    {
+        const char *winText = (game.winner == 1) ? "PLAYER 1 WINS!" : "PLAYER 2 WINS!";
+        DrawRasterText(target, winText, (screenWidth / 2) - (MeasureRasterText(winText, 50) / 2), (screenHeight / 2) - 50, 50, RASTER_GOLD);
+    }
+}
+
+#endif // SOFTRASTER_H
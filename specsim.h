@@ -0,0 +1,218 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium specialised simulation: UpdateGame compiled for one match configuration
+*
+*   UpdateGame (pongsim.h) reads the rules, paddle sizes and speeds from the game every tick and
+*   always steps both balls. UpdateGameFor<Config> is the same tick with all of them constant
+*   (ball count, court size, ball radius and every MatchRules field), so the compiler folds them and,
+*   for a one-ball configuration, drops ball 2 altogether.
+*   SelectUpdateGame picks the specialisation whose configuration matches a match's rules at run
+*   time, or the generic UpdateGame if none does.
+*
+*   A specialisation does exactly the float operations UpdateGame does, in the same order, so the
+*   two give the same state bit for bit (statehash.h) for any game started by InitialiseGame; only
+*   a build contracting multiply-adds (-ffp-contract=fast with FMA) may fuse them differently.
+*
+******************************************************************************************************/
+
+#ifndef SPECSIM_H
+#define SPECSIM_H
+
+#include <math.h>
+#include "pongsim.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for the classic game's configuration, the defaults of MatchRules
+struct ClassicConfig
+{
+    static constexpr int balls = 2;                     // balls that can come into play
+    static constexpr int courtWidth = screenWidth;
+    static constexpr int courtHeight = screenHeight;
+    static constexpr float ballRadius = 10;
+    static constexpr float ballSpeed = 400;
+    static constexpr double speedUp = 1.1;
+    static constexpr float speedCap = 800;
+    static constexpr float paddleWidth = 15;
+    static constexpr float paddleHeight = 150;
+    static constexpr int paddleSpeed = 1000;
+    static constexpr int ball2Score = 3;
+    static constexpr int ball2Delay = 60;
+    static constexpr int winScore = 10;
+};
+
+// Create a structure for a quick match: the classic rules, first to 3, so ball 2 never comes into play
+struct QuickConfig : ClassicConfig
+{
+    static constexpr int balls = 1;
+    static constexpr int winScore = 3;
+};
+
+// Create a type for a function that updates a game by one tick, UpdateGame or a specialisation of it
+typedef TickEvents (*UpdateGameFunction)(Game &game, PaddleInput left, PaddleInput right, float frameTime);
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Check collision between a ball and a player, CheckCollisionBallPlayer with the sizes constant
+template <class Config>
+inline bool CheckCollisionFor(const Ball &ball, const Player &player)
+{
+    float recX = player.position.x - (Config::paddleWidth / 2), recY = player.position.y - (Config::paddleHeight / 2);
+
+    int recCenterX = (int)(recX + Config::paddleWidth / 2.0f);
+    int recCenterY = (int)(recY + Config::paddleHeight / 2.0f);
+
+    float dx = fabsf(ball.position.x - (float)recCenterX);
+    float dy = fabsf(ball.position.y - (float)recCenterY);
+
+    if (dx > (Config::paddleWidth / 2.0f + Config::ballRadius)) return false;
+    if (dy > (Config::paddleHeight / 2.0f + Config::ballRadius)) return false;
+
+    if (dx <= (Config::paddleWidth / 2.0f)) return true;
+    if (dy <= (Config::paddleHeight / 2.0f)) return true;
+
+    float cornerDistanceSq = (dx - Config::paddleWidth / 2.0f) * (dx - Config::paddleWidth / 2.0f) + (dy - Config::paddleHeight / 2.0f) * (dy - Config::paddleHeight / 2.0f);
+
+    return (cornerDistanceSq <= (Config::ballRadius * Config::ballRadius));
+}
+
+template <class Config>
+inline void ClampPlayerFor(Player &player)
+{
+    if (player.position.y > Config::courtHeight - (Config::paddleHeight / 2)) player.position.y = Config::courtHeight - (Config::paddleHeight / 2);
+    else if (player.position.y < 0 + (Config::paddleHeight / 2)) player.position.y = 0 + (Config::paddleHeight / 2);
+}
+
+template <class Config>
+inline void MoveBallFor(Ball &ball, float frameTime)
+{
+    ball.position.x += ball.velocity.x * frameTime;
+    ball.position.y += ball.velocity.y * frameTime;
+
+    if (ball.position.y > Config::courtHeight - Config::ballRadius)
+    {
+        ball.position.y = Config::courtHeight - Config::ballRadius;
+        ball.velocity.y *= -1;
+    }
+    else if (ball.position.y < 0 + Config::ballRadius)
+    {
+        ball.position.y = 0 + Config::ballRadius;
+        ball.velocity.y *= -1;
+    }
+}
+
+template <class Config>
+inline void MovePlayerFor(Player &player, PaddleInput input, float frameTime)
+{
+    if (input.down > 0) player.position.y += Config::paddleSpeed * frameTime * input.down;
+    if (input.up > 0) player.position.y -= Config::paddleSpeed * frameTime * input.up;
+}
+
+template <class Config>
+inline bool BounceBallFor(Ball &ball, const Player &player, int direction)
+{
+    if (!CheckCollisionFor<Config>(ball, player)) return false;
+    if (ball.velocity.x * direction >= 0) return false;
+
+    ball.velocity.x *= -1;
+    if (ball.velocity.x <= Config::speedCap || ball.velocity.y <= Config::speedCap)
+    {
+        ball.velocity.x *= Config::speedUp;
+        ball.velocity.y = (direction * ball.velocity.x) * ((ball.position.y - player.position.y) / (Config::paddleHeight / 2));
+    }
+    return true;
+}
+
+template <class Config>
+inline bool ScoreBallFor(Game &game, Ball &ball)
+{
+    if (ball.position.x > Config::courtWidth)
+    {
+        game.player1LeftScore++;
+        ball.Reset(Config::ballSpeed);
+        return true;
+    }
+    if (ball.position.x < 0)
+    {
+        game.player2RightScore++;
+        ball.Reset(Config::ballSpeed);
+        return true;
+    }
+    return false;
+}
+
+// Update game state by one tick, UpdateGame for a game played with Config's rules
+template <class Config>
+inline TickEvents UpdateGameFor(Game &game, PaddleInput left, PaddleInput right, float frameTime)
+{
+    static_assert(Config::balls == 2 || (Config::balls == 1 && Config::ball2Score >= Config::winScore),
+                  "A one-ball configuration has to be won before ball 2 could come into play");
+    static_assert(Config::courtWidth == screenWidth && Config::courtHeight == screenHeight,
+                  "Ball::Reset puts a ball back in the centre of the screen");
+
+    TickEvents events = { 0, 0, 0, 0 };
+    if (game.gameWon) return events;
+
+    ClampPlayerFor<Config>(game.player1Left);
+    ClampPlayerFor<Config>(game.player2Right);
+
+    // Until ball 2 comes into play it sits still in the centre, where it can't reach a player or be scored,
+    // so it is left out of the tick altogether (UpdateGame still bounces and scores it, to no effect)
+    bool ball2Active = (Config::balls == 2 && game.ball2.visible);
+    MoveBallFor<Config>(game.ball1, frameTime);
+    if (ball2Active) MoveBallFor<Config>(game.ball2, frameTime);
+
+    MovePlayerFor<Config>(game.player1Left, left, frameTime);
+    MovePlayerFor<Config>(game.player2Right, right, frameTime);
+
+    // The same order as UpdateGame: both balls off the left player, then both off the right player
+    if (BounceBallFor<Config>(game.ball1, game.player1Left, 1)) { events.ballHits++; events.hitMask |= 1; }
+    if (ball2Active && BounceBallFor<Config>(game.ball2, game.player1Left, 1)) { events.ballHits++; events.hitMask |= 2; }
+    if (BounceBallFor<Config>(game.ball1, game.player2Right, -1)) { events.ballHits++; events.hitMask |= 1; }
+    if (ball2Active && BounceBallFor<Config>(game.ball2, game.player2Right, -1)) { events.ballHits++; events.hitMask |= 2; }
+
+    if (ScoreBallFor<Config>(game, game.ball1)) { events.ballResets++; events.resetMask |= 1; }
+    if (ball2Active && ScoreBallFor<Config>(game, game.ball2)) { events.ballResets++; events.resetMask |= 2; }
+
+    // Ball 2's counter still runs with one ball, so the state stays the same as UpdateGame's
+    if (game.player1LeftScore >= Config::ball2Score || game.player2RightScore >= Config::ball2Score)
+    {
+        game.frameCounterBall2++;
+        int ball2DelayTicks = (int)(Config::ball2Delay / (60.0f * frameTime) + 0.5f);
+        if (ball2DelayTicks < 1) ball2DelayTicks = 1;
+        if (game.frameCounterBall2 >= ball2DelayTicks) game.ball2.visible = true;
+    }
+
+    if (game.player1LeftScore >= Config::winScore || game.player2RightScore >= Config::winScore)
+    {
+        game.gameWon = true;
+        game.winner = (game.player1LeftScore >= Config::winScore) ? 1 : 2;
+        game.ball1.visible = false;
+        game.ball2.visible = false;
+    }
+
+    game.tick++;
+    return events;
+}
+
+// Check whether a match's rules are a configuration's
+template <class Config>
+inline bool RulesMatchConfig(const MatchRules &rules)
+{
+    return rules.ballSpeed == Config::ballSpeed && rules.speedUp == Config::speedUp && rules.speedCap == Config::speedCap &&
+           rules.paddleWidth == Config::paddleWidth && rules.paddleHeight == Config::paddleHeight &&
+           rules.paddleSpeed == Config::paddleSpeed && rules.ball2Score == Config::ball2Score &&
+           rules.ball2Delay == Config::ball2Delay && rules.winScore == Config::winScore;
+}
+
+// Pick the update for a match's rules: a specialisation if one matches, otherwise the generic UpdateGame
+inline UpdateGameFunction SelectUpdateGame(const MatchRules &rules)
+{
+    if (RulesMatchConfig<ClassicConfig>(rules)) return UpdateGameFor<ClassicConfig>;
+    if (RulesMatchConfig<QuickConfig>(rules)) return UpdateGameFor<QuickConfig>;
+    return UpdateGame;
+}
+
+#endif // SPECSIM_H
@@ -0,0 +1,174 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium state hash: a fingerprint of the game state every tick, to catch desyncs
+*
+*   The same inputs have to give the same game bit for bit wherever the match is simulated (the
+*   game, the server, a replay, another build). Float drift breaks that silently, so every tick
+*   the state is hashed and the hashes compared: replays store one per tick (replay.h) and
+*   replaycheck finds the first tick two runs disagree on and prints both states.
+*
+*   A state can drift and come back (a drifting ball is scored and put back in the centre either
+*   way), so what is stored and compared is the chained hash: each tick's state hash folded into
+*   the chain of the ticks before it. Two chains that differ once differ from then on, so the
+*   first tick two runs disagree on can be found by bisecting their chains.
+*
+*   The hash covers the canonical state, the 16 words of the game that change while it is played,
+*   in a fixed order with no padding. Floats are hashed by their bits (so any drift shows) except
+*   that -0 and 0 hash the same and so does every NaN. Pairs of words are keyed and multiplied into
+*   64 bit products, all independent of each other so they run side by side (SSE2 has the 32 x 32
+*   -> 64 bit multiply), then folded and avalanched to 64 bits.
+*   Player x positions, sizes and the rules don't change during a match so aren't hashed; a
+*   replay stores the rules once.
+*
+******************************************************************************************************/
+
+#ifndef STATEHASH_H
+#define STATEHASH_H
+
+#include <stdio.h>
+#include <string.h>
+#include "pongsim.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int canonicalWords = 16;              // Words of the canonical state, hashed in pairs
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for the canonical state: the changing parts of a game as words in a fixed order
+struct CanonicalState
+{
+    unsigned int words[canonicalWords];
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Get the bits of a float, with -0 turned into 0 and every NaN into the same NaN
+inline unsigned int CanonicalFloat(float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    unsigned int magnitude = bits & 0x7FFFFFFFu;
+    if (magnitude > 0x7F800000u) return 0x7FC00000u;
+    return magnitude ? bits : 0;
+}
+
+inline void CanonicaliseState(const Game &game, CanonicalState &state)
+{
+    unsigned int *w = state.words;
+    w[0] = CanonicalFloat(game.player1Left.position.y);
+    w[1] = CanonicalFloat(game.player2Right.position.y);
+    w[2] = CanonicalFloat(game.ball1.position.x);
+    w[3] = CanonicalFloat(game.ball1.position.y);
+    w[4] = CanonicalFloat(game.ball1.velocity.x);
+    w[5] = CanonicalFloat(game.ball1.velocity.y);
+    w[6] = CanonicalFloat(game.ball2.position.x);
+    w[7] = CanonicalFloat(game.ball2.position.y);
+    w[8] = CanonicalFloat(game.ball2.velocity.x);
+    w[9] = CanonicalFloat(game.ball2.velocity.y);
+    w[10] = (game.ball1.visible ? 1u : 0u) | (game.ball2.visible ? 2u : 0u) | (game.gameWon ? 4u : 0u);
+    w[11] = (unsigned int)game.player1LeftScore;
+    w[12] = (unsigned int)game.player2RightScore;
+    w[13] = (unsigned int)game.frameCounterBall2;
+    w[14] = (unsigned int)game.winner;
+    w[15] = (unsigned int)game.tick;
+}
+
+// Hash a canonical state to 64 bits
+inline unsigned long long HashCanonicalState(const CanonicalState &state)
+{
+    static const unsigned int keys[canonicalWords] = { 0xB8FE6C39u, 0x23A44BBEu, 0x7C01812Cu, 0xF721AD1Cu, 0xDED46DE9u, 0x839097DBu,
+                                                       0x7240A4A4u, 0xB7B3671Fu, 0xCB79E64Eu, 0xCCC0E578u, 0x825AD07Du, 0xCCFF7221u,
+                                                       0xB8084674u, 0xF743248Eu, 0xE03590E6u, 0x813A264Cu };
+
+    // Each pair of words is mixed with its key and multiplied 32 x 32 -> 64, the data itself added too so a key
+    // cancelling a word can't hide the other one (as XXH3 accumulates); every pair is independent so they vectorise
+    unsigned long long lanes[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < canonicalWords; i += 2)
+    {
+        unsigned int low = state.words[i] ^ keys[i], high = state.words[i + 1] ^ keys[i + 1];
+        lanes[(i / 2) & 3] += (unsigned long long)low * high + (((unsigned long long)state.words[i] << 32) | state.words[i + 1]);
+    }
+
+    unsigned long long hash = (lanes[0] ^ (lanes[1] * 0x9E3779B97F4A7C15ull)) + (lanes[2] ^ (lanes[3] * 0xC2B2AE3D27D4EB4Full));
+
+    // Avalanche, so every input bit reaches every output bit
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+inline unsigned long long HashState(const Game &game)
+{
+    CanonicalState state;
+    CanonicaliseState(game, state);
+    return HashCanonicalState(state);
+}
+
+// Fold a tick's state hash into the chain of the ticks before it (0 before the first tick)
+// Rotating and xoring a different chain with the same state hash, then multiplying by an odd number, can't give the same result
+inline unsigned long long ChainStateHash(unsigned long long chain, unsigned long long stateHash)
+{
+    return (((chain << 29) | (chain >> 35)) ^ stateHash) * 0x9E3779B97F4A7C15ull;
+}
+
+// Find the first tick two runs' chained hashes differ at, or -1 if they never do
+inline int FindFirstDivergence(const unsigned long long *a, const unsigned long long *b, int count)
+{
+    if (count <= 0 || a[count - 1] == b[count - 1]) return -1;
+
+    // Chains never come back together, so a[high] != b[high] throughout and every tick before low agrees
+    int low = 0, high = count - 1;
+    while (low < high)
+    {
+        int middle = low + (high - low) / 2;
+        if (a[middle] == b[middle]) low = middle + 1;
+        else high = middle;
+    }
+    return high;
+}
+
+// Print two canonical states side by side, marking the words that differ
+inline void PrintCanonicalDifference(FILE *file, const CanonicalState &stateA, const char *labelA, const CanonicalState &stateB, const char *labelB)
+{
+    static const char *names[canonicalWords] = { "player1Left.y", "player2Right.y", "ball1.x", "ball1.y", "ball1.vx", "ball1.vy",
+                                                 "ball2.x", "ball2.y", "ball2.vx", "ball2.vy", "visible|won", "player1LeftScore",
+                                                 "player2RightScore", "frameCounterBall2", "winner", "tick" };
+    fprintf(file, "  %-18s %-28s %-28s\n", "", labelA, labelB);
+    for (int w = 0; w < canonicalWords; w++)
+    {
+        char valueA[32], valueB[32];
+        if (w < 10)
+        {
+            float floatA, floatB;
+            memcpy(&floatA, &stateA.words[w], sizeof(float));
+            memcpy(&floatB, &stateB.words[w], sizeof(float));
+            snprintf(valueA, sizeof(valueA), "%.9g (%08X)", floatA, stateA.words[w]);
+            snprintf(valueB, sizeof(valueB), "%.9g (%08X)", floatB, stateB.words[w]);
+        }
+        else
+        {
+            snprintf(valueA, sizeof(valueA), "%u", stateA.words[w]);
+            snprintf(valueB, sizeof(valueB), "%u", stateB.words[w]);
+        }
+        fprintf(file, "%s %-18s %-28s %-28s\n", stateA.words[w] != stateB.words[w] ? "*" : " ", names[w], valueA, valueB);
+    }
+    fprintf(file, "  %-18s %016llX             %016llX\n", "hash", HashCanonicalState(stateA), HashCanonicalState(stateB));
+}
+
+// Print two games side by side, marking the words of their canonical states that differ
+inline void PrintStateDifference(FILE *file, const Game &a, const char *labelA, const Game &b, const char *labelB)
+{
+    CanonicalState stateA, stateB;
+    CanonicaliseState(a, stateA);
+    CanonicaliseState(b, stateB);
+    PrintCanonicalDifference(file, stateA, labelA, stateB, labelB);
+}
+
+#endif // STATEHASH_H
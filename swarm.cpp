@@ -0,0 +1,403 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium spectator swarm: watches the match server's tables with tens of thousands of spectators
+*
+*   Each thread runs its share of the spectators over a few hundred non-blocking sockets. Every
+*   spectator sends a WATCH for a table (and again every second, to stay), and the thread decodes
+*   the frames coming back. Spectators of the same table on the same socket get identical frames,
+*   so each (socket, table) stream decodes a frame once and counts the copies, which tells how many
+*   of the spectators missed it. Run loadgen alongside so the tables have matches to show.
+*
+*   Usage: swarm [options]
+*       --server HOST:PORT  server to watch (default 127.0.0.1:7777)
+*       --spectators N      spectators (default 50000)
+*       --tables N          tables they are spread over (default 1000)
+*       --threads N         spectator threads (default 1)
+*       --sockets N         sockets per thread (default 256)
+*       --seconds N         time to watch for once every spectator is watching (default 10)
+*
+*   Linux only. Build: g++ swarm.cpp -o swarm -O2 -pthread
+*
+******************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "pongsim.h"
+#include "protocol.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int batchSize = 64;                   // Packets received per system call
+const int timerRate = 20;                   // Times a second the WATCHes due are sent
+const double watchRetryTime = 0.5;          // Seconds before a WATCH without an answer is sent again
+const double watchRefreshTime = 1.0;        // Seconds between the WATCHes that keep a spectator watching
+const int watchesPerTick = 2000;            // New WATCHes a thread sends per timer tick, so joining doesn't flood the server
+const double watchTimeout = 30;             // Seconds to wait for every spectator to be watching
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for the command line options
+struct Options
+{
+    sockaddr_in server;
+    int spectators;
+    int tables;
+    int threads;
+    int sockets;
+    double seconds;
+};
+
+// Create a structure for one simulated spectator
+struct VirtualSpectator
+{
+    int socket;                     // index of the socket it watches from
+    unsigned int nonce;             // nonce of its WATCH (thread in the high bits, index in the low bits)
+    unsigned int id;                // id handed out by the server, 0 until watching
+    unsigned int table;             // table asked for
+    double watchSent;               // time the last WATCH was sent
+};
+
+// Create a structure for the frames of one table arriving on one socket
+struct Stream
+{
+    int watchers;                   // spectators on the socket watching the table
+    int ticksPerFrame;              // server ticks between frames
+    bool haveKeyframe;
+    unsigned int keyframeTick;
+    QuantisedState keyframe;
+    unsigned int lastTick;          // tick of the newest frame, 0 before the first counted one
+    int copies;                     // copies of that frame received so far
+};
+
+// Create a structure for what a thread counts, and reports at the end
+struct ThreadResult
+{
+    int watching;
+    long long frames;               // frames received, every copy counted
+    long long missed;               // frames a spectator should have received but didn't
+    long long keyframes;            // distinct keyframes decoded
+    long long undecodable;          // frames whose keyframe the stream didn't have
+    long long frameBytes;           // bytes of the distinct frames decoded
+    long long decoded;              // distinct frames decoded
+    double playSeconds;
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Get a monotonic time in seconds
+double NowSeconds()
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+void SendPacket(const Options &options, int socket, const unsigned char *data, int size)
+{
+    sendto(socket, data, size, MSG_DONTWAIT, (const sockaddr *)&options.server, sizeof(options.server));
+}
+
+// Take a frame into its stream: count the copy, and decode it if it is the first copy of its tick
+void ReceiveFrame(Stream &stream, const SpectateMessage &message, ThreadResult &result)
+{
+    result.frames++;
+    if (message.tick == stream.lastTick)
+    {
+        stream.copies++;
+        return;
+    }
+    if (stream.lastTick != 0 && (int)(message.tick - stream.lastTick) < 0) return;     // Late, its tick was already counted
+
+    // A new tick - whoever didn't get the last one, or any tick skipped since, missed it (once the WATCHING said how often frames come)
+    if (stream.lastTick != 0 && stream.ticksPerFrame > 0)
+    {
+        int skipped = (int)(message.tick - stream.lastTick) / stream.ticksPerFrame - 1;
+        result.missed += (stream.watchers - stream.copies) + (long long)stream.watchers * (skipped > 0 ? skipped : 0);
+    }
+    stream.lastTick = message.tick;
+    stream.copies = 1;
+
+    int ticks = SnapshotBaselineTicks(message.snapshot, message.snapshotSize);
+    QuantisedState state;
+    if (ticks == 0 && DecodeSnapshot(message.snapshot, message.snapshotSize, 0, state))
+    {
+        stream.haveKeyframe = true;
+        stream.keyframeTick = message.tick;
+        stream.keyframe = state;
+        result.keyframes++;
+    }
+    else if (ticks < 0 || !stream.haveKeyframe || message.tick - ticks != stream.keyframeTick ||
+             !DecodeSnapshot(message.snapshot, message.snapshotSize, &stream.keyframe, state))
+    {
+        result.undecodable++;
+        return;
+    }
+    result.decoded++;
+    result.frameBytes += message.snapshotSize;
+}
+
+// Receive everything waiting on a socket
+void ReceivePackets(int socket, int socketIndex, std::vector<VirtualSpectator> &spectators, std::vector<std::unordered_map<unsigned int, Stream> > &streams,
+                    int threadIndex, ThreadResult &result)
+{
+    unsigned char buffers[batchSize][maxPacketSize];
+    iovec vectors[batchSize];
+    mmsghdr headers[batchSize];
+
+    for (;;)
+    {
+        for (int i = 0; i < batchSize; i++)
+        {
+            vectors[i].iov_base = buffers[i];
+            vectors[i].iov_len = maxPacketSize;
+            memset(&headers[i], 0, sizeof(mmsghdr));
+            headers[i].msg_hdr.msg_iov = &vectors[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+        int received = recvmmsg(socket, headers, batchSize, MSG_DONTWAIT, 0);
+        if (received <= 0) break;
+
+        for (int i = 0; i < received; i++)
+        {
+            PacketReader reader;
+            int type = BeginReading(reader, buffers[i], headers[i].msg_len);
+
+            if (type == PACKET_WATCHING)
+            {
+                unsigned int nonce = ReadU32(reader);
+                unsigned int id = ReadU32(reader);
+                unsigned int table = ReadU32(reader);
+                int ticksPerFrame = (int)ReadU8(reader);
+                unsigned int index = nonce & 0xFFFFF;
+                if (reader.overflow || (int)(nonce >> 20) != threadIndex || index >= spectators.size() || ticksPerFrame < 1) continue;
+
+                VirtualSpectator &spectator = spectators[index];
+                if (spectator.id == 0)
+                {
+                    spectator.id = id;
+                    Stream &stream = streams[socketIndex][table];
+                    stream.watchers++;
+                    stream.ticksPerFrame = ticksPerFrame;
+                    result.watching++;
+                }
+            }
+            else if (type == PACKET_SPECTATE)
+            {
+                SpectateMessage message;
+                if (!ReadSpectatePacket(reader, message)) continue;
+                std::unordered_map<unsigned int, Stream>::iterator found = streams[socketIndex].find(message.table);
+                if (found != streams[socketIndex].end()) ReceiveFrame(found->second, message, result);
+            }
+        }
+        if (received < batchSize) break;
+    }
+}
+
+// Body of a spectator thread
+void RunSpectators(const Options &options, int threadIndex, int firstSpectator, int spectatorCount, ThreadResult &result)
+{
+    std::vector<int> sockets;
+    int epoll = epoll_create1(0);
+    for (int s = 0; s < options.sockets; s++)
+    {
+        int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        int size = 4 << 20;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = (unsigned int)s;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+        sockets.push_back(fd);
+    }
+
+    int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    long long period = 1000000000ll / timerRate;
+    itimerspec interval = { { 0, period }, { 0, period } };
+    timerfd_settime(timer, 0, &interval, 0);
+    epoll_event timerEvent;
+    timerEvent.events = EPOLLIN;
+    timerEvent.data.u32 = (unsigned int)sockets.size();
+    epoll_ctl(epoll, EPOLL_CTL_ADD, timer, &timerEvent);
+
+    memset(&result, 0, sizeof(result));
+    std::vector<VirtualSpectator> spectators(spectatorCount);
+    for (int c = 0; c < spectatorCount; c++)
+    {
+        VirtualSpectator &spectator = spectators[c];
+        memset(&spectator, 0, sizeof(spectator));
+        spectator.socket = c % (int)sockets.size();
+        spectator.nonce = ((unsigned int)threadIndex << 20) | (unsigned int)c;
+        spectator.table = (unsigned int)((firstSpectator + c) % options.tables);
+        spectator.watchSent = -watchRetryTime;
+    }
+    std::vector<std::unordered_map<unsigned int, Stream> > streams(sockets.size());
+
+    double start = NowSeconds(), playStart = 0, playEnd = 0;
+    unsigned char packet[maxPacketSize];
+    std::vector<epoll_event> events(sockets.size() + 1);
+
+    while (true)
+    {
+        double now = NowSeconds();
+        if (playStart == 0 && (result.watching == spectatorCount || now - start > watchTimeout))
+        {
+            // Everyone is watching - start counting from here
+            playStart = now;
+            playEnd = now + options.seconds;
+            int watching = result.watching;
+            memset(&result, 0, sizeof(result));
+            result.watching = watching;
+            for (size_t s = 0; s < streams.size(); s++)
+            {
+                for (std::unordered_map<unsigned int, Stream>::iterator it = streams[s].begin(); it != streams[s].end(); ++it)
+                {
+                    it->second.lastTick = 0;
+                    it->second.copies = 0;
+                }
+            }
+        }
+        if (playStart > 0 && now >= playEnd) break;
+
+        int count = epoll_wait(epoll, events.data(), (int)events.size(), 100);
+        for (int e = 0; e < count; e++)
+        {
+            unsigned int index = events[e].data.u32;
+            if (index < sockets.size())
+            {
+                ReceivePackets(sockets[index], (int)index, spectators, streams, threadIndex, result);
+                continue;
+            }
+
+            unsigned long long expirations;
+            if (read(timer, &expirations, sizeof(expirations)) != sizeof(expirations)) continue;
+
+            // (Re)send the WATCHes that are due, a couple of thousand new ones per tick at most
+            int watchesSent = 0;
+            for (int c = 0; c < spectatorCount; c++)
+            {
+                VirtualSpectator &spectator = spectators[c];
+                bool due = spectator.id ? now - spectator.watchSent >= watchRefreshTime
+                                        : watchesSent < watchesPerTick && now - spectator.watchSent >= watchRetryTime;
+                if (!due) continue;
+
+                // The server sends a new spectator the table's keyframe straight after the WATCHING, so its stream takes frames from now
+                if (!spectator.id) streams[spectator.socket][spectator.table];
+
+                PacketWriter writer = BeginPacket(packet, sizeof(packet), PACKET_WATCH);
+                WriteU32(writer, spectator.nonce);
+                WriteU32(writer, spectator.table);
+                SendPacket(options, sockets[spectator.socket], packet, writer.size);
+                spectator.watchSent = now;
+                if (!spectator.id) watchesSent++;
+            }
+        }
+    }
+
+    // Stop watching, so the server frees the places straight away
+    for (int c = 0; c < spectatorCount; c++)
+    {
+        if (spectators[c].id == 0) continue;
+        PacketWriter writer = BeginPacket(packet, sizeof(packet), PACKET_UNWATCH);
+        WriteU32(writer, spectators[c].id);
+        SendPacket(options, sockets[spectators[c].socket], packet, writer.size);
+    }
+    result.playSeconds = NowSeconds() - playStart;
+
+    for (size_t s = 0; s < sockets.size(); s++) close(sockets[s]);
+    close(timer);
+    close(epoll);
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    memset(&options, 0, sizeof(options));
+    options.server.sin_family = AF_INET;
+    options.server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    options.server.sin_port = htons(defaultServerPort);
+    options.spectators = 50000;
+    options.tables = 1000;
+    options.threads = 1;
+    options.sockets = 256;
+    options.seconds = 10;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--server") == 0 && i + 1 < argc)
+        {
+            char host[256];
+            int port = defaultServerPort;
+            if (sscanf(argv[++i], "%255[^:]:%d", host, &port) < 1 || inet_pton(AF_INET, host, &options.server.sin_addr) != 1)
+            {
+                fprintf(stderr, "Invalid server address %s\n", argv[i]);
+                return 1;
+            }
+            options.server.sin_port = htons(port);
+        }
+        else if (strcmp(argv[i], "--spectators") == 0 && i + 1 < argc) options.spectators = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--tables") == 0 && i + 1 < argc) options.tables = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) options.threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--sockets") == 0 && i + 1 < argc) options.sockets = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) options.seconds = atof(argv[++i]);
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (options.spectators < 1 || options.tables < 1 || options.threads < 1 || options.sockets < 1 ||
+        options.spectators / options.threads >= (1 << 20))
+    {
+        fprintf(stderr, "Invalid options\n");
+        return 1;
+    }
+
+    // Share the spectators out between the threads
+    std::vector<ThreadResult> results(options.threads);
+    std::vector<std::thread> threads;
+    int first = 0;
+    for (int t = 0; t < options.threads; t++)
+    {
+        int count = options.spectators / options.threads + (t < options.spectators % options.threads ? 1 : 0);
+        threads.push_back(std::thread(RunSpectators, std::cref(options), t, first, count, std::ref(results[t])));
+        first += count;
+    }
+    for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+
+    ThreadResult total;
+    memset(&total, 0, sizeof(total));
+    for (int t = 0; t < options.threads; t++)
+    {
+        total.watching += results[t].watching;
+        total.frames += results[t].frames;
+        total.missed += results[t].missed;
+        total.keyframes += results[t].keyframes;
+        total.undecodable += results[t].undecodable;
+        total.frameBytes += results[t].frameBytes;
+        total.decoded += results[t].decoded;
+        if (results[t].playSeconds > total.playSeconds) total.playSeconds = results[t].playSeconds;
+    }
+
+    double seconds = (total.playSeconds > 0) ? total.playSeconds : 1;
+    printf("spectators watching %d of %d\n", total.watching, options.spectators);
+    printf("frames received/s   %.0f (%.1f per spectator)\n", total.frames / seconds, total.frames / seconds / (total.watching ? total.watching : 1));
+    printf("snapshot bytes      %.2f per frame, %.1f%% keyframes\n", total.decoded ? (double)total.frameBytes / total.decoded : 0.0,
+           100.0 * total.keyframes / (total.decoded ? total.decoded : 1));
+    printf("frames lost         %.3f%%\n", 100.0 * total.missed / ((total.frames + total.missed) ? total.frames + total.missed : 1));
+    printf("frames undecodable  %lld\n", total.undecodable);
+    return 0;
+}
@@ -0,0 +1,439 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium sweep: explores the game-balance constants by playing bot matches headless
+*
+*   Builds a grid or a Latin hypercube of MatchRules (see pongsim.h), plays a number of bot
+*   matches for each configuration on all cores and writes the distributions of match length,
+*   rally length and comeback rate as columnar tables (see columnar.h).
+*
+*   Usage: sweep [options]
+*       --param name=min:max[:steps]    sweep a constant between min and max (steps are for --grid)
+*                                       names: ballSpeed speedUp speedCap paddleWidth paddleHeight
+*                                              paddleSpeed ball2Score ball2Delay winScore
+*       --grid                          every combination of the swept constants (default)
+*       --lhs N                         N configurations from a Latin hypercube instead of a grid
+*       --games N                       matches played per configuration (default 16)
+*       --left / --right controller     bots playing (default "predict:reaction=4,noise=40")
+*       --comeback N                    deficit the winner must have recovered from to count as a comeback (default 3)
+*       --threads N                     worker threads (default all cores)
+*       --seed N                        seed for the bots and the hypercube (default 1)
+*       --per-match                     also write one row per match
+*       --out directory                 where to write the tables (default sweep_out)
+*
+*   Build: g++ sweep.cpp -o sweep.exe -O2 -pthread
+*
+******************************************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "controllers.h"
+#include "columnar.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int maxMatchTicks = 60 * 60 * 20;     // A match still going after 20 minutes of game time is a draw
+const int parameterCount = 9;               // Number of constants in MatchRules that can be swept
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for one balance constant and the range it is swept over
+struct SweepParameter
+{
+    const char *name;               // name on the command line and in the output
+    bool isInt;                     // round values to whole numbers
+    bool swept;                     // true if given with --param, otherwise left at the classic value
+    double minimum, maximum;        // range to sweep
+    int steps;                      // grid points between minimum and maximum
+};
+
+// Create a structure for the per-configuration results
+struct ConfigResult
+{
+    int draws;                      // matches that hit the tick limit
+    int leftWins;                   // matches won by the left player
+    int comebacks;                  // matches won by a player who was behind by the comeback deficit
+    float ticksMean, ticksP10, ticksP50, ticksP90;          // match length in ticks
+    float rallyMean, rallyP50, rallyP90, rallyMax;          // paddle hits per point
+};
+
+// Create a structure for the result of a single match, kept for --per-match
+struct MatchRow
+{
+    int ticks, winner, leftScore, rightScore, winnerMaxDeficit, rallies;
+    float rallyMean;
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Set one constant of a set of rules by its index in the parameter table
+void SetRule(MatchRules &rules, int index, double value)
+{
+    switch (index)
+    {
+        case 0: rules.ballSpeed = (float)value; break;
+        case 1: rules.speedUp = value; break;
+        case 2: rules.speedCap = (float)value; break;
+        case 3: rules.paddleWidth = (float)value; break;
+        case 4: rules.paddleHeight = (float)value; break;
+        case 5: rules.paddleSpeed = (int)value; break;
+        case 6: rules.ball2Score = (int)value; break;
+        case 7: rules.ball2Delay = (int)value; break;
+        case 8: rules.winScore = (int)value; break;
+        default: break;
+    }
+}
+
+// Get one constant of a set of rules by its index in the parameter table
+double GetRule(const MatchRules &rules, int index)
+{
+    switch (index)
+    {
+        case 0: return rules.ballSpeed;
+        case 1: return rules.speedUp;
+        case 2: return rules.speedCap;
+        case 3: return rules.paddleWidth;
+        case 4: return rules.paddleHeight;
+        case 5: return rules.paddleSpeed;
+        case 6: return rules.ball2Score;
+        case 7: return rules.ball2Delay;
+        case 8: return rules.winScore;
+        default: return 0;
+    }
+}
+
+// Get a value a fraction of the way through a parameter's range
+double ParameterValue(const SweepParameter &parameter, double fraction)
+{
+    double value = parameter.minimum + fraction * (parameter.maximum - parameter.minimum);
+    return parameter.isInt ? floor(value + 0.5) : value;
+}
+
+// Build every combination of the swept parameters' grid points
+void BuildGrid(const SweepParameter *parameters, std::vector<MatchRules> &configs)
+{
+    configs.assign(1, MatchRules());
+    for (int p = 0; p < parameterCount; p++)
+    {
+        if (!parameters[p].swept) continue;
+
+        std::vector<MatchRules> expanded;
+        int steps = parameters[p].steps;
+        for (size_t c = 0; c < configs.size(); c++)
+        {
+            for (int s = 0; s < steps; s++)
+            {
+                MatchRules rules = configs[c];
+                SetRule(rules, p, ParameterValue(parameters[p], (steps == 1) ? 0.5 : (double)s / (steps - 1)));
+                expanded.push_back(rules);
+            }
+        }
+        configs.swap(expanded);
+    }
+}
+
+// Build a Latin hypercube: every swept parameter's range is cut into equal strata and each stratum used exactly once
+void BuildLatinHypercube(const SweepParameter *parameters, int samples, unsigned int seed, std::vector<MatchRules> &configs)
+{
+    unsigned int random = seed ? seed : 1;
+    configs.assign(samples, MatchRules());
+
+    std::vector<int> strata(samples);
+    for (int p = 0; p < parameterCount; p++)
+    {
+        if (!parameters[p].swept) continue;
+
+        for (int i = 0; i < samples; i++) strata[i] = i;
+        for (int i = samples - 1; i > 0; i--) std::swap(strata[i], strata[NextRandom(random) % (i + 1)]);   // Shuffle the strata
+
+        for (int i = 0; i < samples; i++)
+        {
+            double jitter = (NextRandom(random) & 0xFFFF) / 65536.0;        // Random point inside the stratum
+            SetRule(configs[i], p, ParameterValue(parameters[p], (strata[i] + jitter) / samples));
+        }
+    }
+}
+
+// Get a percentile of a sorted list of values
+float Percentile(const std::vector<float> &sorted, float fraction)
+{
+    if (sorted.empty()) return 0;
+    size_t index = (size_t)(fraction * (sorted.size() - 1) + 0.5f);
+    return sorted[index];
+}
+
+// Play all the matches of one configuration, keeping the rally and match lengths
+void PlayConfig(const MatchRules &rules, const Controller &left, const Controller &right, int games, int comebackDeficit,
+                unsigned int seed, int configIndex, ConfigResult &result, MatchRow *rows,
+                std::vector<float> &ticks, std::vector<float> &rallies)
+{
+    ticks.clear();
+    rallies.clear();
+    memset(&result, 0, sizeof(result));
+
+    for (int g = 0; g < games; g++)
+    {
+        Game game;
+        InitialiseGame(game, rules);
+
+        ControllerState leftState, rightState;
+        unsigned int matchSeed = MixSeed(seed, configIndex, g, 0);
+        InitialiseControllerState(leftState, matchSeed);
+        InitialiseControllerState(rightState, matchSeed ^ 0x5BD1E995u);
+
+        int rallyHits[2] = { 0, 0 };                // paddle hits so far in each ball's current rally
+        int maxDeficit[3] = { 0, 0, 0 };            // largest deficit each side has been behind by
+        int matchRallies = 0, matchHits = 0;
+
+        while (!game.gameWon && game.tick < maxMatchTicks)
+        {
+            PaddleInput leftInput = ControlPaddle(left, leftState, game, 1);
+            PaddleInput rightInput = ControlPaddle(right, rightState, game, 2);
+            TickEvents events = UpdateGame(game, leftInput, rightInput, simTickTime);
+
+            for (int b = 0; b < 2; b++)
+            {
+                if (events.hitMask & (1 << b)) rallyHits[b]++;
+                if (events.resetMask & (1 << b))
+                {
+                    rallies.push_back((float)rallyHits[b]);
+                    matchRallies++;
+                    matchHits += rallyHits[b];
+                    rallyHits[b] = 0;
+                }
+            }
+            if (events.resetMask)
+            {
+                int lead = game.player1LeftScore - game.player2RightScore;
+                if (-lead > maxDeficit[1]) maxDeficit[1] = -lead;
+                if (lead > maxDeficit[2]) maxDeficit[2] = lead;
+            }
+        }
+
+        ticks.push_back((float)game.tick);
+        if (game.winner == 0) result.draws++;
+        if (game.winner == 1) result.leftWins++;
+        if (game.winner != 0 && maxDeficit[game.winner] >= comebackDeficit) result.comebacks++;
+
+        if (rows)
+        {
+            MatchRow row = { game.tick, game.winner, game.player1LeftScore, game.player2RightScore,
+                             maxDeficit[game.winner], matchRallies, matchRallies ? (float)matchHits / matchRallies : 0 };
+            rows[g] = row;
+        }
+    }
+
+    std::sort(ticks.begin(), ticks.end());
+    std::sort(rallies.begin(), rallies.end());
+
+    double tickSum = 0, rallySum = 0;
+    for (size_t i = 0; i < ticks.size(); i++) tickSum += ticks[i];
+    for (size_t i = 0; i < rallies.size(); i++) rallySum += rallies[i];
+
+    result.ticksMean = (float)(tickSum / ticks.size());
+    result.ticksP10 = Percentile(ticks, 0.1f);
+    result.ticksP50 = Percentile(ticks, 0.5f);
+    result.ticksP90 = Percentile(ticks, 0.9f);
+    result.rallyMean = rallies.empty() ? 0 : (float)(rallySum / rallies.size());
+    result.rallyP50 = Percentile(rallies, 0.5f);
+    result.rallyP90 = Percentile(rallies, 0.9f);
+    result.rallyMax = rallies.empty() ? 0 : rallies.back();
+}
+
+//----------------------------------------------------------------------------------------------------
+// Main entry point of program
+//----------------------------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    SweepParameter parameters[parameterCount] = {
+        { "ballSpeed", false, false, 0, 0, 5 },
+        { "speedUp", false, false, 0, 0, 5 },
+        { "speedCap", false, false, 0, 0, 5 },
+        { "paddleWidth", false, false, 0, 0, 5 },
+        { "paddleHeight", false, false, 0, 0, 5 },
+        { "paddleSpeed", true, false, 0, 0, 5 },
+        { "ball2Score", true, false, 0, 0, 5 },
+        { "ball2Delay", true, false, 0, 0, 5 },
+        { "winScore", true, false, 0, 0, 5 },
+    };
+
+    int lhsSamples = 0, games = 16, comebackDeficit = 3;
+    int threadCount = (int)std::thread::hardware_concurrency();
+    unsigned int seed = 1;
+    bool perMatch = false;
+    const char *outDirectory = "sweep_out";
+    const char *leftDescription = "predict:reaction=4,noise=40";
+    const char *rightDescription = leftDescription;
+
+    // Read the command line
+    //------------------------------------------------------------------------------------------------
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if (strcmp(arg, "--param") == 0 && hasValue)
+        {
+            char name[32] = { 0 };
+            double minimum, maximum;
+            int steps = 5;
+            if (sscanf(argv[++i], "%31[^=]=%lf:%lf:%d", name, &minimum, &maximum, &steps) < 3)
+            {
+                fprintf(stderr, "Expected --param name=min:max[:steps], got %s\n", argv[i]);
+                return 1;
+            }
+
+            int p = 0;
+            while (p < parameterCount && strcmp(parameters[p].name, name) != 0) p++;
+            if (p == parameterCount)
+            {
+                fprintf(stderr, "Unknown parameter %s\n", name);
+                return 1;
+            }
+            parameters[p].swept = true;
+            parameters[p].minimum = minimum;
+            parameters[p].maximum = maximum;
+            parameters[p].steps = (steps < 1) ? 1 : steps;
+        }
+        else if (strcmp(arg, "--grid") == 0) lhsSamples = 0;
+        else if (strcmp(arg, "--lhs") == 0 && hasValue) lhsSamples = atoi(argv[++i]);
+        else if (strcmp(arg, "--games") == 0 && hasValue) games = atoi(argv[++i]);
+        else if (strcmp(arg, "--left") == 0 && hasValue) leftDescription = argv[++i];
+        else if (strcmp(arg, "--right") == 0 && hasValue) rightDescription = argv[++i];
+        else if (strcmp(arg, "--comeback") == 0 && hasValue) comebackDeficit = atoi(argv[++i]);
+        else if (strcmp(arg, "--threads") == 0 && hasValue) threadCount = atoi(argv[++i]);
+        else if (strcmp(arg, "--seed") == 0 && hasValue) seed = (unsigned int)strtoul(argv[++i], 0, 10);
+        else if (strcmp(arg, "--per-match") == 0) perMatch = true;
+        else if (strcmp(arg, "--out") == 0 && hasValue) outDirectory = argv[++i];
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return 1;
+        }
+    }
+
+    Controller left, right;
+    if (!ParseController(left, leftDescription) || !ParseController(right, rightDescription))
+    {
+        fprintf(stderr, "Could not set up the controllers\n");
+        return 1;
+    }
+    if (games < 1) games = 1;
+    if (threadCount < 1) threadCount = 1;
+
+    std::vector<MatchRules> configs;
+    if (lhsSamples > 0) BuildLatinHypercube(parameters, lhsSamples, seed, configs);
+    else BuildGrid(parameters, configs);
+
+    // Play every configuration, each worker takes the next unplayed one
+    //------------------------------------------------------------------------------------------------
+    std::vector<ConfigResult> results(configs.size());
+    std::vector<MatchRow> rows(perMatch ? configs.size() * games : 0);
+    std::atomic<size_t> nextConfig(0);
+
+    printf("Sweeping %zu configurations x %d matches on %d threads\n", configs.size(), games, threadCount);
+    auto startWall = std::chrono::steady_clock::now();
+
+    auto worker = [&]()
+    {
+        std::vector<float> ticks, rallies;      // Reused between configurations to avoid reallocating
+        ticks.reserve(games);
+        rallies.reserve(games * 64);
+
+        for (size_t c = nextConfig++; c < configs.size(); c = nextConfig++)
+        {
+            PlayConfig(configs[c], left, right, games, comebackDeficit, seed, (int)c, results[c],
+                       perMatch ? &rows[c * games] : 0, ticks, rallies);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < threadCount; t++) threads.push_back(std::thread(worker));
+    worker();
+    for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startWall).count();
+    printf("Played %zu matches in %.2f s (%.0f matches/s)\n", configs.size() * games, wallSeconds, configs.size() * games / wallSeconds);
+
+    // Write the results
+    //------------------------------------------------------------------------------------------------
+    ColumnTable summary;
+    int configColumn = AddColumn(summary, "config", false);
+    int parameterColumns[parameterCount];
+    for (int p = 0; p < parameterCount; p++) parameterColumns[p] = AddColumn(summary, parameters[p].name, true);
+    int gamesColumn = AddColumn(summary, "games", false);
+    int drawsColumn = AddColumn(summary, "draws", false);
+    int leftWinColumn = AddColumn(summary, "leftWinRate", true);
+    int comebackColumn = AddColumn(summary, "comebackRate", true);
+    int ticksColumns[4] = { AddColumn(summary, "ticksMean", true), AddColumn(summary, "ticksP10", true),
+                            AddColumn(summary, "ticksP50", true), AddColumn(summary, "ticksP90", true) };
+    int rallyColumns[4] = { AddColumn(summary, "rallyMean", true), AddColumn(summary, "rallyP50", true),
+                            AddColumn(summary, "rallyP90", true), AddColumn(summary, "rallyMax", true) };
+
+    for (size_t c = 0; c < configs.size(); c++)
+    {
+        const ConfigResult &r = results[c];
+        int decided = games - r.draws;
+
+        AppendInt(summary, configColumn, (int)c);
+        for (int p = 0; p < parameterCount; p++) AppendFloat(summary, parameterColumns[p], (float)GetRule(configs[c], p));
+        AppendInt(summary, gamesColumn, games);
+        AppendInt(summary, drawsColumn, r.draws);
+        AppendFloat(summary, leftWinColumn, decided ? (float)r.leftWins / decided : 0);
+        AppendFloat(summary, comebackColumn, decided ? (float)r.comebacks / decided : 0);
+        AppendFloat(summary, ticksColumns[0], r.ticksMean);
+        AppendFloat(summary, ticksColumns[1], r.ticksP10);
+        AppendFloat(summary, ticksColumns[2], r.ticksP50);
+        AppendFloat(summary, ticksColumns[3], r.ticksP90);
+        AppendFloat(summary, rallyColumns[0], r.rallyMean);
+        AppendFloat(summary, rallyColumns[1], r.rallyP50);
+        AppendFloat(summary, rallyColumns[2], r.rallyP90);
+        AppendFloat(summary, rallyColumns[3], r.rallyMax);
+    }
+
+    MakeDirectory(outDirectory);
+    char path[512];
+    snprintf(path, sizeof(path), "%s/summary", outDirectory);
+    bool ok = WriteColumnTable(summary, path);
+
+    if (perMatch)
+    {
+        ColumnTable matches;
+        int columns[8] = { AddColumn(matches, "config", false), AddColumn(matches, "ticks", false),
+                           AddColumn(matches, "winner", false), AddColumn(matches, "leftScore", false),
+                           AddColumn(matches, "rightScore", false), AddColumn(matches, "winnerMaxDeficit", false),
+                           AddColumn(matches, "rallies", false), AddColumn(matches, "rallyMean", true) };
+
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            AppendInt(matches, columns[0], (int)(i / games));
+            AppendInt(matches, columns[1], rows[i].ticks);
+            AppendInt(matches, columns[2], rows[i].winner);
+            AppendInt(matches, columns[3], rows[i].leftScore);
+            AppendInt(matches, columns[4], rows[i].rightScore);
+            AppendInt(matches, columns[5], rows[i].winnerMaxDeficit);
+            AppendInt(matches, columns[6], rows[i].rallies);
+            AppendFloat(matches, columns[7], rows[i].rallyMean);
+        }
+
+        snprintf(path, sizeof(path), "%s/matches", outDirectory);
+        ok = WriteColumnTable(matches, path) && ok;
+    }
+
+    if (!ok)
+    {
+        fprintf(stderr, "Could not write the results to %s\n", outDirectory);
+        return 1;
+    }
+    printf("Results written to %s\n", outDirectory);
+    return 0;
+}
@@ -0,0 +1,449 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium tournament: rates paddle controllers against each other by playing headless matches
+*
+*   Schedules round-robin or Swiss pairings, plays the matches on all cores and keeps Elo and
+*   Glicko ratings. A pairing stops early once the 95% confidence interval of its score no longer
+*   contains 50%, i.e. once it is clear which controller is stronger.
+*
+*   Usage: tournament [options] [controller...]
+*       --format roundrobin|swiss   how to pair controllers (default roundrobin)
+*       --rounds N                  rounds of a Swiss tournament (default log2(controllers) + 2)
+*       --threads N                 worker threads (default all cores)
+*       --min-games N               games a pairing plays before it can be decided (default 20)
+*       --max-games N               games after which a pairing is stopped undecided (default 400)
+*       --batch N                   games scheduled per pairing between checks (default 20)
+*       --seed N                    seed for the bots' random numbers (default 1)
+*       --physics float|fixed       simulation the matches are played with (default float, fixed is fixedsim.h)
+*       controller                  see ParseController in controllers.h, e.g. "search:reaction=6,noise=30"
+*
+*   Build: g++ tournament.cpp -o tournament.exe -O2 -pthread
+*
+******************************************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "controllers.h"
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int maxMatchTicks = 60 * 60 * 20;     // A match still going after 20 minutes of game time is a draw
+const float eloK = 16;                      // Elo update factor per game
+const float glickoStartRD = 350;            // Glicko rating deviation of an unrated controller
+const float confidenceZ = 1.96f;            // z value for 95% confidence intervals
+
+// Default line-up when no controllers are given on the command line
+const char *defaultControllers[] = {
+    "idle",
+    "follow",
+    "follow:reaction=12,noise=40",
+    "predict",
+    "predict:reaction=8,noise=60",
+    "search",
+    "search:reaction=6,noise=30",
+};
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for a controller taking part in the tournament and its ratings
+struct Entrant
+{
+    Controller controller;          // the bot itself
+    double elo;                     // Elo rating
+    double glicko;                  // Glicko rating
+    double glickoRD;                // Glicko rating deviation (uncertainty)
+    int wins, draws, losses;        // game results
+    double points;                  // pairings won (Swiss standings), a drawn pairing is half a point
+};
+
+// Create a structure for two controllers playing a series of games against each other
+struct Pairing
+{
+    int a, b;                       // indices of the two entrants
+    int games;                      // games played so far
+    double scoreA;                  // games won by a, plus half of the draws
+    bool decided;                   // true once the confidence interval excludes 50% (or max games reached)
+};
+
+// Create a structure for one game waiting to be played by a worker thread
+struct GameJob
+{
+    int pairing;                    // index of the pairing it belongs to
+    int gameIndex;                  // index of the game within the pairing (chooses sides and seed)
+    MatchResult result;             // filled in by the worker
+};
+
+// Create a structure for the tournament options
+struct Options
+{
+    bool swiss;
+    int rounds;
+    int threads;
+    int minGames;
+    int maxGames;
+    int batch;
+    unsigned int seed;
+    bool fixedPhysics;
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Get the lower and upper bound of the 95% Wilson score interval of a pairing score
+void WilsonInterval(double score, int games, double &lower, double &upper)
+{
+    if (games == 0)
+    {
+        lower = 0;
+        upper = 1;
+        return;
+    }
+
+    double p = score / games, z2 = confidenceZ * confidenceZ;
+    double centre = (p + z2 / (2 * games)) / (1 + z2 / games);
+    double half = confidenceZ * sqrt(p * (1 - p) / games + z2 / (4.0 * games * games)) / (1 + z2 / games);
+    lower = centre - half;
+    upper = centre + half;
+}
+
+// Play every game in the job list, spread over the worker threads
+void PlayJobs(std::vector<GameJob> &jobs, const std::vector<Entrant> &entrants, const std::vector<Pairing> &pairings, const Options &options)
+{
+    std::atomic<size_t> nextJob(0);
+
+    auto worker = [&]()
+    {
+        for (size_t i = nextJob++; i < jobs.size(); i = nextJob++)
+        {
+            GameJob &job = jobs[i];
+            const Pairing &pairing = pairings[job.pairing];
+            unsigned int seed = MixSeed(options.seed, pairing.a, pairing.b, job.gameIndex);
+
+            // Swap sides every game - ball 1 always serves towards the right player first
+            const Controller &left = entrants[job.gameIndex % 2 == 0 ? pairing.a : pairing.b].controller;
+            const Controller &right = entrants[job.gameIndex % 2 == 0 ? pairing.b : pairing.a].controller;
+            if (options.fixedPhysics) job.result = PlayFixedBotMatch(left, right, seed, maxMatchTicks);
+            else job.result = PlayBotMatch(left, right, seed, maxMatchTicks);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < options.threads; t++) threads.push_back(std::thread(worker));
+    worker();       // The main thread works too
+    for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+}
+
+// Update Elo ratings after one game, score is 1 if a won, 0.5 for a draw and 0 if b won
+void UpdateElo(Entrant &a, Entrant &b, double score)
+{
+    double expected = 1 / (1 + pow(10, (b.elo - a.elo) / 400));
+    a.elo += eloK * (score - expected);
+    b.elo -= eloK * (score - expected);
+}
+
+// Update Glicko ratings of all entrants over one rating period (one batch of games)
+// scores[i][j] and games[i][j] hold the results of entrant i against entrant j during the period
+void UpdateGlicko(std::vector<Entrant> &entrants, const std::vector<double> &scores, const std::vector<int> &games)
+{
+    const double q = log(10.0) / 400;
+    const double pi = 3.14159265358979;
+    int count = (int)entrants.size();
+
+    std::vector<double> newRating(count), newRD(count);
+    for (int i = 0; i < count; i++)
+    {
+        double varianceSum = 0, deltaSum = 0;
+        for (int j = 0; j < count; j++)
+        {
+            int n = games[i * count + j];
+            if (n == 0) continue;
+
+            double g = 1 / sqrt(1 + 3 * q * q * entrants[j].glickoRD * entrants[j].glickoRD / (pi * pi));
+            double expected = 1 / (1 + pow(10, -g * (entrants[i].glicko - entrants[j].glicko) / 400));
+            varianceSum += n * g * g * expected * (1 - expected);
+            deltaSum += g * (scores[i * count + j] - n * expected);
+        }
+
+        newRating[i] = entrants[i].glicko;
+        newRD[i] = entrants[i].glickoRD;
+        if (varianceSum == 0) continue;         // Didn't play this period
+
+        double inverse = 1 / (entrants[i].glickoRD * entrants[i].glickoRD) + q * q * varianceSum;
+        newRating[i] = entrants[i].glicko + q / inverse * deltaSum;
+        newRD[i] = sqrt(1 / inverse);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        entrants[i].glicko = newRating[i];
+        entrants[i].glickoRD = newRD[i];
+    }
+}
+
+// Play the given pairings in batches until every one of them is decided
+void PlayPairings(std::vector<Entrant> &entrants, std::vector<Pairing> &pairings, const Options &options)
+{
+    int count = (int)entrants.size();
+
+    while (true)
+    {
+        // Schedule a batch of games for every pairing that is still undecided
+        std::vector<GameJob> jobs;
+        for (size_t p = 0; p < pairings.size(); p++)
+        {
+            if (pairings[p].decided) continue;
+            for (int g = 0; g < options.batch && pairings[p].games + g < options.maxGames; g++)
+            {
+                GameJob job = { (int)p, pairings[p].games + g, { 0, 0, 0, 0 } };
+                jobs.push_back(job);
+            }
+        }
+        if (jobs.empty()) break;
+
+        PlayJobs(jobs, entrants, pairings, options);
+
+        // Fold the results in job order, so ratings don't depend on which thread finished first
+        std::vector<double> scores(count * count, 0);
+        std::vector<int> games(count * count, 0);
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            Pairing &pairing = pairings[jobs[i].pairing];
+            Entrant &a = entrants[pairing.a];
+            Entrant &b = entrants[pairing.b];
+
+            int aSide = (jobs[i].gameIndex % 2 == 0) ? 1 : 2;
+            double score = 0.5;
+            if (jobs[i].result.winner != 0) score = (jobs[i].result.winner == aSide) ? 1 : 0;
+
+            if (score == 1) { a.wins++; b.losses++; }
+            else if (score == 0) { a.losses++; b.wins++; }
+            else { a.draws++; b.draws++; }
+
+            pairing.games++;
+            pairing.scoreA += score;
+            UpdateElo(a, b, score);
+
+            scores[pairing.a * count + pairing.b] += score;
+            scores[pairing.b * count + pairing.a] += 1 - score;
+            games[pairing.a * count + pairing.b]++;
+            games[pairing.b * count + pairing.a]++;
+        }
+        UpdateGlicko(entrants, scores, games);
+
+        // Stop pairings whose winner is now clear
+        for (size_t p = 0; p < pairings.size(); p++)
+        {
+            Pairing &pairing = pairings[p];
+            if (pairing.decided) continue;
+
+            double lower, upper;
+            WilsonInterval(pairing.scoreA, pairing.games, lower, upper);
+            bool clear = (pairing.games >= options.minGames) && (lower > 0.5 || upper < 0.5);
+            pairing.decided = clear || pairing.games >= options.maxGames;
+        }
+    }
+}
+
+// Award Swiss standings points for a finished pairing
+void AwardPoints(std::vector<Entrant> &entrants, const Pairing &pairing)
+{
+    double share = pairing.scoreA / pairing.games;
+    if (share > 0.5) entrants[pairing.a].points += 1;
+    else if (share < 0.5) entrants[pairing.b].points += 1;
+    else
+    {
+        entrants[pairing.a].points += 0.5;
+        entrants[pairing.b].points += 0.5;
+    }
+}
+
+// Print a pairing's result and its confidence interval
+void PrintPairing(const std::vector<Entrant> &entrants, const Pairing &pairing)
+{
+    double lower, upper;
+    WilsonInterval(pairing.scoreA, pairing.games, lower, upper);
+    printf("  %-30s vs %-30s %5.1f%% [%5.1f%%, %5.1f%%] over %4d games%s\n",
+        entrants[pairing.a].controller.name, entrants[pairing.b].controller.name,
+        100 * pairing.scoreA / pairing.games, 100 * lower, 100 * upper, pairing.games,
+        (lower > 0.5 || upper < 0.5) ? "" : " (undecided)");
+}
+
+// Run a round-robin: every controller plays every other controller once
+void RunRoundRobin(std::vector<Entrant> &entrants, const Options &options)
+{
+    std::vector<Pairing> pairings;
+    for (int a = 0; a < (int)entrants.size(); a++)
+    {
+        for (int b = a + 1; b < (int)entrants.size(); b++)
+        {
+            Pairing pairing = { a, b, 0, 0, false };
+            pairings.push_back(pairing);
+        }
+    }
+
+    PlayPairings(entrants, pairings, options);
+
+    printf("Pairings:\n");
+    for (size_t p = 0; p < pairings.size(); p++)
+    {
+        AwardPoints(entrants, pairings[p]);
+        PrintPairing(entrants, pairings[p]);
+    }
+}
+
+// Run a Swiss tournament: each round pairs controllers on similar points that haven't met yet
+void RunSwiss(std::vector<Entrant> &entrants, const Options &options)
+{
+    int count = (int)entrants.size();
+    std::vector<bool> met(count * count, false);
+
+    for (int round = 1; round <= options.rounds; round++)
+    {
+        // Order by points, then by rating to split ties
+        std::vector<int> order(count);
+        for (int i = 0; i < count; i++) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](int x, int y)
+        {
+            if (entrants[x].points != entrants[y].points) return entrants[x].points > entrants[y].points;
+            return entrants[x].glicko > entrants[y].glicko;
+        });
+
+        // Pair each unpaired controller with the next one down the table it hasn't played yet
+        std::vector<bool> paired(count, false);
+        std::vector<Pairing> pairings;
+        for (int i = 0; i < count; i++)
+        {
+            int a = order[i];
+            if (paired[a]) continue;
+            for (int j = i + 1; j < count; j++)
+            {
+                int b = order[j];
+                if (paired[b] || met[a * count + b]) continue;
+
+                Pairing pairing = { a, b, 0, 0, false };
+                pairings.push_back(pairing);
+                paired[a] = paired[b] = true;
+                met[a * count + b] = met[b * count + a] = true;
+                break;
+            }
+            if (!paired[a])
+            {
+                entrants[a].points += 1;        // Nobody left to play - a bye counts as a win
+                paired[a] = true;
+                printf("Round %d: %s has a bye\n", round, entrants[a].controller.name);
+            }
+        }
+
+        PlayPairings(entrants, pairings, options);
+
+        printf("Round %d:\n", round);
+        for (size_t p = 0; p < pairings.size(); p++)
+        {
+            AwardPoints(entrants, pairings[p]);
+            PrintPairing(entrants, pairings[p]);
+        }
+    }
+}
+
+// Print the final table, best Glicko rating first
+void PrintStandings(std::vector<Entrant> entrants)
+{
+    std::stable_sort(entrants.begin(), entrants.end(), [](const Entrant &x, const Entrant &y)
+    {
+        if (x.points != y.points) return x.points > y.points;
+        return x.glicko > y.glicko;
+    });
+
+    printf("\n%-4s %-30s %6s %7s %17s %7s %7s %7s\n", "#", "controller", "points", "elo", "glicko (95% CI)", "wins", "draws", "losses");
+    for (size_t i = 0; i < entrants.size(); i++)
+    {
+        const Entrant &e = entrants[i];
+        printf("%-4d %-30s %6.1f %7.0f %7.0f +/- %5.0f %7d %7d %7d\n", (int)i + 1, e.controller.name, e.points,
+            e.elo, e.glicko, confidenceZ * e.glickoRD, e.wins, e.draws, e.losses);
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+// Main entry point of program
+//----------------------------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    Options options = { false, 0, (int)std::thread::hardware_concurrency(), 20, 400, 20, 1, false };
+    std::vector<Entrant> entrants;
+
+    // Read the command line
+    //------------------------------------------------------------------------------------------------
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if (strcmp(arg, "--format") == 0 && hasValue) options.swiss = (strcmp(argv[++i], "swiss") == 0);
+        else if (strcmp(arg, "--rounds") == 0 && hasValue) options.rounds = atoi(argv[++i]);
+        else if (strcmp(arg, "--threads") == 0 && hasValue) options.threads = atoi(argv[++i]);
+        else if (strcmp(arg, "--min-games") == 0 && hasValue) options.minGames = atoi(argv[++i]);
+        else if (strcmp(arg, "--max-games") == 0 && hasValue) options.maxGames = atoi(argv[++i]);
+        else if (strcmp(arg, "--batch") == 0 && hasValue) options.batch = atoi(argv[++i]);
+        else if (strcmp(arg, "--seed") == 0 && hasValue) options.seed = (unsigned int)strtoul(argv[++i], 0, 10);
+        else if (strcmp(arg, "--physics") == 0 && hasValue) options.fixedPhysics = (strcmp(argv[++i], "fixed") == 0);
+        else if (arg[0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return 1;
+        }
+        else
+        {
+            Entrant entrant = {};
+            if (!ParseController(entrant.controller, arg))
+            {
+                fprintf(stderr, "Could not set up controller %s\n", arg);
+                return 1;
+            }
+            entrants.push_back(entrant);
+        }
+    }
+
+    if (entrants.empty())
+    {
+        for (size_t i = 0; i < sizeof(defaultControllers) / sizeof(defaultControllers[0]); i++)
+        {
+            Entrant entrant = {};
+            ParseController(entrant.controller, defaultControllers[i]);
+            entrants.push_back(entrant);
+        }
+    }
+    if (entrants.size() < 2)
+    {
+        fprintf(stderr, "A tournament needs at least two controllers\n");
+        return 1;
+    }
+
+    if (options.threads < 1) options.threads = 1;
+    if (options.batch < 1) options.batch = 1;
+    if (options.maxGames < 1) options.maxGames = 1;
+    if (options.rounds < 1) options.rounds = (int)ceil(log2((double)entrants.size())) + 2;
+    if (options.rounds > (int)entrants.size() - 1) options.rounds = (int)entrants.size() - 1;
+
+    for (size_t i = 0; i < entrants.size(); i++)
+    {
+        entrants[i].elo = 1500;
+        entrants[i].glicko = 1500;
+        entrants[i].glickoRD = glickoStartRD;
+    }
+
+    // Run the tournament
+    //------------------------------------------------------------------------------------------------
+    if (options.swiss) RunSwiss(entrants, options);
+    else RunRoundRobin(entrants, options);
+
+    PrintStandings(entrants);
+    return 0;
+}
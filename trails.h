@@ -0,0 +1,221 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium trails: the last few positions of every ball drawn behind it, fading out
+*
+*   Every ball has a slot in a fixed pool, and a slot keeps the ball's last trailLength positions
+*   as a ring in its own run of the pool's x and y arrays, so recording a position is two stores and
+*   nothing is allocated whichever balls have trails. A ball that jumps further than trailBreak in a
+*   frame (put back in the centre after a goal) starts its trail again.
+*
+*   A trail is drawn as a strip of triangles along its positions, as wide as the ball at the ball
+*   and narrowing to nothing trailLength frames back, its alpha fading the same way. The strips of
+*   every slot are written into dynamic meshes whose index buffers never change (as particles.h),
+*   unused points collapsed onto the last one held, so all the trails of up to trailMeshTrails balls
+*   are one DrawMesh, one draw call.
+*
+******************************************************************************************************/
+
+#ifndef TRAILS_H
+#define TRAILS_H
+
+#include <math.h>
+#include "include/raylib.h"
+#include "drawcount.h"
+
+// rlgl functions bundled in libraylib.a (DrawMesh draws straight away, so the batch before it is drawn first)
+extern "C"
+{
+    void rlDrawRenderBatchActive(void);
+    void rlEnableBackfaceCulling(void);
+    void rlDisableBackfaceCulling(void);
+}
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int trailLength = 16;                     // Positions a trail keeps, one a frame (a power of two)
+const int trailVertices = 2 * trailLength;      // Vertices of a trail's strip, one each side of every position
+const int trailTriangles = 2 * (trailLength - 1);
+const int trailMeshTrails = 65536 / trailVertices;      // Trails drawn by one mesh (indexed with unsigned shorts)
+const int trailCapacity = 4 * trailMeshTrails;  // Balls that can have a trail
+const int trailMeshes = trailCapacity / trailMeshTrails;
+const float trailBreak = 100;                   // Furthest a ball moves in a frame without its trail starting again
+const float trailAlpha = 160;                   // Alpha of a trail at its ball, fading to nothing at its end
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for the trails of every slot, field by field, and the meshes they are drawn with
+struct TrailPool
+{
+    float x[trailCapacity * trailLength];       // slot s keeps its positions at s * trailLength onwards, a ring
+    float y[trailCapacity * trailLength];
+    int newest[trailCapacity];                  // place of each slot's newest position in its ring
+    int count[trailCapacity];                   // positions each slot holds
+    float halfWidth[trailCapacity];             // radius of each slot's ball
+    Color colour[trailCapacity];
+    int slots;                                  // slots drawn, from slot 0
+
+    Mesh meshes[trailMeshes];
+    Material material;
+};
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+//----------------------------------------------------------------------------------------------------
+static TrailPool trails;                        // Single trail pool, too big for the stack
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Forget every slot's positions and draw none
+inline void ClearTrails(TrailPool &t)
+{
+    t.slots = 0;
+    for (int s = 0; s < trailCapacity; s++) t.count[s] = 0;
+}
+
+// Set up the meshes the trails are drawn with (after the window is initialised, as OpenGL is required)
+inline void LoadTrailMeshes(TrailPool &t)
+{
+    ClearTrails(t);
+    for (int m = 0; m < trailMeshes; m++)
+    {
+        Mesh &mesh = t.meshes[m];
+        mesh = Mesh();
+        mesh.vertexCount = trailMeshTrails * trailVertices;
+        mesh.triangleCount = trailMeshTrails * trailTriangles;
+        mesh.vertices = (float *)MemAlloc(mesh.vertexCount * 3 * sizeof(float));
+        mesh.colors = (unsigned char *)MemAlloc(mesh.vertexCount * 4);
+        mesh.indices = (unsigned short *)MemAlloc(mesh.triangleCount * 3 * sizeof(unsigned short));
+
+        // Two triangles between each position and the next, on their left and right vertices
+        unsigned short *index = mesh.indices;
+        for (int trail = 0; trail < trailMeshTrails; trail++)
+        {
+            for (int i = 0; i < trailLength - 1; i++)
+            {
+                unsigned short left = (unsigned short)(trail * trailVertices + 2 * i);
+                *index++ = left;
+                *index++ = left + 1;
+                *index++ = left + 2;
+                *index++ = left + 1;
+                *index++ = left + 3;
+                *index++ = left + 2;
+            }
+        }
+        UploadMesh(&mesh, true);
+    }
+    t.material = LoadMaterialDefault();
+}
+
+inline void UnloadTrailMeshes(TrailPool &t)
+{
+    for (int m = 0; m < trailMeshes; m++) UnloadMesh(t.meshes[m]);
+    UnloadMaterial(t.material);
+}
+
+// Forget a slot's positions (its ball has left play)
+inline void ClearTrail(TrailPool &t, int slot)
+{
+    t.count[slot] = 0;
+}
+
+// Add a ball's position to its slot's trail, once a frame
+inline void RecordTrail(TrailPool &t, int slot, float x, float y, float radius, Color colour)
+{
+    float *xs = t.x + slot * trailLength, *ys = t.y + slot * trailLength;
+    int newest = t.newest[slot];
+    if (t.count[slot] > 0 && fabsf(x - xs[newest]) + fabsf(y - ys[newest]) > trailBreak) t.count[slot] = 0;
+
+    newest = (newest + 1) & (trailLength - 1);
+    xs[newest] = x;
+    ys[newest] = y;
+    t.newest[slot] = newest;
+    if (t.count[slot] < trailLength) t.count[slot]++;
+    t.halfWidth[slot] = radius;
+    t.colour[slot] = colour;
+}
+
+// Write a slot's strip into a mesh: newest position first, the points it doesn't hold yet on top of its oldest
+inline void WriteTrailStrip(const TrailPool &t, int slot, float *vertex, Color *colours)
+{
+    const float *xs = t.x + slot * trailLength, *ys = t.y + slot * trailLength;
+    int count = t.count[slot], newest = t.newest[slot];
+    Color colour = t.colour[slot];
+    if (count == 0)
+    {
+        for (int v = 0; v < trailVertices; v++)
+        {
+            vertex[3 * v] = vertex[3 * v + 1] = vertex[3 * v + 2] = 0;
+            colours[v] = Color{ 0, 0, 0, 0 };
+        }
+        return;
+    }
+
+    float normalX = 0, normalY = 0;
+    for (int i = 0; i < trailLength; i++)
+    {
+        int held = (i < count) ? i : count - 1;
+        int place = (newest - held) & (trailLength - 1);
+        float x = xs[place], y = ys[place];
+
+        // Across the trail: at right angles to the way from the next older position (or as the last point was)
+        if (held + 1 < count)
+        {
+            int older = (place - 1) & (trailLength - 1);
+            float dx = x - xs[older], dy = y - ys[older];
+            float length = sqrtf(dx * dx + dy * dy);
+            if (length > 0)
+            {
+                normalX = -dy / length;
+                normalY = dx / length;
+            }
+        }
+
+        float fade = (i < count) ? 1 - (float)i / (trailLength - 1) : 0;
+        float width = t.halfWidth[slot] * fade;
+        vertex[0] = x + normalX * width;
+        vertex[1] = y + normalY * width;
+        vertex[2] = 0;
+        vertex[3] = x - normalX * width;
+        vertex[4] = y - normalY * width;
+        vertex[5] = 0;
+        vertex += 6;
+
+        colour.a = (unsigned char)(trailAlpha * fade);
+        colours[0] = colours[1] = colour;
+        colours += 2;
+    }
+}
+
+// Draw the trails of every slot in use, call between BeginDrawing and EndDrawing before the balls
+inline void DrawTrails(TrailPool &t)
+{
+    if (t.slots == 0) return;
+
+    rlDrawRenderBatchActive();      // What was drawn before the trails goes under them
+    rlDisableBackfaceCulling();     // A strip faces whichever way its ball went
+    const Matrix identity = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+    for (int m = 0; m * trailMeshTrails < t.slots; m++)
+    {
+        Mesh &mesh = t.meshes[m];
+        int first = m * trailMeshTrails;
+        int count = (t.slots - first < trailMeshTrails) ? t.slots - first : trailMeshTrails;
+        for (int trail = 0; trail < count; trail++)
+        {
+            WriteTrailStrip(t, first + trail, mesh.vertices + 3 * trailVertices * trail, (Color *)mesh.colors + trailVertices * trail);
+        }
+
+        UpdateMeshBuffer(mesh, 0, mesh.vertices, count * trailVertices * 3 * sizeof(float), 0);
+        UpdateMeshBuffer(mesh, 3, mesh.colors, count * trailVertices * 4, 0);
+        Mesh used = mesh;
+        used.triangleCount = count * trailTriangles;
+        DrawMesh(used, t.material, identity);
+        CountMesh(count * trailVertices);
+    }
+    rlEnableBackfaceCulling();
+}
+
+#endif // TRAILS_H
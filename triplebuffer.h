@@ -0,0 +1,80 @@
+/*****************************************************************************************************
+*
+*   Pongdemonium triple buffer: hands the newest copy of some state from one thread to another
+*
+*   The writer always has a slot to write into and the reader always has a slot to read from, so
+*   neither ever waits for the other. Publishing swaps the writer's slot with the shared middle
+*   slot and acquiring swaps the reader's slot with it, each with a single atomic exchange.
+*   The reader gets the newest published copy; copies it was too slow to see are skipped.
+*
+******************************************************************************************************/
+
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+//----------------------------------------------------------------------------------------------------
+// Definition of constants
+//----------------------------------------------------------------------------------------------------
+const int tripleBufferFresh = 4;        // Flag set in the middle index while it holds a copy the reader hasn't taken
+
+//----------------------------------------------------------------------------------------------------
+// Definition of custom types
+//----------------------------------------------------------------------------------------------------
+// Create a structure for three copies of a state, one for each thread and one in between
+template <typename T>
+struct TripleBuffer
+{
+    T slots[3];
+    std::atomic<int> middle;        // index of the shared slot, plus tripleBufferFresh if it is unread
+    int writeIndex;                 // slot the writer fills, only used by the writer
+    int readIndex;                  // slot the reader reads, only used by the reader
+};
+
+//----------------------------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------------------------
+// Set up a triple buffer before either thread uses it
+template <typename T>
+inline void InitialiseTripleBuffer(TripleBuffer<T> &buffer)
+{
+    buffer.writeIndex = 0;
+    buffer.middle.store(1);
+    buffer.readIndex = 2;
+}
+
+// Get the slot the writer should fill
+template <typename T>
+inline T &WriteSlot(TripleBuffer<T> &buffer)
+{
+    return buffer.slots[buffer.writeIndex];
+}
+
+// Publish the slot the writer just filled, the writer gets the old middle slot to fill next
+template <typename T>
+inline void PublishSlot(TripleBuffer<T> &buffer)
+{
+    int previous = buffer.middle.exchange(buffer.writeIndex | tripleBufferFresh, std::memory_order_acq_rel);
+    buffer.writeIndex = previous & 3;
+}
+
+// Take the newest published slot if there is one the reader hasn't seen, returns false if there isn't
+template <typename T>
+inline bool AcquireSlot(TripleBuffer<T> &buffer)
+{
+    if (!(buffer.middle.load(std::memory_order_relaxed) & tripleBufferFresh)) return false;
+
+    int previous = buffer.middle.exchange(buffer.readIndex, std::memory_order_acq_rel);
+    buffer.readIndex = previous & 3;
+    return true;
+}
+
+// Get the slot the reader last acquired
+template <typename T>
+inline const T &ReadSlot(const TripleBuffer<T> &buffer)
+{
+    return buffer.slots[buffer.readIndex];
+}
+
+#endif // TRIPLEBUFFER_H